@@ -0,0 +1,238 @@
+// AllocationCheck.cpp
+//
+// Implementation of the AllocationCheck class.
+// Allocations are counted by the replacement operator new in Stats.cpp, so the counts of a window
+// are the difference of Stats::GetAllocations before and after it.  Nothing the window does may
+// allocate for its own purposes: the sample lines are made beforehand, and the program writes to
+// a stream with no buffer, which discards what it is given.
+//
+#include "stdafx.h"
+#include "AllocationCheck.h"
+#include "Instruction.h"
+#include "Emulator.h"
+#include "CycleModel.h"
+#include "Stats.h"
+
+namespace {
+    // Lines of every kind Pass I parses.
+    const char* const sampleLines[] = {
+        "; a comment on a line of its own",
+        "",
+        "        org     100",
+        "start   read    x           ; a comment after a statement",
+        "        load    x",
+        "loop    store   y",
+        "        write   =-3",
+        "        load    =05",
+        "        faa     count",
+        "        cas     pair",
+        "        bcopy   desc",
+        "        bp      loop",
+        "        halt",
+        "x       dc      5",
+        "y       ds      99",
+        "count   dc      100",
+        "pair    ds      2",
+        "desc    dc      220",
+        "        end"
+    };
+
+    // Times the sample lines are parsed in the measured window.
+    const int PARSEREPEATS = 10'000;
+
+    // Times the sample program goes round its loop, and the time slice it is run with.
+    const int LOOPCOUNT = 100'000;
+    const long long SLICE = 1'000;
+
+    // Opcodes of the machine, as the emulator decodes them.
+    const int OP_Load = 5, OP_Store = 6, OP_Read = 7, OP_Write = 8, OP_Branch = 12, OP_Halt = 13,
+        OP_FetchAdd = 14, OP_CompareSwap = 15, OP_BlockCopy = 16, OP_BlockSum = 18;
+
+    // Runs the program until it halts, giving each READ a value.  Returns false if it did not halt.
+    template <class RUN>
+    bool RunToHalt(emulator& a_emul, RUN a_run)
+    {
+        a_emul.startProgram();
+        while (true) {
+            switch (a_run()) {
+            case emulator::RS_NeedInput:
+                a_emul.provideInput(7);
+                break;
+            case emulator::RS_Running:
+                break;
+            case emulator::RS_Halted:
+                return true;
+            default:
+                return false;
+            }
+        }
+    }
+}
+
+/*
+NAME
+
+    AllocationCheck::Run - Check parsing and emulation for allocations.
+
+SYNOPSIS
+
+    int AllocationCheck::Run()
+
+DESCRIPTION
+
+    This function measures parsing, then emulation on a flat memory and on a paged one, and writes
+    the allocations each made in its steady state.
+
+RETURNS
+
+    int - Zero if none of them allocated, one if any did or if allocations are not counted.
+*/
+
+int AllocationCheck::Run()
+{
+    if (Stats::GetAllocations() < 0) {
+        cerr << "Allocations are counted only in a build with VC_COUNT_ALLOCATIONS defined." << endl;
+        return 1;
+    }
+    struct Window {
+        const char* name;
+        const char* unit;
+        long long allocations;
+        long long units;
+    };
+    Window windows[3] = { { "Parsing", "lines", 0, 0 }, { "Emulation, flat memory", "instructions", 0, 0 },
+        { "Emulation, paged memory", "instructions", 0, 0 } };
+    windows[0].allocations = CheckParsing(windows[0].units);
+    windows[1].allocations = CheckEmulation(emulator::MEMSZ, windows[1].units);
+    windows[2].allocations = CheckEmulation(emulator::MAXMEMSZ, windows[2].units);
+
+    bool isClean = true;
+    for (const Window& window : windows) {
+        if (window.allocations < 0) {
+            cout << window.name << ": the program did not halt.\n";
+        }
+        else {
+            cout << left << setw(28) << window.name << right << setw(8) << window.allocations << " allocations in "
+                << window.units << " " << window.unit << "\n";
+        }
+        isClean = isClean && window.allocations == 0;
+    }
+    cout << (isClean ? "No allocations in the steady state." : "Steady state allocates.") << endl;
+    return isClean ? 0 : 1;
+}
+
+/*
+NAME
+
+    AllocationCheck::CheckParsing - Count the allocations of parsing.
+
+SYNOPSIS
+
+    long long AllocationCheck::CheckParsing(long long& a_lines)
+        long long& a_lines --> Receives the number of lines parsed in the measured window.
+
+DESCRIPTION
+
+    The Instruction parses every sample line once before the window opens, so its strings have
+    grown to the longest of them.  In the window each line is parsed and its parts read as Pass I
+    reads them.
+
+RETURNS
+
+    long long - The allocations made in the window.
+*/
+
+long long AllocationCheck::CheckParsing(long long& a_lines)
+{
+    vector<string> lines(begin(sampleLines), end(sampleLines));
+    Instruction inst;
+    for (const string& line : lines) {
+        inst.ParseInstruction(line);
+    }
+
+    long long effects = 0;
+    long long before = Stats::GetAllocations();
+    for (int repeat = 0; repeat < PARSEREPEATS; repeat++) {
+        for (const string& line : lines) {
+            if (inst.ParseInstruction(line) == Instruction::ST_Comment) {
+                continue;
+            }
+            bool isSet = false;
+            int value = 0;
+            inst.LocationEffect(isSet, value);
+            effects += inst.GetLabel().size() + inst.GetOpCode().size() + inst.GetOperand().size() + value;
+        }
+    }
+    long long allocations = Stats::GetAllocations() - before;
+
+    // Used, so that the loop cannot be optimized away.
+    if (effects < 0) {
+        cerr << effects << endl;
+    }
+    a_lines = static_cast<long long>(PARSEREPEATS) * lines.size();
+    return allocations;
+}
+
+/*
+NAME
+
+    AllocationCheck::CheckEmulation - Count the allocations of emulation.
+
+SYNOPSIS
+
+    long long AllocationCheck::CheckEmulation(int a_memSize, long long& a_instructions)
+        int a_memSize               --> Words of memory of the emulator.
+        long long& a_instructions   --> Receives the number of instructions in the measured window.
+
+DESCRIPTION
+
+    The program reads a value, then goes round a loop of loads, stores, writes, atomic and block
+    instructions and a taken branch.  It is run once to allocate the pages it touches and grow the
+    cycle model's counts, then in the window with a time slice through execute and through
+    executeTimed.  Its faults would go to the error stream, but it has none.
+
+RETURNS
+
+    long long - The allocations made in the window, or -1 if the program did not halt.
+*/
+
+long long AllocationCheck::CheckEmulation(int a_memSize, long long& a_instructions)
+{
+    emulator emul(a_memSize);
+    const int COUNT = 200, MINUSONE = 201, VALUE = 202, INPUT = 203, DESC = 210, PAIR = 240;
+    const int program[][2] = { { OP_Read, INPUT }, { OP_Load, MINUSONE }, { OP_FetchAdd, COUNT }, { OP_Store, VALUE },
+        { OP_Write, VALUE }, { OP_BlockCopy, DESC }, { OP_BlockSum, DESC }, { OP_CompareSwap, PAIR },
+        { OP_Load, COUNT }, { OP_Branch, 101 }, { OP_Halt, 0 } };
+    int loc = 100;
+    for (const auto& instruction : program) {
+        emul.insertMemory(loc++, emul.encodeWord(instruction[0], instruction[1]));
+    }
+    emul.insertMemory(MINUSONE, -1);
+    emul.insertMemory(DESC, 220);
+    emul.insertMemory(DESC + 1, 230);
+    emul.insertMemory(DESC + 2, 8);
+
+    ostream discard(nullptr);
+    CycleModel timing;
+    auto execute = [&]() { return emul.execute(discard, cerr, SLICE); };
+    auto executeTimed = [&]() { return emul.executeTimed(discard, cerr, timing, SLICE); };
+
+    emul.insertMemory(COUNT, LOOPCOUNT);
+    bool isHalted = RunToHalt(emul, execute);
+    emul.insertMemory(COUNT, LOOPCOUNT);
+    if (!isHalted || !RunToHalt(emul, executeTimed)) {
+        return -1;
+    }
+
+    a_instructions = 0;
+    long long before = Stats::GetAllocations();
+    emul.insertMemory(COUNT, LOOPCOUNT);
+    isHalted = RunToHalt(emul, execute);
+    a_instructions += emul.getRunCounts().instructions;
+    timing.Reset();
+    emul.insertMemory(COUNT, LOOPCOUNT);
+    isHalted = isHalted && RunToHalt(emul, executeTimed);
+    a_instructions += emul.getRunCounts().instructions;
+    long long allocations = Stats::GetAllocations() - before;
+    return isHalted ? allocations : -1;
+}
@@ -0,0 +1,25 @@
+//
+//		AllocationCheck class.  Checks that parsing a source line and emulating an instruction
+//		allocate nothing once they have warmed up, in a build with VC_COUNT_ALLOCATIONS defined.
+//		Only the steady state is measured: the first pass over the lines and the first run of the
+//		program may grow strings and memory pages, and the IR and symbol table, which grow with
+//		the program, are not built at all.
+//
+#pragma once
+
+#include "stdafx.h"
+
+class AllocationCheck {
+
+public:
+    // Runs the check.  Returns zero if neither parsing nor emulation allocated.
+    int Run();
+
+private:
+    // Parses the sample lines many times with a warmed-up Instruction.  Returns the allocations.
+    long long CheckParsing(long long& a_lines);
+
+    // Runs the sample program on an emulator of a_memSize words, first to warm it up and then
+    // through execute and executeTimed.  Returns the allocations of the second runs.
+    long long CheckEmulation(int a_memSize, long long& a_instructions);
+};
@@ -5,14 +5,149 @@
 #include <stdio.h>
 
 #include "Assembler.h"
+#include "Linker.h"
+#include "Service.h"
+#include "ImageCache.h"
+#include "Errors.h"
+#include "Stats.h"
+#include "LanguageServer.h"
+#include "NativeTranslator.h"
+#include "CrossCheck.h"
+#include "AllocationCheck.h"
+#include "BlockDevice.h"
 
-int main( int argc, char *argv[] )
+#include <fstream>
+
+// Link the object modules named on the command line and run the result.
+static int LinkProgram( const Options &a_opts )
+{
+    Errors::InitErrorReporting( );
+    emulator emul( a_opts.GetMemorySize( ) );
+    Linker linker( emul );
+
+    for( const auto &file : a_opts.GetInputFiles( ) ) {
+        linker.AddModule( file );
+    }
+    bool linked = !Errors::WasThereErrors( ) && linker.Link( );
+    linker.DisplayLinkMap( );
+
+    if( linked && !a_opts.GetImageFile( ).empty( ) ) {
+        linker.WriteImage( a_opts.GetImageFile( ) );
+    }
+    emul.setLimits( { a_opts.GetInstructionLimit( ), a_opts.GetTimeLimit( ), a_opts.GetOutputLimit( ) } );
+    if( linked && !a_opts.GetNativeFile( ).empty( ) ) {
+        NativeTranslator translator( emul );
+        linked = translator.Write( a_opts.GetNativeFile( ) );
+        if( linked ) {
+            cout << "Native program written to " << a_opts.GetNativeFile( ) << "." << endl;
+        }
+    }
+    else if( linked ) {
+        BlockDevice device;
+        linked = device.Open( a_opts, emul );
+        if( linked ) {
+            bool ran;
+            {
+                Stats::Timer timer( Stats::P_Emulation );
+                ran = emul.runProgram( );
+            }
+            Stats::CountRun( emul );
+            linked = device.Close( );
+            if( !ran ) {
+                cout << "Emulator encountered an error." << endl;
+            }
+        }
+    }
+    Errors::DisplayErrors( );
+    return linked ? 0 : 1;
+}
+
+// Assemble and run the program through the image cache, so an unchanged program is not assembled again.
+// The output is the same as when the program is assembled directly.
+static int RunCachedProgram( const Options &a_opts )
 {
-    Assembler assem( argc, argv );
+    ifstream file( a_opts.GetSourceFile( ) );
+    if( !file ) {
+        cerr << "Source file could not be opened, assembler terminated." << endl;
+        return 1;
+    }
+    stringstream source;
+    source << file.rdbuf( );
+
+    ImageCache cache( a_opts.GetCacheDir( ) );
+    if( !cache.Lookup( a_opts, source.str( ) ) ) {
+        string sections[ImageCache::SECTIONCOUNT];
+        vector<string> errors;
+        ObjectModule module;
+        ostringstream listing, diag;
+        bool includesFiles;
+
+        vector<string> *outer = Errors::CaptureErrors( &errors );
+        {
+            Assembler assem( a_opts, source.str( ), listing, diag );
+            assem.PassI( );
+            assem.Optimize( );
+            assem.DisplaySymbolTable( );
+            sections[ImageCache::S_SymbolTable] = listing.str( );
+            listing.str( "" );
+            assem.PassII( );
+            assem.BuildObjectModule( module );
+            includesFiles = assem.IncludesFiles( );
+        }
+        Errors::CaptureErrors( outer );
+
+        sections[ImageCache::S_Listing] = listing.str( );
+        sections[ImageCache::S_Diagnostics] = diag.str( );
+        for( const auto &emsg : errors ) {
+            sections[ImageCache::S_Errors] += emsg + "\n";
+        }
+        cache.Store( sections, module, !includesFiles );
+    }
+
+    // Replay the assembly just as Assem would have shown it.
+    Errors::InitErrorReporting( );
+    cache.WriteSection( ImageCache::S_SymbolTable, cout );
+    system( "pause" );
+    cache.WriteSection( ImageCache::S_Listing, cout );
+    cache.WriteSection( ImageCache::S_Diagnostics, cerr );
+    cout << "\nPress Enter to continue...\n";
+    cin.get( );
+    cache.RecordErrors( );
+
+    emulator emul( a_opts.GetMemorySize( ) );
+    cache.LoadImage( emul );
+    emul.setLimits( { a_opts.GetInstructionLimit( ), a_opts.GetTimeLimit( ), a_opts.GetOutputLimit( ) } );
+    BlockDevice device;
+    if( !Errors::WasThereErrors( ) && device.Open( a_opts, emul ) ) {
+        bool ran;
+        {
+            Stats::Timer timer( Stats::P_Emulation );
+            ran = emul.runProgram( );
+        }
+        Stats::CountRun( emul );
+        device.Close( );
+        if( !ran ) {
+            cout << "Emulator encountered an error." << endl;
+        }
+    }
+    else {
+        cout << "Cannot run emulator due to errors." << endl;
+    }
+    Errors::DisplayErrors( );
+    return 0;
+}
+
+// Assemble the source file and run the program.
+static int AssembleProgram( const Options &opts )
+{
+    Assembler assem( opts );
 
     // Establish the location of the labels:
     assem.PassI( );
 
+    // Optionally remove redundant instructions before translating.
+    assem.Optimize( );
+
     // Display the symbol table.
     assem.DisplaySymbolTable();
     system("pause");
@@ -21,11 +156,65 @@ int main( int argc, char *argv[] )
     // Output the symbol table and the translation.
     assem.PassII( );
     
+    // When assembling a module for separate linking, write it out instead of running it.
+    if( !opts.GetObjectFile( ).empty( ) ) {
+        return assem.WriteObjectModule( ) ? 0 : 1;
+    }
+
+    // Likewise when translating the program to native code.
+    if( !opts.GetNativeFile( ).empty( ) ) {
+        return assem.WriteNativeProgram( ) ? 0 : 1;
+    }
     
     // Run the emulator on the Quack3200 program that was generated in Pass II.
-    assem.RunProgramInEmulator();
+    if( opts.GetDebug( ) ) {
+        assem.DebugProgram( );
+    }
+    else {
+        assem.RunProgramInEmulator( );
+    }
    
     // Terminate indicating all is well.  If there is an unrecoverable error, the 
     // program will terminate at the point that it occurred with an exit(1) call.
     return 0;
 }
+
+int main( int argc, char *argv[] )
+{
+    Options opts( argc, argv );
+    int status;
+    if( opts.GetLink( ) ) {
+        status = LinkProgram( opts );
+    }
+    else if( !opts.GetServePath( ).empty( ) ) {
+        Service service( opts );
+        status = service.Run( );
+    }
+    else if( !opts.GetConnectPath( ).empty( ) ) {
+        status = Service::RunClient( opts );
+    }
+    else if( opts.GetLanguageServer( ) ) {
+        LanguageServer server;
+        status = server.Run( );
+    }
+    else if( opts.GetAllocationCheck( ) ) {
+        AllocationCheck check;
+        status = check.Run( );
+    }
+    else if( opts.GetCrossCheckCount( ) > 0 ) {
+        CrossCheck check( opts );
+        status = check.Run( );
+    }
+    else if( !opts.GetCacheDir( ).empty( ) ) {
+        status = RunCachedProgram( opts );
+    }
+    else {
+        status = AssembleProgram( opts );
+    }
+
+    // The statistics come last, after the errors the assembler displays when it is done.
+    if( opts.GetStats( ) ) {
+        Stats::Report( cerr, opts.GetStatsJson( ) );
+    }
+    return status;
+}
@@ -1,6 +1,12 @@
 #include "stdafx.h"
 #include "Assembler.h"
 #include "Errors.h"
+#include "Optimizer.h"
+#include "Debugger.h"
+#include "NativeTranslator.h"
+#include "BlockDevice.h"
+#include "CycleModel.h"
+#include "Stats.h"
 
 /*
 NAME
@@ -9,22 +15,53 @@ NAME
 
 SYNOPSIS
 
-    Assembler::Assembler(int argc, char* argv[])
-        int argc        --> Number of command-line arguments provided.
-        char* argv[]    --> Array of strings representing the command-line arguments, including the file location.
+    Assembler::Assembler(const Options& a_opts)
+        const Options& a_opts --> The parsed command-line arguments.
 
-        NOTE: argc and argv are passed to the FileAccess constructor to initialize file operations.
+        NOTE: the options supply the source file name to FileAccess and the address space size
+        to the emulator.
 
 DESCRIPTION
 
-    This constructor initializes the Assembler object and passes the command-line arguments
-    to the FileAccess class to handle file opening and processing.
+    This constructor initializes the Assembler object and opens the source file through the
+    FileAccess class.
 
 */
 
 // Constructor
-Assembler::Assembler(int argc, char* argv[])
-    : m_facc(argc, argv), m_emul() {
+Assembler::Assembler(const Options& a_opts)
+    : m_opts(a_opts), m_facc(m_opts.GetSourceFile()), m_emul(m_opts.GetMemorySize()),
+    m_buildObject(!m_opts.GetObjectFile().empty()), m_out(cout), m_diag(cerr), m_interactive(true), m_streamSize(0),
+    m_literalPool(-1), m_sourceName(m_opts.GetSourceFile()), m_sawInclude(false), m_isPassI(true) {
+    Errors::InitErrorReporting(); // Initialize error reporting system
+}
+
+/*
+NAME
+
+    Assembler::Assembler - Constructor for assembling source held in memory.
+
+SYNOPSIS
+
+    Assembler::Assembler(const Options& a_opts, const string& a_source, ostream& a_listing, ostream& a_diag)
+        const Options& a_opts   --> The options to assemble with.  The source file name is not used.
+        const string& a_source  --> The source text.
+        ostream& a_listing      --> Receives the symbol table, the translation listing and messages.
+        ostream& a_diag         --> Receives the emulator's messages about the words loaded.
+
+DESCRIPTION
+
+    This constructor is used by the assembly service, which receives programs over a socket, and
+    when filling the image cache.  The assembler never pauses for the user, and Pass II always
+    collects the object module so that the translation can be loaded into other emulators.  Files
+    the source includes are found from the current directory.
+
+*/
+
+Assembler::Assembler(const Options& a_opts, const string& a_source, ostream& a_listing, ostream& a_diag)
+    : m_opts(a_opts), m_sourceText(a_source), m_facc(m_sourceText), m_emul(m_opts.GetMemorySize()),
+    m_buildObject(true), m_out(a_listing), m_diag(a_diag), m_interactive(false), m_streamSize(0),
+    m_literalPool(-1), m_sawInclude(false), m_isPassI(true) {
     Errors::InitErrorReporting(); // Initialize error reporting system
 }
 
@@ -35,93 +72,1295 @@ NAME
 
 SYNOPSIS
 
-    Assembler::~Assembler()
+    Assembler::~Assembler()
+
+DESCRIPTION
+
+    This destructor ensures that any recorded errors during the assembly process are displayed by calling
+    the Errors::DisplayErrors function. It provides a clean and informative conclusion to the assembly
+    process, showing all accumulated errors if present.
+
+*/
+
+// Destructor
+Assembler::~Assembler() {
+    Errors::DisplayErrors(); // Display any errors that were recorded
+}
+
+/*
+NAME
+
+    Assembler::PassI - Determine the locations of labels.
+
+SYNOPSIS
+
+    void Assembler::PassI()
+
+DESCRIPTION
+
+    This function identifies and records the memory locations of all labels in the input text file.
+    It achieves this by parsing each instruction into its components and verifying the presence of a label on the line.
+
+    The pass is data parallel.  The source is read and split into chunks of lines that are parsed
+    concurrently, and each chunk folds the location effects of its lines (see Instruction::LocationEffect)
+    into a single effect.  A scan over the chunk effects gives the location at the start of every chunk,
+    after which the chunks locate their own lines concurrently.  Finally the labels and errors noted by
+    each chunk are entered in source order, so multiply defined symbols and the error report are the
+    same as for a sequential pass whatever the number of threads.  The literal pool is then placed
+    after the program.
+
+    With -pipeline the pass is done by PipelinePassI instead, which also translates the lines, and
+    with -stream by StreamPassI, which keeps nothing of the lines.
+
+    Whichever form the pass takes, the lines come from NextLine, which follows each INCLUDE
+    directive with the lines of the file it names.  The lines of an included file were parsed when
+    the file was first read, so they are not parsed again.
+
+*/
+
+namespace {
+    // Effect of one line on the location counter.
+    struct LineEffect {
+        bool isSet;         // True if the line sets the location counter (ORG).
+        bool isValid;       // False if the ORG or DS operand could not be parsed.
+        int value;          // The new location or the increment.
+    };
+
+    // The share of Pass I handled by one thread.
+    struct PassIChunk {
+        size_t begin;                           // First source line of the chunk.
+        size_t end;                             // One past the last source line.
+        size_t firstEnd;                        // First END statement in the chunk, or end if none.
+        bool isSet;                             // Combined location effect of the lines in the chunk.
+        int value;
+        int startLoc;                           // Location counter at the first line.
+        vector<size_t> notable;                 // Lines with a label, EXTERN, PUBLIC or ENTRY, a literal, an error or a bad ORG/DS operand.
+        vector<pair<size_t, string>> errors;    // Errors recorded while parsing, by line.
+        long long lines;                        // Lines up to the first END statement.
+        long long tokens;                       // Their tokens.
+    };
+
+    // The label, opcode and operand a line has, for the statistics.  Lines and tokens are counted
+    // once, by Pass I, for the lines up to the END statement, whichever form the pass takes.
+    int TokenCount(const IntermediateInstruction& a_interm)
+    {
+        return !a_interm.label.empty() + !a_interm.opcode.empty() + !a_interm.operand.empty();
+    }
+
+    // Where a line of an included file is, to go before its errors.
+    string Place(const IntermediateInstruction& a_interm)
+    {
+        return *a_interm.includeFile + "(" + to_string(a_interm.includeLine) + "): ";
+    }
+
+    // Records the errors made during its lifetime with the place of a line, if it is from an
+    // included file; errors about a line of the source are recorded as they are.
+    class ErrorsAt {
+
+    public:
+        ErrorsAt(const IntermediateInstruction& a_interm)
+            : m_interm(a_interm), m_outer(nullptr)
+        {
+            if (m_interm.includeFile != nullptr) {
+                m_outer = Errors::CaptureErrors(&m_errors);
+            }
+        }
+
+        ~ErrorsAt()
+        {
+            if (m_interm.includeFile == nullptr) return;
+
+            Errors::CaptureErrors(m_outer);
+            for (const auto& emsg : m_errors) {
+                Errors::RecordError(Place(m_interm) + emsg);
+            }
+        }
+
+    private:
+        const IntermediateInstruction& m_interm;
+        vector<string>* m_outer;
+        vector<string> m_errors;
+    };
+
+    // True if a line of the source may be an INCLUDE directive.  Only these lines are parsed as
+    // they are read.
+    bool MayBeInclude(const string& a_text)
+    {
+        const char* const name = "INCLUDE";
+        size_t end = min(a_text.find(';'), a_text.size());
+        for (size_t i = 0; i + 7 <= end; i++) {
+            size_t c = 0;
+            while (c < 7 && toupper(static_cast<unsigned char>(a_text[i + c])) == name[c]) {
+                c++;
+            }
+            if (c == 7) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // A path with its "." steps and each "name\.." pair taken out, and / between the steps, so that
+    // two ways of writing the path of a file compare equal.
+    string NormalizePath(const string& a_path)
+    {
+        vector<string> steps;
+        for (size_t start = 0; start <= a_path.size(); ) {
+            size_t end = min(a_path.find_first_of("\\/", start), a_path.size());
+            string step = a_path.substr(start, end - start);
+            if (step == ".." && !steps.empty() && steps.back() != "..") {
+                steps.pop_back();
+            }
+            else if (!step.empty() && step != ".") {
+                steps.push_back(step);
+            }
+            start = end + 1;
+        }
+        string path = !a_path.empty() && (a_path[0] == '\\' || a_path[0] == '/') ? "/" : "";
+        for (size_t i = 0; i < steps.size(); i++) {
+            path += (i == 0 ? "" : "/") + steps[i];
+        }
+        return path;
+    }
+
+    // The path of a file named by an INCLUDE directive, which is relative to the directory of the
+    // file the directive is in unless it is absolute.
+    string IncludePath(const string& a_name, const string& a_from)
+    {
+        bool isAbsolute = a_name[0] == '\\' || a_name[0] == '/' || (a_name.size() > 1 && a_name[1] == ':');
+        size_t slash = a_from.find_last_of("\\/");
+        if (isAbsolute || slash == string::npos) {
+            return NormalizePath(a_name);
+        }
+        return NormalizePath(a_from.substr(0, slash + 1) + a_name);
+    }
+}
+
+// Pass I - Establish the locations of the symbols
+void Assembler::PassI() {
+    if (m_opts.GetPipeline()) {
+        PipelinePassI();
+        return;
+    }
+    if (m_opts.GetStream()) {
+        StreamPassI();
+        return;
+    }
+
+    // Read the whole source so that it can be divided among the threads.
+    Stats::Timer timer(Stats::P_ReadFile);
+    vector<SourceLine> lines;
+    SourceLine line;
+    while (NextLine(line)) {
+        lines.push_back(move(line));
+    }
+    size_t numLines = lines.size();
+    timer.Switch(Stats::P_PassI);
+
+    m_intermediate.clear();
+    m_intermediate.resize(numLines);
+    vector<LineEffect> effects(numLines);
+
+    vector<PassIChunk> chunks(ChunkCount(numLines));
+    size_t perChunk = (numLines + chunks.size() - 1) / chunks.size();
+    for (size_t c = 0; c < chunks.size(); c++) {
+        chunks[c].begin = min(c * perChunk, numLines);
+        chunks[c].end = min(chunks[c].begin + perChunk, numLines);
+    }
+
+    // Parse the chunks and combine the location effects of their lines.
+    RunChunks(chunks.size(), [&](size_t a_chunk) {
+        PassIChunk& chunk = chunks[a_chunk];
+        Instruction inst;
+        vector<string> errors;
+
+        vector<string>* outer = Errors::CaptureErrors(&errors);
+        chunk.firstEnd = chunk.end;
+        chunk.isSet = false;
+        chunk.value = 0;
+        chunk.lines = 0;
+        chunk.tokens = 0;
+        for (size_t i = chunk.begin; i < chunk.end; i++) {
+            IntermediateInstruction& interm = m_intermediate[i];
+            LineEffect& effect = effects[i];
+            bool isLiteral;
+            effect.isValid = ParseLine(inst, lines[i], interm, effect.isSet, effect.value, isLiteral); // Parse the instruction
+            Instruction::InstructionType instType = interm.type;
+
+            if (chunk.firstEnd == chunk.end) {
+                chunk.lines++;
+                chunk.tokens += TokenCount(interm);
+                if (instType == Instruction::ST_End) {
+                    chunk.firstEnd = i;
+                }
+            }
+
+            if (effect.isSet) {
+                chunk.isSet = true;
+                chunk.value = effect.value;
+            }
+            else {
+                chunk.value += effect.value;
+            }
+
+            bool definesLabel = !interm.label.empty() &&
+                (instType == Instruction::ST_AssemblerInstr || instType == Instruction::ST_MachineLanguage);
+            bool linkage = interm.opcode == "EXTERN" || interm.opcode == "PUBLIC" || interm.opcode == "ENTRY";
+            if (definesLabel || linkage || isLiteral || !effect.isValid || !errors.empty()) {
+                chunk.notable.push_back(i);
+                for (auto& emsg : errors) {
+                    chunk.errors.push_back(make_pair(i, move(emsg)));
+                }
+                errors.clear();
+            }
+        }
+        Errors::CaptureErrors(outer);
+    });
+
+    // Scan the chunk effects for the starting location of each chunk, then locate the lines.
+    int loc = 0; // Location counter
+    for (auto& chunk : chunks) {
+        chunk.startLoc = loc;
+        loc = chunk.isSet ? chunk.value : loc + chunk.value;
+    }
+    RunChunks(chunks.size(), [&](size_t a_chunk) {
+        int loc = chunks[a_chunk].startLoc;
+        for (size_t i = chunks[a_chunk].begin; i < chunks[a_chunk].end; i++) {
+            m_intermediate[i].location = loc;
+            loc = effects[i].isSet ? effects[i].value : loc + effects[i].value;
+        }
+    });
+
+    // Nothing after the first END statement is part of the program.
+    size_t endLine = numLines;
+    for (const auto& chunk : chunks) {
+        Stats::Count(Stats::C_Lines, chunk.lines);
+        Stats::Count(Stats::C_Tokens, chunk.tokens);
+        if (chunk.firstEnd != chunk.end) {
+            endLine = chunk.firstEnd;
+            break;
+        }
+    }
+
+    // Enter the labels and errors in source order.
+    timer.Switch(Stats::P_SymbolTable);
+    for (auto& chunk : chunks) {
+        size_t nextError = 0;
+        for (size_t i : chunk.notable) {
+            if (i > endLine) break;
+
+            for (; nextError < chunk.errors.size() && chunk.errors[nextError].first == i; nextError++) {
+                Errors::RecordError(chunk.errors[nextError].second);
+            }
+            EnterLine(m_intermediate[i], effects[i].isValid);
+        }
+    }
+
+    if (endLine == numLines) {
+        Errors::RecordError("Missing END directive."); // Record error if END is missing
+    }
+    else {
+        m_intermediate.resize(endLine + 1);
+    }
+    PlaceLiterals();
+}
+
+/*
+NAME
+
+    Assembler::NextLine - Read the next line of the program.
+
+SYNOPSIS
+
+    bool Assembler::NextLine(SourceLine& a_line)
+        SourceLine& a_line --> Receives the line.
+
+DESCRIPTION
+
+    This function reads the next line of the innermost included file being read, or of the source
+    once there are none.  An INCLUDE directive is itself a line of the program, listed like the
+    other directives, and the lines of the file it names follow it.  Only the lines of the source
+    that may be INCLUDE directives are parsed here; the lines of included files were parsed when
+    the files were read.
+
+RETURNS
+
+    bool - False at the end of the source.
+*/
+
+bool Assembler::NextLine(SourceLine& a_line) {
+    a_line.error.clear();
+    while (!m_includeStack.empty() && m_includeStack.back().next == m_includeStack.back().file->lines.size()) {
+        m_includeStack.pop_back();
+    }
+    if (!m_includeStack.empty()) {
+        IncludeLevel& level = m_includeStack.back();
+        a_line.text.clear();
+        a_line.included = &level.file->lines[level.next++];
+        a_line.file = &level.file->name;
+        a_line.number = static_cast<int>(level.next);
+        a_line.depth = m_includeStack.size();
+        if (a_line.included->opcode == "INCLUDE" && !a_line.included->operand.empty()) {
+            EnterInclude(a_line.included->operand, a_line);
+        }
+        return true;
+    }
+
+    if (!m_facc.GetNextLine(a_line.text)) {
+        return false;
+    }
+    a_line.included = nullptr;
+    a_line.file = nullptr;
+    a_line.number = 0;
+    a_line.depth = 0;
+    if (MayBeInclude(a_line.text)) {
+        // The errors of the line are recorded when Pass I parses it.
+        Instruction inst;
+        vector<string> errors;
+        vector<string>* outer = Errors::CaptureErrors(&errors);
+        inst.ParseInstruction(a_line.text);
+        Errors::CaptureErrors(outer);
+        if (inst.GetOpCode() == "INCLUDE" && !inst.GetOperand().empty()) {
+            EnterInclude(inst.GetOperand(), a_line);
+        }
+    }
+    return true;
+}
+
+/*
+NAME
+
+    Assembler::EnterInclude - Start reading an included file.
+
+SYNOPSIS
+
+    void Assembler::EnterInclude(const string& a_name, SourceLine& a_line)
+        const string& a_name    --> The file the INCLUDE directive names.
+        SourceLine& a_line      --> The directive.
+
+DESCRIPTION
+
+    The file is found relative to the file holding the directive and looked up in the source
+    cache, which reads and parses it unless it has done so already.  Each file is looked up once
+    an assembly, so Pass II with -stream reads the same lines as Pass I.  A file that is already
+    being read would include itself, so the cycle is reported instead, as is a file that cannot
+    be read or is nested too deeply.  The error goes with the directive, for Pass I to record.
+
+*/
+
+void Assembler::EnterInclude(const string& a_name, SourceLine& a_line) {
+    m_sawInclude = true;
+    string path = IncludePath(a_name, a_line.file != nullptr ? *a_line.file : m_sourceName);
+
+    bool isCycle = !m_sourceName.empty() && path == NormalizePath(m_sourceName);
+    for (const auto& level : m_includeStack) {
+        isCycle = isCycle || level.file->name == path;
+    }
+    if (isCycle) {
+        string chain = m_sourceName.empty() ? "the source" : m_sourceName;
+        for (const auto& level : m_includeStack) {
+            chain += " -> " + level.file->name;
+        }
+        a_line.error = "INCLUDE of " + a_name + " forms a cycle: " + chain + " -> " + path;
+        return;
+    }
+    if (m_includeStack.size() >= MAXINCLUDEDEPTH) {
+        a_line.error = "INCLUDE of " + a_name + " is nested more than " + to_string(MAXINCLUDEDEPTH) + " deep.";
+        return;
+    }
+
+    shared_ptr<const SourceCache::File>& file = m_includedFiles[path];
+    if (!file) {
+        file = SourceCache::Find(path);
+        if (!file) {
+            m_includedFiles.erase(path);
+            a_line.error = "Included file " + path + " could not be opened.";
+            return;
+        }
+    }
+    m_includeStack.push_back(IncludeLevel{ file, 0 });
+    if (m_isPassI) {
+        Stats::Count(Stats::C_Includes);
+    }
+}
+
+/*
+NAME
+
+    Assembler::ParseLine - Parse a line of the program.
+
+SYNOPSIS
+
+    bool Assembler::ParseLine(Instruction& a_inst, SourceLine& a_line, IntermediateInstruction& a_interm,
+        bool& a_isSet, int& a_value, bool& a_isLiteral)
+        Instruction& a_inst                 --> Parses a line of the source.
+        SourceLine& a_line                  --> The line.  The text of a line of the source is moved out.
+        IntermediateInstruction& a_interm   --> Receives the label, opcode, operand and original line.
+        bool& a_isSet, int& a_value         --> Receive the effect of the line on the location counter.
+        bool& a_isLiteral                   --> True if the operand is a literal (=N).
+
+DESCRIPTION
+
+    A line of the source is parsed by a_inst, which records its errors as it goes.  A line of an
+    included file takes its parse from the source cache, and its errors are recorded again with
+    the file and line number they belong to.  It is listed with a + before the statement for each
+    file it is included through.  The error of an INCLUDE directive whose file was not included
+    is recorded last.
+
+RETURNS
+
+    bool - False if the operand of an ORG or DS directive is invalid.
+*/
+
+bool Assembler::ParseLine(Instruction& a_inst, SourceLine& a_line, IntermediateInstruction& a_interm, bool& a_isSet,
+    int& a_value, bool& a_isLiteral) {
+    a_interm.includeFile = a_line.file;
+    a_interm.includeLine = a_line.number;
+    bool isValid;
+    if (a_line.included == nullptr) {
+        a_interm.type = a_inst.ParseInstruction(a_line.text);
+        a_interm.label = a_inst.isLabel() ? a_inst.GetLabel() : "";
+        a_interm.opcode = a_inst.GetOpCode();
+        a_interm.operand = a_inst.GetOperand();
+        a_interm.originalLine = move(a_line.text);
+        a_isLiteral = a_inst.IsLiteralOperand();
+        isValid = a_inst.LocationEffect(a_isSet, a_value);
+    }
+    else {
+        const SourceCache::Line& parsed = *a_line.included;
+        a_interm.type = parsed.type;
+        a_interm.label = parsed.label;
+        a_interm.opcode = parsed.opcode;
+        a_interm.operand = parsed.operand;
+        a_interm.originalLine = string(a_line.depth, '+') + " " + parsed.text;
+        a_isLiteral = parsed.isLiteral;
+        a_isSet = parsed.isSet;
+        a_value = parsed.value;
+        isValid = parsed.isValid;
+        for (const auto& emsg : parsed.errors) {
+            Errors::RecordError(Place(a_interm) + emsg);
+        }
+    }
+    if (!a_line.error.empty()) {
+        Errors::RecordError(a_interm.includeFile != nullptr ? Place(a_interm) + a_line.error : a_line.error);
+    }
+    return isValid;
+}
+
+/*
+NAME
+
+    Assembler::IncludesFiles - Tell whether the program includes other files.
+
+SYNOPSIS
+
+    bool Assembler::IncludesFiles() const
+
+DESCRIPTION
+
+    The image cache keys a program by its source text, which does not cover the files it includes,
+    so it does not keep programs for which this is true.
+
+RETURNS
+
+    bool - True if Pass I found an INCLUDE directive.
+*/
+
+bool Assembler::IncludesFiles() const {
+    return m_sawInclude;
+}
+
+/*
+NAME
+
+    Assembler::EnterLine - Enter what Pass I learns from a located line.
+
+SYNOPSIS
+
+    void Assembler::EnterLine(IntermediateInstruction& a_interm, bool a_isValid)
+        IntermediateInstruction& a_interm       --> The line, with its location.
+        bool a_isValid                          --> False if its ORG or DS operand could not be parsed.
+
+DESCRIPTION
+
+    This function adds the label of the line to the symbol table, notes the symbols named by EXTERN,
+    PUBLIC and ENTRY, adds a literal operand to the literal pool unless it is already there, and
+    records the error for an invalid ORG or DS operand.  Every form of Pass I calls it for each line
+    in source order, so the pool is in order of first use.  The errors about a line of an included
+    file are recorded with its place.
+
+*/
+
+void Assembler::EnterLine(IntermediateInstruction& a_interm, bool a_isValid) {
+    ErrorsAt at(a_interm);
+    if (!a_interm.label.empty() &&
+        (a_interm.type == Instruction::ST_AssemblerInstr || a_interm.type == Instruction::ST_MachineLanguage)) {
+        m_symtab.AddSymbol(a_interm.label, a_interm.location); // Add label to the symbol table
+    }
+    if (a_interm.opcode == "EXTERN") {
+        m_imports.insert(a_interm.operand);
+    }
+    else if (a_interm.opcode == "PUBLIC") {
+        m_exports.push_back(a_interm.operand);
+    }
+    else if (a_interm.opcode == "ENTRY") {
+        m_entries.push_back(a_interm.operand);
+    }
+    if (a_interm.type == Instruction::ST_MachineLanguage && !a_interm.operand.empty() && a_interm.operand[0] == '=' &&
+        m_literalIndex.count(a_interm.operand) == 0) {
+        try {
+            int value = stoi(a_interm.operand.substr(1));
+            if (a_interm.operand == "=" + to_string(value)) {
+                m_literalIndex.emplace(a_interm.operand, m_literals.size());
+                m_literals.push_back(value);
+            }
+        }
+        catch (...) {
+            // An invalid literal, reported when the line was parsed.
+        }
+    }
+    if (!a_isValid) {
+        if (a_interm.opcode == "ORG") {
+            Errors::RecordError("Invalid operand for ORG directive."); // Handle invalid operand
+        }
+        else {
+            Errors::RecordError("Invalid size for DS at location: " + to_string(a_interm.location));
+        }
+    }
+}
+
+/*
+NAME
+
+    Assembler::ProgramSize - Find the number of words the program spans.
+
+SYNOPSIS
+
+    int Assembler::ProgramSize() const
+
+DESCRIPTION
+
+    This function finds the end of the highest word or DS area of the program, which is where the
+    literal pool goes.  With -stream the lines are not kept, and StreamPassI found the size instead.
+
+RETURNS
+
+    int - One past the last location the program occupies, not counting its literal pool.
+*/
+
+int Assembler::ProgramSize() const {
+    int size = m_streamSize;
+    for (const auto& interm : m_intermediate) {
+        if (interm.type != Instruction::ST_MachineLanguage && interm.type != Instruction::ST_AssemblerInstr) continue;
+
+        if (interm.type == Instruction::ST_MachineLanguage || interm.opcode == "DC") {
+            size = max(size, interm.location + 1);
+        }
+        else if (interm.opcode == "DS") {
+            try {
+                size = max(size, interm.location + stoi(interm.operand));
+            }
+            catch (...) {
+                // Already reported by Pass I.
+            }
+        }
+    }
+    return size;
+}
+
+/*
+NAME
+
+    Assembler::PlaceLiterals - Place the literal pool after the program.
+
+SYNOPSIS
+
+    void Assembler::PlaceLiterals()
+
+DESCRIPTION
+
+    Each distinct literal gets one word of the pool, which starts where the program ends.  The word
+    is entered in the symbol table under the literal itself (=N), so the instructions that use it
+    are encoded like any other, and it is listed with the other symbols.  If the pool has already
+    been placed, its entries are moved to where the program now ends.
+
+*/
+
+void Assembler::PlaceLiterals() {
+    if (m_literals.empty()) return;
+
+    bool isPlaced = m_literalPool >= 0;
+    m_literalPool = ProgramSize();
+    unordered_map<string, int> newLocations;
+    for (size_t i = 0; i < m_literals.size(); i++) {
+        string symbol = "=" + to_string(m_literals[i]);
+        int location = m_literalPool + static_cast<int>(i);
+        if (isPlaced) {
+            newLocations[symbol] = location;
+        }
+        else {
+            m_symtab.AddSymbol(symbol, location);
+        }
+    }
+    if (isPlaced) {
+        m_symtab.RelocateSymbols(newLocations);
+    }
+}
+
+/*
+NAME
+
+    Assembler::ChunkCount - Decide how many chunks to split a pass into.
+
+SYNOPSIS
+
+    size_t Assembler::ChunkCount(size_t a_items) const
+        size_t a_items --> Number of source lines to be processed.
+
+DESCRIPTION
+
+    A chunk is worth a thread only if it holds enough lines to outweigh starting the thread, so small
+    programs are processed in one chunk on the calling thread.  The count never exceeds the number of
+    threads requested on the command line.
+
+RETURNS
+
+    size_t - The number of chunks, at least one.
+*/
+
+size_t Assembler::ChunkCount(size_t a_items) const {
+    size_t count = a_items / MINCHUNKLINES;
+    count = min(count, static_cast<size_t>(m_opts.GetThreadCount()));
+    return max(count, static_cast<size_t>(1));
+}
+
+/*
+NAME
+
+    Assembler::RunChunks - Run the chunks of a pass concurrently.
+
+SYNOPSIS
+
+    void Assembler::RunChunks(size_t a_count, const function<void(size_t)>& a_work)
+        size_t a_count                          --> Number of chunks.
+        const function<void(size_t)>& a_work    --> Processes the chunk whose index it is given.
+
+DESCRIPTION
+
+    This function runs a_work for every chunk index, each on its own thread except the first, which
+    runs on the calling thread.  It returns when all chunks are done.
+
+*/
+
+void Assembler::RunChunks(size_t a_count, const function<void(size_t)>& a_work) {
+    vector<thread> workers;
+    for (size_t c = 1; c < a_count; c++) {
+        workers.emplace_back(a_work, c);
+    }
+    if (a_count > 0) {
+        a_work(0);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+/*
+NAME
+
+    Assembler::Optimize - Optimize the program between the passes.
+
+SYNOPSIS
+
+    void Assembler::Optimize()
+
+DESCRIPTION
+
+    If optimization or the merging of constants was requested on the command line, this function
+    runs the optimizer over the intermediate representation built by Pass I and reports the words
+    it saved.  The literal pool follows the program down.  Programs with errors, or that the
+    optimizer cannot rewrite safely, are translated as written.
+
+*/
+
+// Optimize the program between the passes.
+void Assembler::Optimize() {
+    if (!m_opts.GetOptimize() && !m_opts.GetMergeConstants()) return;
+
+    if (Errors::WasThereErrors()) {
+        m_out << "Optimization skipped due to errors." << endl;
+        return;
+    }
+    Optimizer optimizer(m_intermediate, m_symtab, m_exports);
+    if (optimizer.Optimize(m_opts.GetOptimize(), m_opts.GetMergeConstants())) {
+        optimizer.DisplaySavings(m_out);
+        PlaceLiterals();
+    }
+    else {
+        m_out << "Optimization skipped: " << optimizer.GetReason() << "." << endl;
+    }
+}
+
+/*
+NAME
+
+    Assembler::PassII - Perform error checking, translation, and memory preparation.
+
+SYNOPSIS
+
+    Assembler::PassII()
+
+DESCRIPTION
+
+    This function performs a second pass through the input file, translating assembly instructions into
+    machine code, preparing data for emulation, and outputting formatted results for the user. During this pass:
+
+    - Each instruction is parsed, and its type is identified (e.g., assembler directive, machine language, comment).
+    - Assembler directives (e.g., ORG, DC, DS) are processed and converted into memory representations.
+    - Machine language instructions are translated into machine code, and errors such as undefined symbols or
+      unknown opcodes are reported.
+    - The translated instructions and data are inserted into the emulator's memory for execution.
+    - The function outputs a formatted table displaying memory locations, generated contents, and original source lines.
+    - Errors and warnings encountered during the translation process are recorded and reported.
+
+    This function ensures the program is ready for execution by the emulator.
+
+    The symbol table is complete after Pass I, so every line translates independently.  The lines are
+    split into chunks that are translated concurrently, each into its own listing buffer and error list,
+    writing its words straight into the emulator.  The chunks cover disjoint lines, and the pages they
+    write are allocated up front, so the writes do not interfere.  The buffers and errors are then
+    emitted in chunk order, which makes the output identical to a sequential pass.
+
+    With -pipeline the lines were already translated during Pass I, and only the words that needed
+    the symbol table are left to resolve; see PipelinePassII.
+
+*/
+
+namespace {
+    // The share of Pass II handled by one thread.
+    struct PassIIChunk {
+        size_t begin;               // First line of the chunk.
+        size_t end;                 // One past the last line.
+        stringstream listing;       // Translation listing of the lines.
+        stringstream diag;          // Messages the emulator reported while loading the words.
+        vector<string> errors;      // Errors recorded for the lines, in order.
+        vector<int> pages;          // First location of each memory page the chunk writes.
+        vector<ObjectWord> object;  // Words for the object module, if one is being built.
+    };
+}
+
+// Pass II - Generate a translation
+void Assembler::PassII() {
+    size_t irBytes = m_intermediate.capacity() * sizeof(IntermediateInstruction);
+    for (const auto& interm : m_intermediate) {
+        irBytes += interm.label.capacity() + interm.opcode.capacity() + interm.operand.capacity() +
+            interm.originalLine.capacity();
+    }
+    Stats::Count(Stats::C_IRBytes, irBytes);
+
+    m_out << "\nTranslation of Program:\n\n";
+    m_out << left << setw(12) << "Location" << setw(12) << "Contents" << "Original Statement\n";
+    m_out << "-------------------------------------------------------------\n";
+
+    if (m_opts.GetPipeline()) {
+        PipelinePassII();
+    }
+    else if (m_opts.GetStream()) {
+        StreamPassII();
+    }
+    else {
+        TranslateChunks();
+    }
+    TranslateLiterals();
+    ResolveEntryPoints();
+    m_out << "-------------------------------------------------------------\n";
+    if (m_interactive) {
+        m_out << "\nPress Enter to continue...\n";
+        cin.get(); // Pause for user input
+    }
+}
+
+/*
+NAME
+
+    Assembler::TranslateChunks - Translate the lines concurrently.
+
+SYNOPSIS
+
+    void Assembler::TranslateChunks()
+
+DESCRIPTION
+
+    This function is the body of Pass II: it translates the lines in chunks on separate threads and
+    emits their listings, messages and errors in source order.
+
+*/
+
+void Assembler::TranslateChunks() {
+    Stats::Timer timer(Stats::P_PassII);
+    size_t numLines = m_intermediate.size();
+    vector<PassIIChunk> chunks(ChunkCount(numLines));
+    size_t perChunk = (numLines + chunks.size() - 1) / chunks.size();
+    for (size_t c = 0; c < chunks.size(); c++) {
+        chunks[c].begin = min(c * perChunk, numLines);
+        chunks[c].end = min(chunks[c].begin + perChunk, numLines);
+    }
+
+    // Allocate the memory the chunks will write, so that no thread allocates pages while others write.
+    if (chunks.size() > 1) {
+        RunChunks(chunks.size(), [&](size_t a_chunk) {
+            PassIIChunk& chunk = chunks[a_chunk];
+            for (size_t i = chunk.begin; i < chunk.end; i++) {
+                const IntermediateInstruction& interm = m_intermediate[i];
+                if (interm.type != Instruction::ST_MachineLanguage && interm.opcode != "DC") continue;
+
+                int page = interm.location - interm.location % emulator::PAGESZ;
+                if (chunk.pages.empty() || chunk.pages.back() != page) {
+                    chunk.pages.push_back(page);
+                }
+            }
+        });
+        for (const auto& chunk : chunks) {
+            for (int page : chunk.pages) {
+                m_emul.reserveMemory(page);
+            }
+        }
+    }
+
+    // Translate the chunks.
+    RunChunks(chunks.size(), [&](size_t a_chunk) {
+        PassIIChunk& chunk = chunks[a_chunk];
+        vector<ObjectWord>* object = m_buildObject ? &chunk.object : nullptr;
+        vector<string>* outer = Errors::CaptureErrors(&chunk.errors);
+        chunk.listing << left;
+        for (size_t i = chunk.begin; i < chunk.end; i++) {
+            TranslateInstruction(m_intermediate[i], chunk.listing, chunk.diag, object);
+        }
+        Errors::CaptureErrors(outer);
+    });
+
+    // Emit the results in source order.
+    timer.Switch(Stats::P_Listing);
+    for (const auto& chunk : chunks) {
+        m_out << chunk.listing.str();
+        m_diag << chunk.diag.str();
+        for (const auto& emsg : chunk.errors) {
+            Errors::RecordError(emsg);
+        }
+        m_objectWords.insert(m_objectWords.end(), chunk.object.begin(), chunk.object.end());
+    }
+}
+
+/*
+NAME
+
+    Assembler::PipelinePassI - Read, parse and translate the source in a pipeline.
+
+SYNOPSIS
+
+    void Assembler::PipelinePassI()
+
+DESCRIPTION
+
+    This function is Pass I with -pipeline.  Reading, parsing and translating each run on their own
+    thread, handing batches of lines to the next stage through bounded queues, so that waiting for
+    the file overlaps with the work on lines already read.
+
+    The parser is a sequential Pass I: it locates the lines, enters the labels and records the Pass I
+    errors, stopping at the END statement.  The translator, on the calling thread, lists each line
+    as it arrives.  Anything that depends on the symbol table, which is only complete at the end, is
+    deferred: the words are kept in m_deferred with room left for their contents in the listing, and
+    resolved by PipelinePassII.  The errors found while translating are kept by line until then.
+
+*/
+
+void Assembler::PipelinePassI() {
+    Stats::Timer timer(Stats::P_PassI);
+    SpscQueue<vector<SourceLine>> readQueue(QUEUEBATCHES);
+    SpscQueue<vector<IntermediateInstruction>> parseQueue(QUEUEBATCHES);
+    vector<string> parseErrors;
+    bool sawEnd = false;
+
+    // Reader: batches of source lines, then an empty batch at the end of the file.
+    thread reader([&] {
+        vector<SourceLine> batch;
+        SourceLine line;
+        while (NextLine(line)) {
+            batch.push_back(move(line));
+            if (batch.size() == BATCHLINES) {
+                readQueue.Push(move(batch));
+                batch.clear();
+            }
+        }
+        if (!batch.empty()) {
+            readQueue.Push(move(batch));
+        }
+        readQueue.Push(vector<SourceLine>());
+    });
+
+    // Parser: locates the lines and enters the labels, up to the END statement.
+    thread parser([&] {
+        Errors::CaptureErrors(&parseErrors);
+        Instruction inst;
+        int loc = 0; // Location counter
+        for (vector<SourceLine> lines = readQueue.Pop(); !lines.empty(); lines = readQueue.Pop()) {
+            if (sawEnd) continue; // Nothing after the first END statement is part of the program.
+
+            vector<IntermediateInstruction> batch;
+            for (auto& line : lines) {
+                IntermediateInstruction interm;
+                bool isSet;
+                int value;
+                bool isLiteral;
+                bool isValid = ParseLine(inst, line, interm, isSet, value, isLiteral);
+                interm.location = loc;
+                loc = isSet ? value : loc + value;
+                EnterLine(interm, isValid);
+                Stats::Count(Stats::C_Lines);
+        Stats::Count(Stats::C_Tokens, TokenCount(interm));
+
+                sawEnd = interm.type == Instruction::ST_End;
+                batch.push_back(move(interm));
+                if (sawEnd) break;
+            }
+            parseQueue.Push(move(batch));
+        }
+        parseQueue.Push(vector<IntermediateInstruction>());
+        Errors::CaptureErrors(nullptr);
+    });
+
+    // Translator: lists the lines and defers their words.
+    m_intermediate.clear();
+    m_deferred.clear();
+    m_pendingErrors.clear();
+    ostringstream listing;
+    listing << left;
+    ostringstream diag;
+    vector<string> lineErrors;
+    vector<string>* outer = Errors::CaptureErrors(&lineErrors);
+    for (auto batch = parseQueue.Pop(); !batch.empty(); batch = parseQueue.Pop()) {
+        for (auto& interm : batch) {
+            m_intermediate.push_back(move(interm));
+            TranslateInstruction(m_intermediate.back(), listing, diag, nullptr);
+            for (auto& emsg : lineErrors) {
+                m_pendingErrors.push_back(make_pair(m_intermediate.size() - 1, move(emsg)));
+            }
+            lineErrors.clear();
+        }
+    }
+    Errors::CaptureErrors(outer);
+    reader.join();
+    parser.join();
+    m_pendingListing = listing.str();
+
+    for (const auto& emsg : parseErrors) {
+        Errors::RecordError(emsg);
+    }
+    if (!sawEnd) {
+        Errors::RecordError("Missing END directive."); // Record error if END is missing
+    }
+    PlaceLiterals();
+}
+
+/*
+NAME
+
+    Assembler::PipelinePassII - Resolve the deferred words and emit the translation.
+
+SYNOPSIS
+
+    void Assembler::PipelinePassII()
 
 DESCRIPTION
 
-    This destructor ensures that any recorded errors during the assembly process are displayed by calling
-    the Errors::DisplayErrors function. It provides a clean and informative conclusion to the assembly
-    process, showing all accumulated errors if present.
+    This function completes the translation started by PipelinePassI now that the symbol table is
+    complete.  Each deferred word is resolved in source order, its contents filled into the listing,
+    and it is stored in the emulator's memory and the object module.  The errors of the translation
+    are recorded in source order, so the output is the same as without -pipeline.
 
 */
 
-// Destructor
-Assembler::~Assembler() {
-    Errors::DisplayErrors(); // Display any errors that were recorded
+void Assembler::PipelinePassII() {
+    Stats::Timer timer(Stats::P_PassII);
+    ostringstream diag;
+    vector<pair<size_t, string>> resolveErrors;
+    vector<string> lineErrors;
+    vector<string>* outer = Errors::CaptureErrors(&lineErrors);
+    for (const auto& word : m_deferred) {
+        const IntermediateInstruction& interm = m_intermediate[word.line];
+        int contents = word.value;
+        char relocation = 'A';
+        if (word.opcode >= 0) {
+            ErrorsAt at(interm);
+            contents = EncodeInstruction(word.opcode, interm.operand, relocation);
+            stringstream ss;
+            ss << setw(m_emul.getWordDigits()) << setfill('0') << contents;
+            m_pendingListing.replace(word.offset, ss.str().size(), ss.str());
+        }
+        m_emul.insertMemory(interm.location, contents, diag);
+        if (m_buildObject) {
+            m_objectWords.push_back(ObjectWord{ interm.location, contents, relocation,
+                relocation == 'X' ? interm.operand : "" });
+        }
+        for (auto& emsg : lineErrors) {
+            resolveErrors.push_back(make_pair(word.line, move(emsg)));
+        }
+        lineErrors.clear();
+    }
+    Errors::CaptureErrors(outer);
+
+    timer.Switch(Stats::P_Listing);
+    m_out << m_pendingListing;
+    m_diag << diag.str();
+    vector<pair<size_t, string>> errors(m_pendingErrors.size() + resolveErrors.size());
+    merge(m_pendingErrors.begin(), m_pendingErrors.end(), resolveErrors.begin(), resolveErrors.end(), errors.begin(),
+        [](const pair<size_t, string>& a_left, const pair<size_t, string>& a_right) {
+            return a_left.first < a_right.first;
+        });
+    for (const auto& error : errors) {
+        Errors::RecordError(error.second);
+    }
+    m_pendingListing.clear();
+    m_deferred.clear();
+    m_pendingErrors.clear();
 }
 
 /*
 NAME
 
-    Assembler::PassI - Determine the locations of labels.
+    Assembler::StreamPassI - Locate the labels without keeping the lines.
 
 SYNOPSIS
 
-    void Assembler::PassI()
+    void Assembler::StreamPassI()
 
 DESCRIPTION
 
-    This function identifies and records the memory locations of all labels in the input text file.
-    It achieves this by parsing each instruction into its components and verifying the presence of a label on the line.
+    This function is Pass I with -stream.  Each line is parsed, located and entered as it is read,
+    and then dropped, so the memory used depends on the number of symbols rather than the size of
+    the source.  StreamPassII reads the source again to translate it.  If the source cannot be read
+    again, as when it is a pipe, FileAccess spools the lines to a temporary file as they go by.
+
+    The size of the module is found here, since the lines are not kept for BuildObjectModule.
 
 */
 
-// Pass I - Establish the locations of the symbols
-void Assembler::PassI() {
-    int loc = 0; // Location counter
+void Assembler::StreamPassI() {
+    Stats::Timer timer(Stats::P_PassI);
+    m_facc.EnableRewind();
+    m_intermediate.clear();
+    m_streamSize = 0;
 
-    while (true) {
-        string line;
-        if (!m_facc.GetNextLine(line)) {
-            Errors::RecordError("Missing END directive."); // Record error if END is missing
-            break;
+    Instruction inst;
+    IntermediateInstruction interm;
+    int loc = 0; // Location counter
+    bool sawEnd = false;
+    SourceLine line;
+    while (!sawEnd && NextLine(line)) {
+        bool isSet;
+        int value;
+        bool isLiteral;
+        bool isValid = ParseLine(inst, line, interm, isSet, value, isLiteral);
+        interm.location = loc;
+        if (!isSet && value > 0) {
+            m_streamSize = max(m_streamSize, loc + value);
         }
+        loc = isSet ? value : loc + value;
+        EnterLine(interm, isValid);
+        Stats::Count(Stats::C_Lines);
+        Stats::Count(Stats::C_Tokens, TokenCount(interm));
+
+        sawEnd = interm.type == Instruction::ST_End;
+    }
+    if (!sawEnd) {
+        Errors::RecordError("Missing END directive."); // Record error if END is missing
+    }
+    PlaceLiterals();
+}
 
-        Instruction::InstructionType instType = m_inst.ParseInstruction(line); // Parse the instruction
+/*
+NAME
+
+    Assembler::StreamPassII - Translate the source as it is read again.
+
+SYNOPSIS
+
+    void Assembler::StreamPassII()
+
+DESCRIPTION
+
+    This function is Pass II with -stream.  The source is rewound and each line parsed and located
+    again, exactly as StreamPassI did, then translated and listed straight away.  Errors in parsing
+    the line were recorded by Pass I, so they are not recorded again.
+
+*/
+
+void Assembler::StreamPassII() {
+    Stats::Timer timer(Stats::P_PassII);
+    m_facc.rewind();
+    m_includeStack.clear();
+    m_isPassI = false;
+
+    vector<ObjectWord>* object = m_buildObject ? &m_objectWords : nullptr;
+    Instruction inst;
+    IntermediateInstruction interm;
+    vector<string> parseErrors;
+    int loc = 0; // Location counter
+    SourceLine line;
+    while (NextLine(line)) {
+        bool isSet;
+        int value;
+        bool isLiteral;
+        vector<string>* outer = Errors::CaptureErrors(&parseErrors);
+        ParseLine(inst, line, interm, isSet, value, isLiteral);
+        Errors::CaptureErrors(outer);
+        parseErrors.clear();
 
-        IntermediateInstruction interm; // Create an intermediate representation for this line
-        interm.type = instType;
-        interm.label = m_inst.isLabel() ? m_inst.GetLabel() : ""; // Get label if present
-        interm.opcode = m_inst.GetOpCode();
-        interm.operand = m_inst.GetOperand();
         interm.location = loc;
-        interm.originalLine = line; // Store original line for reference
+        loc = isSet ? value : loc + value;
+
+        TranslateInstruction(interm, m_out, m_diag, object);
+        if (interm.type == Instruction::ST_End) break; // Nothing after END is part of the program.
+    }
+}
 
-        m_intermediate.push_back(interm); // Save the parsed line
+/*
+NAME
 
-        if (instType == Instruction::ST_Invalid) continue; // Skip invalid instructions
-        if (instType == Instruction::ST_End) break; // Stop at END directive
-        if (instType == Instruction::ST_Comment) continue; // Skip comments
+    Assembler::TranslateLiterals - Translate the literal pool and list it.
 
-        if (instType == Instruction::ST_AssemblerInstr) {
-            if (m_inst.isLabel()) {
-                m_symtab.AddSymbol(m_inst.GetLabel(), loc); // Add label to the symbol table
-            }
+SYNOPSIS
+
+    void Assembler::TranslateLiterals()
+
+DESCRIPTION
+
+    This function lists each word of the literal pool after the lines of the program, with the
+    literal in place of a source statement, and inserts it into the emulator's memory and the
+    object module.  The pool holds plain constants, so its words are not relocated.
+
+*/
+
+void Assembler::TranslateLiterals() {
+    for (size_t i = 0; i < m_literals.size(); i++) {
+        int location = m_literalPool + static_cast<int>(i);
+        int value = m_literals[i];
+        stringstream ss;
+        ss << setw(m_emul.getWordDigits()) << setfill('0') << value;
+        m_out << setw(12) << location << setw(12) << ss.str() << "=" << value << "\n";
+        m_emul.insertMemory(location, value, m_diag);
+        if (m_buildObject) {
+            m_objectWords.push_back(ObjectWord{ location, value, 'A', "" });
+        }
+    }
+}
+
+/*
+NAME
+
+    Assembler::TranslateInstruction - Translate one line and list it.
+
+SYNOPSIS
+
+    void Assembler::TranslateInstruction(const IntermediateInstruction& a_interm, ostream& a_listing, ostream& a_diag,
+            vector<ObjectWord>* a_object)
+        const IntermediateInstruction& a_interm --> The line, as recorded by Pass I.
+        ostream& a_listing                      --> Receives the line of the translation listing.
+        ostream& a_diag                         --> Receives messages from the emulator about the word.
+        vector<ObjectWord>* a_object            --> Receives the word and its relocation, or nullptr if
+                                                    no object module is being built.
+
+DESCRIPTION
+
+    This function translates a single line of the program: it lists the line, looks up the opcode and
+    operand of a machine instruction, records any errors, and inserts the resulting word into the
+    emulator's memory.  It only reads the symbol table, so it may be called from several threads at
+    once for different lines.  Errors about a line of an included file are recorded with its place.
+
+    An operand named by EXTERN is only resolved when the program is linked, so it is translated as
+    address zero with a relocation naming the symbol; outside of an object module it is an error.
+    Every other operand is an address within the module and is marked for relocation by the linker.
+
+*/
+
+void Assembler::TranslateInstruction(const IntermediateInstruction& a_interm, ostream& a_listing, ostream& a_diag,
+    vector<ObjectWord>* a_object) {
+    const IntermediateInstruction& interm = a_interm;
+    ErrorsAt at(interm);
+
+    if (interm.type == Instruction::ST_Invalid) return; // Skip invalid instructions
+
+    if (interm.type == Instruction::ST_End) {
+        a_listing << setw(12) << "" << setw(12) << "" << interm.originalLine << "\n";
+        return;
+    }
 
-            if (m_inst.GetOpCode() == "ORG") {
-                try {
-                    loc = stoi(m_inst.GetOperand()); // Set location to operand value
+    if (interm.type == Instruction::ST_Comment) {
+        a_listing << setw(36) << "" << interm.originalLine << "\n";
+        return;
+    }
+
+    if (interm.type == Instruction::ST_AssemblerInstr) {
+        if (interm.opcode == "ORG") {
+            a_listing << setw(12) << interm.location << setw(12) << "" << interm.originalLine << "\n";
+        }
+        else if (interm.opcode == "DC") {
+            try {
+                int value = stoi(interm.operand); // Parse operand value
+                stringstream ss;
+                ss << setw(m_emul.getWordDigits()) << setfill('0') << value; // Format the value
+                a_listing << setw(12) << interm.location << setw(12) << ss.str() << interm.originalLine << "\n";
+                if (m_opts.GetPipeline()) {
+                    m_deferred.push_back(DeferredWord{ static_cast<size_t>(&interm - m_intermediate.data()), 0, -1, value });
+                    return;
                 }
-                catch (...) {
-                    Errors::RecordError("Invalid operand for ORG directive."); // Handle invalid operand
+                m_emul.insertMemory(interm.location, value, a_diag); // Insert value into memory
+                if (a_object != nullptr) {
+                    a_object->push_back(ObjectWord{ interm.location, value, 'A', "" });
                 }
-                continue;
             }
-            else if (m_inst.GetOpCode() == "DC" || m_inst.GetOpCode() == "DS") {
-                loc = m_inst.LocationNextInstruction(loc); // Update location for data storage
-                continue;
-            }
-            else {
-                Errors::RecordError("Unknown assembler instruction: " + m_inst.GetOpCode()); // Handle unknown instructions
-                continue;
+            catch (...) {
+                Errors::RecordError("Invalid operand for DC directive."); // Handle invalid operand
             }
         }
+        else if (interm.opcode == "DS") {
+            a_listing << setw(12) << interm.location << setw(12) << "" << interm.originalLine << "\n";
+        }
+        else if (interm.opcode == "EXTERN" || interm.opcode == "PUBLIC" || interm.opcode == "ENTRY" ||
+            interm.opcode == "INCLUDE") {
+            a_listing << setw(36) << "" << interm.originalLine << "\n";
+        }
+        return;
+    }
+
+    if (interm.type == Instruction::ST_MachineLanguage) {
+        int machineOpcode = OpcodeTable::lookup(interm.opcode);
+        if (machineOpcode >= 0) {
+
+            if (m_opts.GetPipeline()) {
+                // The symbol table is not complete yet; leave room for the contents.
+                a_listing << setw(12) << interm.location;
+                m_deferred.push_back(DeferredWord{ static_cast<size_t>(&interm - m_intermediate.data()),
+                    static_cast<size_t>(a_listing.tellp()), machineOpcode, 0 });
+                a_listing << setw(12) << "" << interm.originalLine << "\n";
+                return;
+            }
+
+            char relocation;
+            int machineCode = EncodeInstruction(machineOpcode, interm.operand, relocation); // Calculate machine code
 
-        if (instType == Instruction::ST_MachineLanguage) {
-            if (m_inst.isLabel()) {
-                m_symtab.AddSymbol(m_inst.GetLabel(), loc); // Add label to the symbol table
+            stringstream ss;
+            ss << setw(m_emul.getWordDigits()) << setfill('0') << machineCode; // Format machine code
+
+            a_listing << setw(12) << interm.location << setw(12) << ss.str() << interm.originalLine << "\n";
+            m_emul.insertMemory(interm.location, machineCode, a_diag); // Insert machine code into memory
+            if (a_object != nullptr) {
+                a_object->push_back(ObjectWord{ interm.location, machineCode, relocation,
+                    relocation == 'X' ? interm.operand : "" });
             }
-            loc = m_inst.LocationNextInstruction(loc); // Update location for machine language instruction
+        }
+        else {
+            Errors::RecordError("Unknown opcode: " + interm.opcode); // Handle unknown opcode
         }
     }
 }
@@ -129,100 +1368,204 @@ void Assembler::PassI() {
 /*
 NAME
 
-    Assembler::PassII - Perform error checking, translation, and memory preparation.
+    Assembler::EncodeInstruction - Encode a machine instruction.
 
 SYNOPSIS
 
-    Assembler::PassII()
+    int Assembler::EncodeInstruction(int a_opcode, const string& a_operand, char& a_relocation) const
+        int a_opcode            --> The machine opcode.
+        const string& a_operand --> The operand, a symbol or empty.
+        char& a_relocation      --> Set to how the linker must relocate the word.
 
 DESCRIPTION
 
-    This function performs a second pass through the input file, translating assembly instructions into
-    machine code, preparing data for emulation, and outputting formatted results for the user. During this pass:
-
-    - Each instruction is parsed, and its type is identified (e.g., assembler directive, machine language, comment).
-    - Assembler directives (e.g., ORG, DC, DS) are processed and converted into memory representations.
-    - Machine language instructions are translated into machine code, and errors such as undefined symbols or
-      unknown opcodes are reported.
-    - The translated instructions and data are inserted into the emulator's memory for execution.
-    - The function outputs a formatted table displaying memory locations, generated contents, and original source lines.
-    - Errors and warnings encountered during the translation process are recorded and reported.
+    This function looks up the operand and encodes the instruction word, recording an error if the
+    operand is undefined, is imported while the program is not being assembled for linking, or is
+    at an address outside memory, whose digits would not fit the address field.  A literal operand
+    is the symbol of its entry in the literal pool.  An invalid literal was reported when its line
+    was parsed and is not reported again.
 
-    This function ensures the program is ready for execution by the emulator.
+RETURNS
 
+    int - The instruction word.
 */
 
-// Pass II - Generate a translation
-void Assembler::PassII() {
-    unordered_map<string, int> opcodeMap = {
-        {"READ", 7}, {"LOAD", 5}, {"STORE", 6},
-        {"WRITE", 8}, {"BP", 12}, {"HALT", 13}
-    };
+int Assembler::EncodeInstruction(int a_opcode, const string& a_operand, char& a_relocation) const {
+    int operandAddr = 0;
+    a_relocation = a_operand.empty() ? 'A' : 'R';
 
-    cout << "\nTranslation of Program:\n\n";
-    cout << left << setw(12) << "Location" << setw(12) << "Contents" << "Original Statement\n";
-    cout << "-------------------------------------------------------------\n";
+    if (m_imports.count(a_operand) != 0) {
+        a_relocation = 'X';
+        if (m_opts.GetObjectFile().empty()) {
+            Errors::RecordError("External symbol " + a_operand + " requires linking."); // Handle unlinked imports
+        }
+    }
+    else if (!a_operand.empty() && a_operand[0] == '=' && m_literalIndex.count(a_operand) == 0) {
+        // An invalid literal.
+    }
+    else if (!a_operand.empty() && !m_symtab.LookupSymbol(a_operand, operandAddr)) {
+        Errors::RecordError("Undefined symbol: " + a_operand); // Handle undefined symbols
+    }
+    else if (operandAddr < 0 || operandAddr >= m_emul.getMemorySize()) {
+        // An address that outgrew the address field would carry into the opcode.
+        Errors::RecordError("Address " + to_string(operandAddr) + " of " + a_operand + " is outside memory.");
+        operandAddr = 0;
+    }
+    return m_emul.encodeWord(a_opcode, operandAddr);
+}
 
-    for (const auto& interm : m_intermediate) {
-        if (interm.type == Instruction::ST_Invalid) continue; // Skip invalid instructions
+/*
+NAME
 
-        if (interm.type == Instruction::ST_End) {
-            cout << setw(12) << "" << setw(12) << "" << interm.originalLine << "\n";
-            continue;
-        }
+    Assembler::ResolveEntryPoints - Give the emulator a hart for each ENTRY directive.
 
-        if (interm.type == Instruction::ST_Comment) {
-            cout << setw(36) << "" << interm.originalLine << "\n";
-            continue;
-        }
+SYNOPSIS
 
-        if (interm.type == Instruction::ST_AssemblerInstr) {
-            if (interm.opcode == "ORG") {
-                cout << setw(12) << interm.location << setw(12) << "" << interm.originalLine << "\n";
-            }
-            else if (interm.opcode == "DC") {
-                try {
-                    int value = stoi(interm.operand); // Parse operand value
-                    stringstream ss;
-                    ss << setw(6) << setfill('0') << value; // Format the value
-                    cout << setw(12) << interm.location << setw(12) << ss.str() << interm.originalLine << "\n";
-                    m_emul.insertMemory(interm.location, value); // Insert value into memory
-                }
-                catch (...) {
-                    Errors::RecordError("Invalid operand for DC directive."); // Handle invalid operand
-                }
-            }
-            else if (interm.opcode == "DS") {
-                cout << setw(12) << interm.location << setw(12) << "" << interm.originalLine << "\n";
-            }
-            continue;
+    void Assembler::ResolveEntryPoints()
+
+DESCRIPTION
+
+    Each ENTRY directive names the label at which one hart of the machine starts, in the order the
+    directives appear.  A program without any runs on the single classic hart starting at location
+    100.  The labels must be defined in the program.
+
+*/
+
+void Assembler::ResolveEntryPoints() {
+    if (m_entries.empty()) return;
+
+    vector<int> entries;
+    for (const auto& symbol : m_entries) {
+        int location = 0;
+        if (symbol.empty()) {
+            Errors::RecordError("Missing label for ENTRY directive.");
+        }
+        else if (!m_symtab.LookupSymbol(symbol, location)) {
+            Errors::RecordError("Undefined entry point: " + symbol);
         }
+        entries.push_back(location);
+    }
+    if (entries.size() > static_cast<size_t>(emulator::MAXHARTS)) {
+        Errors::RecordError("Too many ENTRY directives; the machine has at most " + to_string(emulator::MAXHARTS) +
+            " harts.");
+        return;
+    }
+    m_emul.setEntryPoints(entries, m_diag);
+}
 
-        if (interm.type == Instruction::ST_MachineLanguage) {
-            auto it = opcodeMap.find(interm.opcode);
-            if (it != opcodeMap.end()) {
-                int machineOpcode = it->second;
-                int operandAddr = 0;
+/*
+NAME
 
-                if (!interm.operand.empty() && !m_symtab.LookupSymbol(interm.operand, operandAddr)) {
-                    Errors::RecordError("Undefined symbol: " + interm.operand); // Handle undefined symbols
-                }
+    Assembler::WriteObjectModule - Write the translation as a relocatable object module.
+
+SYNOPSIS
 
-                int machineCode = machineOpcode * 10000 + operandAddr; // Calculate machine code
+    bool Assembler::WriteObjectModule()
 
-                stringstream ss;
-                ss << setw(6) << setfill('0') << machineCode; // Format machine code
+DESCRIPTION
 
-                cout << setw(12) << interm.location << setw(12) << ss.str() << interm.originalLine << "\n";
-                m_emul.insertMemory(interm.location, machineCode); // Insert machine code into memory
-            }
-            else {
-                Errors::RecordError("Unknown opcode: " + interm.opcode); // Handle unknown opcode
-            }
+    This function writes the object module built from the translation to the object file named on
+    the command line.
+
+RETURNS
+
+    bool - True if the module was written without errors.
+*/
+
+// Write the translation as an object module.
+bool Assembler::WriteObjectModule() {
+    ObjectModule module;
+    if (!BuildObjectModule(module)) {
+        m_out << "Object module not written due to errors." << endl;
+        return false;
+    }
+    if (!module.Write(m_opts.GetObjectFile())) {
+        return false;
+    }
+    m_out << "Object module written to " << m_opts.GetObjectFile() << "." << endl;
+    return true;
+}
+
+/*
+NAME
+
+    Assembler::WriteNativeProgram - Translate the program to C++.
+
+SYNOPSIS
+
+    bool Assembler::WriteNativeProgram()
+
+DESCRIPTION
+
+    This function writes the program loaded into the emulator by Pass II as a C++ source file, the
+    one named on the command line, to be compiled to native code.  As with RunProgramInEmulator, a
+    program with errors is not translated.
+
+RETURNS
+
+    bool - True if the file was written.
+*/
+
+// Translate the program to C++.
+bool Assembler::WriteNativeProgram() {
+    if (Errors::WasThereErrors()) {
+        m_out << "Native program not written due to errors." << endl;
+        return false;
+    }
+    NativeTranslator translator(m_emul);
+    if (!translator.Write(m_opts.GetNativeFile())) {
+        return false;
+    }
+    m_out << "Native program written to " << m_opts.GetNativeFile() << "." << endl;
+    return true;
+}
+
+/*
+NAME
+
+    Assembler::BuildObjectModule - Collect the translation as an object module.
+
+SYNOPSIS
+
+    bool Assembler::BuildObjectModule(ObjectModule& a_module)
+        ObjectModule& a_module --> Receives the module.
+
+DESCRIPTION
+
+    This function gathers the words produced by Pass II together with the symbols the program
+    exports and imports.  The module spans every location the program occupies, including its DS
+    areas and literal pool, so the linker can place the next module after it.  A symbol named by
+    PUBLIC must be defined in the program.  A module has no harts of its own, so a program with
+    ENTRY directives cannot be made into one.
+
+RETURNS
+
+    bool - True if the module was built without errors.
+*/
+
+// Collect the translation as an object module.
+bool Assembler::BuildObjectModule(ObjectModule& a_module) {
+    ObjectModule& module = a_module;
+    if (!m_entries.empty()) {
+        Errors::RecordError("ENTRY directives cannot be used in an object module.");
+    }
+    module.SetAddressDigits(m_emul.getAddressDigits());
+
+    module.SetSize(ProgramSize() + static_cast<int>(m_literals.size()));
+
+    for (const auto& symbol : m_exports) {
+        int location;
+        if (m_symtab.LookupSymbol(symbol, location)) {
+            module.AddExport(symbol, location);
         }
     }
-    cout << "-------------------------------------------------------------\n\nPress Enter to continue...\n";
-    cin.get(); // Pause for user input
+    for (const auto& symbol : m_imports) {
+        module.AddImport(symbol);
+    }
+    for (const auto& word : m_objectWords) {
+        module.AddWord(word);
+    }
+    return !Errors::WasThereErrors();
 }
 
 /*
@@ -247,7 +1590,8 @@ DESCRIPTION
 
 // Display the symbols in the symbol table.
 void Assembler::DisplaySymbolTable() const {
-    m_symtab.DisplaySymbolTable(); // Call the SymbolTable's display function
+    Stats::Timer timer(Stats::P_Listing);
+    m_symtab.DisplaySymbolTable(m_out); // Call the SymbolTable's display function
 }
 
 /*
@@ -270,16 +1614,121 @@ DESCRIPTION
     indicating the issue. Similarly, if the assembly process encountered errors,
     the emulator will not run, and an appropriate message is displayed.
 
+    A program with ENTRY directives runs on one hart per directive, taking turns on this thread
+    unless -free asks for each hart to run on its own thread.  The data file named by -device is
+    attached for the run and saved after it.
+
+    With -timing, a program with one hart runs with a cycle model as the emulator's timing policy,
+    and the cycles it estimated are reported after the run, even one that faulted.  A program with
+    several harts runs without it.
+
 */
 
 // Run the program in the emulator
 void Assembler::RunProgramInEmulator() {
-    if (!Errors::WasThereErrors()) {
-        if (!m_emul.runProgram()) {
+    BlockDevice device;
+    CycleModel model;
+    bool timing = m_opts.GetTiming() && m_entries.empty();
+    if (m_opts.GetTiming() && !timing) {
+        cout << "Cycles are not estimated for a program with several harts." << endl;
+    }
+    if (!Errors::WasThereErrors() && (m_opts.GetCostFile().empty() || model.Load(m_opts.GetCostFile())) &&
+        device.Open(m_opts, m_emul)) {
+        m_emul.setLimits({ m_opts.GetInstructionLimit(), m_opts.GetTimeLimit(), m_opts.GetOutputLimit() });
+        bool ran;
+        {
+            Stats::Timer timer(Stats::P_Emulation);
+            if (timing) {
+                ran = m_emul.runProgram(model);
+            }
+            else if (m_entries.empty()) {
+                ran = m_emul.runProgram();
+            }
+            else {
+                ran = m_emul.runHarts(m_opts.GetFreeRunning() ? emulator::SC_FreeRunning : emulator::SC_Deterministic);
+            }
+        }
+        Stats::CountRun(m_emul);
+        device.Close();
+        if (!ran) {
             cout << "Emulator encountered an error." << endl; // Report emulator error
         }
+        if (timing) {
+            DisplayTiming(model);
+        }
     }
     else {
         cout << "Cannot run emulator due to errors." << endl; // Report assembly errors
     }
 }
+
+/*
+NAME
+
+    Assembler::DisplayTiming - Report the cycles the program was estimated to take.
+
+SYNOPSIS
+
+    void Assembler::DisplayTiming(const CycleModel& a_model) const
+        const CycleModel& a_model --> The cycle model the program ran with.
+
+DESCRIPTION
+
+    This function reports the cycles of the run by basic block, then lists each machine
+    instruction of the program with the times it was executed and the cycles spent on it.
+    Lines from included files are listed where they were included.
+
+*/
+
+void Assembler::DisplayTiming(const CycleModel& a_model) const {
+    a_model.DisplayBlocks(cout, m_emul);
+
+    cout << "\nCycles by source line:\n\n";
+    cout << left << setw(12) << "Location" << setw(12) << "Executed" << setw(12) << "Cycles" << "Original Statement\n";
+    cout << "-------------------------------------------------------------\n";
+    for (const auto& interm : m_intermediate) {
+        if (interm.type == Instruction::ST_MachineLanguage) {
+            cout << setw(12) << interm.location << setw(12) << a_model.GetExecutions(interm.location)
+                << setw(12) << a_model.GetCycles(interm.location) << interm.originalLine << "\n";
+        }
+    }
+    cout << "-------------------------------------------------------------" << endl;
+}
+
+/*
+NAME
+
+    Assembler::DebugProgram - Execute the program under the debugger.
+
+SYNOPSIS
+
+    void Assembler::DebugProgram()
+
+DESCRIPTION
+
+    This function runs the assembled program under the interactive debugger, which finds labels
+    in the symbol table.  As with RunProgramInEmulator, a program with errors is not run.  The
+    debugger controls a single hart, so programs with several ENTRY directives cannot be debugged.
+
+*/
+
+// Run the program under the debugger
+void Assembler::DebugProgram() {
+    if (Errors::WasThereErrors()) {
+        cout << "Cannot run debugger due to errors." << endl;
+        return;
+    }
+    if (m_emul.getHartCount() > 1) {
+        cout << "The debugger cannot run a program with several harts." << endl;
+        return;
+    }
+    BlockDevice device;
+    if (!device.Open(m_opts, m_emul)) {
+        cout << "Cannot run debugger due to errors." << endl;
+        return;
+    }
+    Debugger debugger(m_emul, m_symtab);
+    if (!debugger.Run()) {
+        cout << "Emulator encountered an error." << endl;
+    }
+}
@@ -8,40 +8,176 @@
 #include "Instruction.h"
 #include "FileAccess.h"
 #include "Emulator.h"
+#include "Options.h"
+#include "ObjectModule.h"
+#include "SpscQueue.h"
+#include "SourceCache.h"
 #include "stdafx.h"
 
-// Struct to hold the intermediate representation of each line of assembly code.
-struct IntermediateInstruction {
-    Instruction::InstructionType type; // The type of instruction (e.g., machine language, assembler directive).
-    string label;                     // Label associated with the instruction, if any.
-    string opcode;                    // The operation code of the instruction.
-    string operand;                   // Operand for the instruction, if any.
-    int location;                     // Memory location of the instruction.
-    string originalLine;              // The original line of assembly code for reference.
-};
+class CycleModel;
 
 class Assembler {
 
 public:
-    Assembler(int argc, char* argv[]); // Constructor: Initialize the assembler with command-line arguments.
+    Assembler(const Options& a_opts); // Constructor: Initialize the assembler with the command-line options.
+    // Constructor: Assemble source text held in memory, listing to a_listing without pausing for the user.
+    Assembler(const Options& a_opts, const string& a_source, ostream& a_listing, ostream& a_diag = cerr);
     ~Assembler();                     // Destructor: Clean up resources used by the assembler.
 
+    // Version of the translation.  Cached images are keyed by it, so change it whenever the
+    // listing or the words produced for a program change.
+    const static int VERSION = 40;
+
     // Pass I - Analyze the assembly file to determine symbol locations.
     void PassI();
 
+    // Optionally optimize the program between the passes.
+    void Optimize();
+
     // Pass II - Convert assembly instructions into machine code.
     void PassII();
 
+    // Write the translation as a relocatable object module instead of running it.
+    bool WriteObjectModule();
+
+    // Translate the program to C++ instead of running it.
+    bool WriteNativeProgram();
+
+    // Collect the translation as an object module, for the linker or to load into another emulator.
+    bool BuildObjectModule(ObjectModule& a_module);
+
+    // True if the program includes other files, so its source text alone does not determine it.
+    bool IncludesFiles() const;
+
     // Display the contents of the symbol table (useful for debugging).
     void DisplaySymbolTable() const;
 
     // Run the translated program using the emulator to verify functionality.
     void RunProgramInEmulator();
 
+    // Run the translated program under the interactive debugger.
+    void DebugProgram();
+
 private:
+    // Fewest source lines worth giving a thread of their own.
+    const static size_t MINCHUNKLINES = 4'096;
+
+    // Lines the stages of the pipeline hand on at a time, and batches each queue holds.
+    const static size_t BATCHLINES = 256;
+    const static size_t QUEUEBATCHES = 64;
+
+    // Most files INCLUDE directives may be nested in.  Cycles are found before this is reached;
+    // it stops a chain of files that name each other by different paths.
+    const static size_t MAXINCLUDEDEPTH = 16;
+
+    // A line of the program, from the source or from a file it includes.
+    struct SourceLine {
+        string text;                            // The line, if it is a line of the source.
+        const SourceCache::Line* included;      // The line and its parse, if it is from an included file.
+        const string* file;                     // The file it is from, if it was included.
+        int number;                             // Its line number there.
+        size_t depth;                           // Number of files it is included through.
+        string error;                           // Why the file an INCLUDE names was not included.
+    };
+
+    // An included file being read.
+    struct IncludeLevel {
+        shared_ptr<const SourceCache::File> file;
+        size_t next;                            // Index of its next line.
+    };
+
+    // A word whose translation waits for the symbol table, with -pipeline.
+    struct DeferredWord {
+        size_t line;        // Index of its line in m_intermediate.
+        size_t offset;      // Where its contents go in m_pendingListing, for an instruction.
+        int opcode;         // Machine opcode, or -1 for a DC constant.
+        int value;          // The constant, for DC.
+    };
+
+    // Number of chunks to split a pass over a_items lines into.
+    size_t ChunkCount(size_t a_items) const;
+
+    // Translates the lines in concurrent chunks; the body of Pass II.
+    void TranslateChunks();
+
+    // Pass I with reading, parsing and translation overlapped on separate threads, for -pipeline.
+    void PipelinePassI();
+
+    // Pass II for -pipeline: resolves the deferred words and emits the translation.
+    void PipelinePassII();
+
+    // Pass I and Pass II for -stream, which read the source twice rather than keep its lines.
+    void StreamPassI();
+    void StreamPassII();
+
+    // Reads the next line of the program.  The lines of an included file follow its INCLUDE directive.
+    bool NextLine(SourceLine& a_line);
+
+    // Starts reading the file an INCLUDE directive names, or notes in a_line why it cannot be read.
+    void EnterInclude(const string& a_name, SourceLine& a_line);
+
+    // Parses a line into a_interm, taking the parse of an included line from the cache, and records
+    // its errors.  Returns false if its ORG or DS operand is invalid.  Safe to call concurrently.
+    static bool ParseLine(Instruction& a_inst, SourceLine& a_line, IntermediateInstruction& a_interm, bool& a_isSet,
+        int& a_value, bool& a_isLiteral);
+
+    // Enters the label and linkage of a located line, and records its Pass I errors.
+    void EnterLine(IntermediateInstruction& a_interm, bool a_isValid);
+
+    // Words the program spans, not counting its literal pool.
+    int ProgramSize() const;
+
+    // Places the literal pool after the program and enters its entries in the symbol table.  Called
+    // again once the optimizer has moved the program, to move the pool with it.
+    void PlaceLiterals();
+
+    // Lists the literal pool and loads its words, after the lines of the program.
+    void TranslateLiterals();
+
+    // Gives the emulator a hart for each ENTRY directive.
+    void ResolveEntryPoints();
+
+    // Reports the cycles a run with -timing was estimated to take, by basic block and by source line.
+    void DisplayTiming(const CycleModel& a_model) const;
+
+    // Encodes a machine instruction, looking up its operand.  Safe to call concurrently.
+    int EncodeInstruction(int a_opcode, const string& a_operand, char& a_relocation) const;
+
+    // Runs a_work on every chunk index concurrently and waits for all of them.
+    static void RunChunks(size_t a_count, const function<void(size_t)>& a_work);
+
+    // Translates one line into the emulator's memory and lists it.  Safe to call concurrently.
+    // When building an object module, the word and its relocation are also added to a_object.
+    void TranslateInstruction(const IntermediateInstruction& a_interm, ostream& a_listing, ostream& a_diag,
+        vector<ObjectWord>* a_object);
+
+    Options m_opts;     // Command line options
+    istringstream m_sourceText; // Source held in memory, if it did not come from a file
     FileAccess m_facc;  // File Access object
     SymbolTable m_symtab;   // Symbol table object
     Instruction m_inst; //Instruction object
     emulator m_emul;   // Emulator object
     vector<IntermediateInstruction> m_intermediate; // Stores the intermediate representation of the assembly program.
+    set<string> m_imports;              // Symbols named by EXTERN, defined in other modules.
+    vector<string> m_exports;           // Symbols named by PUBLIC, for other modules to use.
+    vector<string> m_entries;           // Symbols named by ENTRY, where the harts start.
+    vector<ObjectWord> m_objectWords;   // Words of the object module, when one is being built.
+    bool m_buildObject;                 // True if Pass II collects the words of an object module.
+    ostream& m_out;                     // Receives the translation listing and messages.
+    ostream& m_diag;                    // Receives the emulator's messages about the words loaded.
+    bool m_interactive;                 // True if the assembler may pause for the user.
+    int m_streamSize;                   // Words the module spans, found by StreamPassI.
+    vector<int> m_literals;                         // Constants of the literal pool, in order of first use.
+    unordered_map<string, size_t> m_literalIndex;   // Entry of each literal in the pool, by operand (=N).
+    int m_literalPool;                              // Location of the literal pool, or -1 until it is placed.
+    string m_sourceName;                            // Name of the source file, or empty if it is held in memory.
+    vector<IncludeLevel> m_includeStack;            // The included files being read, innermost last.
+    map<string, shared_ptr<const SourceCache::File>> m_includedFiles;  // Files included, by path, held while their lines are.
+    bool m_sawInclude;                              // True if the program has an INCLUDE directive.
+    bool m_isPassI;                                 // False once -stream reads the program again for Pass II.
+
+    // Left by PipelinePassI for PipelinePassII.
+    string m_pendingListing;                        // The listing, with room for the deferred contents.
+    vector<DeferredWord> m_deferred;                // Words waiting for the symbol table, in source order.
+    vector<pair<size_t, string>> m_pendingErrors;   // Errors found while translating, by line.
 };
@@ -0,0 +1,281 @@
+// BlockDevice.cpp
+//
+// Implementation of the BlockDevice class.
+// A file whose name ends in .txt holds the words as decimal numbers separated by white space, for
+// data sets prepared by hand; any other file holds them as 32-bit words in the host's byte order.
+// A binary file is mapped with write access, so what the program writes with BWRITE is in the
+// file as soon as the operating system writes the page back, and a text file is rewritten when
+// the device is closed if the program changed it.  Either way a file that does not exist is
+// created, and the device is at least as long as -devicesize asks.
+//
+#include "stdafx.h"
+#include "BlockDevice.h"
+#include "Errors.h"
+
+#include <cerrno>
+#include <climits>
+#include <fstream>
+
+/*
+NAME
+
+    BlockDevice::BlockDevice - Constructor for the BlockDevice class.
+
+SYNOPSIS
+
+    BlockDevice::BlockDevice()
+
+DESCRIPTION
+
+    The device is closed until Open is called.
+
+*/
+
+BlockDevice::BlockDevice()
+    : m_isText(false), m_emul(nullptr), m_words(nullptr), m_size(0), m_file(INVALID_HANDLE_VALUE),
+    m_mapping(nullptr), m_view(nullptr)
+{
+}
+
+BlockDevice::~BlockDevice()
+{
+    Close();
+}
+
+/*
+NAME
+
+    BlockDevice::Open - Open the data file and attach it to the emulator.
+
+SYNOPSIS
+
+    bool BlockDevice::Open(const Options& a_opts, emulator& a_emul)
+        const Options& a_opts   --> The options naming the file and its least size.
+        emulator& a_emul        --> The emulator the program runs on.
+
+DESCRIPTION
+
+    This function opens the file named by -device as a binary or a text file according to its
+    name, and attaches its words to the emulator for BREAD and BWRITE.  Without -device there is
+    nothing to open, and the emulator keeps a device of no words.
+
+RETURNS
+
+    bool - True if the program can be run.
+*/
+
+bool BlockDevice::Open(const Options& a_opts, emulator& a_emul)
+{
+    Close();
+    m_fileName = a_opts.GetDeviceFile();
+    if (m_fileName.empty()) {
+        return true;
+    }
+    const string suffix = ".txt";
+    m_isText = m_fileName.size() >= suffix.size() &&
+        m_fileName.compare(m_fileName.size() - suffix.size(), suffix.size(), suffix) == 0;
+    if (!(m_isText ? OpenText(a_opts.GetDeviceSize()) : OpenBinary(a_opts.GetDeviceSize()))) {
+        Unmap();
+        return false;
+    }
+    m_emul = &a_emul;
+    m_emul->attachDevice(m_words, m_size);
+    return true;
+}
+
+/*
+NAME
+
+    BlockDevice::Close - Detach the device and save it.
+
+SYNOPSIS
+
+    bool BlockDevice::Close()
+
+DESCRIPTION
+
+    This function detaches the device from the emulator.  The changes to a binary file are
+    flushed and the file is unmapped; a text file is written again if its words changed, one
+    number to a line.
+
+RETURNS
+
+    bool - True if the device was saved, or was not open.
+*/
+
+bool BlockDevice::Close()
+{
+    if (m_emul == nullptr) {
+        return true;
+    }
+    m_emul->attachDevice(nullptr, 0);
+    m_emul = nullptr;
+
+    bool saved = true;
+    if (m_isText && m_text != m_original) {
+        ofstream out(m_fileName);
+        for (int word : m_text) {
+            out << word << '\n';
+        }
+        if (!out) {
+            Errors::RecordError("Device file " + m_fileName + " could not be written.");
+            saved = false;
+        }
+    }
+    if (m_view != nullptr && !FlushViewOfFile(m_view, 0)) {
+        Errors::RecordError("Device file " + m_fileName + " could not be written.");
+        saved = false;
+    }
+    Unmap();
+    return saved;
+}
+
+/*
+NAME
+
+    BlockDevice::OpenBinary - Map a binary data file.
+
+SYNOPSIS
+
+    bool BlockDevice::OpenBinary(int a_minWords)
+        int a_minWords  --> Least number of words in the device.
+
+DESCRIPTION
+
+    This function opens the file for reading and writing, creating it if it does not exist, and
+    maps it whole.  A file shorter than a_minWords words is extended with zeros by the mapping.
+    An empty file gives a device of no words, which is not mapped.
+
+RETURNS
+
+    bool - True if the file was mapped.
+*/
+
+bool BlockDevice::OpenBinary(int a_minWords)
+{
+    m_file = CreateFileA(m_fileName.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        Errors::RecordError("Device file " + m_fileName + " could not be opened.");
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size)) {
+        Errors::RecordError("Device file " + m_fileName + " could not be read.");
+        return false;
+    }
+    if (size.QuadPart % sizeof(int) != 0) {
+        Errors::RecordError("Device file " + m_fileName + " is not a whole number of words.");
+        return false;
+    }
+    if (size.QuadPart / sizeof(int) > INT_MAX) {
+        Errors::RecordError("Device file " + m_fileName + " is too large.");
+        return false;
+    }
+    m_size = max(static_cast<int>(size.QuadPart / sizeof(int)), a_minWords);
+    if (m_size == 0) {
+        return true;
+    }
+
+    unsigned long long bytes = static_cast<unsigned long long>(m_size) * sizeof(int);
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, static_cast<DWORD>(bytes >> 32),
+        static_cast<DWORD>(bytes), nullptr);
+    if (m_mapping != nullptr) {
+        m_view = MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, 0);
+    }
+    if (m_view == nullptr) {
+        Errors::RecordError("Device file " + m_fileName + " could not be mapped.");
+        return false;
+    }
+    m_words = static_cast<int*>(m_view);
+    return true;
+}
+
+/*
+NAME
+
+    BlockDevice::OpenText - Read a text data file.
+
+SYNOPSIS
+
+    bool BlockDevice::OpenText(int a_minWords)
+        int a_minWords  --> Least number of words in the device.
+
+DESCRIPTION
+
+    This function reads the numbers of the file, which are separated by white space, and pads
+    them with zeros to a_minWords words.  A file that does not exist is created empty.  The words
+    as read are kept, so the file is written again at the end if the program or the padding
+    changed them.
+
+RETURNS
+
+    bool - True if every number was read.
+*/
+
+bool BlockDevice::OpenText(int a_minWords)
+{
+    m_text.clear();
+    ifstream in(m_fileName);
+    if (in) {
+        string token;
+        while (in >> token) {
+            const char* digits = token.c_str();
+            char* end;
+            errno = 0;
+            long value = strtol(digits, &end, 10);
+            if (*end != '\0' || errno == ERANGE || value < INT_MIN || value > INT_MAX) {
+                Errors::RecordError("Device file " + m_fileName + " has an invalid word " + token + " at word " +
+                    to_string(m_text.size()) + ".");
+                return false;
+            }
+            m_text.push_back(static_cast<int>(value));
+        }
+    }
+    else if (!ofstream(m_fileName)) {
+        Errors::RecordError("Device file " + m_fileName + " could not be opened.");
+        return false;
+    }
+    m_original = m_text;
+    if (m_text.size() < static_cast<size_t>(a_minWords)) {
+        m_text.resize(a_minWords, 0);
+    }
+    m_words = m_text.data();
+    m_size = static_cast<int>(m_text.size());
+    return true;
+}
+
+/*
+NAME
+
+    BlockDevice::Unmap - Release the data file.
+
+SYNOPSIS
+
+    void BlockDevice::Unmap()
+
+DESCRIPTION
+
+    This function unmaps and closes a binary file, or frees the words of a text file.
+
+*/
+
+void BlockDevice::Unmap()
+{
+    if (m_view != nullptr) {
+        UnmapViewOfFile(m_view);
+        m_view = nullptr;
+    }
+    if (m_mapping != nullptr) {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+    m_text.clear();
+    m_original.clear();
+    m_words = nullptr;
+    m_size = 0;
+}
@@ -0,0 +1,48 @@
+//
+//		BlockDevice class.  A data file the program reads and writes a range of words at a time with
+//		BREAD and BWRITE.  A binary file is mapped into memory, so a transfer is a copy between the
+//		file's pages and the emulator's; a text file is read into memory and written back at the end.
+//
+#pragma once
+
+#include "Options.h"
+#include "Emulator.h"
+#include "stdafx.h"
+
+class BlockDevice {
+
+public:
+    BlockDevice();
+    ~BlockDevice();
+
+    // Opens the data file named by -device, if there is one, and attaches it to the emulator.
+    // Returns false, having recorded an error, if the file cannot be used.
+    bool Open(const Options& a_opts, emulator& a_emul);
+
+    // Detaches the device and saves what the program wrote to it.  Returns false, having recorded
+    // an error, if it cannot be saved.
+    bool Close();
+
+private:
+    // Maps a binary file of 32-bit words, extending it with zeros to at least a_minWords words.
+    bool OpenBinary(int a_minWords);
+
+    // Reads a text file of whitespace-separated numbers, padded with zeros to at least a_minWords words.
+    bool OpenText(int a_minWords);
+
+    // Releases the mapped file, if any.
+    void Unmap();
+
+    string m_fileName;          // The data file.
+    bool m_isText;              // True if it is a text file rather than a binary one.
+    emulator* m_emul;           // The emulator the device is attached to, if it is open.
+    int* m_words;               // The words of the device.
+    int m_size;                 // Number of words.
+
+    HANDLE m_file;              // The mapped binary file.
+    HANDLE m_mapping;           // Its file mapping.
+    void* m_view;               // The mapped view of the file.
+
+    vector<int> m_text;         // The words of a text file.
+    vector<int> m_original;     // What they were when the file was read, so an unchanged file is not rewritten.
+};
@@ -0,0 +1,55 @@
+// ConstAssembler.cpp
+//
+// Checks of the ConstAssembler class.  The class is all constexpr and lives in its header, so
+// this file assembles small programs at compile time and checks their images, so that a build
+// fails if the constexpr assembler stops compiling or stops agreeing with Assembler.
+//
+#include "stdafx.h"
+#include "ConstAssembler.h"
+
+namespace {
+    // A load, a write and a halt of a constant that follows them.
+    constexpr auto simpleImage = VC_ASSEMBLE(
+        "        org     100\n"
+        "        load    x       ; the constant\n"
+        "        write   x\n"
+        "        halt\n"
+        "x       dc      7\n"
+        "        end\n");
+
+    static_assert(simpleImage.memory.size() == 104, "The image ends after the last word of the program");
+    static_assert(simpleImage.memory[100] == 50103 && simpleImage.memory[101] == 80103 &&
+        simpleImage.memory[102] == 130000 && simpleImage.memory[103] == 7, "The words are as Assembler makes them");
+    static_assert(simpleImage.symbols.size() == 1 && simpleImage.symbols[0].location == 103 &&
+        simpleImage.symbols[0].name[0] == 'x' && simpleImage.symbols[0].name[1] == '\0', "x is at 103");
+
+    // A loop, a DS area and a label on the first instruction.
+    constexpr auto loopImage = VC_ASSEMBLE(
+        "        org     100\n"
+        "top     read    n\n"
+        "        load    n\n"
+        "        bp      top\n"
+        "        halt\n"
+        "n       ds      2\n"
+        "        bcopy   n\n"
+        "        end\n");
+
+    static_assert(loopImage.memory.size() == 107, "DS leaves its words out of the image unless words follow");
+    static_assert(loopImage.memory[100] == 70104 && loopImage.memory[102] == 120100 && loopImage.memory[106] == 160104,
+        "Operands are the locations of their labels");
+
+    // Literals, two of them equal, after a DS area that ends the program.
+    constexpr auto literalImage = VC_ASSEMBLE(
+        "        org     100\n"
+        "        load    =5\n"
+        "        write   =-3\n"
+        "        write   =05\n"
+        "        halt\n"
+        "buffer  ds      3\n"
+        "        end\n");
+
+    static_assert(literalImage.memory.size() == 109, "The literal pool follows the DS area");
+    static_assert(literalImage.memory[100] == 50107 && literalImage.memory[101] == 80108 &&
+        literalImage.memory[102] == 80107, "Equal literals share a word of the pool");
+    static_assert(literalImage.memory[107] == 5 && literalImage.memory[108] == -3, "The pool holds the literals in order of use");
+}
@@ -0,0 +1,515 @@
+//
+//		ConstAssembler class.  Assembles VC programs held in string literals while the C++
+//		program that embeds them is compiled, so loading them costs no parsing at run time.
+//
+//		    constexpr auto image = VC_ASSEMBLE("       org 100\n       halt\n       end\n");
+//		    emulator emul;
+//		    image.Load(emul);
+//
+//		The source is the same language Assembler accepts, for the default machine of
+//		emulator::MEMSZ words, with its literal pool placed after the program as Assembler
+//		places it.  Words are built with the traits of that machine's word format, as the
+//		emulator builds them for Assembler.  The symbol table of an image holds the labels, not
+//		the literals.  An assembly error stops the compilation; the compiler names the error
+//		function that was reached, such as ConstAssembler::UndefinedSymbol.
+//
+#pragma once
+
+#include "Emulator.h"
+#include "stdafx.h"
+
+#include <array>
+#include <utility>
+#include <stdexcept>
+
+class ConstAssembler {
+
+public:
+    // Longest symbol name kept in the symbol table of an image.
+    const static size_t MAXNAME = 31;
+
+    // One entry of the symbol table of an image.
+    struct Symbol {
+        char name[MAXNAME + 1];     // The symbol, null terminated.
+        int location;               // Its location.
+    };
+
+    // A program assembled at compile time.
+    template <size_t N, size_t S>
+    struct Image {
+        array<int, N> memory;       // The word at every location from zero to the last word of the program.
+        array<Symbol, S> symbols;   // The symbol table, in order of definition.
+
+        // Loads the program into an emulator with the default word format.
+        bool Load(emulator& a_emul) const
+        {
+            if (a_emul.getAddressDigits() != 4) {
+                cerr << "Error: Program was assembled for a four digit address field." << endl;
+                return false;
+            }
+            return a_emul.loadImage(memory.data(), static_cast<int>(N));
+        }
+
+        // Finds the location of a symbol.
+        bool LookupSymbol(const string& a_symbol, int& a_loc) const
+        {
+            for (const auto& symbol : symbols) {
+                if (a_symbol == symbol.name) {
+                    a_loc = symbol.location;
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    // Pass I: the number of words the image of a program spans.
+    template <size_t L>
+    static constexpr size_t ImageSize(const char (&a_source)[L])
+    {
+        Cursor cursor(a_source, L);
+        Line line{};
+        int loc = 0;
+        size_t size = 0;
+        while (cursor.Next(line, loc)) {
+            if (line.kind == K_Machine || IsOpcode(line.opcode, "DC")) {
+                if (loc < 0 || loc >= emulator::MEMSZ) {
+                    LocationOutOfRange();
+                }
+                size = max(size, static_cast<size_t>(loc + 1));
+            }
+        }
+        int literals = LiteralCount(a_source);
+        if (literals > 0) {
+            int poolEnd = ProgramEnd(a_source) + literals;
+            if (poolEnd > emulator::MEMSZ) {
+                LocationOutOfRange();
+            }
+            size = static_cast<size_t>(poolEnd);
+        }
+        return size;
+    }
+
+    // Pass I: the number of symbols a program defines.
+    template <size_t L>
+    static constexpr size_t SymbolCount(const char (&a_source)[L])
+    {
+        Cursor cursor(a_source, L);
+        Line line{};
+        int loc = 0;
+        size_t count = 0;
+        while (cursor.Next(line, loc)) {
+            if (line.label.size != 0) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    // Pass II: the image of a program, given its size and number of symbols from Pass I.
+    template <size_t N, size_t S, size_t L>
+    static constexpr Image<N, S> Assemble(const char (&a_source)[L])
+    {
+        Table<int, N> memory{};
+        Table<Symbol, S> symbols{};
+        size_t count = 0;
+
+        Cursor cursor(a_source, L);
+        Line line{};
+        int loc = 0;
+        while (cursor.Next(line, loc)) {
+            if (line.label.size != 0) {
+                if (line.label.size > MAXNAME) {
+                    SymbolNameTooLong();
+                }
+                for (size_t s = 0; s < count; s++) {
+                    if (line.label.Equals(symbols.items[s].name)) {
+                        MultiplyDefinedSymbol();
+                    }
+                }
+                for (size_t c = 0; c < line.label.size; c++) {
+                    symbols.items[count].name[c] = line.label.data[c];
+                }
+                symbols.items[count].location = loc;
+                count++;
+            }
+
+            if (line.kind == K_Machine) {
+                int opcode = MachineOpcode(line.opcode);
+                int address = 0;
+                if (IsLiteral(line)) {
+                    int value = LiteralValue(line);
+                    address = ProgramEnd(a_source) + LiteralIndex(a_source, value);
+                    memory.items[address] = value;
+                }
+                else if (line.operand.size != 0) {
+                    address = FindSymbol(a_source, line.operand);
+                }
+                memory.items[loc] = Format::encode(opcode, address);
+            }
+            else if (IsOpcode(line.opcode, "DC")) {
+                int value = 0;
+                if (!ParseNumber(line.operand, value)) {
+                    InvalidOperandForDC();
+                }
+                memory.items[loc] = value;
+            }
+            else if (IsOpcode(line.opcode, "EXTERN")) {
+                ExternalSymbolRequiresLinking();
+            }
+            else if (IsOpcode(line.opcode, "ENTRY")) {
+                EntryPointsRequireHarts();
+            }
+        }
+        return Image<N, S>{ ToArray(memory, make_index_sequence<N>()), ToArray(symbols, make_index_sequence<S>()) };
+    }
+
+    // Errors.  They are not constexpr, so reaching one while assembling at compile time stops the
+    // compilation with the name of the error.  At run time they throw.
+    static void MissingOpcodeAfterLabel() { throw runtime_error("Missing opcode after label."); }
+    static void MissingEndDirective() { throw runtime_error("Missing END directive."); }
+    static void InvalidOperandForORG() { throw runtime_error("Invalid operand for ORG directive."); }
+    static void InvalidSizeForDS() { throw runtime_error("Invalid size for DS."); }
+    static void InvalidOperandForDC() { throw runtime_error("Invalid operand for DC directive."); }
+    static void UnknownOpcode() { throw runtime_error("Unknown opcode."); }
+    static void UndefinedSymbol() { throw runtime_error("Undefined symbol."); }
+    static void MultiplyDefinedSymbol() { throw runtime_error("Multiply defined symbol."); }
+    static void SymbolNameTooLong() { throw runtime_error("Symbol name too long."); }
+    static void LocationOutOfRange() { throw runtime_error("Location out of range."); }
+    static void ExternalSymbolRequiresLinking() { throw runtime_error("External symbol requires linking."); }
+    static void EntryPointsRequireHarts() { throw runtime_error("ENTRY directives are not supported in an image."); }
+    static void InvalidLiteral() { throw runtime_error("Invalid literal."); }
+    static void LiteralNotAllowed() { throw runtime_error("A literal can only be the operand of LOAD or WRITE."); }
+
+private:
+    // The word format of the default machine.
+    typedef WordFormat<emulator::MINADDRDIGITS> Format;
+
+    // Kinds of source lines, as Instruction::InstructionType.
+    enum Kind { K_Empty, K_Machine, K_Directive, K_End };
+
+    // A piece of the source text.
+    struct Text {
+        const char* data;
+        size_t size;
+
+        // True if the text is a_name exactly.
+        constexpr bool Equals(const char* a_name) const
+        {
+            for (size_t c = 0; c < size; c++) {
+                if (a_name[c] != data[c]) return false;
+            }
+            return a_name[size] == '\0';
+        }
+
+        // True if the text is the same as a_other exactly.
+        constexpr bool Equals(const Text& a_other) const
+        {
+            if (a_other.size != size) return false;
+            for (size_t c = 0; c < size; c++) {
+                if (a_other.data[c] != data[c]) return false;
+            }
+            return true;
+        }
+    };
+
+    // The parts of a source line.
+    struct Line {
+        Text label;
+        Text opcode;
+        Text operand;
+        Kind kind;
+    };
+
+    // A fixed number of items that can be filled in by a constexpr function.
+    template <typename T, size_t N>
+    struct Table {
+        T items[N == 0 ? 1 : N];
+    };
+
+    // Walks the lines of a program up to its END statement, keeping the location counter.
+    struct Cursor {
+        const char* next;       // Start of the next line.
+        const char* end;        // End of the source.
+        int location;           // Location counter.
+        bool ended;             // True once END is reached.
+
+        constexpr Cursor(const char* a_source, size_t a_length)
+            : next(a_source), end(a_source + a_length - 1), location(0), ended(false)
+        {
+        }
+
+        // Parses the next line that is not a comment into a_line and gives its location.  Returns
+        // false at the END statement.
+        constexpr bool Next(Line& a_line, int& a_loc)
+        {
+            while (!ended) {
+                if (next >= end) {
+                    MissingEndDirective();
+                }
+                const char* lineEnd = next;
+                while (lineEnd < end && *lineEnd != '\n') {
+                    lineEnd++;
+                }
+                a_line = ParseLine(next, lineEnd);
+                next = lineEnd + 1;
+
+                if (a_line.kind == K_Empty) continue;
+                if (a_line.kind == K_End) {
+                    ended = true;
+                    break;
+                }
+                a_loc = location;
+                location = LocationAfter(a_line, location);
+                return true;
+            }
+            return false;
+        }
+    };
+
+    static constexpr bool IsSpace(char a_char)
+    {
+        return a_char == ' ' || a_char == '\t' || a_char == '\r' || a_char == '\v' || a_char == '\f';
+    }
+
+    // True if the opcode is a_name, ignoring case.  a_name is in upper case.
+    static constexpr bool IsOpcode(const Text& a_opcode, const char* a_name)
+    {
+        for (size_t c = 0; c < a_opcode.size; c++) {
+            char upper = a_opcode.data[c] >= 'a' && a_opcode.data[c] <= 'z' ? a_opcode.data[c] - 'a' + 'A' : a_opcode.data[c];
+            if (a_name[c] != upper) return false;
+        }
+        return a_name[a_opcode.size] == '\0';
+    }
+
+    // Takes the next whitespace separated token from [a_next, a_end).
+    static constexpr Text NextToken(const char*& a_next, const char* a_end)
+    {
+        while (a_next < a_end && IsSpace(*a_next)) {
+            a_next++;
+        }
+        Text token{ a_next, 0 };
+        while (a_next < a_end && !IsSpace(*a_next)) {
+            a_next++;
+            token.size++;
+        }
+        return token;
+    }
+
+    // Splits a line into label, opcode and operand, as Instruction::ParseInstruction does.
+    static constexpr Line ParseLine(const char* a_begin, const char* a_end)
+    {
+        const char* end = a_begin;
+        while (end < a_end && *end != ';') {
+            end++;
+        }
+        Line line{ { a_begin, 0 }, { a_begin, 0 }, { a_begin, 0 }, K_Empty };
+        const char* next = a_begin;
+        Text first = NextToken(next, end);
+        if (first.size == 0) {
+            return line;
+        }
+        const char* opcodes[] = { "READ", "LOAD", "STORE", "WRITE", "BP", "HALT", "FAA", "CAS",
+            "BCOPY", "BFILL", "BSUM", "BCMP", "BREAD", "BWRITE", "ORG", "DC", "DS", "END", "EXTERN", "PUBLIC", "ENTRY" };
+        bool isOpcode = false;
+        for (const char* opcode : opcodes) {
+            isOpcode = isOpcode || IsOpcode(first, opcode);
+        }
+        if (isOpcode) {
+            line.opcode = first;
+        }
+        else {
+            line.label = first;
+            line.opcode = NextToken(next, end);
+            if (line.opcode.size == 0) {
+                MissingOpcodeAfterLabel();
+            }
+        }
+        line.operand = NextToken(next, end);
+
+        if (IsOpcode(line.opcode, "END")) {
+            line.kind = K_End;
+        }
+        else if (IsOpcode(line.opcode, "ORG") || IsOpcode(line.opcode, "DC") || IsOpcode(line.opcode, "DS") ||
+            IsOpcode(line.opcode, "EXTERN") || IsOpcode(line.opcode, "PUBLIC") || IsOpcode(line.opcode, "ENTRY")) {
+            line.kind = K_Directive;
+        }
+        else {
+            line.kind = K_Machine;
+        }
+        return line;
+    }
+
+    // Reads a number the way stoi does: optional sign, then digits, ignoring anything after them
+    // unless a_whole asks for the whole text to be the number.
+    static constexpr bool ParseNumber(const Text& a_text, int& a_value, bool a_whole = false)
+    {
+        size_t c = 0;
+        bool negative = false;
+        if (c < a_text.size && (a_text.data[c] == '-' || a_text.data[c] == '+')) {
+            negative = a_text.data[c] == '-';
+            c++;
+        }
+        size_t first = c;
+        long long value = 0;
+        for (; c < a_text.size && a_text.data[c] >= '0' && a_text.data[c] <= '9'; c++) {
+            value = value * 10 + (a_text.data[c] - '0');
+            if (value > INT_MAX) return false;
+        }
+        a_value = static_cast<int>(negative ? -value : value);
+        return c > first && (!a_whole || c == a_text.size);
+    }
+
+    // True if the operand of an instruction is a literal (=N).
+    static constexpr bool IsLiteral(const Line& a_line)
+    {
+        return a_line.kind == K_Machine && a_line.operand.size != 0 && a_line.operand.data[0] == '=';
+    }
+
+    // The value of a literal operand, which only LOAD and WRITE may have, as Instruction checks.
+    static constexpr int LiteralValue(const Line& a_line)
+    {
+        int value = 0;
+        if (!ParseNumber(Text{ a_line.operand.data + 1, a_line.operand.size - 1 }, value, true)) {
+            InvalidLiteral();
+        }
+        if (!IsOpcode(a_line.opcode, "LOAD") && !IsOpcode(a_line.opcode, "WRITE")) {
+            LiteralNotAllowed();
+        }
+        return value;
+    }
+
+    // One past the highest word or DS area of a program, where its literal pool goes, as
+    // Assembler::ProgramSize.
+    template <size_t L>
+    static constexpr int ProgramEnd(const char (&a_source)[L])
+    {
+        Cursor cursor(a_source, L);
+        Line line{};
+        int loc = 0;
+        int end = 0;
+        while (cursor.Next(line, loc)) {
+            if (line.kind == K_Machine || IsOpcode(line.opcode, "DC") || IsOpcode(line.opcode, "DS")) {
+                end = max(end, cursor.location);
+            }
+        }
+        return end;
+    }
+
+    // True if no literal used before the a_use'th one, counting from zero, has the value a_value.
+    template <size_t L>
+    static constexpr bool IsFirstUse(const char (&a_source)[L], int a_use, int a_value)
+    {
+        Cursor cursor(a_source, L);
+        Line line{};
+        int loc = 0;
+        for (int use = 0; use < a_use && cursor.Next(line, loc); ) {
+            if (!IsLiteral(line)) continue;
+            if (LiteralValue(line) == a_value) return false;
+            use++;
+        }
+        return true;
+    }
+
+    // The word of the literal pool that holds a_value.  The pool has a word for each distinct
+    // value, in the order the values are first used, as Assembler::PlaceLiterals gives them.
+    template <size_t L>
+    static constexpr int LiteralIndex(const char (&a_source)[L], int a_value)
+    {
+        Cursor cursor(a_source, L);
+        Line line{};
+        int loc = 0;
+        int index = 0;
+        int use = 0;
+        while (cursor.Next(line, loc)) {
+            if (!IsLiteral(line)) continue;
+            int value = LiteralValue(line);
+            if (value == a_value) break;
+            if (IsFirstUse(a_source, use, value)) {
+                index++;
+            }
+            use++;
+        }
+        return index;
+    }
+
+    // The number of words in the literal pool.
+    template <size_t L>
+    static constexpr int LiteralCount(const char (&a_source)[L])
+    {
+        Cursor cursor(a_source, L);
+        Line line{};
+        int loc = 0;
+        int count = 0;
+        int use = 0;
+        while (cursor.Next(line, loc)) {
+            if (!IsLiteral(line)) continue;
+            if (IsFirstUse(a_source, use, LiteralValue(line))) {
+                count++;
+            }
+            use++;
+        }
+        return count;
+    }
+
+    // The location counter after a line, as Instruction::LocationEffect.
+    static constexpr int LocationAfter(const Line& a_line, int a_loc)
+    {
+        int value = 0;
+        if (IsOpcode(a_line.opcode, "ORG")) {
+            if (!ParseNumber(a_line.operand, value)) {
+                InvalidOperandForORG();
+            }
+            return value;
+        }
+        if (IsOpcode(a_line.opcode, "DS")) {
+            if (!ParseNumber(a_line.operand, value)) {
+                InvalidSizeForDS();
+            }
+            return a_loc + value;
+        }
+        if (a_line.kind == K_Machine || IsOpcode(a_line.opcode, "DC")) {
+            return a_loc + 1;
+        }
+        return a_loc;
+    }
+
+    // The machine opcode of an instruction.
+    static constexpr int MachineOpcode(const Text& a_opcode)
+    {
+        for (int op = 0; op < Format::Opcodes::COUNT; op++) {
+            const char* name = Format::Opcodes::mnemonic(op);
+            if (name[0] != '\0' && IsOpcode(a_opcode, name)) {
+                return op;
+            }
+        }
+        UnknownOpcode();
+        return 0;
+    }
+
+    // The location of a symbol, found by walking the program again.
+    template <size_t L>
+    static constexpr int FindSymbol(const char (&a_source)[L], const Text& a_symbol)
+    {
+        Cursor cursor(a_source, L);
+        Line line{};
+        int loc = 0;
+        while (cursor.Next(line, loc)) {
+            if (line.label.Equals(a_symbol)) {
+                return loc;
+            }
+        }
+        UndefinedSymbol();
+        return 0;
+    }
+
+    template <typename T, size_t N, size_t... I>
+    static constexpr array<T, N> ToArray(const Table<T, N>& a_table, index_sequence<I...>)
+    {
+        return array<T, N>{ { a_table.items[I]... } };
+    }
+};
+
+// Assembles a VC program in a string literal at compile time.
+#define VC_ASSEMBLE(source) \
+    ConstAssembler::Assemble<ConstAssembler::ImageSize(source), ConstAssembler::SymbolCount(source)>(source)
@@ -0,0 +1,576 @@
+// CrossCheck.cpp
+//
+// Implementation of the CrossCheck class.
+// Each program is made from a seed, so any program can be made again.  The programs are valid VC
+// programs, with loops, self-modifying stores, block instructions with good and bad descriptors,
+// and READs that run out of input, and the instruction limit stops those that never halt.  The
+// engines are compared on everything they leave behind: the status, the error messages, what was
+// written, the registers, the instruction, READ and WRITE counts and the memory.
+//
+#include "stdafx.h"
+#include "CrossCheck.h"
+#include "CycleModel.h"
+
+#include <atomic>
+
+namespace {
+    // Opcodes of the machine, as the emulator decodes them.
+    const int OP_Read = 7, OP_Store = 6, OP_Branch = 12, OP_Halt = 13, OP_FetchAdd = 14, OP_CompareSwap = 15,
+        OP_BlockCopy = 16, OP_BlockFill = 17;
+
+    // The opcodes a program is made of, each as often as it appears here.
+    const int opcodeMix[] = { 5, 5, 5, 6, 6, 7, 8, 8, 12, 12, 12, 13, 14, 14, 15, 16, 17, 18, 19 };
+
+    const char* const engineNames[] = { "reference", "sliced", "shared", "restored", "paged", "timed" };
+
+    string Mnemonic(int a_opcode)
+    {
+        static const map<int, string> names = { { 5, "load" }, { 6, "store" }, { 7, "read" }, { 8, "write" },
+            { 12, "bp" }, { 13, "halt" }, { 14, "faa" }, { 15, "cas" }, { 16, "bcopy" }, { 17, "bfill" },
+            { 18, "bsum" }, { 19, "bcmp" } };
+        return names.at(a_opcode);
+    }
+
+    bool IsBlock(int a_opcode)
+    {
+        return a_opcode >= 16 && a_opcode <= 19;
+    }
+
+    // True if an instruction writes the word its operand names.
+    bool StoresToOperand(int a_opcode)
+    {
+        return a_opcode == OP_Store || a_opcode == OP_Read || a_opcode == OP_FetchAdd || a_opcode == OP_CompareSwap;
+    }
+}
+
+/*
+NAME
+
+    CrossCheck::CrossCheck - Constructor for the CrossCheck class.
+
+SYNOPSIS
+
+    CrossCheck::CrossCheck(const Options& a_opts)
+        const Options& a_opts --> The command line options.  -crosscheck gives the number of
+                                  programs, -seed the seed of the first, -j the threads to use and
+                                  -maxinstr the instruction limit of each run.
+
+*/
+
+CrossCheck::CrossCheck(const Options& a_opts)
+    : m_opts(a_opts), m_programs(a_opts.GetCrossCheckCount()), m_firstSeed(a_opts.GetSeed()),
+    m_instructionLimit(a_opts.GetInstructionLimit() > 0 ? a_opts.GetInstructionLimit() : 10'000)
+{
+}
+
+/*
+NAME
+
+    CrossCheck::Run - Check the programs.
+
+SYNOPSIS
+
+    int CrossCheck::Run()
+
+DESCRIPTION
+
+    The programs are shared out among the threads a seed at a time.  Once MAXREPORTS programs have
+    been found on which the engines differ, no more are started.  Each of those is shrunk and
+    written out as VC source, with the seed that made it and the difference it shows.
+
+RETURNS
+
+    int - Zero if the engines agreed on every program, one otherwise.
+*/
+
+int CrossCheck::Run()
+{
+    struct Failure {
+        Program program;
+        string difference;
+    };
+    atomic<long long> next(0);
+    atomic<long long> checked(0);
+    atomic<int> failed(0);
+    mutex failuresMutex;
+    vector<Failure> failures;
+
+    auto work = [&]() {
+        long long index;
+        while (failed < MAXREPORTS && (index = next++) < m_programs) {
+            Program prog = Generate(m_firstSeed + index);
+            string difference = Compare(prog);
+            checked++;
+            if (!difference.empty()) {
+                lock_guard<mutex> lock(failuresMutex);
+                failures.push_back(Failure{ prog, difference });
+                failed++;
+            }
+        }
+    };
+    long long threads = min(static_cast<long long>(m_opts.GetThreadCount()), max(m_programs, 1ll));
+    vector<thread> workers;
+    for (long long i = 1; i < threads; i++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    sort(failures.begin(), failures.end(), [](const Failure& a_left, const Failure& a_right) {
+        return a_left.program.seed < a_right.program.seed;
+    });
+    for (size_t i = 0; i < failures.size() && i < static_cast<size_t>(MAXREPORTS); i++) {
+        const Failure& failure = failures[i];
+        Program shrunk = Shrink(failure.program);
+        cout << "Seed " << failure.program.seed << ": the " << failure.difference << ".\n";
+        cout << "Shrunk from " << failure.program.opcodes.size() << " instructions to " << shrunk.opcodes.size()
+            << ", which shows that the " << Compare(shrunk) << ":\n\n" << Source(shrunk) << endl;
+    }
+    cout << "Cross-checked " << checked << " programs from seed " << m_firstSeed << " on " << ENGINECOUNT
+        << " engines: " << (failures.empty() ? "no" : to_string(failures.size())) << " differences." << endl;
+    return failures.empty() ? 0 : 1;
+}
+
+/*
+NAME
+
+    CrossCheck::Generate - Make the program for a seed.
+
+SYNOPSIS
+
+    CrossCheck::Program CrossCheck::Generate(long long a_seed) const
+        long long a_seed --> The seed.
+
+DESCRIPTION
+
+    Half the programs are made so that the paged engine can run them: they end with HALT, branch
+    only to instructions and write only data.  The rest may do anything a VC program can.  The
+    descriptors of block instructions name data words, literal locations either side of the first
+    page boundary of a paged memory, or now and then locations out of bounds.
+
+RETURNS
+
+    Program - The program.
+*/
+
+CrossCheck::Program CrossCheck::Generate(long long a_seed) const
+{
+    mt19937_64 random(static_cast<unsigned long long>(a_seed));
+    auto pick = [&random](int a_count) { return static_cast<int>(random() % a_count); };
+
+    Program prog;
+    prog.seed = a_seed;
+    bool portable = pick(2) == 0;
+    int codeSize = 3 + pick(22);
+    int dataSize = 4 + pick(10);
+
+    for (int i = 0; i < dataSize; i++) {
+        int choice = pick(10);
+        if (choice < 6) {
+            prog.data.push_back(Ref{ RK_Literal, pick(14) - 3 });
+        }
+        else if (choice < 8) {
+            prog.data.push_back(Ref{ RK_Data, pick(dataSize) });
+        }
+        else if (choice < 9 && !portable) {
+            prog.data.push_back(Ref{ RK_Code, pick(codeSize) });
+        }
+        else {
+            prog.data.push_back(Ref{ RK_Literal, static_cast<int>(random()) });
+        }
+    }
+    for (int i = 0; i < codeSize; i++) {
+        int opcode = opcodeMix[pick(sizeof(opcodeMix) / sizeof(opcodeMix[0]))];
+        if (portable && i == codeSize - 1) {
+            opcode = OP_Halt;
+        }
+        Ref operand = { RK_Data, pick(dataSize) };
+        if (opcode == OP_Halt) {
+            operand = Ref{ RK_Literal, 0 };
+        }
+        else if (opcode == OP_Branch ? portable || pick(10) != 0 : !portable && pick(8) == 0) {
+            operand = Ref{ RK_Code, pick(codeSize) };
+        }
+        else if (IsBlock(opcode) && operand.value + 2 < dataSize) {
+            // The descriptor: destination, source and number of words.
+            int kind = pick(8);
+            for (int word = 0; word < 2; word++) {
+                prog.data[operand.value + word] = kind == 0 ? Ref{ RK_Literal, 4'090 + pick(12) } :
+                    kind == 1 ? Ref{ RK_Literal, pick(2) == 0 ? -1 : 100'000'000 } :
+                    kind == 2 && !portable ? Ref{ RK_Code, pick(codeSize) } : Ref{ RK_Data, pick(dataSize) };
+            }
+            prog.data[operand.value + 2] = Ref{ RK_Literal, pick(9) };
+        }
+        prog.opcodes.push_back(opcode);
+        prog.operands.push_back(operand);
+    }
+    int inputs = pick(6);
+    for (int i = 0; i < inputs; i++) {
+        prog.input.push_back(pick(26) - 5);
+    }
+    return prog;
+}
+
+/*
+NAME
+
+    CrossCheck::Execute - Run a program on an engine.
+
+SYNOPSIS
+
+    CrossCheck::Outcome CrossCheck::Execute(const Program& a_prog, Engine a_engine) const
+        const Program& a_prog   --> The program.
+        Engine a_engine         --> The engine.
+
+DESCRIPTION
+
+    The program is loaded into a new emulator and run until it halts, faults or reaches the
+    instruction limit, each READ taking the next input value.  A run stopped by the limit is
+    described by its snapshot rather than its message, which gives the time taken.
+
+RETURNS
+
+    Outcome - The result.
+*/
+
+CrossCheck::Outcome CrossCheck::Execute(const Program& a_prog, Engine a_engine) const
+{
+    emulator emul(a_engine == E_Paged ? PAGEDSIZE : emulator::MEMSZ);
+    int dataStart = ORIGIN + static_cast<int>(a_prog.opcodes.size());
+    for (size_t i = 0; i < a_prog.opcodes.size(); i++) {
+        emul.insertMemory(ORIGIN + static_cast<int>(i), emul.encodeWord(a_prog.opcodes[i], Resolve(a_prog, a_prog.operands[i])));
+    }
+    for (size_t i = 0; i < a_prog.data.size(); i++) {
+        emul.insertMemory(dataStart + static_cast<int>(i), Resolve(a_prog, a_prog.data[i]));
+    }
+    emul.setLimits({ m_instructionLimit, 0, 0 });
+
+    CycleModel model;
+    auto run = [&](ostream& a_out, ostream& a_err) {
+        size_t nextInput = 0;
+        while (true) {
+            emulator::RunStatus status = a_engine == E_Sliced ? emul.execute(a_out, a_err, 1) :
+                a_engine == E_Shared ? emul.executeShared(a_out, a_err) :
+                a_engine == E_Timed ? emul.executeTimed(a_out, a_err, model) : emul.execute(a_out, a_err);
+            if (status == emulator::RS_NeedInput) {
+                a_out << "? ";
+                emul.provideInput(nextInput < a_prog.input.size() ? a_prog.input[nextInput++] : 0);
+            }
+            else if (status != emulator::RS_Running) {
+                return status;
+            }
+        }
+    };
+
+    if (a_engine == E_Restored) {
+        emul.saveImage();
+        ostringstream out, err;
+        emul.startProgram();
+        run(out, err);
+        emul.resetImage();
+    }
+    else {
+        emul.startProgram();
+    }
+    ostringstream out, err;
+    Outcome outcome;
+    outcome.status = run(out, err);
+    outcome.pc = emul.getProgramCounter();
+    outcome.accum = emul.getAccumulator();
+    outcome.output = out.str();
+    outcome.errors = err.str();
+    if (outcome.status == emulator::RS_LimitReached) {
+        emulator::LimitSnapshot snapshot = emul.getLimitSnapshot();
+        outcome.errors = "limit " + to_string(snapshot.limit) + " at " + to_string(snapshot.pc);
+    }
+    outcome.counts = emul.getRunCounts();
+    outcome.memory.resize(emulator::MEMSZ);
+    for (int loc = 0; loc < emulator::MEMSZ; loc++) {
+        outcome.memory[loc] = emul.peekWord(loc);
+    }
+    return outcome;
+}
+
+/*
+NAME
+
+    CrossCheck::Compare - Run a program on every engine.
+
+SYNOPSIS
+
+    string CrossCheck::Compare(const Program& a_prog) const
+        const Program& a_prog --> The program.
+
+DESCRIPTION
+
+    The instructions of the paged engine are encoded differently, so its memory is compared with
+    the reference's everywhere but where the instructions are.
+
+RETURNS
+
+    string - How the first engine to differ from the reference differs, or an empty string.
+*/
+
+string CrossCheck::Compare(const Program& a_prog) const
+{
+    Outcome reference = Execute(a_prog, E_Reference);
+    for (int engine = E_Reference + 1; engine < ENGINECOUNT; engine++) {
+        if (engine == E_Paged && !IsPortable(a_prog)) continue;
+
+        Outcome outcome = Execute(a_prog, static_cast<Engine>(engine));
+        int codeEnd = ORIGIN + static_cast<int>(a_prog.opcodes.size());
+        string difference = Difference(reference, outcome, engine == E_Paged ? ORIGIN : 0, engine == E_Paged ? codeEnd : 0);
+        if (!difference.empty()) {
+            return string(engineNames[engine]) + " engine differs from the reference in " + difference;
+        }
+    }
+    return "";
+}
+
+string CrossCheck::Difference(const Outcome& a_expected, const Outcome& a_actual, int a_skipFrom, int a_skipTo)
+{
+    auto numbers = [](long long a_expected, long long a_actual) {
+        return " (" + to_string(a_actual) + " rather than " + to_string(a_expected) + ")";
+    };
+    if (a_actual.status != a_expected.status) {
+        return "its status" + numbers(a_expected.status, a_actual.status);
+    }
+    if (a_actual.errors != a_expected.errors) {
+        return "its errors (\"" + a_actual.errors + "\" rather than \"" + a_expected.errors + "\")";
+    }
+    if (a_actual.output != a_expected.output) {
+        return "its output";
+    }
+    if (a_actual.pc != a_expected.pc) {
+        return "its program counter" + numbers(a_expected.pc, a_actual.pc);
+    }
+    if (a_actual.accum != a_expected.accum) {
+        return "its accumulator" + numbers(a_expected.accum, a_actual.accum);
+    }
+    if (a_actual.counts.instructions != a_expected.counts.instructions) {
+        return "its instruction count" + numbers(a_expected.counts.instructions, a_actual.counts.instructions);
+    }
+    if (a_actual.counts.reads != a_expected.counts.reads || a_actual.counts.writes != a_expected.counts.writes) {
+        return "its READ and WRITE counts";
+    }
+    for (int loc = 0; loc < static_cast<int>(a_expected.memory.size()); loc++) {
+        if ((loc < a_skipFrom || loc >= a_skipTo) && a_actual.memory[loc] != a_expected.memory[loc]) {
+            return "the word at " + to_string(loc) + numbers(a_expected.memory[loc], a_actual.memory[loc]);
+        }
+    }
+    return "";
+}
+
+/*
+NAME
+
+    CrossCheck::Shrink - Make a program on which the engines differ smaller.
+
+SYNOPSIS
+
+    CrossCheck::Program CrossCheck::Shrink(const Program& a_prog) const
+        const Program& a_prog --> A program on which the engines differ.
+
+DESCRIPTION
+
+    Instructions, data words and input values are removed one at a time, and data words set to
+    zero, as long as the engines still differ, until nothing more can be taken away.  References to
+    a removed instruction or data word move to the one that takes its place.  The engines may come
+    to differ in another way than they did at first.
+
+RETURNS
+
+    Program - The smallest program found.
+*/
+
+CrossCheck::Program CrossCheck::Shrink(const Program& a_prog) const
+{
+    // Removes the instruction or data word a_index of a kind, keeping the references in range.
+    auto remove = [](const Program& a_from, RefKind a_kind, int a_index) {
+        Program prog = a_from;
+        if (a_kind == RK_Code) {
+            prog.opcodes.erase(prog.opcodes.begin() + a_index);
+            prog.operands.erase(prog.operands.begin() + a_index);
+        }
+        else {
+            prog.data.erase(prog.data.begin() + a_index);
+        }
+        int size = static_cast<int>(a_kind == RK_Code ? prog.opcodes.size() : prog.data.size());
+        for (vector<Ref>* refs : { &prog.operands, &prog.data }) {
+            for (Ref& ref : *refs) {
+                if (ref.kind == a_kind && ref.value > a_index) {
+                    ref.value--;
+                }
+                if (ref.kind == a_kind && ref.value >= size) {
+                    ref.value = size - 1;
+                }
+            }
+        }
+        return prog;
+    };
+
+    Program best = a_prog;
+    bool shrunk = true;
+    while (shrunk) {
+        shrunk = false;
+        auto attempt = [&](const Program& a_candidate) {
+            if (!Compare(a_candidate).empty()) {
+                best = a_candidate;
+                shrunk = true;
+                return true;
+            }
+            return false;
+        };
+        for (int i = static_cast<int>(best.opcodes.size()) - 1; i >= 0 && best.opcodes.size() > 1; i--) {
+            attempt(remove(best, RK_Code, i));
+        }
+        for (int i = static_cast<int>(best.data.size()) - 1; i >= 0 && best.data.size() > 1; i--) {
+            attempt(remove(best, RK_Data, i));
+        }
+        for (int i = static_cast<int>(best.input.size()) - 1; i >= 0; i--) {
+            Program candidate = best;
+            candidate.input.erase(candidate.input.begin() + i);
+            attempt(candidate);
+        }
+        for (size_t i = 0; i < best.data.size(); i++) {
+            if (best.data[i].kind != RK_Literal || best.data[i].value != 0) {
+                Program candidate = best;
+                candidate.data[i] = Ref{ RK_Literal, 0 };
+                attempt(candidate);
+            }
+        }
+    }
+    return best;
+}
+
+/*
+NAME
+
+    CrossCheck::IsPortable - Check that the paged engine can run a program.
+
+SYNOPSIS
+
+    bool CrossCheck::IsPortable(const Program& a_prog)
+        const Program& a_prog --> The program.
+
+DESCRIPTION
+
+    The program must end with HALT, branch only to its instructions, refer to them nowhere else,
+    and never write the descriptors of its block instructions.  Its descriptors then hold the same
+    blocks throughout the run, and if none of them ends between the ends of the two memories, every
+    engine finds them in or out of bounds alike.
+
+RETURNS
+
+    bool - True if the program runs the same way on the paged engine.
+*/
+
+bool CrossCheck::IsPortable(const Program& a_prog)
+{
+    if (a_prog.opcodes.empty() || a_prog.opcodes.back() != OP_Halt) {
+        return false;
+    }
+    for (const Ref& ref : a_prog.data) {
+        if (ref.kind == RK_Code) {
+            return false;
+        }
+    }
+    int dataStart = ORIGIN + static_cast<int>(a_prog.opcodes.size());
+    int dataEnd = dataStart + static_cast<int>(a_prog.data.size());
+    set<int> descriptors;
+    for (size_t i = 0; i < a_prog.opcodes.size(); i++) {
+        if ((a_prog.operands[i].kind == RK_Code) != (a_prog.opcodes[i] == OP_Branch)) {
+            return false;
+        }
+        if (IsBlock(a_prog.opcodes[i])) {
+            int location = Resolve(a_prog, a_prog.operands[i]);
+            if (location + 2 >= dataEnd) {
+                return false;
+            }
+            descriptors.insert({ location, location + 1, location + 2 });
+        }
+    }
+    for (size_t i = 0; i < a_prog.opcodes.size(); i++) {
+        int opcode = a_prog.opcodes[i];
+        int location = Resolve(a_prog, a_prog.operands[i]);
+        if (StoresToOperand(opcode) && descriptors.count(location) != 0) {
+            return false;
+        }
+        if (!IsBlock(opcode)) continue;
+
+        int dest = Resolve(a_prog, a_prog.data[location - dataStart]);
+        int source = Resolve(a_prog, a_prog.data[location - dataStart + 1]);
+        int count = Resolve(a_prog, a_prog.data[location - dataStart + 2]);
+        for (int start : { dest, source }) {
+            long long end = static_cast<long long>(start) + count;
+            if (start >= 0 && count >= 0 && end > emulator::MEMSZ && end <= PAGEDSIZE) {
+                return false;
+            }
+        }
+        auto first = descriptors.lower_bound(dest);
+        if ((opcode == OP_BlockCopy || opcode == OP_BlockFill) && count > 0 && first != descriptors.end() &&
+            *first < static_cast<long long>(dest) + count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int CrossCheck::Resolve(const Program& a_prog, const Ref& a_ref)
+{
+    switch (a_ref.kind) {
+    case RK_Code:
+        return ORIGIN + a_ref.value;
+    case RK_Data:
+        return ORIGIN + static_cast<int>(a_prog.opcodes.size()) + a_ref.value;
+    default:
+        return a_ref.value;
+    }
+}
+
+/*
+NAME
+
+    CrossCheck::Source - Write a program as VC source.
+
+SYNOPSIS
+
+    string CrossCheck::Source(const Program& a_prog)
+        const Program& a_prog --> The program.
+
+DESCRIPTION
+
+    Every instruction and data word is labelled, the instructions cN and the data words dN, and
+    the input is given in a comment.  The source assembles to the words the engines ran.
+
+RETURNS
+
+    string - The source.
+*/
+
+string CrossCheck::Source(const Program& a_prog)
+{
+    ostringstream source;
+    source << "; Seed " << a_prog.seed << ".  Input:";
+    for (int value : a_prog.input) {
+        source << " " << value;
+    }
+    source << "\n" << setw(8) << "" << left << setw(8) << "org" << ORIGIN << "\n";
+    auto label = [](const Ref& a_ref) {
+        return (a_ref.kind == RK_Code ? "c" : "d") + to_string(a_ref.value);
+    };
+    for (size_t i = 0; i < a_prog.opcodes.size(); i++) {
+        source << setw(8) << label(Ref{ RK_Code, static_cast<int>(i) }) << setw(8) << Mnemonic(a_prog.opcodes[i]);
+        if (a_prog.operands[i].kind != RK_Literal) {
+            source << label(a_prog.operands[i]);
+        }
+        source << "\n";
+    }
+    for (size_t i = 0; i < a_prog.data.size(); i++) {
+        source << setw(8) << label(Ref{ RK_Data, static_cast<int>(i) }) << setw(8) << "dc" << Resolve(a_prog, a_prog.data[i]) << "\n";
+    }
+    source << setw(8) << "" << "end\n";
+    return source.str();
+}
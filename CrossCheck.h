@@ -0,0 +1,102 @@
+//
+//		CrossCheck class.  Runs random programs on every way the emulator has of running a program
+//		and compares the results, so a faster way of running cannot quietly differ from the
+//		reference.  A program on which they differ is shrunk to a small one that still shows it.
+//
+#pragma once
+
+#include "Options.h"
+#include "Emulator.h"
+#include "stdafx.h"
+
+#include <random>
+
+class CrossCheck {
+
+public:
+    CrossCheck(const Options& a_opts);
+
+    // Checks the programs on all the threads -j allows.  Returns zero if the engines always agreed.
+    int Run();
+
+private:
+    // The ways of running a program that are compared.
+    enum Engine {
+        E_Reference,        // execute with no time slice, on a flat memory.
+        E_Sliced,           // execute returning at every taken branch and called again.
+        E_Shared,           // executeShared, with the atomic memory operations of free-running harts.
+        E_Restored,         // execute after a first run and resetImage.
+        E_Paged,            // execute on a paged memory, which has a wider word format.
+        E_Timed,            // executeTimed, with a cycle model as the timing policy.
+        ENGINECOUNT
+    };
+
+    // What an operand or a data word refers to.
+    enum RefKind {
+        RK_Literal,         // A number, not a location.
+        RK_Code,            // The location of an instruction.
+        RK_Data             // The location of a data word.
+    };
+
+    struct Ref {
+        RefKind kind;
+        int value;          // The number, or the index of the instruction or data word.
+    };
+
+    // A program, held so that it can be shrunk without breaking its references: the instructions
+    // start at ORIGIN and the data words follow them.
+    struct Program {
+        long long seed;             // The seed that generated it.
+        vector<int> opcodes;        // The instructions.
+        vector<Ref> operands;       // Their operands, literal only for HALT, which has none.
+        vector<Ref> data;           // The data words.
+        vector<int> input;          // Values for the READs, after which they read zero.
+    };
+
+    // The result of running a program.
+    struct Outcome {
+        emulator::RunStatus status;
+        int pc;
+        int accum;
+        string output;              // What it wrote, with a prompt for each value it read.
+        string errors;              // What it reported on the error stream.
+        emulator::RunCounts counts;
+        vector<int> memory;         // The first emulator::MEMSZ words.
+    };
+
+    // Makes the program for a seed.
+    Program Generate(long long a_seed) const;
+
+    // Runs a program on an engine.
+    Outcome Execute(const Program& a_prog, Engine a_engine) const;
+
+    // Runs a program on every engine that can run it.  Returns a description of the first
+    // difference from the reference, or an empty string if there is none.
+    string Compare(const Program& a_prog) const;
+
+    // Describes how two outcomes differ, ignoring the memory from a_skipFrom up to a_skipTo.
+    static string Difference(const Outcome& a_expected, const Outcome& a_actual, int a_skipFrom, int a_skipTo);
+
+    // Removes instructions, data and input while the engines still differ.
+    Program Shrink(const Program& a_prog) const;
+
+    // True if the paged engine can run the program the same way.  Its instructions are encoded
+    // differently and its memory is larger, so the program must not execute data or write code,
+    // and the descriptors of its block instructions must not change.
+    static bool IsPortable(const Program& a_prog);
+
+    // The value a reference has in a program.
+    static int Resolve(const Program& a_prog, const Ref& a_ref);
+
+    // Writes a program as VC source.
+    static string Source(const Program& a_prog);
+
+    const static int ORIGIN = 100;              // Location of the first instruction.
+    const static int PAGEDSIZE = 2 * emulator::MEMSZ; // Memory of the paged engine.
+    const static int MAXREPORTS = 3;            // Most differences reported.
+
+    const Options& m_opts;
+    long long m_programs;           // Number of programs to check.
+    long long m_firstSeed;          // Seed of the first of them.
+    long long m_instructionLimit;   // Most instructions a run may execute.
+};
@@ -0,0 +1,298 @@
+// CycleModel.cpp
+//
+// Implementation of the CycleModel class.
+// The costs are estimates rather than measurements: an instruction takes the cycles of its opcode,
+// which include a cache hit, and a taken branch, a transfer and each word of a block instruction
+// add to them.  The cache is direct-mapped and holds only the words LOAD, STORE, READ, WRITE, FAA
+// and CAS access; instructions are fetched without it, and block instructions stream past it.
+//
+// A cost file holds one cost on each line, with anything after a ';' a comment:
+//
+//      <opcode> <cycles>       Cycles of an opcode, such as LOAD 2.
+//      BRANCH <cycles>         Penalty for a taken branch.
+//      IO <cycles>             Latency of READ, WRITE, BREAD and BWRITE.
+//      WORD <cycles>           Cycles for each word of a block instruction.
+//      MISS <cycles>           Penalty for an access that misses the cache.
+//      CACHE <lines> <words>   A cache of this many lines of this many words, or none if 0 lines.
+//
+#include "stdafx.h"
+#include "CycleModel.h"
+#include "Errors.h"
+
+#include <fstream>
+#include <numeric>
+
+namespace {
+    // Default costs of the opcodes.
+    const int defaultCycles[] = { 0, 0, 0, 0, 0, 2, 2, 1, 1, 0, 0, 0, 1, 1, 4, 5, 4, 4, 4, 4, 4, 4 };
+}
+
+/*
+NAME
+
+    CycleModel::CycleModel - Constructor for the CycleModel class.
+
+SYNOPSIS
+
+    CycleModel::CycleModel()
+
+DESCRIPTION
+
+    The model starts with the default costs: two cycles for LOAD and STORE, one for the other
+    simple instructions, four or five for the atomic and block instructions, two more for a taken
+    branch, one more for each word of a block, 50 more for a transfer, and no cache.
+
+*/
+
+CycleModel::CycleModel()
+    : m_branchCycles(2), m_ioCycles(50), m_wordCycles(1), m_missCycles(10), m_lineWords(4), m_hits(0), m_misses(0)
+{
+    static_assert(sizeof(defaultCycles) / sizeof(defaultCycles[0]) == OPCODES, "Every opcode needs a default cost");
+    copy(begin(defaultCycles), end(defaultCycles), m_opcodeCycles);
+    PriceInstructions();
+}
+
+/*
+NAME
+
+    CycleModel::Load - Read costs from a cost file.
+
+SYNOPSIS
+
+    bool CycleModel::Load(const string& a_fileName)
+        const string& a_fileName --> The cost file.
+
+DESCRIPTION
+
+    This function reads the costs a cost file gives, in place of those the model has.  Costs the
+    file does not give are left as they were.  Names are not case sensitive.
+
+RETURNS
+
+    bool - True if every line of the file was understood.
+*/
+
+bool CycleModel::Load(const string& a_fileName)
+{
+    ifstream file(a_fileName);
+    if (!file) {
+        Errors::RecordError("Cost file " + a_fileName + " could not be opened.");
+        return false;
+    }
+    string text;
+    for (int lineNumber = 1; getline(file, text); lineNumber++) {
+        istringstream line(text.substr(0, text.find(';')));
+        string name;
+        if (!(line >> name)) {
+            continue;
+        }
+        transform(name.begin(), name.end(), name.begin(), ::toupper);
+
+        int cycles = 0;
+        int words = 0;
+        bool isValid = static_cast<bool>(line >> cycles) && cycles >= 0;
+        if (isValid && name == "CACHE") {
+            isValid = static_cast<bool>(line >> words) && words > 0;
+        }
+        string extra;
+        isValid = isValid && !(line >> extra);
+
+        int* cost = nullptr;
+        if (name == "BRANCH") {
+            cost = &m_branchCycles;
+        }
+        else if (name == "IO") {
+            cost = &m_ioCycles;
+        }
+        else if (name == "WORD") {
+            cost = &m_wordCycles;
+        }
+        else if (name == "MISS") {
+            cost = &m_missCycles;
+        }
+        else if (name != "CACHE") {
+            int opcode = OpcodeTable::lookup(name);
+            if (opcode >= 0) {
+                cost = &m_opcodeCycles[opcode];
+            }
+        }
+        if (!isValid || (cost == nullptr && name != "CACHE")) {
+            Errors::RecordError("Cost file " + a_fileName + " has an invalid line " + to_string(lineNumber) + ": " + text);
+            return false;
+        }
+        if (cost != nullptr) {
+            *cost = cycles;
+        }
+        else {
+            m_lineWords = words;
+            m_cacheTags.assign(cycles, -1);
+        }
+    }
+    PriceInstructions();
+    return true;
+}
+
+/*
+NAME
+
+    CycleModel::Reset - Forget the counts of the last run.
+
+SYNOPSIS
+
+    void CycleModel::Reset()
+
+DESCRIPTION
+
+    This function clears the cycles and executions counted and empties the cache, keeping the costs.
+
+*/
+
+void CycleModel::Reset()
+{
+    m_cycles.clear();
+    m_executions.clear();
+    m_targets.clear();
+    fill(m_cacheTags.begin(), m_cacheTags.end(), -1);
+    m_hits = 0;
+    m_misses = 0;
+}
+
+// Accessors
+long long CycleModel::GetCycles(int a_loc) const
+{
+    return static_cast<size_t>(a_loc) < m_cycles.size() ? m_cycles[a_loc] : 0;
+}
+
+long long CycleModel::GetExecutions(int a_loc) const
+{
+    return static_cast<size_t>(a_loc) < m_executions.size() ? m_executions[a_loc] : 0;
+}
+
+long long CycleModel::GetTotalCycles() const
+{
+    return accumulate(m_cycles.begin(), m_cycles.end(), 0LL);
+}
+
+/*
+NAME
+
+    CycleModel::DisplayBlocks - Report the cycles of the run by basic block.
+
+SYNOPSIS
+
+    void CycleModel::DisplayBlocks(ostream& a_out, const emulator& a_emul) const
+        ostream& a_out          --> Receives the report.
+        const emulator& a_emul  --> The emulator the program ran on.
+
+DESCRIPTION
+
+    This function writes the cycles and instructions of the run, and the hits and misses of the
+    cache if there is one, then a line for each basic block that was executed, the costliest
+    first.  A block starts at a location a branch was taken to, after a BP or HALT, after a location
+    that never ran, and wherever an instruction ran a different number of times from the one
+    before it, which catches any other way in.
+
+*/
+
+void CycleModel::DisplayBlocks(ostream& a_out, const emulator& a_emul) const
+{
+    struct Block {
+        int start;
+        int end;
+        long long cycles;
+    };
+    vector<Block> blocks;
+    long long instructions = 0;
+    for (int loc = 0; loc < static_cast<int>(m_executions.size()); loc++) {
+        if (m_executions[loc] == 0) {
+            continue;
+        }
+        instructions += m_executions[loc];
+        int previous = loc > 0 ? a_emul.decodeOpcode(a_emul.peekWord(loc - 1)) : 0;
+        bool isStart = blocks.empty() || blocks.back().end != loc - 1 || (loc < static_cast<int>(m_targets.size()) && m_targets[loc]) ||
+            previous == 12 || previous == 13 || m_executions[loc] != m_executions[loc - 1];
+        if (isStart) {
+            blocks.push_back(Block{ loc, loc, 0 });
+        }
+        blocks.back().end = loc;
+        blocks.back().cycles += m_cycles[loc];
+    }
+    stable_sort(blocks.begin(), blocks.end(), [](const Block& a_first, const Block& a_second) {
+        return a_first.cycles > a_second.cycles;
+    });
+
+    // The ratios are formatted apart, so that a_out keeps its own format for numbers.
+    auto format = [](double a_value, int a_precision) {
+        ostringstream text;
+        text << fixed << setprecision(a_precision) << a_value;
+        return text.str();
+    };
+    long long total = GetTotalCycles();
+    a_out << "\nEstimated cycles: " << total << " for " << instructions << " instructions";
+    if (instructions > 0) {
+        a_out << ", " << format(static_cast<double>(total) / instructions, 2) << " per instruction";
+    }
+    a_out << ".\n";
+    if (!m_cacheTags.empty()) {
+        a_out << "Cache of " << m_cacheTags.size() << " lines of " << m_lineWords << " words: " << m_hits << " hits, "
+            << m_misses << " misses.\n";
+    }
+
+    a_out << "\nCycles by basic block:\n\n";
+    a_out << left << setw(16) << "Block" << setw(12) << "Entries" << setw(12) << "Cycles" << "Share\n";
+    a_out << "-------------------------------------------------------------\n";
+    for (const Block& block : blocks) {
+        a_out << setw(16) << (to_string(block.start) + "-" + to_string(block.end)) << setw(12) << m_executions[block.start]
+            << setw(12) << block.cycles << format(100.0 * block.cycles / max(total, 1LL), 1) << "%\n";
+    }
+    a_out << "-------------------------------------------------------------" << endl;
+}
+
+/*
+NAME
+
+    CycleModel::Grow - Make room for the counts of a location.
+
+SYNOPSIS
+
+    void CycleModel::Grow(int a_loc)
+        int a_loc --> A location the program reached.
+
+DESCRIPTION
+
+    The counts grow with the highest location the program reaches rather than with the size of
+    memory, since a large address space is mostly unused.
+
+*/
+
+void CycleModel::Grow(int a_loc)
+{
+    size_t size = max(static_cast<size_t>(a_loc) + 1, 2 * m_cycles.size());
+    m_cycles.resize(size, 0);
+    m_executions.resize(size, 0);
+}
+
+/*
+NAME
+
+    CycleModel::PriceInstructions - Work out the cycles charged for each opcode.
+
+SYNOPSIS
+
+    void CycleModel::PriceInstructions()
+
+DESCRIPTION
+
+    The transfers pay the I/O latency on top of the cycles of their opcodes, so that instruction
+    adds a single cost whatever the opcode.
+
+*/
+
+void CycleModel::PriceInstructions()
+{
+    for (int opcode = 0; opcode < OPCODES; opcode++) {
+        bool isTransfer = opcode == OpcodeTable::Read || opcode == OpcodeTable::Write
+            || opcode == OpcodeTable::BlockRead || opcode == OpcodeTable::BlockWrite;
+        m_instructionCycles[opcode] = m_opcodeCycles[opcode] + (isTransfer ? m_ioCycles : 0);
+    }
+}
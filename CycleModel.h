@@ -0,0 +1,105 @@
+//
+//		CycleModel class.  A timing policy for the emulator that estimates the cycles a program
+//		would take on the VC370 hardware: a cost for each opcode, a penalty for each taken branch,
+//		a latency for each transfer to or from the console or the block device, and optionally a
+//		direct-mapped cache in front of memory.  The cycles are kept for each location, so they
+//		can be reported by basic block and by source line.
+//
+#pragma once
+
+#include "Emulator.h"
+#include "stdafx.h"
+
+class CycleModel {
+
+public:
+    // The model starts with the default costs and no cache.
+    CycleModel();
+
+    // Replaces costs with those in a cost file.  Returns false, having recorded an error, if the
+    // file cannot be read or has a line that is not understood.
+    bool Load(const string& a_fileName);
+
+    // Forgets the cycles counted so far and empties the cache, for another run.
+    void Reset();
+
+    // The timing policy, called by the emulator as it runs.  The calls are named as the emulator
+    // names its own members.
+    void instruction(int a_loc, int a_opcode)
+    {
+        if (static_cast<size_t>(a_loc) >= m_cycles.size()) {
+            Grow(a_loc);
+        }
+        m_executions[a_loc]++;
+        m_cycles[a_loc] += m_instructionCycles[a_opcode];
+    }
+
+    void access(int a_loc, int a_address)
+    {
+        if (m_cacheTags.empty()) {
+            return;
+        }
+        int line = a_address / m_lineWords;
+        int& tag = m_cacheTags[line % m_cacheTags.size()];
+        if (tag == line) {
+            m_hits++;
+            return;
+        }
+        tag = line;
+        m_misses++;
+        m_cycles[a_loc] += m_missCycles;
+    }
+
+    void takenBranch(int a_loc, int a_target)
+    {
+        m_cycles[a_loc] += m_branchCycles;
+        if (static_cast<size_t>(a_target) >= m_targets.size()) {
+            m_targets.resize(a_target + 1, false);
+        }
+        m_targets[a_target] = true;
+    }
+
+    void block(int a_loc, int a_words)
+    {
+        m_cycles[a_loc] += static_cast<long long>(a_words) * m_wordCycles;
+    }
+
+    // Cycles and executions of the instruction at a location.
+    long long GetCycles(int a_loc) const;
+    long long GetExecutions(int a_loc) const;
+
+    // Cycles of the whole run.
+    long long GetTotalCycles() const;
+
+    // Writes the totals of the run, then the cycles of each basic block, the costliest first.
+    // The emulator holds the program, whose branches end the blocks.
+    void DisplayBlocks(ostream& a_out, const emulator& a_emul) const;
+
+private:
+    const static int OPCODES = OpcodeTable::COUNT;  // Opcodes of the machine, from 0.
+
+    // Makes room for the counts of a location.
+    void Grow(int a_loc);
+
+    // Works out m_instructionCycles from the costs.
+    void PriceInstructions();
+
+    // Costs.
+    int m_opcodeCycles[OPCODES];            // Cycles of each opcode, including a cache hit.
+    int m_branchCycles;                     // Added for a taken branch.
+    int m_ioCycles;                         // Added for READ, WRITE, BREAD and BWRITE.
+    int m_wordCycles;                       // Added for each word of a block instruction.
+    int m_missCycles;                       // Added for an access that misses the cache.
+    int m_lineWords;                        // Words in a line of the cache.
+    int m_instructionCycles[OPCODES];       // Cycles charged for each opcode, with the I/O latency.
+
+    // The cache: the line of memory each cache line holds, or -1.  Empty if there is no cache.
+    vector<int> m_cacheTags;
+
+    // Counts of the run.
+    vector<long long> m_cycles;             // Cycles spent at each location.
+    vector<long long> m_executions;         // Times the instruction at each location was carried out.
+    vector<bool> m_targets;                 // True for each location a branch was taken to.
+    long long m_hits;                       // Accesses that hit the cache.
+    long long m_misses;                     // Accesses that missed it.
+};
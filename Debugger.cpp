@@ -0,0 +1,756 @@
+// Debugger.cpp
+//
+// Implementation of the Debugger class.
+// Nothing in the emulator's execution loop checks for the debugger, so the program runs at full
+// speed between stops.  A breakpoint replaces its instruction with a word holding the reserved
+// trap opcode, which stops execute like any other instruction; the instruction is put back while
+// it is stepped over.  A single step plants a temporary trap on the following word and lets a
+// taken branch end the time slice, so it too needs nothing from the loop.
+//
+// A watchpoint makes the host pages holding its words read-only.  A write to them raises an
+// access violation, which the exception handler records before releasing the page for the one
+// host instruction that writes it and protecting it again on the single-step exception that
+// follows.  While watchpoints are set the program runs a basic block at a time, so it stops at
+// the first taken branch after a watched write.
+//
+// A program that reads its own instructions sees the trap words at its breakpoints.
+//
+#include "stdafx.h"
+#include "Debugger.h"
+#include "Errors.h"
+
+namespace {
+    // The trap flag of the host processor, which raises a single-step exception after one instruction.
+    const DWORD TRAPFLAG = 0x100;
+}
+
+Debugger* Debugger::s_active = nullptr;
+
+/*
+NAME
+
+    Debugger::Debugger - Constructor for the Debugger class.
+
+SYNOPSIS
+
+    Debugger::Debugger(emulator& a_emul, const SymbolTable& a_symtab)
+        emulator& a_emul            --> The emulator, with the program loaded.
+        const SymbolTable& a_symtab --> The program's labels.
+
+DESCRIPTION
+
+    This constructor indexes the labels by location, saves the loaded program so that it can be
+    restarted, has the emulator stop at the trap opcode of its breakpoints, and installs the
+    exception handler for watchpoints.
+
+*/
+
+Debugger::Debugger(emulator& a_emul, const SymbolTable& a_symtab)
+    : m_emul(a_emul), m_symtab(a_symtab), m_steppingLocation(-1), m_running(true)
+{
+    for (const auto& symbol : m_symtab.GetSymbolTable()) {
+        if (symbol.second >= 0 && m_labels.count(symbol.second) == 0) {
+            m_labels[symbol.second] = symbol.first;
+        }
+    }
+    m_hits.reserve(MAXHITS);
+    m_emul.saveImage();
+    m_emul.enableTraps(true);
+    s_active = this;
+    m_handler = AddVectoredExceptionHandler(1, HandleException);
+}
+
+Debugger::~Debugger()
+{
+    ProtectWatchpoints(false);
+    m_emul.enableTraps(false);
+    for (const auto& breakpoint : m_breakpoints) {
+        m_emul.patchWord(breakpoint.first, breakpoint.second);
+    }
+    if (m_handler != nullptr) {
+        RemoveVectoredExceptionHandler(m_handler);
+    }
+    s_active = nullptr;
+}
+
+/*
+NAME
+
+    Debugger::Run - Debug the program.
+
+SYNOPSIS
+
+    bool Debugger::Run()
+
+DESCRIPTION
+
+    This function reads commands from the console and carries them out until the user quits or
+    the input ends.  The program starts stopped at its first instruction.  Locations are given as
+    labels or numbers.
+
+RETURNS
+
+    bool - False if the program faulted.
+*/
+
+bool Debugger::Run()
+{
+    cout << "\nDebugging program.  Type help for the commands.\n\n";
+    m_emul.startProgram();
+    bool faulted = false;
+    ShowStop(SR_Step);
+
+    string line;
+    while (true) {
+        cout << "(vcdb) " << flush;
+        if (!getline(cin, line)) break;
+
+        istringstream args(line);
+        string command, where;
+        args >> command >> where;
+        if (command.empty()) continue;
+
+        bool step = command == "step" || command == "s";
+        int location = 0;
+        bool hasLocation = !where.empty() && !step && ParseLocation(where, location);
+        if (!where.empty() && !step && !hasLocation) {
+            cout << "No such location: " << where << endl;
+            continue;
+        }
+
+        if (command == "break" || command == "b") {
+            if (!hasLocation) {
+                cout << "Give the location of the breakpoint." << endl;
+            }
+            else if (SetBreakpoint(location)) {
+                cout << "Breakpoint at " << Describe(location) << "." << endl;
+            }
+        }
+        else if (command == "delete" || command == "d") {
+            if (!hasLocation || !ClearBreakpoint(location)) {
+                cout << "No breakpoint there." << endl;
+            }
+        }
+        else if (command == "watch" || command == "w") {
+            int count = 1;
+            args >> count;
+            if (!hasLocation || count <= 0) {
+                cout << "Give the location and number of words to watch." << endl;
+            }
+            else if (SetWatchpoint(location, count)) {
+                cout << "Watching " << count << " word" << (count == 1 ? "" : "s") << " at " << Describe(location) << "." << endl;
+            }
+        }
+        else if (command == "unwatch") {
+            if (!hasLocation || !ClearWatchpoint(location)) {
+                cout << "No watchpoint there." << endl;
+            }
+        }
+        else if (command == "print" || command == "p") {
+            int count = 1;
+            args >> count;
+            if (!hasLocation) {
+                cout << "Give the location to print." << endl;
+            }
+            else {
+                ShowWords(location, max(count, 1));
+            }
+        }
+        else if (step || command == "continue" || command == "c") {
+            if (!m_running) {
+                cout << "The program is not running.  Use run to start it again." << endl;
+                continue;
+            }
+            int times = 1;
+            try {
+                times = where.empty() ? 1 : stoi(where);
+            }
+            catch (...) {
+                cout << "Give the number of instructions to step." << endl;
+                continue;
+            }
+            StopReason reason = SR_Step;
+            for (int i = 0; i < (step ? times : 1) && (i == 0 || reason == SR_Step); i++) {
+                reason = step ? Step() : Continue();
+            }
+            faulted = reason == SR_Error;
+            ShowStop(reason);
+        }
+        else if (command == "run" || command == "r") {
+            Restart();
+            faulted = false;
+            ShowStop(SR_Step);
+        }
+        else if (command == "info" || command == "i") {
+            for (const auto& breakpoint : m_breakpoints) {
+                cout << "Breakpoint at " << Describe(breakpoint.first) << endl;
+            }
+            for (const auto& watch : m_watchpoints) {
+                cout << "Watching " << watch.count << " at " << Describe(watch.location) << endl;
+            }
+        }
+        else if (command == "quit" || command == "q") {
+            break;
+        }
+        else {
+            Help();
+        }
+    }
+    return !faulted;
+}
+
+/*
+NAME
+
+    Debugger::Continue - Run the program until something stops it.
+
+SYNOPSIS
+
+    Debugger::StopReason Debugger::Continue()
+
+DESCRIPTION
+
+    The instruction at a breakpoint where the program stopped is stepped over first, so that the
+    program does not stop there again at once.  Then the program runs until it reaches a
+    breakpoint, writes a watched word, halts or faults.
+
+RETURNS
+
+    StopReason - Why the program stopped.
+*/
+
+Debugger::StopReason Debugger::Continue()
+{
+    if (m_breakpoints.count(m_emul.getProgramCounter()) != 0) {
+        StopReason reason = Step();
+        if (reason != SR_Step || m_breakpoints.count(m_emul.getProgramCounter()) != 0) {
+            return reason == SR_Step ? SR_Breakpoint : reason;
+        }
+    }
+    while (true) {
+        emulator::RunStatus status = Execute(m_watchpoints.empty() ? LLONG_MAX : 1);
+        if (!m_hits.empty()) {
+            return status == emulator::RS_Error ? SR_Error : SR_Watchpoint;
+        }
+        switch (status) {
+        case emulator::RS_Trap:
+            return SR_Breakpoint;
+        case emulator::RS_Halted:
+            m_running = false;
+            return SR_Halted;
+        case emulator::RS_Error:
+            m_running = false;
+            return SR_Error;
+        default:
+            break;
+        }
+    }
+}
+
+/*
+NAME
+
+    Debugger::Step - Execute one instruction.
+
+SYNOPSIS
+
+    Debugger::StopReason Debugger::Step()
+
+DESCRIPTION
+
+    The instruction is put back if a breakpoint covers it, and a trap is planted on the word after
+    it.  Running with a time slice of one taken branch then stops after the one instruction,
+    whether it falls through to the trap or branches.  The breakpoint and the word after are
+    restored afterwards.
+
+RETURNS
+
+    StopReason - SR_Step, unless the instruction halted, faulted or wrote a watched word.
+*/
+
+Debugger::StopReason Debugger::Step()
+{
+    int pc = m_emul.getProgramCounter();
+    auto breakpoint = m_breakpoints.find(pc);
+    if (breakpoint != m_breakpoints.end()) {
+        Patch(pc, breakpoint->second);
+    }
+    int next = pc + 1;
+    bool planted = next < m_emul.getMemorySize() && m_breakpoints.count(next) == 0;
+    int nextWord = 0;
+    if (planted) {
+        nextWord = Patch(next, m_emul.encodeWord(emulator::TRAPOPCODE, 0));
+    }
+
+    emulator::RunStatus status = Execute(1);
+
+    if (planted) {
+        Patch(next, nextWord);
+    }
+    if (breakpoint != m_breakpoints.end()) {
+        Patch(pc, m_emul.encodeWord(emulator::TRAPOPCODE, 0));
+    }
+
+    if (status == emulator::RS_Halted || status == emulator::RS_Error) {
+        m_running = false;
+        return status == emulator::RS_Halted ? SR_Halted : SR_Error;
+    }
+    return m_hits.empty() ? SR_Step : SR_Watchpoint;
+}
+
+/*
+NAME
+
+    Debugger::Execute - Run the emulator for a time slice.
+
+SYNOPSIS
+
+    emulator::RunStatus Debugger::Execute(long long a_slice)
+        long long a_slice --> Taken branches to run for.
+
+DESCRIPTION
+
+    This function runs the program, prompting for the value of each READ, until it stops for
+    any other reason.
+
+RETURNS
+
+    emulator::RunStatus - The reason execute stopped.
+*/
+
+emulator::RunStatus Debugger::Execute(long long a_slice)
+{
+    while (true) {
+        emulator::RunStatus status = m_emul.execute(cout, cerr, a_slice);
+        if (status != emulator::RS_NeedInput) {
+            return status;
+        }
+        cout << "? ";
+        int value = 0;
+        cin >> value;
+        m_emul.provideInput(value);
+    }
+}
+
+/*
+NAME
+
+    Debugger::SetBreakpoint - Set a breakpoint.
+
+SYNOPSIS
+
+    bool Debugger::SetBreakpoint(int a_location)
+        int a_location --> The location of the instruction.
+
+DESCRIPTION
+
+    This function saves the word at the location and patches the trap over it.
+
+RETURNS
+
+    bool - True if the breakpoint was set.
+*/
+
+bool Debugger::SetBreakpoint(int a_location)
+{
+    if (m_breakpoints.count(a_location) != 0) {
+        return true;
+    }
+    m_breakpoints[a_location] = Patch(a_location, m_emul.encodeWord(emulator::TRAPOPCODE, 0));
+    return true;
+}
+
+/*
+NAME
+
+    Debugger::ClearBreakpoint - Remove a breakpoint.
+
+SYNOPSIS
+
+    bool Debugger::ClearBreakpoint(int a_location)
+        int a_location --> The location of the breakpoint.
+
+DESCRIPTION
+
+    This function puts back the instruction the trap replaced.
+
+RETURNS
+
+    bool - False if there is no breakpoint at the location.
+*/
+
+bool Debugger::ClearBreakpoint(int a_location)
+{
+    auto breakpoint = m_breakpoints.find(a_location);
+    if (breakpoint == m_breakpoints.end()) {
+        return false;
+    }
+    Patch(a_location, breakpoint->second);
+    m_breakpoints.erase(breakpoint);
+    return true;
+}
+
+/*
+NAME
+
+    Debugger::Patch - Replace a word for the debugger.
+
+SYNOPSIS
+
+    int Debugger::Patch(int a_location, int a_contents)
+        int a_location --> The location.
+        int a_contents --> The new word.
+
+DESCRIPTION
+
+    The word may be in watched memory, so its page is released for the change, which is not the
+    program's and is not reported.
+
+RETURNS
+
+    int - The word that was replaced.
+*/
+
+int Debugger::Patch(int a_location, int a_contents)
+{
+    if (m_watchpoints.empty()) {
+        return m_emul.patchWord(a_location, a_contents);
+    }
+    m_emul.protectWords(a_location, 1, false);
+    int old = m_emul.patchWord(a_location, a_contents);
+    ProtectWatchpoints(true);
+    return old;
+}
+
+/*
+NAME
+
+    Debugger::SetWatchpoint - Watch a range of words.
+
+SYNOPSIS
+
+    bool Debugger::SetWatchpoint(int a_location, int a_count)
+        int a_location --> The first word.
+        int a_count    --> The number of words.
+
+DESCRIPTION
+
+    This function makes the host pages holding the words read-only, so that the program stops
+    after writing any of them.  Watchpoints need the trap flag of an x86 or x64 processor.
+
+RETURNS
+
+    bool - True if the watchpoint was set.
+*/
+
+bool Debugger::SetWatchpoint(int a_location, int a_count)
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    if (static_cast<long long>(a_location) + a_count > m_emul.getMemorySize()) {
+        cout << "The words are not all in memory." << endl;
+        return false;
+    }
+    if (!m_emul.protectWords(a_location, a_count, true)) {
+        cout << "The memory could not be protected." << endl;
+        return false;
+    }
+    m_watchpoints.push_back(Watchpoint{ a_location, a_count });
+    return true;
+#else
+    cout << "Watchpoints are not supported on this processor." << endl;
+    return false;
+#endif
+}
+
+/*
+NAME
+
+    Debugger::ClearWatchpoint - Stop watching a range of words.
+
+SYNOPSIS
+
+    bool Debugger::ClearWatchpoint(int a_location)
+        int a_location --> The first word of the range.
+
+DESCRIPTION
+
+    This function removes the watchpoint and releases its memory.  The remaining watchpoints are
+    protected again, since they may share host pages with it.
+
+RETURNS
+
+    bool - False if no watchpoint starts at the location.
+*/
+
+bool Debugger::ClearWatchpoint(int a_location)
+{
+    for (auto watch = m_watchpoints.begin(); watch != m_watchpoints.end(); ++watch) {
+        if (watch->location == a_location) {
+            ProtectWatchpoints(false);
+            m_watchpoints.erase(watch);
+            ProtectWatchpoints(true);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+NAME
+
+    Debugger::ProtectWatchpoints - Protect or release the watched memory.
+
+SYNOPSIS
+
+    void Debugger::ProtectWatchpoints(bool a_readOnly)
+        bool a_readOnly --> True to protect the memory, false to release it.
+
+DESCRIPTION
+
+    This function sets the protection of the host pages of every watchpoint.
+
+*/
+
+void Debugger::ProtectWatchpoints(bool a_readOnly)
+{
+    for (const auto& watch : m_watchpoints) {
+        m_emul.protectWords(watch.location, watch.count, a_readOnly);
+    }
+}
+
+/*
+NAME
+
+    Debugger::Restart - Start the program again.
+
+SYNOPSIS
+
+    void Debugger::Restart()
+
+DESCRIPTION
+
+    This function restores the memory the program changed, which also restores the instructions
+    under the breakpoints, then plants the traps again and restarts the program from its first
+    instruction.  The breakpoints and watchpoints are kept.
+
+*/
+
+void Debugger::Restart()
+{
+    ProtectWatchpoints(false);
+    m_emul.resetImage();
+    for (auto& breakpoint : m_breakpoints) {
+        breakpoint.second = m_emul.patchWord(breakpoint.first, m_emul.encodeWord(emulator::TRAPOPCODE, 0));
+    }
+    ProtectWatchpoints(true);
+    m_hits.clear();
+    m_running = true;
+}
+
+/*
+NAME
+
+    Debugger::HandleException - Catch writes to watched memory.
+
+SYNOPSIS
+
+    LONG CALLBACK Debugger::HandleException(PEXCEPTION_POINTERS a_info)
+        PEXCEPTION_POINTERS a_info --> The exception and the state of the thread that raised it.
+
+DESCRIPTION
+
+    A write to a protected page of the emulator's memory is recorded if it is to a watched word,
+    with the word's old value.  The page is then released and the trap flag set, so the write goes
+    ahead and the next host instruction raises a single-step exception, on which the page is
+    protected again.  Other exceptions are left to other handlers.
+
+RETURNS
+
+    LONG - EXCEPTION_CONTINUE_EXECUTION if the exception was handled, else EXCEPTION_CONTINUE_SEARCH.
+*/
+
+LONG CALLBACK Debugger::HandleException(PEXCEPTION_POINTERS a_info)
+{
+    Debugger* debugger = s_active;
+    if (debugger == nullptr) {
+        return EXCEPTION_CONTINUE_SEARCH;
+    }
+    const EXCEPTION_RECORD* record = a_info->ExceptionRecord;
+
+    if (record->ExceptionCode == EXCEPTION_SINGLE_STEP && debugger->m_steppingLocation >= 0) {
+        debugger->m_emul.protectWords(debugger->m_steppingLocation, 1, true);
+        debugger->m_steppingLocation = -1;
+        a_info->ContextRecord->EFlags &= ~TRAPFLAG;
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+
+    int location;
+    if (record->ExceptionCode != EXCEPTION_ACCESS_VIOLATION || record->NumberParameters < 2 ||
+        record->ExceptionInformation[0] != 1 || debugger->m_watchpoints.empty() ||
+        !debugger->m_emul.locateWord(reinterpret_cast<const void*>(record->ExceptionInformation[1]), location)) {
+        return EXCEPTION_CONTINUE_SEARCH;
+    }
+    for (const auto& watch : debugger->m_watchpoints) {
+        if (location >= watch.location && location < watch.location + watch.count &&
+            debugger->m_hits.size() < MAXHITS) {
+            debugger->m_hits.push_back(WatchHit{ location, debugger->m_emul.peekWord(location) });
+            break;
+        }
+    }
+    debugger->m_emul.protectWords(location, 1, false);
+    debugger->m_steppingLocation = location;
+    a_info->ContextRecord->EFlags |= TRAPFLAG;
+    return EXCEPTION_CONTINUE_EXECUTION;
+}
+
+/*
+NAME
+
+    Debugger::ParseLocation - Interpret a location given in a command.
+
+SYNOPSIS
+
+    bool Debugger::ParseLocation(const string& a_text, int& a_location) const
+        const string& a_text --> A label or a number.
+        int& a_location      --> Receives the location.
+
+DESCRIPTION
+
+    Labels are looked up in the symbol table.  Anything else must be a location in memory.
+
+RETURNS
+
+    bool - True if a_text names a location.
+*/
+
+bool Debugger::ParseLocation(const string& a_text, int& a_location) const
+{
+    // A failed lookup is not an error in the program, so keep it off the error list.
+    vector<string> lookupErrors;
+    vector<string>* outer = Errors::CaptureErrors(&lookupErrors);
+    bool isLabel = m_symtab.LookupSymbol(a_text, a_location);
+    Errors::CaptureErrors(outer);
+    if (isLabel) {
+        return a_location >= 0;
+    }
+    try {
+        size_t used = 0;
+        a_location = stoi(a_text, &used);
+        return used == a_text.size() && a_location >= 0 && a_location < m_emul.getMemorySize();
+    }
+    catch (...) {
+        return false;
+    }
+}
+
+/*
+NAME
+
+    Debugger::OriginalWord - The word at a location as the program left it.
+
+SYNOPSIS
+
+    int Debugger::OriginalWord(int a_location) const
+        int a_location --> The location.
+
+RETURNS
+
+    int - The word, or the instruction a breakpoint's trap replaced.
+*/
+
+int Debugger::OriginalWord(int a_location) const
+{
+    auto breakpoint = m_breakpoints.find(a_location);
+    return breakpoint != m_breakpoints.end() ? breakpoint->second : m_emul.peekWord(a_location);
+}
+
+// A location followed by its label, if it has one.
+string Debugger::Describe(int a_location) const
+{
+    auto label = m_labels.find(a_location);
+    return to_string(a_location) + (label != m_labels.end() ? " (" + label->second + ")" : "");
+}
+
+/*
+NAME
+
+    Debugger::ShowStop - Report where the program stopped.
+
+SYNOPSIS
+
+    void Debugger::ShowStop(StopReason a_reason)
+        StopReason a_reason --> Why it stopped.
+
+DESCRIPTION
+
+    This function reports the watched writes, if any, then the reason for stopping, and the
+    instruction that executes next with the accumulator.
+
+*/
+
+void Debugger::ShowStop(StopReason a_reason)
+{
+    for (const auto& hit : m_hits) {
+        cout << "Watchpoint: " << Describe(hit.location) << " changed from " << hit.oldValue << " to "
+            << m_emul.peekWord(hit.location) << "." << endl;
+    }
+    m_hits.clear();
+
+    switch (a_reason) {
+    case SR_Breakpoint:
+        cout << "Breakpoint reached." << endl;
+        break;
+    case SR_Halted:
+        cout << "The program halted." << endl;
+        return;
+    case SR_Error:
+        cout << "The program faulted." << endl;
+        return;
+    default:
+        break;
+    }
+    int pc = m_emul.getProgramCounter();
+    cout << "Next: " << right << setw(m_emul.getWordDigits()) << setfill('0') << OriginalWord(pc) << setfill(' ')
+        << " at " << Describe(pc) << ", accumulator " << m_emul.getAccumulator() << endl;
+}
+
+/*
+NAME
+
+    Debugger::ShowWords - Display words of memory.
+
+SYNOPSIS
+
+    void Debugger::ShowWords(int a_location, int a_count) const
+        int a_location --> The first word.
+        int a_count    --> The number of words.
+
+DESCRIPTION
+
+    Each word is shown with its location and label.  Breakpoints show the instruction they cover.
+
+*/
+
+void Debugger::ShowWords(int a_location, int a_count) const
+{
+    for (int location = a_location; location < a_location + a_count && location < m_emul.getMemorySize(); location++) {
+        cout << left << setw(16) << Describe(location) << right << setw(m_emul.getWordDigits()) << setfill('0')
+            << OriginalWord(location) << setfill(' ') << endl;
+    }
+}
+
+// Lists the debugger's commands.
+void Debugger::Help()
+{
+    cout << "Commands (a location is a label or a number):\n"
+        << "  break <location>          Stop before the instruction at the location.\n"
+        << "  delete <location>         Remove a breakpoint.\n"
+        << "  watch <location> [words]  Stop after the program writes the words.\n"
+        << "  unwatch <location>        Remove a watchpoint.\n"
+        << "  step [count]              Execute one instruction, or count of them.\n"
+        << "  continue                  Run until a breakpoint or watchpoint, or the end.\n"
+        << "  print <location> [words]  Show words of memory.\n"
+        << "  info                      List the breakpoints and watchpoints.\n"
+        << "  run                       Start the program again.\n"
+        << "  quit                      Stop debugging.\n";
+}
@@ -0,0 +1,80 @@
+//
+//		Debugger class.  Runs a program in the emulator under the control of commands from the
+//		console, with breakpoints, single stepping and watchpoints on memory.
+//
+#pragma once
+
+#include "Emulator.h"
+#include "SymTab.h"
+#include "stdafx.h"
+
+class Debugger {
+
+public:
+    // Debugs the program loaded in a_emul, whose labels are in a_symtab.
+    Debugger(emulator& a_emul, const SymbolTable& a_symtab);
+    ~Debugger();
+
+    // Reads and carries out commands until the user quits.  Returns false if the program faulted.
+    bool Run();
+
+private:
+    // Why the program stopped running.
+    enum StopReason {
+        SR_Breakpoint,      // It reached a breakpoint.
+        SR_Step,            // It executed the instructions asked for.
+        SR_Watchpoint,      // It wrote a watched word.
+        SR_Halted,          // It executed HALT.
+        SR_Error            // It faulted.
+    };
+
+    // A range of words whose writes stop the program.
+    struct Watchpoint {
+        int location;       // First word.
+        int count;          // Number of words.
+    };
+
+    // A write to a watched word, recorded by the exception handler.
+    struct WatchHit {
+        int location;       // The word written.
+        int oldValue;       // Its value before the write.
+    };
+
+    StopReason Continue();                  // Runs until something stops the program.
+    StopReason Step();                      // Executes one instruction.
+    emulator::RunStatus Execute(long long a_slice); // Runs the emulator, supplying input for READ.
+
+    bool SetBreakpoint(int a_location);     // Patches a trap over the instruction at a location.
+    bool ClearBreakpoint(int a_location);   // Puts the instruction back.
+    int Patch(int a_location, int a_contents);  // Replaces a word, even in watched memory.
+    bool SetWatchpoint(int a_location, int a_count);    // Protects the memory of a range of words.
+    bool ClearWatchpoint(int a_location);   // Removes the watchpoint starting at a location.
+    void ProtectWatchpoints(bool a_readOnly);   // Protects or releases all watched memory.
+    void Restart();                         // Puts the program back as it was loaded.
+
+    bool ParseLocation(const string& a_text, int& a_location) const;    // A label or a location.
+    int OriginalWord(int a_location) const; // The word at a location as the program sees it.
+    string Describe(int a_location) const;  // A location and its label, if it has one.
+    void ShowStop(StopReason a_reason);     // Reports where and why the program stopped.
+    void ShowWords(int a_location, int a_count) const;  // Displays words of memory.
+    static void Help();                     // Lists the commands.
+
+    // Handles access violations on watched memory and the single steps that follow them.
+    static LONG CALLBACK HandleException(PEXCEPTION_POINTERS a_info);
+
+    // Most watched writes recorded between stops.  Room is reserved for them, since the exception
+    // handler must not allocate.
+    const static size_t MAXHITS = 16;
+
+    emulator& m_emul;                       // The machine running the program.
+    const SymbolTable& m_symtab;            // The program's labels.
+    map<int, string> m_labels;              // Label of each labeled location.
+    map<int, int> m_breakpoints;            // Instruction replaced by the trap at each breakpoint.
+    vector<Watchpoint> m_watchpoints;       // The watched ranges.
+    vector<WatchHit> m_hits;                // Watched writes since the last stop.
+    int m_steppingLocation;                 // Word whose page is unprotected for one host instruction, or -1.
+    bool m_running;                         // False once the program has halted or faulted.
+    PVOID m_handler;                        // The installed exception handler.
+
+    static Debugger* s_active;              // The debugger whose watchpoints the exception handler serves.
+};
@@ -6,93 +6,1411 @@
 
 #include "stdafx.h"
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define VC_BLOCK_SSE2   // The block kernels use SSE2.
+#endif
+
+// The opcodes of the VC370, the same in every word format.  Numbers below COUNT with no mnemonic,
+// and any above it, are illegal.
+struct OpcodeTable
+{
+	enum Opcode
+	{
+		Load = 5, Store = 6, Read = 7, Write = 8, Branch = 12, Halt = 13, FetchAdd = 14, CompareSwap = 15,
+		BlockCopy = 16, BlockFill = 17, BlockSum = 18, BlockCompare = 19, BlockRead = 20, BlockWrite = 21
+	};
+	const static int COUNT = 22;
+
+	// The mnemonic of an opcode, or an empty string if it is not one.
+	static constexpr const char* mnemonic(int a_opcode)
+	{
+		switch (a_opcode)
+		{
+		case Load: return "LOAD";
+		case Store: return "STORE";
+		case Read: return "READ";
+		case Write: return "WRITE";
+		case Branch: return "BP";
+		case Halt: return "HALT";
+		case FetchAdd: return "FAA";
+		case CompareSwap: return "CAS";
+		case BlockCopy: return "BCOPY";
+		case BlockFill: return "BFILL";
+		case BlockSum: return "BSUM";
+		case BlockCompare: return "BCMP";
+		case BlockRead: return "BREAD";
+		case BlockWrite: return "BWRITE";
+		default: return "";
+		}
+	}
+
+	// The opcode of an upper case mnemonic, or -1 if it is not one.
+	static int lookup(const string& a_mnemonic)
+	{
+		static const unordered_map<string, int> opcodes = []
+		{
+			unordered_map<string, int> table;
+			for (int opcode = 0; opcode < COUNT; opcode++)
+			{
+				if (*mnemonic(opcode) != '\0')
+				{
+					table[mnemonic(opcode)] = opcode;
+				}
+			}
+			return table;
+		}();
+		auto it = opcodes.find(a_mnemonic);
+		return it == opcodes.end() ? -1 : it->second;
+	}
+};
+
+// The word formats of the machine.  A word holds an opcode and an address as opcode * DIVISOR +
+// address, with an address field of ADDRDIGITS decimal digits, so a format addresses at most
+// MAXWORDS words.  The classic VC370 has four digits and a flat memory of emulator::MEMSZ words;
+// the wider formats address larger memories, which are paged.  The emulator's decoder is
+// instantiated for each format, so it divides by a constant and reaches a word of a flat memory
+// without asking which kind of memory the machine has, and the emulator builds and splits words
+// for the assembler and the linker through the same format.
+template <int ADDRDIGITS>
+struct WordFormat
+{
+	typedef OpcodeTable Opcodes;
+	const static int DIGITS = ADDRDIGITS;
+	const static int DIVISOR = 10 * WordFormat<ADDRDIGITS - 1>::DIVISOR;
+	const static int MAXWORDS = DIVISOR;
+	const static bool FLAT = ADDRDIGITS <= 4;	// True if memory is a flat array of emulator::MEMSZ words.
+
+	static constexpr int encode(int a_opcode, int a_address) { return a_opcode * DIVISOR + a_address; }
+	static constexpr int opcode(int a_word) { return a_word / DIVISOR; }
+	static constexpr int address(int a_word) { return a_word % DIVISOR; }
+};
+
+template <>
+struct WordFormat<0>
+{
+	const static int DIVISOR = 1;
+};
+
+// A machine may have several harts, each with its own accumulator and program counter, sharing
+// one memory.  The memory-ordering model is that of the host's acquire and release operations:
+//
+//	- Every word is read and written whole; a hart never sees part of another hart's store.
+//	- LOAD, WRITE and instruction fetches are acquire loads, and STORE and READ are release
+//	  stores, so a hart that loads a word another hart stored also sees everything that hart
+//	  stored before it.  A store followed by a load of a different word may still be reordered.
+//	- FAA and CAS are sequentially consistent read-modify-writes, and so act as full fences.
+//	- A block instruction is a series of single-word loads and stores as above, not one access.
+//
+// Under the deterministic schedule the harts take turns on one thread, so every run is
+// sequentially consistent and repeatable.
 class emulator {
 
 public:
 
-	const static int MEMSZ = 10'000;	// The size of the memory of the VC370.
-	emulator() {
+	const static int MEMSZ = 10'000;	    // The size of the memory of the VC370.
+	const static int MAXMEMSZ = 10'000'000; // The largest address space the wider word format can encode.
+	const static int PAGESZ = 4'096;        // Words per lazily allocated page of a large address space.
+	const static int DIRTYSZ = 256;         // Words per block tracked for resetImage.
+	const static int MAXHARTS = 64;         // Most harts a machine may have.
+	const static long long HARTSLICE = 64;  // Taken branches a hart runs before relaying its output.
+	const static int BLOCKSLICE = 256;      // Words of a block instruction counted as one taken branch.
+	const static int TRAPOPCODE = 99;       // Reserved for the debugger's breakpoints; never assembled.
+	const static long long CLOCKCHECK = 65'536; // Instructions between readings of the clock for a time limit.
+	const static int MINADDRDIGITS = 4;     // Address digits of the classic word format.
+	const static int MAXADDRDIGITS = 7;     // Address digits of the widest word format.
+
+	// Memories of up to MEMSZ words use a flat array; larger ones are paged.  Either way the
+	// constructor only sets up bookkeeping, so its cost does not depend on a_memSize.
+	emulator(int a_memSize = MEMSZ)
+	{
+		if (a_memSize <= 0 || a_memSize > MAXMEMSZ)
+		{
+			cerr << "Error: Invalid memory size " << a_memSize << ", using " << MEMSZ << "." << endl;
+			a_memSize = MEMSZ;
+		}
+		m_memSize = a_memSize;
 
-		memset(m_memory, 0, MEMSZ * sizeof(int));
-		m_accum = 0;
+		// The word format is the narrowest that addresses every word, so the default machine
+		// keeps the classic opcode * 10000 + address word.
+		static_assert(WordFormat<MINADDRDIGITS>::MAXWORDS == MEMSZ && WordFormat<MAXADDRDIGITS>::MAXWORDS >= MAXMEMSZ,
+			"The word formats must cover every memory size");
+		m_addrDigits = MINADDRDIGITS;
+		while (inFormat([](auto a_format) { return decltype(a_format)::MAXWORDS; }) < m_memSize)
+		{
+			m_addrDigits++;
+		}
+		if (m_memSize <= MEMSZ)
+		{
+			m_flat = allocateWords(MEMSZ);
+		}
+		m_harts.assign(1, Hart(100));
 	}
-	// Records instructions and data into VC370 memory.
-	bool insertMemory(int a_location, int a_contents)
+
+	// Records instructions and data into VC370 memory.  Threads may insert into different locations
+	// at the same time provided the pages involved were reserved beforehand.
+	bool insertMemory(int a_location, int a_contents, ostream& a_diag = cerr)
 	{
-		if (a_location >= 0 && a_location < MEMSZ)
+		if (a_location >= 0 && a_location < m_memSize)
 		{
-			m_memory[a_location] = a_contents;
+			writeMemory(a_location, a_contents);
 			return true;
 		}
 		else
 		{
-			cerr << "Error: Invalid memory location " << a_location << " for insertion." << endl;
+			a_diag << "Error: Invalid memory location " << a_location << " for insertion." << endl;
 			return false;
 		}
 	}
 
+	// Copies a memory image of a_count words into locations 0 through a_count - 1, replacing
+	// whatever was there.  Fails if the image does not fit in the address space.
+	bool loadImage(const int* a_words, int a_count, ostream& a_diag = cerr)
+	{
+		if (a_count < 0 || a_count > m_memSize)
+		{
+			a_diag << "Error: Image of " << a_count << " words does not fit in memory." << endl;
+			return false;
+		}
+		for (int location = 0; location < a_count; )
+		{
+			int words = min(a_count - location, m_flat ? a_count : PAGESZ - location % PAGESZ);
+			memcpy(&memoryRef(location), a_words + location, words * sizeof(int));
+			location += words;
+		}
+		return true;
+	}
+
+	// Records the current memory as the image that resetImage restores, and starts tracking
+	// which blocks of memory are written.
+	void saveImage()
+	{
+		m_dirty.assign((m_memSize + DIRTYSZ - 1) / DIRTYSZ, false);
+		m_dirtyBlocks.clear();
+		if (m_flat)
+		{
+			m_savedFlat.reset(new int[MEMSZ]);
+			memcpy(m_savedFlat.get(), m_flat.get(), MEMSZ * sizeof(int));
+			return;
+		}
+		m_savedPages.clear();
+		m_savedPages.resize(m_pages.size());
+		for (size_t page = 0; page < m_pages.size(); page++)
+		{
+			if (m_pages[page])
+			{
+				m_savedPages[page].reset(new int[PAGESZ]);
+				memcpy(m_savedPages[page].get(), m_pages[page].get(), PAGESZ * sizeof(int));
+			}
+		}
+	}
+
+	// Puts the machine back as it was when saveImage was called, ready to run again.  Only the
+	// blocks written since then are copied back, so the cost depends on how much memory the run
+	// touched rather than on the size of memory.
+	void resetImage()
+	{
+		for (int block : m_dirtyBlocks)
+		{
+			int location = block * DIRTYSZ;
+			int words = min(m_memSize - location, static_cast<int>(DIRTYSZ));
+			const int* saved = nullptr;
+			if (m_flat)
+			{
+				saved = m_savedFlat.get() + location;
+			}
+			else if (location / PAGESZ < static_cast<int>(m_savedPages.size()) && m_savedPages[location / PAGESZ])
+			{
+				saved = m_savedPages[location / PAGESZ].get() + location % PAGESZ;
+			}
+
+			int* current = &memoryRef(location);
+			if (saved != nullptr)
+			{
+				memcpy(current, saved, words * sizeof(int));
+			}
+			else
+			{
+				memset(current, 0, words * sizeof(int));
+			}
+			m_dirty[block] = false;
+		}
+		m_dirtyBlocks.clear();
+		for (Hart& hart : m_harts)
+		{
+			hart.accum = 0;
+		}
+		startProgram();
+	}
+
+	// Allocates the page holding a location ahead of concurrent insertions.
+	void reserveMemory(int a_location)
+	{
+		if (a_location >= 0 && a_location < m_memSize)
+		{
+			memoryRef(a_location);
+		}
+	}
+
+	// Builds a machine word from an opcode and an address, in the machine's word format.
+	int encodeWord(int a_opcode, int a_address) const
+	{
+		return inFormat([=](auto a_format) { return decltype(a_format)::encode(a_opcode, a_address); });
+	}
+
+	// Extracts the address field of a word.
+	int decodeAddress(int a_word) const
+	{
+		return inFormat([=](auto a_format) { return decltype(a_format)::address(a_word); });
+	}
+
+	// Extracts the opcode field of a word.
+	int decodeOpcode(int a_word) const
+	{
+		return inFormat([=](auto a_format) { return decltype(a_format)::opcode(a_word); });
+	}
+
+	// Accessors for the word format and the size of the address space.
+	int getMemorySize() const { return m_memSize; }
+	int getAddressDigits() const { return m_addrDigits; }
+	int getWordDigits() const { return m_addrDigits + 2; }
+
+	// Outcome of a call to execute.
+	enum RunStatus {
+		RS_Running,		// The time slice ran out; call execute again to continue.
+		RS_NeedInput,	// A READ is waiting for provideInput.
+		RS_Halted,		// The program executed HALT.
+		RS_Error,		// The program faulted; the reason was written to the error stream.
+		RS_Trap,		// The first hart reached a debugger trap, at getProgramCounter.
+		RS_LimitReached	// A run limit stopped the program; getLimitSnapshot tells which and where.
+	};
+
+	// Limits on a run, so a runaway program cannot hold its host forever.  Zero means no limit.
+	// Each emulator has its own, so emulators sharing a process may have different limits.
+	struct RunLimits
+	{
+		long long instructions;             // Most instructions each hart may execute.
+		long long milliseconds;             // Most wall-clock time from startProgram.
+		long long outputLines;              // Most values each hart may write.
+	};
+
+	// Which limit stopped a hart.
+	enum LimitKind {
+		LK_None,		// None has.
+		LK_Instructions,
+		LK_Time,
+		LK_Output
+	};
+
+	// The state of a hart when a limit stopped it.
+	struct LimitSnapshot
+	{
+		LimitKind limit;                    // The limit reached, or LK_None.
+		int pc;                             // Location of the instruction it would have executed next.
+		int accum;                          // Its accumulator.
+		long long instructions;             // Instructions it executed.
+		long long milliseconds;             // Wall-clock time from startProgram to the stop.
+		long long outputLines;              // Values it wrote.
+	};
+
+	// Sets the limits for the runs that follow.  The limits are checked at taken branches, and the
+	// clock is only read every CLOCKCHECK instructions, so checking costs next to nothing; a hart
+	// may run to the end of its basic block past the instruction limit.  A block instruction counts
+	// as a loop over its words would, as it does for the time slice of execute.
+	void setLimits(const RunLimits& a_limits)
+	{
+		m_limits = a_limits;
+		for (Hart& hart : m_harts)
+		{
+			hart.nextCheck = nextLimitCheck(hart);
+		}
+	}
+
+	LimitSnapshot getLimitSnapshot(int a_hart = 0) const
+	{
+		const Hart& hart = m_harts[a_hart];
+		return LimitSnapshot{ hart.limit, hart.pc, hart.accum, hart.executed, hart.elapsed, hart.written };
+	}
+
+	// Work done by all the harts since startProgram.
+	struct RunCounts
+	{
+		long long instructions;             // Instructions executed.
+		long long reads;                    // Values read.
+		long long writes;                   // Values written.
+	};
+
+	RunCounts getRunCounts() const
+	{
+		RunCounts counts = { 0, 0, 0 };
+		for (const Hart& hart : m_harts)
+		{
+			counts.instructions += hart.executed;
+			counts.reads += hart.read;
+			counts.writes += hart.written;
+		}
+		return counts;
+	}
+
+	// Attaches a block device of a_count words, which BREAD and BWRITE transfer to and from memory.
+	// The words belong to the caller, usually a mapped view of a data file, and must outlive the
+	// runs that use them.  A machine with no device attached has one of no words.
+	void attachDevice(int* a_words, int a_count)
+	{
+		m_device = a_words;
+		m_deviceSize = a_words ? a_count : 0;
+	}
+
+	// Makes the debugger's trap opcode stop the first hart with RS_Trap.  Without a debugger
+	// attached there is nothing to handle a trap, so the opcode is illegal like any other.
+	void enableTraps(bool a_enabled) { m_trapsEnabled = a_enabled; }
+
+	// Access for the debugger, which inspects the first hart and patches memory while it is stopped.
+	int getProgramCounter() const { return m_harts[0].pc; }
+	int getAccumulator() const { return m_harts[0].accum; }
+	int peekWord(int a_location) const { return readMemory(a_location); }
+
+	// Replaces a word, returning the one that was there.
+	int patchWord(int a_location, int a_contents)
+	{
+		int old = readMemory(a_location);
+		writeMemory(a_location, a_contents);
+		return old;
+	}
+
+	// Sets the protection of the host pages holding a range of words.  While they are read-only,
+	// writing them raises an access violation, which the debugger uses for its watchpoints.  The
+	// host pages may hold words outside the range, and writing those faults as well.
+	bool protectWords(int a_location, int a_count, bool a_readOnly)
+	{
+		SYSTEM_INFO system;
+		GetSystemInfo(&system);
+		uintptr_t hostPage = system.dwPageSize;
+		for (int location = a_location; location < a_location + a_count; )
+		{
+			int words = min(a_location + a_count - location, wordsFrom(location));
+			uintptr_t begin = reinterpret_cast<uintptr_t>(&memoryRef(location));
+			uintptr_t end = begin + words * sizeof(int);
+			begin -= begin % hostPage;
+			end += (hostPage - end % hostPage) % hostPage;
+			DWORD old;
+			if (!VirtualProtect(reinterpret_cast<void*>(begin), end - begin, a_readOnly ? PAGE_READONLY : PAGE_READWRITE, &old))
+			{
+				return false;
+			}
+			location += words;
+		}
+		return true;
+	}
+
+	// Finds the location of the word at a host address.  Returns false if it is not in memory.
+	bool locateWord(const void* a_host, int& a_location) const
+	{
+		uintptr_t host = reinterpret_cast<uintptr_t>(a_host);
+		if (m_flat)
+		{
+			uintptr_t begin = reinterpret_cast<uintptr_t>(m_flat.get());
+			if (host < begin || host >= begin + m_memSize * sizeof(int))
+			{
+				return false;
+			}
+			a_location = static_cast<int>((host - begin) / sizeof(int));
+			return true;
+		}
+		for (size_t page = 0; page < m_pages.size(); page++)
+		{
+			uintptr_t begin = reinterpret_cast<uintptr_t>(m_pages[page].get());
+			if (m_pages[page] && host >= begin && host < begin + PAGESZ * sizeof(int))
+			{
+				a_location = static_cast<int>(page * PAGESZ + (host - begin) / sizeof(int));
+				return a_location < m_memSize;
+			}
+		}
+		return false;
+	}
+
+	// The timing policy of a run, which run tells of the work each instruction does so that a cost
+	// model can estimate the cycles the program would take on the hardware.  It is a template
+	// parameter, and NoTiming's calls compile to nothing, so a run without timing pays nothing
+	// for it.  A timing policy has these members, called in this order for each instruction:
+	struct NoTiming
+	{
+		void instruction(int a_loc, int a_opcode) {}	// The instruction at a_loc was carried out.
+		void access(int a_loc, int a_address) {}		// It loaded or stored the word at a_address.
+		void takenBranch(int a_loc, int a_target) {}	// It branched to a_target.
+		void block(int a_loc, int a_words) {}			// It was a block instruction of a_words words.
+	};
+
 	// Runs the VC370 program recorded in memory.
 	bool runProgram()
+	{
+		NoTiming timing;
+		return runProgram(timing);
+	}
+
+	// Runs the program as runProgram does, telling a_timing of every instruction of the run.
+	template <class TIMING>
+	bool runProgram(TIMING& a_timing)
 	{
 		cout << "\nResults from emulating program:\n\n";
 
-		int loc = 100; // Starting location
+		startProgram();
 		while (true)
 		{
-			if (loc < 0 || loc >= MEMSZ)
+			switch (executeTimed(cout, cerr, a_timing))
+			{
+			case RS_NeedInput:
+			{
+				cout << "? ";
+				int value = 0;
+				cin >> value;
+				provideInput(value);
+				break;
+			}
+			case RS_Halted:
+				cout << "\nEnd of emulation" << endl;
+				return true;
+			case RS_Error:
+			case RS_Trap:
+			case RS_LimitReached:
+				return false;
+			default:
+				break;
+			}
+		}
+	}
+
+	// Prepares to run the program from its starting location, or each hart from its entry point.
+	void startProgram()
+	{
+		m_started = chrono::steady_clock::now();
+		for (Hart& hart : m_harts)
+		{
+			hart.pc = hart.entry;
+			hart.inputPending = false;
+			hart.executed = 0;
+			hart.read = 0;
+			hart.written = 0;
+			hart.limit = LK_None;
+			hart.elapsed = 0;
+			hart.nextCheck = nextLimitCheck(hart);
+		}
+	}
+
+	// Supplies the value for the READ that stopped execute with RS_NeedInput.
+	void provideInput(int a_value)
+	{
+		m_harts[0].input = a_value;
+		m_harts[0].inputPending = true;
+	}
+
+	// Gives the machine a hart for each entry point, in place of the single hart that starts at
+	// location 100.  execute and provideInput work on the first hart; runHarts runs them all.
+	bool setEntryPoints(const vector<int>& a_entries, ostream& a_diag = cerr)
+	{
+		if (a_entries.empty() || a_entries.size() > static_cast<size_t>(MAXHARTS))
+		{
+			a_diag << "Error: A machine has from 1 to " << MAXHARTS << " harts." << endl;
+			return false;
+		}
+		for (int entry : a_entries)
+		{
+			if (entry < 0 || entry >= m_memSize)
 			{
-				cerr << "Error: Program counter out of bounds at location " << loc << "." << endl;
+				a_diag << "Error: Invalid entry point " << entry << "." << endl;
 				return false;
 			}
+		}
+		m_harts.clear();
+		for (int entry : a_entries)
+		{
+			m_harts.push_back(Hart(entry));
+		}
+		return true;
+	}
 
-			int contents = m_memory[loc];
-			int opcode = contents / 10000;
-			int address = contents % 10000;
+	int getHartCount() const { return static_cast<int>(m_harts.size()); }
+	int getEntryPoint(int a_hart = 0) const { return m_harts[a_hart].entry; }
+
+	// How runHarts shares the host among the harts.
+	enum Schedule {
+		SC_Deterministic,	// The harts take turns on the calling thread, HARTSLICE taken branches each.
+		SC_FreeRunning		// Each hart runs on its own thread.
+	};
+
+	// Runs every hart from its entry point until all have halted or one faults.  Each line a hart
+	// writes is prefixed with its number, and so is the prompt for each value it reads.
+	bool runHarts(Schedule a_schedule)
+	{
+		cout << "\nResults from emulating program on " << m_harts.size() << " harts:\n\n";
+
+		startProgram();
+		mutex console;
+		bool ok = true;
+		if (a_schedule == SC_Deterministic)
+		{
+			vector<RunStatus> status(m_harts.size(), RS_Running);
+			for (size_t running = m_harts.size(); running > 0 && ok; )
+			{
+				for (size_t hart = 0; hart < m_harts.size() && ok; hart++)
+				{
+					if (status[hart] != RS_Running) continue;
+
+					status[hart] = runHartSlice<false>(hart, console);
+					if (status[hart] != RS_Running)
+					{
+						running--;
+					}
+					ok = status[hart] == RS_Running || status[hart] == RS_Halted;
+				}
+			}
+		}
+		else
+		{
+			// The harts must not change the page directory or the record of dirty blocks while
+			// others use them, so every page is allocated first and a saved image is given up.
+			if (!m_flat)
+			{
+				for (int location = 0; location < m_memSize; location += PAGESZ)
+				{
+					memoryRef(location);
+				}
+			}
+			m_dirty.clear();
+			m_dirtyBlocks.clear();
+			m_savedFlat.reset();
+			m_savedPages.clear();
+
+			atomic<bool> failed(false);
+			vector<thread> threads;
+			for (size_t hart = 0; hart < m_harts.size(); hart++)
+			{
+				threads.emplace_back([this, hart, &console, &failed]()
+				{
+					RunStatus status = RS_Running;
+					while (status == RS_Running && !failed.load())
+					{
+						status = runHartSlice<true>(hart, console);
+					}
+					if (status != RS_Running && status != RS_Halted)
+					{
+						failed = true;
+					}
+				});
+			}
+			for (auto& worker : threads)
+			{
+				worker.join();
+			}
+			ok = !failed;
+		}
+		if (ok)
+		{
+			cout << "\nEnd of emulation" << endl;
+		}
+		return ok;
+	}
+
+	// Runs the program from where it stopped until it halts, faults or needs input.  A READ
+	// with no input supplied returns to the caller, so a program waiting for input holds no
+	// thread.  So does the a_slice'th taken branch, so a long-running program cannot keep its
+	// caller from other work; straight-line code always reaches a branch, READ or HALT.
+	RunStatus execute(ostream& a_out, ostream& a_err, long long a_slice = LLONG_MAX)
+	{
+		NoTiming timing;
+		return runFormat<false>(m_harts[0], a_out, a_err, a_slice, timing);
+	}
+
+	// Runs the first hart as execute does, telling a_timing of every instruction.
+	template <class TIMING>
+	RunStatus executeTimed(ostream& a_out, ostream& a_err, TIMING& a_timing, long long a_slice = LLONG_MAX)
+	{
+		return runFormat<false>(m_harts[0], a_out, a_err, a_slice, a_timing);
+	}
+
+	// Runs the first hart as execute does, but through the atomic memory operations harts use when
+	// they run on threads of their own, so the two ways of running can be checked against each
+	// other.  A large address space must have all its pages allocated first.
+	RunStatus executeShared(ostream& a_out, ostream& a_err, long long a_slice = LLONG_MAX)
+	{
+		NoTiming timing;
+		return runFormat<true>(m_harts[0], a_out, a_err, a_slice, timing);
+	}
+
+private:
+
+	// The registers of one hart.
+	struct Hart
+	{
+		// A hart that starts at a_entry, with a clear accumulator and nothing counted.
+		explicit Hart(int a_entry) : entry(a_entry), pc(a_entry) {}
+
+		int entry;                          // Location the hart starts at.
+		int accum = 0;                      // Its accumulator.
+		int pc;                             // Location of its next instruction.
+		int input = 0;                      // Value supplied for a pending READ.
+		bool inputPending = false;          // True if input has not been read yet.
+
+		// Accounting for the run limits.
+		long long executed = 0;             // Instructions executed since startProgram.
+		long long read = 0;                 // Values read since startProgram.
+		long long written = 0;              // Values written since startProgram.
+		long long nextCheck = 0;            // The count of executed at which to check the limits again.
+		LimitKind limit = LK_None;          // The limit that stopped the hart, if one has.
+		long long elapsed = 0;              // Milliseconds it had run when a limit stopped it.
+	};
+
+	// Calls a_use with the traits of the machine's word format.  Every format is instantiated, so
+	// the format is chosen once for each call rather than at each word a_use handles.
+	template <class USE>
+	auto inFormat(USE a_use) const -> decltype(a_use(WordFormat<MINADDRDIGITS>()))
+	{
+		static_assert(MAXADDRDIGITS - MINADDRDIGITS == 3, "Every word format needs a case");
+		switch (m_addrDigits)
+		{
+		case MINADDRDIGITS:
+			return a_use(WordFormat<MINADDRDIGITS>());
+		case MINADDRDIGITS + 1:
+			return a_use(WordFormat<MINADDRDIGITS + 1>());
+		case MINADDRDIGITS + 2:
+			return a_use(WordFormat<MINADDRDIGITS + 2>());
+		default:
+			return a_use(WordFormat<MAXADDRDIGITS>());
+		}
+	}
+
+	// Runs a hart with the decoder of the machine's word format.
+	template <bool SHARED, class TIMING>
+	RunStatus runFormat(Hart& a_hart, ostream& a_out, ostream& a_err, long long a_slice, TIMING& a_timing)
+	{
+		return inFormat([&](auto a_format) {
+			return this->template run<SHARED, decltype(a_format)>(a_hart, a_out, a_err, a_slice, a_timing);
+		});
+	}
+
+	// Runs a hart as execute does, on a machine whose words are in FORMAT.  With SHARED, other
+	// harts are running on other threads, so memory is accessed through the atomic operations of
+	// the memory-ordering model.  a_timing is told of each instruction carried out; one that faults
+	// or stops the hart is not carried out.
+	template <bool SHARED, class FORMAT, class TIMING>
+	RunStatus run(Hart& a_hart, ostream& a_out, ostream& a_err, long long a_slice, TIMING& a_timing)
+	{
+		typedef typename FORMAT::Opcodes OP;
+		int loc = a_hart.pc;
+
+		// The instructions from here to loc have not been added to the hart's count yet.  They
+		// are added once for the whole basic block, at the branch that ends it or when the
+		// hart stops.
+		int blockStart = loc;
+		while (true)
+		{
+			if (loc < 0 || loc >= m_memSize)
+			{
+				a_err << "Error: Program counter out of bounds at location " << loc << "." << endl;
+				return stop(a_hart, loc, blockStart, RS_Error);
+			}
+
+			int contents = loadWord<SHARED, FORMAT>(loc);
+			int opcode = FORMAT::opcode(contents);
+			int address = FORMAT::address(contents);
+
+			if (address < 0 || address >= m_memSize)
+			{
+				a_err << "Error: Address " << address << " out of bounds at location " << loc << "." << endl;
+				return stop(a_hart, loc, blockStart, RS_Error);
+			}
 
 			switch (opcode)
 			{
-			case 5: // LOAD
-				m_accum = m_memory[address];
+			case OP::Load: // LOAD
+				a_timing.instruction(loc, opcode);
+				a_timing.access(loc, address);
+				a_hart.accum = loadWord<SHARED, FORMAT>(address);
 				loc += 1;
 				break;
-			case 6: // STORE
-				m_memory[address] = m_accum;
+			case OP::Store: // STORE
+				a_timing.instruction(loc, opcode);
+				a_timing.access(loc, address);
+				storeWord<SHARED, FORMAT>(address, a_hart.accum);
 				loc += 1;
 				break;
-			case 7: // READ
-				cout << "? ";
-				cin >> m_memory[address];
-				// Removed: cout << m_memory[address] << endl;
+			case OP::Read: // READ
+				if (!a_hart.inputPending)
+				{
+					return stop(a_hart, loc, blockStart, RS_NeedInput);
+				}
+				a_timing.instruction(loc, opcode);
+				a_timing.access(loc, address);
+				storeWord<SHARED, FORMAT>(address, a_hart.input);
+				a_hart.inputPending = false;
+				a_hart.read++;
 				loc += 1;
 				break;
-			case 8: // WRITE
-				cout << m_memory[address] << endl;
+			case OP::Write: // WRITE
+				if (m_limits.outputLines > 0 && a_hart.written >= m_limits.outputLines)
+				{
+					stop(a_hart, loc, blockStart, RS_Running);
+					return stopAtLimit(a_hart, LK_Output, a_err);
+				}
+				a_timing.instruction(loc, opcode);
+				a_timing.access(loc, address);
+				a_out << loadWord<SHARED, FORMAT>(address) << endl;
+				a_hart.written++;
 				loc += 1;
 				break;
-			case 12: // BP (Branch if Positive)
-				if (m_accum > 0)
+			case OP::Branch: // BP (Branch if Positive)
+				a_timing.instruction(loc, opcode);
+				if (a_hart.accum > 0)
 				{
+					a_timing.takenBranch(loc, address);
+					a_hart.executed += loc + 1 - blockStart;
 					loc = address;
+					blockStart = loc;
+					if (a_hart.executed >= a_hart.nextCheck)
+					{
+						a_hart.pc = loc;
+						if (checkLimits(a_hart, a_err) != RS_Running)
+						{
+							return RS_LimitReached;
+						}
+					}
+					if (--a_slice <= 0)
+					{
+						a_hart.pc = loc;
+						return RS_Running;
+					}
 				}
 				else
 				{
 					loc += 1;
 				}
 				break;
-			case 13: // HALT
-				cout << "\nEnd of emulation" << endl;
-				return true;
+			case OP::Halt: // HALT
+				a_timing.instruction(loc, opcode);
+				return stop(a_hart, loc, blockStart, RS_Halted);
+			case TRAPOPCODE:
+				if (m_trapsEnabled)
+				{
+					return stop(a_hart, loc, blockStart, RS_Trap);
+				}
+				a_err << "Illegal opcode " << opcode << " at location " << loc << "." << endl;
+				return stop(a_hart, loc, blockStart, RS_Error);
+			case OP::FetchAdd: // FAA (Fetch and Add): the word gains the accumulator, which receives the old word.
+				a_timing.instruction(loc, opcode);
+				a_timing.access(loc, address);
+				if (SHARED)
+				{
+					a_hart.accum = sharedWord(wordRef<FORMAT>(address)).fetch_add(a_hart.accum);
+				}
+				else
+				{
+					int old = loadWord<false, FORMAT>(address);
+					storeWord<false, FORMAT>(address, static_cast<int>(static_cast<unsigned>(old) + static_cast<unsigned>(a_hart.accum)));
+					a_hart.accum = old;
+				}
+				loc += 1;
+				break;
+			case OP::CompareSwap: // CAS (Compare and Swap): if the word equals the one after it, it becomes the
+				     // accumulator.  Either way the accumulator receives the old word.
+			{
+				if (address + 1 >= m_memSize)
+				{
+					a_err << "Error: Address " << address + 1 << " out of bounds at location " << loc << "." << endl;
+					return stop(a_hart, loc, blockStart, RS_Error);
+				}
+				a_timing.instruction(loc, opcode);
+				a_timing.access(loc, address);
+				a_timing.access(loc, address + 1);
+				int expected = loadWord<SHARED, FORMAT>(address + 1);
+				if (SHARED)
+				{
+					sharedWord(wordRef<FORMAT>(address)).compare_exchange_strong(expected, a_hart.accum);
+					a_hart.accum = expected;
+				}
+				else
+				{
+					int old = loadWord<false, FORMAT>(address);
+					if (old == expected)
+					{
+						storeWord<false, FORMAT>(address, a_hart.accum);
+					}
+					a_hart.accum = old;
+				}
+				loc += 1;
+				break;
+			}
+			case OP::BlockCopy: // BCOPY (Block Copy)
+			case OP::BlockFill: // BFILL (Block Fill)
+			case OP::BlockSum: // BSUM (Block Sum)
+			case OP::BlockCompare: // BCMP (Block Compare)
+			case OP::BlockRead: // BREAD (Block Read from the device)
+			case OP::BlockWrite: // BWRITE (Block Write to the device)
+			{
+				int words = 0;
+				if (!executeBlock<SHARED, FORMAT>(opcode, address, a_hart.accum, words))
+				{
+					a_err << "Error: Block at " << address << " out of bounds at location " << loc << "." << endl;
+					return stop(a_hart, loc, blockStart, RS_Error);
+				}
+				a_timing.instruction(loc, opcode);
+				a_timing.block(loc, words);
+				loc += 1;
+
+				// A long block takes as much of the slice as a loop over its words would, and
+				// brings the next reading of the clock as much closer, but counts as one
+				// instruction.
+				stop(a_hart, loc, blockStart, RS_Running);
+				blockStart = loc;
+				a_hart.nextCheck -= words / BLOCKSLICE;
+				if (a_hart.executed >= a_hart.nextCheck && checkLimits(a_hart, a_err) != RS_Running)
+				{
+					return RS_LimitReached;
+				}
+				a_slice -= words / BLOCKSLICE;
+				if (a_slice <= 0)
+				{
+					return RS_Running;
+				}
+				break;
+			}
 			default:
-				cerr << "Illegal opcode " << opcode << " at location " << loc << "." << endl;
-				return false;
+				a_err << "Illegal opcode " << opcode << " at location " << loc << "." << endl;
+				return stop(a_hart, loc, blockStart, RS_Error);
 			}
 		}
 	}
 
-private:
+	// Leaves a hart stopped at a location, adding the instructions it ran since a_blockStart to its
+	// count.  Returns a_status, for run to return.
+	RunStatus stop(Hart& a_hart, int a_loc, int a_blockStart, RunStatus a_status)
+	{
+		a_hart.pc = a_loc;
+		a_hart.executed += a_loc - a_blockStart;
+		return a_status;
+	}
+
+	// Called when a hart's count of instructions reaches nextCheck, with its pc up to date.  Stops
+	// it with RS_LimitReached if it has reached the instruction or time limit, and otherwise sets
+	// when to check again.
+	RunStatus checkLimits(Hart& a_hart, ostream& a_err)
+	{
+		if (m_limits.instructions > 0 && a_hart.executed >= m_limits.instructions)
+		{
+			return stopAtLimit(a_hart, LK_Instructions, a_err);
+		}
+		if (m_limits.milliseconds > 0 && elapsedMilliseconds() >= m_limits.milliseconds)
+		{
+			return stopAtLimit(a_hart, LK_Time, a_err);
+		}
+		a_hart.nextCheck = nextLimitCheck(a_hart);
+		return RS_Running;
+	}
+
+	// Records the snapshot of a hart a limit stopped, and reports it like a fault.
+	RunStatus stopAtLimit(Hart& a_hart, LimitKind a_limit, ostream& a_err)
+	{
+		static const char* const names[] = { "", "Instruction", "Time", "Output" };
+
+		a_hart.limit = a_limit;
+		a_hart.elapsed = elapsedMilliseconds();
+		a_err << "Error: " << names[a_limit] << " limit reached at location " << a_hart.pc
+			<< " with accumulator " << a_hart.accum << ", after " << a_hart.executed << " instructions, "
+			<< a_hart.elapsed << " ms and " << a_hart.written << " values written." << endl;
+		return RS_LimitReached;
+	}
+
+	// The count of executed instructions at which a hart's limits are next checked.
+	long long nextLimitCheck(const Hart& a_hart) const
+	{
+		long long next = LLONG_MAX;
+		if (m_limits.milliseconds > 0)
+		{
+			next = a_hart.executed + CLOCKCHECK;
+		}
+		if (m_limits.instructions > 0)
+		{
+			next = min(next, m_limits.instructions);
+		}
+		return next;
+	}
+
+	long long elapsedMilliseconds() const
+	{
+		return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - m_started).count();
+	}
+
+	// Runs one slice of a hart for runHarts and relays what it wrote.  A READ prompts for its value
+	// on the console, and a fault is reported there.
+	template <bool SHARED>
+	RunStatus runHartSlice(size_t a_hart, mutex& a_console)
+	{
+		Hart& hart = m_harts[a_hart];
+		ostringstream out;
+		ostringstream err;
+		NoTiming timing;
+		RunStatus status = runFormat<SHARED>(hart, out, err, HARTSLICE, timing);
+
+		lock_guard<mutex> lock(a_console);
+		istringstream written(out.str());
+		string value;
+		while (getline(written, value))
+		{
+			cout << a_hart << ": " << value << "\n";
+		}
+		if (status == RS_NeedInput)
+		{
+			cout << a_hart << "? ";
+			hart.input = 0;
+			cin >> hart.input;
+			hart.inputPending = true;
+			status = RS_Running;
+		}
+		else if (status == RS_Error || status == RS_LimitReached)
+		{
+			cerr << "Hart " << a_hart << ": " << err.str();
+		}
+		cout.flush();
+		return status;
+	}
+
+	// Carries out a block instruction.  Its operand is a descriptor of three words: the destination
+	// address, the source address and the number of words.  BCOPY copies the source to the
+	// destination as if through a temporary, so the two may overlap.  BFILL stores the accumulator
+	// in each destination word.  BSUM loads the sum of the source words, and BCMP compares the
+	// destination with the source and loads zero if they are the same, otherwise one more than the
+	// offset of the first word that differs.  The ranges are checked once for the whole block, then
+	// the words are handled a page at a time by the block kernels.  Returns false if the descriptor
+	// or a range it describes is out of bounds; a_words receives the number of words in the block.
+	// BREAD and BWRITE, which also use the block device, are carried out by executeDeviceBlock.
+	template <bool SHARED, class FORMAT>
+	bool executeBlock(int a_opcode, int a_address, int& a_accum, int& a_words)
+	{
+		if (a_address + 2 >= m_memSize)
+		{
+			return false;
+		}
+		int dest = loadWord<SHARED, FORMAT>(a_address);
+		int source = loadWord<SHARED, FORMAT>(a_address + 1);
+		int count = loadWord<SHARED, FORMAT>(a_address + 2);
+		typedef typename FORMAT::Opcodes OP;
+		if (a_opcode >= OP::BlockRead)
+		{
+			return executeDeviceBlock<SHARED, FORMAT>(a_opcode == OP::BlockRead, dest, source, count, a_accum, a_words);
+		}
+		bool usesDest = a_opcode != OP::BlockSum;
+		bool usesSource = a_opcode != OP::BlockFill;
+		if (count < 0 || (usesDest && !isBlockInMemory(dest, count)) || (usesSource && !isBlockInMemory(source, count)))
+		{
+			return false;
+		}
+		a_words = count;
+
+		if (SHARED)
+		{
+			executeSharedBlock<FORMAT>(a_opcode, dest, source, count, a_accum);
+			return true;
+		}
+		switch (a_opcode)
+		{
+		case OP::BlockCopy: // BCOPY
+		{
+			// Copying downwards into an overlapping block starts from the end.
+			bool backward = dest > source && dest < source + count;
+			for (int done = 0; done < count; )
+			{
+				int words;
+				if (backward)
+				{
+					int destEnd = dest + count - done;
+					int sourceEnd = source + count - done;
+					words = min(count - done, min(wordsBefore(destEnd), wordsBefore(sourceEnd)));
+					int* to = &memoryRef(destEnd - words);
+					memmove(to, readPointer(sourceEnd - words), words * sizeof(int));
+				}
+				else
+				{
+					words = min(count - done, min(wordsFrom(dest + done), wordsFrom(source + done)));
+					int* to = &memoryRef(dest + done);
+					memmove(to, readPointer(source + done), words * sizeof(int));
+				}
+				done += words;
+			}
+			markDirty(dest, count);
+			break;
+		}
+		case OP::BlockFill: // BFILL
+			for (int done = 0; done < count; )
+			{
+				int words = min(count - done, wordsFrom(dest + done));
+				fill_n(&memoryRef(dest + done), words, a_accum);
+				done += words;
+			}
+			markDirty(dest, count);
+			break;
+		case OP::BlockSum: // BSUM
+		{
+			unsigned sum = 0;
+			for (int done = 0; done < count; )
+			{
+				int words = min(count - done, wordsFrom(source + done));
+				sum += sumWords(readPointer(source + done), words);
+				done += words;
+			}
+			a_accum = static_cast<int>(sum);
+			break;
+		}
+		default: // BCMP
+			a_accum = 0;
+			for (int done = 0; done < count; )
+			{
+				int words = min(count - done, min(wordsFrom(dest + done), wordsFrom(source + done)));
+				int same = countSameWords(readPointer(dest + done), readPointer(source + done), words);
+				if (same < words)
+				{
+					a_accum = done + same + 1;
+					break;
+				}
+				done += words;
+			}
+			break;
+		}
+		return true;
+	}
+
+	// Carries out a block instruction while other harts are running, a word at a time.
+	template <class FORMAT>
+	void executeSharedBlock(int a_opcode, int a_dest, int a_source, int a_count, int& a_accum)
+	{
+		typedef typename FORMAT::Opcodes OP;
+		switch (a_opcode)
+		{
+		case OP::BlockCopy: // BCOPY
+			if (a_dest > a_source && a_dest < a_source + a_count)
+			{
+				for (int i = a_count - 1; i >= 0; i--)
+				{
+					storeWord<true, FORMAT>(a_dest + i, loadWord<true, FORMAT>(a_source + i));
+				}
+			}
+			else
+			{
+				for (int i = 0; i < a_count; i++)
+				{
+					storeWord<true, FORMAT>(a_dest + i, loadWord<true, FORMAT>(a_source + i));
+				}
+			}
+			break;
+		case OP::BlockFill: // BFILL
+			for (int i = 0; i < a_count; i++)
+			{
+				storeWord<true, FORMAT>(a_dest + i, a_accum);
+			}
+			break;
+		case OP::BlockSum: // BSUM
+		{
+			unsigned sum = 0;
+			for (int i = 0; i < a_count; i++)
+			{
+				sum += static_cast<unsigned>(loadWord<true, FORMAT>(a_source + i));
+			}
+			a_accum = static_cast<int>(sum);
+			break;
+		}
+		default: // BCMP
+			a_accum = 0;
+			for (int i = 0; i < a_count; i++)
+			{
+				if (loadWord<true, FORMAT>(a_dest + i) != loadWord<true, FORMAT>(a_source + i))
+				{
+					a_accum = i + 1;
+					break;
+				}
+			}
+			break;
+		}
+	}
+
+	// Carries out BREAD or BWRITE, whose descriptors are laid out as for the other block
+	// instructions.  BREAD copies words from the device, starting at the word the source names, to
+	// memory at the destination; BWRITE copies words from memory at the source to the device,
+	// starting at the word the destination names.  A transfer that would run past the end of the
+	// device stops there, and the accumulator receives the number of words moved, so a program can
+	// read a data file without knowing its length.  Returns false if the memory range is out of
+	// bounds or the device offset is negative.
+	template <bool SHARED, class FORMAT>
+	bool executeDeviceBlock(bool a_toMemory, int a_dest, int a_source, int a_count, int& a_accum, int& a_words)
+	{
+		int location = a_toMemory ? a_dest : a_source;
+		int offset = a_toMemory ? a_source : a_dest;
+		if (a_count < 0 || offset < 0 || !isBlockInMemory(location, a_count))
+		{
+			return false;
+		}
+		int count = static_cast<int>(min<long long>(a_count, max(0LL, static_cast<long long>(m_deviceSize) - offset)));
+		a_words = count;
+		a_accum = count;
+
+		if (SHARED)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				if (a_toMemory)
+				{
+					storeWord<true, FORMAT>(location + i, sharedWord(m_device[offset + i]).load(memory_order_acquire));
+				}
+				else
+				{
+					sharedWord(m_device[offset + i]).store(loadWord<true, FORMAT>(location + i), memory_order_release);
+				}
+			}
+			return true;
+		}
+		for (int done = 0; done < count; )
+		{
+			int words = min(count - done, wordsFrom(location + done));
+			if (a_toMemory)
+			{
+				memcpy(&memoryRef(location + done), m_device + offset + done, words * sizeof(int));
+			}
+			else
+			{
+				memcpy(m_device + offset + done, readPointer(location + done), words * sizeof(int));
+			}
+			done += words;
+		}
+		if (a_toMemory)
+		{
+			markDirty(location, count);
+		}
+		return true;
+	}
+
+	// True if a_count words starting at a_location are all in memory.
+	bool isBlockInMemory(int a_location, int a_count) const
+	{
+		return a_location >= 0 && static_cast<long long>(a_location) + a_count <= m_memSize;
+	}
+
+	// Number of words from a location to the end of its page, or of memory if it is flat.
+	int wordsFrom(int a_location) const
+	{
+		return m_flat ? m_memSize - a_location : PAGESZ - a_location % PAGESZ;
+	}
+
+	// Number of words before a location back to the start of its page, or of memory if it is flat.
+	int wordsBefore(int a_end) const
+	{
+		return m_flat ? a_end : (a_end - 1) % PAGESZ + 1;
+	}
+
+	// Returns the words from a location to the end of its page for reading.  A page that was never
+	// written is read from a page of zeros rather than allocated.
+	const int* readPointer(int a_location) const
+	{
+		static const int zeros[PAGESZ] = {};
+		if (m_flat)
+		{
+			return &m_flat[a_location];
+		}
+		size_t page = a_location / PAGESZ;
+		if (page >= m_pages.size() || !m_pages[page])
+		{
+			return zeros;
+		}
+		return &m_pages[page][a_location % PAGESZ];
+	}
+
+	// Notes the blocks of a range as changed, if an image was saved.
+	void markDirty(int a_location, int a_count)
+	{
+		if (m_dirty.empty() || a_count == 0)
+		{
+			return;
+		}
+		for (int block = a_location / DIRTYSZ; block <= (a_location + a_count - 1) / DIRTYSZ; block++)
+		{
+			if (!m_dirty[block])
+			{
+				m_dirty[block] = true;
+				m_dirtyBlocks.push_back(block);
+			}
+		}
+	}
+
+	// Block kernel: the sum of a_count words, wrapping around on overflow.
+	static unsigned sumWords(const int* a_words, int a_count)
+	{
+		unsigned sum = 0;
+		int i = 0;
+#ifdef VC_BLOCK_SSE2
+		__m128i partial = _mm_setzero_si128();
+		for (; i + 4 <= a_count; i += 4)
+		{
+			partial = _mm_add_epi32(partial, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_words + i)));
+		}
+		alignas(16) unsigned lanes[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), partial);
+		sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+		for (; i < a_count; i++)
+		{
+			sum += static_cast<unsigned>(a_words[i]);
+		}
+		return sum;
+	}
+
+	// Block kernel: the number of leading words that are the same in two arrays of a_count words.
+	static int countSameWords(const int* a_first, const int* a_second, int a_count)
+	{
+		int i = 0;
+#ifdef VC_BLOCK_SSE2
+		for (; i + 4 <= a_count; i += 4)
+		{
+			__m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a_first + i)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(a_second + i)));
+			if (_mm_movemask_epi8(equal) != 0xFFFF) break;
+		}
+#endif
+		while (i < a_count && a_first[i] == a_second[i])
+		{
+			i++;
+		}
+		return i;
+	}
+
+	// Memory is allocated from the system rather than the heap, so that its pages can be protected
+	// without affecting anything else.  The system clears the words.
+	struct WordsDeleter
+	{
+		void operator()(int* a_words) const { VirtualFree(a_words, 0, MEM_RELEASE); }
+	};
+	typedef unique_ptr<int[], WordsDeleter> Words;
+
+	static Words allocateWords(int a_count)
+	{
+		void* words = VirtualAlloc(nullptr, a_count * sizeof(int), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		if (words == nullptr)
+		{
+			throw bad_alloc();
+		}
+		return Words(static_cast<int*>(words));
+	}
+
+	// Views a word of memory as an atomic, for harts running at once.
+	static atomic<int>& sharedWord(int& a_word)
+	{
+		static_assert(sizeof(atomic<int>) == sizeof(int) && ATOMIC_INT_LOCK_FREE == 2,
+			"Memory words must be usable as lock-free atomics");
+		return reinterpret_cast<atomic<int>&>(a_word);
+	}
+
+	// Returns a writable reference to a word of a machine whose words are in FORMAT.  A flat
+	// memory is indexed directly; otherwise memoryRef finds the page.
+	template <class FORMAT>
+	int& wordRef(int a_location)
+	{
+		return FORMAT::FLAT ? m_flat[a_location] : memoryRef(a_location);
+	}
+
+	// Reads a word for a hart, with an acquire load if harts are running at once.
+	template <bool SHARED, class FORMAT>
+	int loadWord(int a_location)
+	{
+		if (SHARED)
+		{
+			return sharedWord(wordRef<FORMAT>(a_location)).load(memory_order_acquire);
+		}
+		return FORMAT::FLAT ? m_flat[a_location] : readMemory(a_location);
+	}
+
+	// Writes a word for a hart, with a release store if harts are running at once.
+	template <bool SHARED, class FORMAT>
+	void storeWord(int a_location, int a_contents)
+	{
+		if (SHARED)
+		{
+			sharedWord(wordRef<FORMAT>(a_location)).store(a_contents, memory_order_release);
+			return;
+		}
+		noteWritten(a_location);
+		wordRef<FORMAT>(a_location) = a_contents;
+	}
+
+	// Reads a word.  Pages that were never written read as zero and are not allocated.
+	int readMemory(int a_location) const
+	{
+		if (m_flat)
+		{
+			return m_flat[a_location];
+		}
+		size_t page = a_location / PAGESZ;
+		if (page >= m_pages.size() || !m_pages[page])
+		{
+			return 0;
+		}
+		return m_pages[page][a_location % PAGESZ];
+	}
+
+	// Writes a word, noting its block as changed if an image was saved.
+	void writeMemory(int a_location, int a_contents)
+	{
+		noteWritten(a_location);
+		memoryRef(a_location) = a_contents;
+	}
+
+	// Notes the block of a word about to be written as changed, if an image was saved.
+	void noteWritten(int a_location)
+	{
+		if (!m_dirty.empty())
+		{
+			int block = a_location / DIRTYSZ;
+			if (!m_dirty[block])
+			{
+				m_dirty[block] = true;
+				m_dirtyBlocks.push_back(block);
+			}
+		}
+	}
+
+	// Returns a writable reference to a word, allocating its page on first use.
+	int& memoryRef(int a_location)
+	{
+		if (m_flat)
+		{
+			return m_flat[a_location];
+		}
+		size_t page = a_location / PAGESZ;
+		if (page >= m_pages.size())
+		{
+			m_pages.resize(page + 1);
+		}
+		if (!m_pages[page])
+		{
+			m_pages[page] = allocateWords(PAGESZ);
+		}
+		return m_pages[page][a_location % PAGESZ];
+	}
+
+	Words m_flat;                           // The memory of the VC370 when it fits in MEMSZ words.
+	vector<Words> m_pages;                  // Page directory of a large memory; null pages are all zero.
+	int m_memSize;                          // Number of words in the address space.
+	int m_addrDigits;                       // Width of the address field in decimal digits.
+	vector<Hart> m_harts;                   // The harts; the classic machine has one, starting at 100.
+	RunLimits m_limits = {};                // Limits on each run; none by default.
+	chrono::steady_clock::time_point m_started; // When the program was last started.
+	int* m_device = nullptr;                // The words of the block device, if one is attached.
+	int m_deviceSize = 0;                   // Number of words in the block device.
+	bool m_trapsEnabled = false;            // True while a debugger handles the trap opcode.
 
-	int m_memory[MEMSZ];    // The memory of the VC370.
-	int m_accum;		    	// The accumulator for the VC370
+	// The image saved by saveImage, and the blocks written since.
+	unique_ptr<int[]> m_savedFlat;          // Copy of the flat memory.
+	vector<unique_ptr<int[]>> m_savedPages; // Copies of the pages of a large memory; null pages were all zero.
+	vector<bool> m_dirty;                   // True for each block written since the image was saved.
+	vector<int> m_dirtyBlocks;              // The blocks written, so a reset visits only those.
 };
 
 #endif
@@ -4,6 +4,7 @@
 // Manages error reporting by collecting and displaying error messages.
 //
 #include "Errors.h"
+#include "Stats.h"
 #include "stdafx.h"
 
 using namespace std;
@@ -11,6 +12,7 @@ using namespace std;
 // Initialize static members
 vector<string> Errors::m_ErrorMsgs; // List to store error messages.
 bool Errors::m_WasErrorMessages = false; // Flag to indicate if errors were recorded.
+thread_local vector<string> *Errors::m_Capture = nullptr; // Per-thread error redirection.
 
 /*
 NAME
@@ -27,10 +29,16 @@ DESCRIPTION
     and resetting the boolean flag m_WasErrorMessages to false. It ensures that any previous errors are cleared,
     preparing the system for a new assembly process.
 
+    A thread that is capturing its errors has its capture list cleared instead.
+
 */
 
 // Initializes error reports.
 void Errors::InitErrorReporting() {
+    if (m_Capture != nullptr) {
+        m_Capture->clear();
+        return;
+    }
     // Clear the error messages list.
     if (!m_ErrorMsgs.empty()) {
         m_ErrorMsgs.clear(); // Remove all existing error messages.
@@ -54,16 +62,53 @@ DESCRIPTION
     This function adds a given error message to the vector of error messages and sets the boolean flag
     m_WasErrorMessages to true, indicating that at least one error has been recorded.
 
+    If the calling thread is capturing errors, the message goes to its capture list instead.  The owner
+    of that list decides when, and in what order, to record the messages for real.
+
 */
 
 // Records an error message.
 void Errors::RecordError(const string a_emsg) {
+    if (m_Capture != nullptr) {
+        m_Capture->push_back(a_emsg);
+        return;
+    }
     // Add the error message to the list.
     m_ErrorMsgs.push_back(a_emsg);
+    Stats::Count(Stats::C_Errors);
     // Set the error flag to true to indicate an error was recorded.
     m_WasErrorMessages = true;
 }
 
+/*
+NAME
+
+    Errors::CaptureErrors - Redirect the calling thread's errors into a private list.
+
+SYNOPSIS
+
+    vector<string> *Errors::CaptureErrors(vector<string> *a_sink)
+        vector<string> *a_sink --> List to receive the messages, or nullptr to stop capturing.
+
+DESCRIPTION
+
+    The error list is shared by the whole program and is not safe to use from several threads at once.
+    Worker threads capture their errors privately, and the thread that started them records the captured
+    messages afterwards in source order, so the report does not depend on thread scheduling.
+    Captures nest: a thread that is already capturing restores its list when it is done.
+
+RETURNS
+
+    vector<string> * - The list that was receiving the thread's errors before, or nullptr.
+*/
+
+// Redirects the calling thread's errors.
+vector<string> *Errors::CaptureErrors(vector<string> *a_sink) {
+    vector<string> *previous = m_Capture;
+    m_Capture = a_sink;
+    return previous;
+}
+
 /*
 NAME
 
@@ -77,7 +122,7 @@ DESCRIPTION
 
     This function checks if any errors have been recorded during the assembly process. It returns the value
     of the boolean flag m_WasErrorMessages, which is set to true if at least one error has been recorded,
-    and false otherwise.
+    and false otherwise.  A thread that is capturing its errors is told whether its capture list has any.
 
 RETURNS
 
@@ -87,6 +132,9 @@ RETURNS
 
 // Checks if there were any errors.
 bool Errors::WasThereErrors() {
+    if (m_Capture != nullptr) {
+        return !m_Capture->empty();
+    }
     // Return the value of the error flag.
     return m_WasErrorMessages;
 }
@@ -110,11 +158,16 @@ DESCRIPTION
 
     If no errors are found, a message is displayed indicating that the assembly process encountered no issues.
 
+    Nothing is displayed for a thread that is capturing its errors; the owner of the capture list reports them.
+
 */
 
 
 // Displays the collected error messages.
 void Errors::DisplayErrors() {
+    if (m_Capture != nullptr) {
+        return;
+    }
     // Check if there are any errors.
     if (m_WasErrorMessages) {
         cout << "Assembler encountered the following errors:" << endl;
@@ -22,6 +22,10 @@ public:
 
     static bool WasThereErrors();
 
+    // Redirects errors recorded by the calling thread into a_sink, or back to the shared list if null.
+    // Returns the list that was receiving them, so a nested capture can restore it.
+    static vector<string> *CaptureErrors(vector<string> *a_sink);
+
     // Displays the collected error messages.
     static void DisplayErrors();
 
@@ -30,6 +34,8 @@ private:
     static vector<string> m_ErrorMsgs;
     //bool that keeps track if there was an error for a line of the file.
     static bool m_WasErrorMessages;
+    //per-thread destination for errors recorded by worker threads.
+    static thread_local vector<string> *m_Capture;
 };
 
 #endif
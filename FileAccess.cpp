@@ -11,29 +11,24 @@ NAME
 
 SYNOPSIS
 
-    FileAccess::FileAccess(int argc, char *argv[])
-        int argc   --> The number of command-line arguments provided.
-        char *argv[] --> An array of strings representing the command-line arguments, including the file location.
+    FileAccess::FileAccess(const string &a_fileName)
+        const string &a_fileName --> The name of the source file, as given on the command line.
 
 DESCRIPTION
 
-    This constructor opens the specified file for reading and ensures that exactly one runtime parameter is provided.
-    It performs basic error checking to validate the correctness of the command-line arguments passed to the program.
+    This constructor opens the specified file for reading.  The command line itself is validated by the
+    Options class before the file name reaches this point.
 
 */
 
 
 // Don't forget to comment the function headers.
-FileAccess::FileAccess( int argc, char *argv[] )
+FileAccess::FileAccess( const string &a_fileName )
+    : m_source( &m_sfile ), m_spooling( false ), m_spoolEmpty( true )
 {
-    // Check that there is exactly one run time parameter.
-    if( argc != 2 ) {
-        cerr << "Usage: Assem <FileName>" << endl;
-        exit( 1 );
-    }
     // Open the file.  One might question if this is the best place to open the file.
     // One might also question whether we need a file access class.
-    m_sfile.open( argv[1], ios::in );
+    m_sfile.open( a_fileName, ios::in );
 
     // If the open failed, report the error and terminate.
     if( ! m_sfile ) {
@@ -43,6 +38,28 @@ FileAccess::FileAccess( int argc, char *argv[] )
     }
 }
 
+/*
+NAME
+
+    FileAccess::FileAccess - Constructor for FileAccess that reads from an open stream.
+
+SYNOPSIS
+
+    FileAccess::FileAccess(istream &a_source)
+        istream &a_source --> The stream holding the source.  It must outlive the FileAccess object.
+
+DESCRIPTION
+
+    This constructor lets the assembler read source that is not in a file, for example source text
+    received by the assembly service.
+
+*/
+
+FileAccess::FileAccess( istream &a_source )
+    : m_source( &a_source ), m_spooling( false ), m_spoolEmpty( true )
+{
+}
+
 /*
 NAME
 
@@ -64,6 +81,10 @@ FileAccess::~FileAccess( )
 {
     // Not that necessary in that the file will be closed when the program terminates, but good form.
     m_sfile.close( );
+    if( !m_spoolName.empty( ) ) {
+        m_spool.close( );
+        DeleteFileA( m_spoolName.c_str( ) );
+    }
 }
 
 /*
@@ -92,11 +113,20 @@ RETURNS
 bool FileAccess::GetNextLine( string &a_buff )
 {
     // If there is no more data, return false.
-    if( m_sfile.eof() ) {
+    if( m_source->eof() ) {
     
         return false;
     }
-    getline( m_sfile, a_buff );
+    getline( *m_source, a_buff );
+
+    // The line breaks go between the lines, so the copy reads back as the same lines.
+    if( m_spooling ) {
+        if( !m_spoolEmpty ) {
+            m_spool << '\n';
+        }
+        m_spool << a_buff;
+        m_spoolEmpty = false;
+    }
     
     // Return indicating success.
     return true;
@@ -121,8 +151,53 @@ DESCRIPTION
 
 void FileAccess::rewind( )
 {
+    // Read the copy from now on, if the source could not go back.
+    if( m_spooling ) {
+        m_spool.flush( );
+        m_spooling = false;
+        m_source = &m_spool;
+    }
     // Clean all file flags and go back to the beginning of the file.
-    m_sfile.clear();
-    m_sfile.seekg( 0, ios::beg );
+    m_source->clear();
+    m_source->seekg( 0, ios::beg );
+}
+
+/*
+NAME
+
+    FileAccess::EnableRewind - Make sure the source can be read again.
+
+SYNOPSIS
+
+    void FileAccess::EnableRewind()
+
+DESCRIPTION
+
+    A source that can seek needs nothing more.  For one that cannot, such as a pipe, a temporary file
+    is created and every line read from then on is copied to it, and rewind switches to reading the
+    copy.  If the temporary file cannot be created, the error is reported and the program terminates.
+
+*/
+
+void FileAccess::EnableRewind( )
+{
+    if( m_source->tellg( ) != streampos( -1 ) ) {
+        return;
+    }
+    m_source->clear( );
+
+    char directory[MAX_PATH];
+    char name[MAX_PATH];
+    if( GetTempPathA( MAX_PATH, directory ) == 0 || GetTempFileNameA( directory, "vcs", 0, name ) == 0 ) {
+        cerr << "Could not create a file to spool the source, assembler terminated." << endl;
+        exit( 1 );
+    }
+    m_spoolName = name;
+    m_spool.open( m_spoolName, ios::in | ios::out | ios::trunc );
+    if( !m_spool ) {
+        cerr << "Could not create a file to spool the source, assembler terminated." << endl;
+        exit( 1 );
+    }
+    m_spooling = true;
 }
     
@@ -13,7 +13,10 @@ class FileAccess {
 public:
 
     // Opens the file.
-    FileAccess( int argc, char *argv[] );
+    FileAccess( const string &a_fileName );
+
+    // Reads the source from a stream that is already open, such as source text held in memory.
+    FileAccess( istream &a_source );
 
     // Closes the file.
     ~FileAccess( );
@@ -24,9 +27,18 @@ public:
     // Put the file pointer back to the beginning of the file.
     void rewind( );
 
+    // Makes sure rewind can go back to the beginning of a source that cannot seek, such as a pipe,
+    // by copying the lines read from now on to a temporary file.  Call it before reading.
+    void EnableRewind( );
+
 private:
 
     ifstream m_sfile;		// Source file object.
+    istream *m_source;      // The stream the source is read from: m_sfile or one supplied by the caller.
+    fstream m_spool;        // Copy of the lines read from a source that cannot seek, if EnableRewind made one.
+    string m_spoolName;     // Name of the temporary file holding the copy.
+    bool m_spooling;        // True while the lines read are being copied to m_spool.
+    bool m_spoolEmpty;      // True until the first line is copied.
 };
 #endif
 
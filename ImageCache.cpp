@@ -0,0 +1,382 @@
+// ImageCache.cpp
+//
+// Implementation of the ImageCache class.
+// Each program is kept in its own file in the cache directory, named by a hash of the program's
+// source, the assembler version and the options that affect the translation.  A file holds a
+// header, the words of the program and the assembler's output, so a program found in the cache
+// is loaded by mapping its file, without assembling it.
+//
+// Several processes may use the same directory at once.  Images are written to a private file
+// and renamed into place, so a reader sees a whole image or none, and an image that is deleted
+// while another process has it mapped stays readable until that process is done with it.
+//
+#include "stdafx.h"
+#include "ImageCache.h"
+#include "Assembler.h"
+#include "Errors.h"
+
+#include <tuple>
+
+/*
+NAME
+
+    ImageCache::ImageCache - Constructor for the ImageCache class.
+
+SYNOPSIS
+
+    ImageCache::ImageCache(const string& a_dir)
+        const string& a_dir --> The cache directory.
+
+DESCRIPTION
+
+    This constructor creates the cache directory if it does not exist yet.
+
+*/
+
+ImageCache::ImageCache(const string& a_dir)
+    : m_dir(a_dir), m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr), m_view(nullptr), m_header(nullptr),
+    m_words(nullptr)
+{
+    m_key[0] = m_key[1] = 0;
+    CreateDirectoryA(m_dir.c_str(), nullptr);
+}
+
+ImageCache::~ImageCache()
+{
+    Unmap();
+}
+
+/*
+NAME
+
+    ImageCache::Lookup - Find the image of a program.
+
+SYNOPSIS
+
+    bool ImageCache::Lookup(const Options& a_opts, const string& a_source)
+        const Options& a_opts   --> The options the program is assembled with.
+        const string& a_source  --> The source text of the program.
+
+DESCRIPTION
+
+    This function hashes the source, the assembler version and the options that change the
+    translation into the key of the program, and maps the image file with that key if there is
+    one.  The image is marked as recently used so that it is among the last to be evicted.  The
+    key is kept for a following Store.
+
+RETURNS
+
+    bool - True if the image was found.  An incomplete or outdated image file is not used.
+*/
+
+bool ImageCache::Lookup(const Options& a_opts, const string& a_source)
+{
+    Unmap();
+    m_buffer.clear();
+    m_header = nullptr;
+
+    // Two FNV-1a hashes with different starting values make a 128 bit key.
+    const uint64_t prime = 0x100000001b3ull;
+    m_key[0] = 0xcbf29ce484222325ull;
+    m_key[1] = 0x84222325cbf29ce4ull;
+    string signature = "VCIMAGE " + to_string(Assembler::VERSION) + " " + to_string(a_opts.GetMemorySize()) +
+        " " + to_string(a_opts.GetOptimize()) + to_string(a_opts.GetMergeConstants()) + " " + to_string(a_source.size()) + "\n";
+    const string* texts[] = { &signature, &a_source };
+    for (const string* text : texts) {
+        for (unsigned char c : *text) {
+            m_key[0] = (m_key[0] ^ c) * prime;
+            m_key[1] = (m_key[1] ^ c) * prime;
+        }
+    }
+
+    ostringstream name;
+    name << hex << setfill('0') << setw(16) << m_key[0] << setw(16) << m_key[1];
+    m_path = m_dir + "\\" + name.str() + ".img";
+
+    m_file = CreateFileA(m_path.c_str(), GENERIC_READ | FILE_WRITE_ATTRIBUTES,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(Header))) {
+        Unmap();
+        return false;
+    }
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping != nullptr) {
+        m_view = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (m_view == nullptr || !Attach(static_cast<const char*>(m_view), size.QuadPart)) {
+        Unmap();
+        return false;
+    }
+
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    SetFileTime(m_file, nullptr, nullptr, &now);
+    return true;
+}
+
+/*
+NAME
+
+    ImageCache::Store - Add a program to the cache.
+
+SYNOPSIS
+
+    void ImageCache::Store(const string a_sections[SECTIONCOUNT], const ObjectModule& a_module, bool a_write)
+        const string a_sections[SECTIONCOUNT] --> The assembler's output, by section.
+        const ObjectModule& a_module          --> The words of the program.
+        bool a_write                          --> False to keep the image for this run only.
+
+DESCRIPTION
+
+    This function builds the image of the program last looked up and writes it to the cache, then
+    evicts old images if the cache has grown too large.  If another process stores the same program
+    at the same time, either copy may be kept; they are the same.  Failing to write the image only
+    means the program will be assembled again next time, so it is not an error.  A program that
+    includes other files is not written, since its key covers only its own source text and the
+    included files may change.
+
+*/
+
+void ImageCache::Store(const string a_sections[SECTIONCOUNT], const ObjectModule& a_module, bool a_write)
+{
+    Unmap();
+
+    Header header = {};
+    memcpy(header.magic, "VCIMAGE", sizeof(header.magic));
+    header.format = FORMAT;
+    header.wordCount = static_cast<uint32_t>(a_module.GetWords().size());
+    header.key[0] = m_key[0];
+    header.key[1] = m_key[1];
+    for (int s = 0; s < SECTIONCOUNT; s++) {
+        header.sectionSize[s] = a_sections[s].size();
+    }
+
+    m_buffer.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& word : a_module.GetWords()) {
+        int32_t pair[2] = { word.location, word.contents };
+        m_buffer.append(reinterpret_cast<const char*>(pair), sizeof(pair));
+    }
+    for (int s = 0; s < SECTIONCOUNT; s++) {
+        m_buffer += a_sections[s];
+    }
+    Attach(m_buffer.data(), m_buffer.size());
+    if (!a_write) {
+        return;
+    }
+
+    string temp = m_path + "." + to_string(GetCurrentProcessId()) + "-" + to_string(GetCurrentThreadId()) + ".tmp";
+    HANDLE file = CreateFileA(temp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    DWORD written = 0;
+    bool ok = WriteFile(file, m_buffer.data(), static_cast<DWORD>(m_buffer.size()), &written, nullptr) &&
+        written == m_buffer.size();
+    CloseHandle(file);
+    if (!ok || !MoveFileExA(temp.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileA(temp.c_str());
+        return;
+    }
+    Evict();
+}
+
+/*
+NAME
+
+    ImageCache::Attach - Point the view at an image.
+
+SYNOPSIS
+
+    bool ImageCache::Attach(const char* a_data, uint64_t a_size)
+        const char* a_data --> The image, mapped or in memory.
+        uint64_t a_size    --> Its size in bytes.
+
+DESCRIPTION
+
+    This function checks that the bytes hold an image in the current format for the key last
+    looked up, with nothing missing or left over, and locates its words and sections.
+
+RETURNS
+
+    bool - True if the image is usable.
+*/
+
+bool ImageCache::Attach(const char* a_data, uint64_t a_size)
+{
+    const Header* header = reinterpret_cast<const Header*>(a_data);
+    if (a_size < sizeof(Header) || memcmp(header->magic, "VCIMAGE", sizeof(header->magic)) != 0 ||
+        header->format != FORMAT || header->key[0] != m_key[0] || header->key[1] != m_key[1]) {
+        return false;
+    }
+    uint64_t expected = sizeof(Header) + uint64_t(header->wordCount) * 2 * sizeof(int32_t);
+    for (int s = 0; s < SECTIONCOUNT; s++) {
+        if (header->sectionSize[s] > a_size) {
+            return false;
+        }
+        expected += header->sectionSize[s];
+    }
+    if (expected != a_size) {
+        return false;
+    }
+
+    m_header = header;
+    m_words = reinterpret_cast<const int32_t*>(a_data + sizeof(Header));
+    const char* section = reinterpret_cast<const char*>(m_words + 2 * header->wordCount);
+    for (int s = 0; s < SECTIONCOUNT; s++) {
+        m_sections[s] = section;
+        section += header->sectionSize[s];
+    }
+    return true;
+}
+
+/*
+NAME
+
+    ImageCache::Unmap - Release the mapped image file.
+
+SYNOPSIS
+
+    void ImageCache::Unmap()
+
+DESCRIPTION
+
+    This function unmaps and closes the image file found by the last lookup, if there is one.
+
+*/
+
+void ImageCache::Unmap()
+{
+    if (m_view != nullptr) {
+        UnmapViewOfFile(m_view);
+        m_view = nullptr;
+    }
+    if (m_mapping != nullptr) {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+    m_header = nullptr;
+}
+
+/*
+NAME
+
+    ImageCache::Evict - Keep the cache within its size limit.
+
+SYNOPSIS
+
+    void ImageCache::Evict() const
+
+DESCRIPTION
+
+    If the images in the cache directory take more than MAXCACHEBYTES, this function deletes the
+    least recently used ones until they fit.  Images are marked used when they are looked up.
+    Another process may be evicting at the same time, so an image that is already gone is simply
+    counted as deleted.
+
+*/
+
+void ImageCache::Evict() const
+{
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA((m_dir + "\\*.img").c_str(), &found);
+    if (search == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    // Last use, size and name of each image.
+    vector<tuple<uint64_t, uint64_t, string>> images;
+    uint64_t total = 0;
+    do {
+        uint64_t used = (uint64_t(found.ftLastWriteTime.dwHighDateTime) << 32) | found.ftLastWriteTime.dwLowDateTime;
+        uint64_t size = (uint64_t(found.nFileSizeHigh) << 32) | found.nFileSizeLow;
+        images.emplace_back(used, size, found.cFileName);
+        total += size;
+    } while (FindNextFileA(search, &found));
+    FindClose(search);
+
+    sort(images.begin(), images.end());
+    for (const auto& image : images) {
+        if (total <= MAXCACHEBYTES) break;
+        DeleteFileA((m_dir + "\\" + get<2>(image)).c_str());
+        total -= get<1>(image);
+    }
+}
+
+/*
+NAME
+
+    ImageCache::WriteSection - Write part of the assembler's output.
+
+SYNOPSIS
+
+    void ImageCache::WriteSection(Section a_section, ostream& a_out) const
+        Section a_section --> The part to write.
+        ostream& a_out    --> Receives it.
+
+DESCRIPTION
+
+    This function writes a section of the image found or stored, exactly as the assembler produced it.
+
+*/
+
+void ImageCache::WriteSection(Section a_section, ostream& a_out) const
+{
+    a_out.write(m_sections[a_section], static_cast<streamsize>(m_header->sectionSize[a_section]));
+}
+
+/*
+NAME
+
+    ImageCache::RecordErrors - Record the errors of the cached assembly.
+
+SYNOPSIS
+
+    void ImageCache::RecordErrors() const
+
+DESCRIPTION
+
+    This function records the error messages kept with the image, so that they are reported just as
+    if the program had been assembled.
+
+*/
+
+void ImageCache::RecordErrors() const
+{
+    istringstream errors(string(m_sections[S_Errors], static_cast<size_t>(m_header->sectionSize[S_Errors])));
+    string emsg;
+    while (getline(errors, emsg)) {
+        Errors::RecordError(emsg);
+    }
+}
+
+/*
+NAME
+
+    ImageCache::LoadImage - Load the program into the emulator.
+
+SYNOPSIS
+
+    void ImageCache::LoadImage(emulator& a_emul) const
+        emulator& a_emul --> Receives the words.
+
+DESCRIPTION
+
+    This function stores the words of the image in the emulator's memory.  Any messages the
+    emulator had about them were kept as the diagnostics section, so they are not repeated.
+
+*/
+
+void ImageCache::LoadImage(emulator& a_emul) const
+{
+    ostringstream repeated;
+    for (uint32_t i = 0; i < m_header->wordCount; i++) {
+        a_emul.insertMemory(m_words[2 * i], m_words[2 * i + 1], repeated);
+    }
+}
@@ -0,0 +1,79 @@
+//
+//		ImageCache class.  A cache of assembled programs on disk, shared by every process
+//		that assembles with the same cache directory, so unchanged programs are not assembled again.
+//
+#pragma once
+
+#include "Options.h"
+#include "ObjectModule.h"
+#include "Emulator.h"
+#include "stdafx.h"
+
+#include <cstdint>
+
+class ImageCache {
+
+public:
+    // The parts of the assembler's output kept with each program.
+    enum Section {
+        S_SymbolTable,      // The symbol table display.
+        S_Listing,          // The translation listing.
+        S_Diagnostics,      // Messages from the emulator while loading the words.
+        S_Errors,           // Error messages, one per line.
+        SECTIONCOUNT
+    };
+
+    // Images are kept in a_dir, which is created if it does not exist.
+    ImageCache(const string& a_dir);
+    ~ImageCache();
+
+    // Finds the image of a program assembled with the given options.  Returns false if there is none.
+    bool Lookup(const Options& a_opts, const string& a_source);
+
+    // Adds the image of the program last looked up.  The image is available even if it cannot be
+    // written, or if a_write is false because the source text alone does not determine the program.
+    void Store(const string a_sections[SECTIONCOUNT], const ObjectModule& a_module, bool a_write = true);
+
+    // Using the image found or stored.
+    void WriteSection(Section a_section, ostream& a_out) const;    // Writes a part of the output.
+    void RecordErrors() const;                                      // Records the errors again.
+    void LoadImage(emulator& a_emul) const;                         // Loads the words into the emulator.
+
+private:
+    // The start of every cached image.  The words follow as location and contents pairs, then the sections.
+    struct Header {
+        char magic[8];                      // Identifies an image file.
+        uint32_t format;                    // Layout of the file.
+        uint32_t wordCount;                 // Number of words.
+        uint64_t key[2];                    // Hash of the source, the assembler version and the options.
+        uint64_t sectionSize[SECTIONCOUNT]; // Bytes in each section.
+    };
+
+    // Checks that a_size bytes at a_data are a complete image for the current key and points the view at them.
+    bool Attach(const char* a_data, uint64_t a_size);
+
+    // Releases the mapped file, if any.
+    void Unmap();
+
+    // Deletes the least recently used images until the cache is within its size limit.
+    void Evict() const;
+
+    // Layout of the image files.  Images written with another layout are ignored.
+    const static uint32_t FORMAT = 1;
+
+    // Most bytes of images kept in the cache directory.
+    const static uint64_t MAXCACHEBYTES = 64ull << 20;
+
+    string m_dir;               // The cache directory.
+    uint64_t m_key[2];          // Key of the program last looked up.
+    string m_path;              // Its image file.
+
+    HANDLE m_file;              // The mapped image file, if the image came from the cache.
+    HANDLE m_mapping;           // Its file mapping.
+    const void* m_view;         // The mapped view of the file.
+    string m_buffer;            // The image, if it was stored rather than found.
+
+    const Header* m_header;     // The image found or stored, wherever it is.
+    const int32_t* m_words;     // Its words.
+    const char* m_sections[SECTIONCOUNT]; // Its sections.
+};
@@ -8,6 +8,8 @@
 #include "Errors.h"
 #include "stdafx.h"
 
+#include <cerrno>
+
 /*
 NAME
 
@@ -35,6 +37,7 @@ Instruction::Instruction()
     m_NumOpCode = 0;
     m_type = ST_Invalid;
     m_IsNumericOperand = false;
+    m_IsLiteralOperand = false;
     m_OperandNumValue = 0;
 }
 
@@ -63,38 +66,76 @@ Instruction::~Instruction()
 /*
 NAME
 
-    trim - Helper function to remove leading and trailing whitespace.
+    splitTokens - Helper function to find the whitespace separated tokens of a line.
 
 SYNOPSIS
 
-    static std::string trim(const std::string &str)
-        const std::string &str --> The input string to be trimmed.
+    static int splitTokens(const string& a_buff, size_t a_end, size_t a_start[], size_t a_length[], int a_max)
+        const string& a_buff --> The line.
+        size_t a_end         --> Where the part of the line to split ends, such as at a comment.
+        size_t a_start[]     --> Receives the position of each token.
+        size_t a_length[]    --> Receives the length of each token.
+        int a_max            --> Most tokens to find.  Any further tokens are ignored.
 
 DESCRIPTION
 
-    This function removes any leading and trailing whitespace characters (including spaces, tabs, carriage
-    returns, and newline characters) from the input string. If the input string contains only whitespace,
-    an empty string is returned.
+    This function splits the line where an input stream would, but records where the tokens are
+    rather than copying them, so that parsing a line allocates nothing.
 
 RETURNS
 
-    std::string - A new string with leading and trailing whitespace removed.
-
+    int - The number of tokens found.
 */
 
-// Helper function to trim whitespace
-static string trim(const string& str) {
-    // Find the first and last non-whitespace characters.
-    size_t start = str.find_first_not_of(" \t\r\n");
-    size_t end = str.find_last_not_of(" \t\r\n");
-
-    // If no non-whitespace characters are found, return an empty string.
-    if (start == string::npos || end == string::npos) {
-        return "";
+static int splitTokens(const string& a_buff, size_t a_end, size_t a_start[], size_t a_length[], int a_max)
+{
+    int count = 0;
+    size_t pos = 0;
+    while (count < a_max) {
+        while (pos < a_end && isspace(static_cast<unsigned char>(a_buff[pos]))) pos++;
+        if (pos == a_end) break;
+
+        a_start[count] = pos;
+        while (pos < a_end && !isspace(static_cast<unsigned char>(a_buff[pos]))) pos++;
+        a_length[count] = pos - a_start[count];
+        count++;
     }
+    return count;
+}
+
+/*
+NAME
+
+    parseNumber - Helper function to read a number at the start of a string.
+
+SYNOPSIS
+
+    static bool parseNumber(const char* a_text, int& a_value, const char** a_rest)
+        const char* a_text  --> The text.
+        int& a_value        --> Receives the number.
+        const char** a_rest --> Receives where the number ends.
+
+DESCRIPTION
+
+    This function accepts what stoi accepts, but reports failure by its result rather than by
+    throwing, since most operands are labels and an exception for each would be costly.
 
-    // Return the trimmed string.
-    return str.substr(start, end - start + 1);
+RETURNS
+
+    bool - True if the text starts with a number that fits in an int.
+*/
+
+static bool parseNumber(const char* a_text, int& a_value, const char** a_rest)
+{
+    char* rest;
+    errno = 0;
+    long value = strtol(a_text, &rest, 10);
+    if (rest == a_text || errno == ERANGE || value < INT_MIN || value > INT_MAX) {
+        return false;
+    }
+    a_value = static_cast<int>(value);
+    *a_rest = rest;
+    return true;
 }
 
 /*
@@ -104,8 +145,8 @@ NAME
 
 SYNOPSIS
 
-    Instruction::InstructionType Instruction::ParseInstruction(std::string a_buff)
-        std::string a_buff --> Unprocessed line of code from the file.
+    Instruction::InstructionType Instruction::ParseInstruction(const string& a_buff)
+        const string& a_buff --> Unprocessed line of code from the file.
 
 DESCRIPTION
 
@@ -113,8 +154,12 @@ DESCRIPTION
     or machine instruction). It extracts relevant details such as the label, opcode, and operand, and stores
     them in the corresponding member variables of the Instruction object.
 
-    The function also removes comments and trims whitespace from the line to process it accurately. If the
-    operand is numeric, it sets a flag and records its numeric value.
+    The function ignores any comment and the whitespace around the tokens. If the operand is numeric, it
+    sets a flag and records its numeric value.
+
+    The tokens are found in place and copied into the members, which keep their storage from line to
+    line, so once an Instruction has parsed a few lines, parsing another allocates nothing unless it
+    records an error.
 
 RETURNS
 
@@ -122,92 +167,58 @@ RETURNS
 */
 
 // Parse a line of assembly code
-Instruction::InstructionType Instruction::ParseInstruction(string a_buff)
+Instruction::InstructionType Instruction::ParseInstruction(const string& a_buff)
 {
+    // List of valid opcodes.
+    static const vector<string> opcodes = { "READ", "LOAD", "STORE", "WRITE", "BP", "HALT", "FAA", "CAS",
+        "BCOPY", "BFILL", "BSUM", "BCMP", "BREAD", "BWRITE", "ORG", "DC", "DS", "END", "EXTERN", "PUBLIC", "ENTRY", "INCLUDE" };
+
     // Clear all previous data for a fresh start.
-    m_Label = "";
-    m_OpCode = "";
-    m_Operand = "";
+    m_Label.clear();
+    m_OpCode.clear();
+    m_Operand.clear();
     m_instruction = a_buff;
     m_NumOpCode = 0;
     m_type = ST_Invalid;
     m_IsNumericOperand = false;
+    m_IsLiteralOperand = false;
     m_OperandNumValue = 0;
 
-    // Remove any comments from the line.
+    // Split the line, up to any comment, into its tokens.
     size_t commentPos = a_buff.find(';');
-    string line = (commentPos != string::npos) ? a_buff.substr(0, commentPos) : a_buff;
-
-    // Trim spaces from the line.
-    line = trim(line);
+    size_t start[3], length[3];
+    int tokens = splitTokens(a_buff, commentPos != string::npos ? commentPos : a_buff.size(), start, length, 3);
 
     // If the line is empty, it's a comment.
-    if (line.empty()) {
+    if (tokens == 0) {
         m_type = ST_Comment;
         return m_type;
     }
 
-    // Use a stringstream to split the line into parts.
-    istringstream iss(line);
-    string firstToken, secondToken, thirdToken;
-
-    iss >> firstToken;
-
-    // List of valid opcodes.
-    vector<string> opcodes = { "READ", "LOAD", "STORE", "WRITE", "BP", "HALT", "ORG", "DC", "DS", "END" };
-
-    // Convert the first token to uppercase for comparison.
-    string firstTokenUpper = firstToken;
-    transform(firstTokenUpper.begin(), firstTokenUpper.end(), firstTokenUpper.begin(), ::toupper);
-
-    // Check if the first token is an opcode.
-    if (find(opcodes.begin(), opcodes.end(), firstTokenUpper) != opcodes.end()) {
-        // It's an opcode. Determine the type of instruction.
-        if (firstTokenUpper == "END") {
-            m_type = ST_End;
+    // Check if the first token, in uppercase, is an opcode.  If not, it is a label and the opcode follows.
+    m_OpCode.assign(a_buff, start[0], length[0]);
+    transform(m_OpCode.begin(), m_OpCode.end(), m_OpCode.begin(), ::toupper);
+    int opcodeToken = 0;
+    if (find(opcodes.begin(), opcodes.end(), m_OpCode) == opcodes.end()) {
+        m_Label.assign(a_buff, start[0], length[0]);
+        if (tokens < 2) {
+            // If no opcode follows the label, it's invalid.
+            m_OpCode.clear();
+            m_type = ST_Invalid;
+            Errors::RecordError("Missing opcode after label: " + m_Label);
+            return m_type;
         }
-        else if (firstTokenUpper == "ORG" || firstTokenUpper == "DC" || firstTokenUpper == "DS") {
-            m_type = ST_AssemblerInstr;
-        }
-        else {
-            m_type = ST_MachineLanguage;
-        }
-        m_OpCode = firstTokenUpper;
-
-        // Check if there's an operand.
-        if (iss >> secondToken) {
-            m_Operand = secondToken;
-            try {
-                // Try to convert the operand to a numeric value.
-                m_OperandNumValue = stoi(m_Operand);
-                m_IsNumericOperand = true;
-            }
-            catch (...) {
-                // If conversion fails, the operand is not numeric.
-                m_IsNumericOperand = false;
-            }
-        }
-        return m_type;
-    }
-
-    // If the first token is not an opcode, treat it as a label.
-    m_Label = firstToken;
-    if (!(iss >> secondToken)) {
-        // If no opcode follows the label, it's invalid.
-        m_type = ST_Invalid;
-        Errors::RecordError("Missing opcode after label: " + m_Label);
-        return m_type;
+        opcodeToken = 1;
+        m_OpCode.assign(a_buff, start[1], length[1]);
+        transform(m_OpCode.begin(), m_OpCode.end(), m_OpCode.begin(), ::toupper);
     }
 
-    // Process the second token as the opcode.
-    string secondTokenUpper = secondToken;
-    transform(secondTokenUpper.begin(), secondTokenUpper.end(), secondTokenUpper.begin(), ::toupper);
-    m_OpCode = secondTokenUpper;
-
+    // Determine the type of instruction.
     if (m_OpCode == "END") {
         m_type = ST_End;
     }
-    else if (m_OpCode == "ORG" || m_OpCode == "DC" || m_OpCode == "DS") {
+    else if (m_OpCode == "ORG" || m_OpCode == "DC" || m_OpCode == "DS" ||
+        m_OpCode == "EXTERN" || m_OpCode == "PUBLIC" || m_OpCode == "ENTRY" || m_OpCode == "INCLUDE") {
         m_type = ST_AssemblerInstr;
     }
     else {
@@ -215,22 +226,70 @@ Instruction::InstructionType Instruction::ParseInstruction(string a_buff)
     }
 
     // Check if there's an operand.
-    if (iss >> thirdToken) {
-        m_Operand = thirdToken;
-        try {
-            // Try to convert the operand to a numeric value.
-            m_OperandNumValue = stoi(m_Operand);
-            m_IsNumericOperand = true;
+    if (tokens > opcodeToken + 1) {
+        SetOperand(a_buff, start[opcodeToken + 1], length[opcodeToken + 1]);
+    }
+
+    // The lines of an included file take the place of the directive, so it has nothing to label.
+    if (m_OpCode == "INCLUDE") {
+        if (!m_Label.empty()) {
+            Errors::RecordError("INCLUDE cannot have a label: " + m_Label);
         }
-        catch (...) {
-            // If conversion fails, the operand is not numeric.
-            m_IsNumericOperand = false;
+        if (m_Operand.empty()) {
+            Errors::RecordError("Missing file name for INCLUDE.");
         }
     }
-
     return m_type;
 }
 
+/*
+NAME
+
+    Instruction::SetOperand - Record the operand of the instruction.
+
+SYNOPSIS
+
+    void Instruction::SetOperand(const string& a_buff, size_t a_pos, size_t a_length)
+        const string& a_buff --> The line.
+        size_t a_pos         --> Where the operand starts in it.
+        size_t a_length      --> Length of the operand.  The opcode must already be set.
+
+DESCRIPTION
+
+    This function records the operand and its numeric value, if it has one.  An operand of the form
+    =N is a literal: the assembler places the constant N in the literal pool after the program and
+    the instruction addresses that word.  A literal is written as its decimal value, so =05 and =5
+    name the same pool entry.  Only LOAD and WRITE may take a literal, since the pool is shared and
+    must not be written or executed.
+
+*/
+
+void Instruction::SetOperand(const string& a_buff, size_t a_pos, size_t a_length)
+{
+    m_Operand.assign(a_buff, a_pos, a_length);
+    const char* rest;
+    if (m_Operand[0] == '=') {
+        if (!parseNumber(m_Operand.c_str() + 1, m_OperandNumValue, &rest) || *rest != '\0') {
+            Errors::RecordError("Invalid literal: " + m_Operand);
+            m_OperandNumValue = 0;
+            return;
+        }
+        char text[16];
+        snprintf(text, sizeof(text), "=%d", m_OperandNumValue);
+        m_Operand = text;
+        m_IsLiteralOperand = true;
+        if (m_OpCode != "LOAD" && m_OpCode != "WRITE") {
+            Errors::RecordError("A literal cannot be the operand of " + m_OpCode + ".");
+        }
+        return;
+    }
+    // The operand is numeric if it starts with a number, as stoi would read it.
+    m_IsNumericOperand = parseNumber(m_Operand.c_str(), m_OperandNumValue, &rest);
+    if (!m_IsNumericOperand) {
+        m_OperandNumValue = 0;
+    }
+}
+
 /*
 NAME
 
@@ -291,6 +350,68 @@ int Instruction::LocationNextInstruction(int a_loc)
 }
 
 
+/*
+NAME
+
+    Instruction::LocationEffect - Describe how the instruction moves the location counter.
+
+SYNOPSIS
+
+    bool Instruction::LocationEffect(bool& a_isSet, int& a_value) const
+        bool& a_isSet --> Set to true if the instruction sets the location counter to a_value,
+                          false if it advances the location counter by a_value.
+        int& a_value  --> The new location or the increment.
+
+DESCRIPTION
+
+    This function expresses the effect of the instruction on the location counter independently of
+    the current location.  Effects of consecutive lines compose (an increment after an increment adds,
+    anything followed by an ORG is that ORG), which lets Pass I compute the locations of a block of
+    lines before the location at the start of the block is known.
+
+    A DS with an invalid size advances by one slot and an ORG with an invalid operand leaves the
+    location unchanged, matching Pass I.  In both cases the function returns false so the caller can
+    report the error once the location of the line is known.
+
+RETURNS
+
+    bool - False if the operand of a DS or ORG directive is invalid, true otherwise.
+*/
+
+bool Instruction::LocationEffect(bool& a_isSet, int& a_value) const
+{
+    a_isSet = false;
+    a_value = 0;
+
+    if (m_type == ST_MachineLanguage) {
+        a_value = 1;
+    }
+    else if (m_type == ST_AssemblerInstr) {
+        if (m_OpCode == "DC") {
+            a_value = 1;
+        }
+        else if (m_OpCode == "DS") {
+            try {
+                a_value = stoi(m_Operand);
+            }
+            catch (...) {
+                a_value = 1;
+                return false;
+            }
+        }
+        else if (m_OpCode == "ORG") {
+            try {
+                a_value = stoi(m_Operand);
+                a_isSet = true;
+            }
+            catch (...) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 /*
 NAME
 
@@ -345,20 +466,21 @@ NAME
 
 SYNOPSIS
 
-    std::string Instruction::GetOpCode() const
+    const std::string& Instruction::GetOpCode() const
 
 DESCRIPTION
 
     This function returns the opcode of the current instruction. The opcode represents the operation
-    to be performed by the instruction, typically stored in the m_OpCode member variable.
+    to be performed by the instruction, typically stored in the m_OpCode member variable.  The
+    reference is valid until the next line is parsed.
 
 RETURNS
 
-    std::string - A string representing the opcode of the instruction.
+    const std::string& - A string representing the opcode of the instruction.
 */
 
 
-string Instruction::GetOpCode() const {
+const string& Instruction::GetOpCode() const {
     return m_OpCode;
 }
 
@@ -369,19 +491,20 @@ NAME
 
 SYNOPSIS
 
-    std::string Instruction::GetOperand() const
+    const std::string& Instruction::GetOperand() const
 
 DESCRIPTION
 
     This function returns the operand of the current instruction. The operand is an argument
     or data value associated with the instruction, typically stored in the m_Operand member variable.
+    The reference is valid until the next line is parsed.
 
 RETURNS
 
-    std::string - A string representing the operand of the instruction.
+    const std::string& - A string representing the operand of the instruction.
 */
 
-string Instruction::GetOperand() const {
+const string& Instruction::GetOperand() const {
     return m_Operand;
 }
 
@@ -432,3 +555,27 @@ RETURNS
 int Instruction::GetOperandNumValue() const {
     return m_OperandNumValue;
 }
+
+/*
+NAME
+
+    Instruction::IsLiteralOperand - Check if the operand is a literal.
+
+SYNOPSIS
+
+    bool Instruction::IsLiteralOperand() const
+
+DESCRIPTION
+
+    This function determines whether the operand is a valid literal of the form =N, whose constant
+    is then given by GetOperandNumValue.  The operand of such an instruction names its entry in the
+    literal pool.
+
+RETURNS
+
+    bool - True if the operand is a literal, false otherwise.
+*/
+
+bool Instruction::IsLiteralOperand() const {
+    return m_IsLiteralOperand;
+}
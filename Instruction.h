@@ -24,24 +24,31 @@ public:
     };
 
     // Parses the given instruction string and identifies its type.
-    InstructionType ParseInstruction(string a_buff);
+    InstructionType ParseInstruction(const string& a_buff);
 
     // Computes the memory location of the next instruction based on the current location.
     int LocationNextInstruction(int a_loc);
 
+    // Reports how the instruction moves the location counter without knowing the current location.
+    bool LocationEffect(bool& a_isSet, int& a_value) const;
+
     // Accessors
     string& GetLabel();                // Retrieves the label of the instruction.
     bool isLabel() const;              // Checks if the instruction contains a label.
-    string GetOpCode() const;          // Retrieves the operation code.
-    string GetOperand() const;         // Retrieves the operand.
+    const string& GetOpCode() const;   // Retrieves the operation code.
+    const string& GetOperand() const;  // Retrieves the operand.
     bool IsNumericOperand() const;     // Checks if the operand is numeric.
     int GetOperandNumValue() const;    // Retrieves the numeric value of the operand if applicable.
+    bool IsLiteralOperand() const;     // Checks if the operand is a literal (=N).
 
 private:
 
     // Helper method to parse and extract label, opcode, and operand from an instruction string.
     void GetLabelOpcodeEtc(const string& a_buff);
 
+    // Records the operand found at a_pos in a_buff and works out its value, once the opcode is known.
+    void SetOperand(const string& a_buff, size_t a_pos, size_t a_length);
+
     // The components of an instruction.
     string m_Label;         // The label part of the instruction, if any.
     string m_OpCode;        // The symbolic operation code.
@@ -54,5 +61,18 @@ private:
     InstructionType m_type;      // The type/category of the instruction.
 
     bool m_IsNumericOperand;     // True if the operand is a numeric value.
+    bool m_IsLiteralOperand;     // True if the operand is a literal (=N).
     int m_OperandNumValue;       // The numeric value of the operand, if applicable.
 };
+
+// Struct to hold the intermediate representation of each line of assembly code.
+struct IntermediateInstruction {
+    Instruction::InstructionType type; // The type of instruction (e.g., machine language, assembler directive).
+    string label;                     // Label associated with the instruction, if any.
+    string opcode;                    // The operation code of the instruction.
+    string operand;                   // Operand for the instruction, if any.
+    int location;                     // Memory location of the instruction.
+    string originalLine;              // The original line of assembly code for reference.
+    const string* includeFile = nullptr; // The file the line was included from, or null for a line of the source.
+    int includeLine = 0;              // Its line number in that file, counting from one.
+};
@@ -0,0 +1,875 @@
+// LanguageServer.cpp
+//
+// Implementation of the LanguageServer class.
+// Messages are JSON-RPC, each preceded by a Content-Length header, as the Language Server Protocol
+// specifies.  The server supports:
+//
+//      initialize, shutdown, exit
+//      textDocument/didOpen, didChange (whole or incremental), didClose
+//      textDocument/definition, textDocument/references, textDocument/documentSymbol
+//      textDocument/publishDiagnostics, sent after every change
+//
+// Each document is indexed when it is opened: every line is parsed by Instruction, and the
+// positions of the definitions, declarations and references of each symbol are kept in order.
+// A change parses only the lines it replaces, and moves the positions after them if the number of
+// lines changed, so the index stays current without assembling the document again.  Queries are
+// a lookup of the symbol under the cursor.
+//
+// Columns are counted in characters.  The protocol counts UTF-16 code units, which is the same for
+// the ASCII text of VC programs.
+//
+#include "stdafx.h"
+#include "LanguageServer.h"
+#include "Errors.h"
+
+#include <fcntl.h>
+#include <io.h>
+
+// A parsed JSON value.
+struct JsonValue {
+    enum Kind { J_Null, J_Bool, J_Number, J_String, J_Array, J_Object };
+
+    Kind kind = J_Null;
+    bool boolean = false;
+    double number = 0;
+    string text;                // A string, or the serialized value of a request id.
+    vector<JsonValue> items;    // Elements of an array, or values of an object.
+    vector<string> keys;        // Keys of an object, matching items.
+
+    // The member named a_key, or null if there is none.
+    const JsonValue& operator[](const char* a_key) const
+    {
+        static const JsonValue none;
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (keys[i] == a_key) {
+                return items[i];
+            }
+        }
+        return none;
+    }
+
+    int AsInt() const { return static_cast<int>(number); }
+};
+
+namespace {
+    // Reads JSON text.  Malformed text gives a null value.
+    class JsonParser {
+    public:
+        JsonParser(const string& a_text) : m_text(a_text), m_pos(0), m_ok(true) {}
+
+        bool Parse(JsonValue& a_value)
+        {
+            ParseValue(a_value);
+            SkipSpace();
+            return m_ok && m_pos == m_text.size();
+        }
+
+    private:
+        void SkipSpace()
+        {
+            while (m_pos < m_text.size() && isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+                m_pos++;
+            }
+        }
+
+        bool Consume(char a_char)
+        {
+            SkipSpace();
+            if (m_pos < m_text.size() && m_text[m_pos] == a_char) {
+                m_pos++;
+                return true;
+            }
+            return false;
+        }
+
+        void ParseValue(JsonValue& a_value)
+        {
+            SkipSpace();
+            if (!m_ok || m_pos >= m_text.size()) {
+                m_ok = false;
+                return;
+            }
+            char c = m_text[m_pos];
+            if (c == '{') {
+                m_pos++;
+                a_value.kind = JsonValue::J_Object;
+                if (Consume('}')) return;
+                do {
+                    string key;
+                    SkipSpace();
+                    if (!ParseString(key) || !Consume(':')) {
+                        m_ok = false;
+                        return;
+                    }
+                    a_value.keys.push_back(key);
+                    a_value.items.emplace_back();
+                    ParseValue(a_value.items.back());
+                } while (m_ok && Consume(','));
+                m_ok = m_ok && Consume('}');
+            }
+            else if (c == '[') {
+                m_pos++;
+                a_value.kind = JsonValue::J_Array;
+                if (Consume(']')) return;
+                do {
+                    a_value.items.emplace_back();
+                    ParseValue(a_value.items.back());
+                } while (m_ok && Consume(','));
+                m_ok = m_ok && Consume(']');
+            }
+            else if (c == '"') {
+                a_value.kind = JsonValue::J_String;
+                m_ok = ParseString(a_value.text);
+            }
+            else if (m_text.compare(m_pos, 4, "true") == 0 || m_text.compare(m_pos, 5, "false") == 0) {
+                a_value.kind = JsonValue::J_Bool;
+                a_value.boolean = c == 't';
+                m_pos += a_value.boolean ? 4 : 5;
+            }
+            else if (m_text.compare(m_pos, 4, "null") == 0) {
+                m_pos += 4;
+            }
+            else {
+                size_t begin = m_pos;
+                while (m_pos < m_text.size() && strchr("+-0123456789.eE", m_text[m_pos]) != nullptr) {
+                    m_pos++;
+                }
+                a_value.kind = JsonValue::J_Number;
+                a_value.text = m_text.substr(begin, m_pos - begin);
+                try {
+                    a_value.number = stod(a_value.text);
+                }
+                catch (...) {
+                    m_ok = false;
+                }
+            }
+        }
+
+        bool ParseString(string& a_text)
+        {
+            if (m_pos >= m_text.size() || m_text[m_pos] != '"') return false;
+            m_pos++;
+            while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+                char c = m_text[m_pos++];
+                if (c != '\\') {
+                    a_text += c;
+                    continue;
+                }
+                if (m_pos >= m_text.size()) return false;
+                c = m_text[m_pos++];
+                switch (c) {
+                case 'b': a_text += '\b'; break;
+                case 'f': a_text += '\f'; break;
+                case 'n': a_text += '\n'; break;
+                case 'r': a_text += '\r'; break;
+                case 't': a_text += '\t'; break;
+                case 'u': {
+                    if (m_pos + 4 > m_text.size()) return false;
+                    unsigned code = static_cast<unsigned>(stoul(m_text.substr(m_pos, 4), nullptr, 16));
+                    m_pos += 4;
+                    // Encode as UTF-8.  Surrogate pairs are not combined; VC source is ASCII.
+                    if (code < 0x80) {
+                        a_text += static_cast<char>(code);
+                    }
+                    else if (code < 0x800) {
+                        a_text += static_cast<char>(0xC0 | (code >> 6));
+                        a_text += static_cast<char>(0x80 | (code & 0x3F));
+                    }
+                    else {
+                        a_text += static_cast<char>(0xE0 | (code >> 12));
+                        a_text += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                        a_text += static_cast<char>(0x80 | (code & 0x3F));
+                    }
+                    break;
+                }
+                default: a_text += c; break;
+                }
+            }
+            if (m_pos >= m_text.size()) return false;
+            m_pos++;
+            return true;
+        }
+
+        const string& m_text;
+        size_t m_pos;
+        bool m_ok;
+    };
+
+    // Writes a string as a JSON string.
+    string Quote(const string& a_text)
+    {
+        string quoted = "\"";
+        for (char c : a_text) {
+            switch (c) {
+            case '"': quoted += "\\\""; break;
+            case '\\': quoted += "\\\\"; break;
+            case '\n': quoted += "\\n"; break;
+            case '\r': quoted += "\\r"; break;
+            case '\t': quoted += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escape[8];
+                    snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    quoted += escape;
+                }
+                else {
+                    quoted += c;
+                }
+            }
+        }
+        return quoted + "\"";
+    }
+
+    // Writes a range of one line as a JSON object.
+    string Range(int a_line, int a_column, size_t a_length)
+    {
+        return "{\"start\":{\"line\":" + to_string(a_line) + ",\"character\":" + to_string(a_column) +
+            "},\"end\":{\"line\":" + to_string(a_line) + ",\"character\":" + to_string(a_column + a_length) + "}}";
+    }
+
+    // Splits text into lines, dropping the carriage returns of CR LF line ends.
+    vector<string> SplitLines(const string& a_text)
+    {
+        vector<string> lines(1);
+        for (char c : a_text) {
+            if (c == '\n') {
+                if (!lines.back().empty() && lines.back().back() == '\r') {
+                    lines.back().pop_back();
+                }
+                lines.emplace_back();
+            }
+            else {
+                lines.back() += c;
+            }
+        }
+        if (!lines.back().empty() && lines.back().back() == '\r') {
+            lines.back().pop_back();
+        }
+        return lines;
+    }
+
+    // Compares positions by line, then column.
+    template <typename P>
+    bool Before(const P& a_left, const P& a_right)
+    {
+        return a_left.line < a_right.line || (a_left.line == a_right.line && a_left.column < a_right.column);
+    }
+
+    // Adds a position to a list in order, or removes it.
+    template <typename P>
+    void InsertPosition(vector<P>& a_list, const P& a_position)
+    {
+        a_list.insert(upper_bound(a_list.begin(), a_list.end(), a_position, Before<P>), a_position);
+    }
+
+    template <typename P>
+    void ErasePosition(vector<P>& a_list, const P& a_position)
+    {
+        auto found = lower_bound(a_list.begin(), a_list.end(), a_position, Before<P>);
+        if (found != a_list.end() && found->line == a_position.line && found->column == a_position.column) {
+            a_list.erase(found);
+        }
+    }
+
+    // The opcodes of machine instructions.
+    const set<string> machineOpcodes = { "READ", "LOAD", "STORE", "WRITE", "BP", "HALT", "FAA", "CAS",
+        "BCOPY", "BFILL", "BSUM", "BCMP", "BREAD", "BWRITE" };
+
+    // Error codes of the protocol.
+    const int METHODNOTFOUND = -32601;
+    const int INVALIDREQUEST = -32600;
+}
+
+/*
+NAME
+
+    LanguageServer::LanguageServer - Constructor for the LanguageServer class.
+
+SYNOPSIS
+
+    LanguageServer::LanguageServer()
+
+DESCRIPTION
+
+    This constructor puts the standard input and output in binary mode, so the lengths in the
+    message headers count the bytes actually sent.
+
+*/
+
+LanguageServer::LanguageServer()
+    : m_shutdown(false)
+{
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+}
+
+/*
+NAME
+
+    LanguageServer::Run - Serve the client.
+
+SYNOPSIS
+
+    int LanguageServer::Run()
+
+DESCRIPTION
+
+    This function reads and handles messages until the client sends exit or closes the input.
+
+RETURNS
+
+    int - Zero if the client shut the server down before it exited, one otherwise.
+*/
+
+int LanguageServer::Run()
+{
+    string body;
+    while (ReadMessage(body)) {
+        JsonValue message;
+        JsonParser parser(body);
+        if (!parser.Parse(message) || message.kind != JsonValue::J_Object) {
+            cerr << "Language server: malformed message ignored." << endl;
+            continue;
+        }
+        if (message["method"].text == "exit") {
+            break;
+        }
+        HandleMessage(message);
+    }
+    return m_shutdown ? 0 : 1;
+}
+
+/*
+NAME
+
+    LanguageServer::ReadMessage - Read the body of the next message.
+
+SYNOPSIS
+
+    bool LanguageServer::ReadMessage(string& a_body)
+        string& a_body --> Receives the body.
+
+RETURNS
+
+    bool - False when the input ends.
+*/
+
+bool LanguageServer::ReadMessage(string& a_body)
+{
+    size_t length = 0;
+    string header;
+    while (getline(cin, header)) {
+        if (!header.empty() && header.back() == '\r') {
+            header.pop_back();
+        }
+        if (header.empty()) {
+            if (length == 0) continue;  // A blank line before any header.
+            a_body.assign(length, '\0');
+            return static_cast<bool>(cin.read(&a_body[0], length));
+        }
+        const string name = "Content-Length:";
+        if (header.compare(0, name.size(), name) == 0) {
+            length = static_cast<size_t>(atol(header.c_str() + name.size()));
+        }
+    }
+    return false;
+}
+
+void LanguageServer::WriteMessage(const string& a_body)
+{
+    cout << "Content-Length: " << a_body.size() << "\r\n\r\n" << a_body;
+    cout.flush();
+}
+
+void LanguageServer::Respond(const JsonValue& a_id, const string& a_result)
+{
+    WriteMessage("{\"jsonrpc\":\"2.0\",\"id\":" + (a_id.kind == JsonValue::J_String ? Quote(a_id.text) : a_id.text) +
+        ",\"result\":" + a_result + "}");
+}
+
+void LanguageServer::RespondError(const JsonValue& a_id, int a_code, const string& a_message)
+{
+    WriteMessage("{\"jsonrpc\":\"2.0\",\"id\":" + (a_id.kind == JsonValue::J_String ? Quote(a_id.text) : a_id.text) +
+        ",\"error\":{\"code\":" + to_string(a_code) + ",\"message\":" + Quote(a_message) + "}}");
+}
+
+/*
+NAME
+
+    LanguageServer::HandleMessage - Carry out a request or notification.
+
+SYNOPSIS
+
+    void LanguageServer::HandleMessage(const JsonValue& a_message)
+        const JsonValue& a_message --> The message.
+
+DESCRIPTION
+
+    Requests, which have an id, are answered; notifications are not.  Requests for methods the
+    server does not support are answered with an error, and such notifications are ignored.
+
+*/
+
+void LanguageServer::HandleMessage(const JsonValue& a_message)
+{
+    const string& method = a_message["method"].text;
+    const JsonValue& id = a_message["id"];
+    const JsonValue& params = a_message["params"];
+    const string& uri = params["textDocument"]["uri"].text;
+    bool isRequest = id.kind != JsonValue::J_Null;
+
+    if (method == "initialize") {
+        Respond(id, "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+            "\"definitionProvider\":true,\"referencesProvider\":true,\"documentSymbolProvider\":true},"
+            "\"serverInfo\":{\"name\":\"vc370\"}}");
+    }
+    else if (method == "shutdown") {
+        m_shutdown = true;
+        Respond(id, "null");
+    }
+    else if (method == "textDocument/didOpen") {
+        Document& doc = m_documents[uri];
+        doc = Document();
+        doc.endLines = 0;
+        vector<string> lines = SplitLines(params["textDocument"]["text"].text);
+        ReplaceLines(doc, 0, 0, lines);
+        PublishDiagnostics(uri);
+    }
+    else if (method == "textDocument/didChange") {
+        auto doc = m_documents.find(uri);
+        if (doc == m_documents.end()) return;
+        for (const JsonValue& change : params["contentChanges"].items) {
+            ApplyChange(doc->second, change);
+        }
+        PublishDiagnostics(uri);
+    }
+    else if (method == "textDocument/didClose") {
+        m_documents.erase(uri);
+        WriteMessage("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":" +
+            Quote(uri) + ",\"diagnostics\":[]}}");
+    }
+    else if (method == "textDocument/definition" || method == "textDocument/references" ||
+        method == "textDocument/documentSymbol") {
+        if (m_documents.count(uri) == 0) {
+            RespondError(id, INVALIDREQUEST, "Document " + uri + " is not open.");
+        }
+        else if (method == "textDocument/definition") {
+            Respond(id, Definition(uri, params));
+        }
+        else if (method == "textDocument/references") {
+            Respond(id, References(uri, params));
+        }
+        else {
+            Respond(id, DocumentSymbols(uri));
+        }
+    }
+    else if (isRequest) {
+        RespondError(id, METHODNOTFOUND, "Method " + method + " is not supported.");
+    }
+}
+
+/*
+NAME
+
+    LanguageServer::ApplyChange - Apply one change to a document.
+
+SYNOPSIS
+
+    void LanguageServer::ApplyChange(Document& a_doc, const JsonValue& a_change)
+        Document& a_doc             --> The document.
+        const JsonValue& a_change   --> A TextDocumentContentChangeEvent: new text for a range, or
+                                        for the whole document if it has no range.
+
+DESCRIPTION
+
+    The lines the range touches are replaced by the lines of their new text.
+
+*/
+
+void LanguageServer::ApplyChange(Document& a_doc, const JsonValue& a_change)
+{
+    const JsonValue& range = a_change["range"];
+    if (range.kind == JsonValue::J_Null) {
+        vector<string> lines = SplitLines(a_change["text"].text);
+        ReplaceLines(a_doc, 0, a_doc.lines.size(), lines);
+        return;
+    }
+    size_t last = a_doc.lines.empty() ? 0 : a_doc.lines.size() - 1;
+    size_t startLine = min(static_cast<size_t>(max(range["start"]["line"].AsInt(), 0)), last);
+    size_t endLine = min(static_cast<size_t>(max(range["end"]["line"].AsInt(), 0)), last);
+    if (endLine < startLine) {
+        swap(startLine, endLine);
+    }
+    string prefix;
+    string suffix;
+    if (!a_doc.lines.empty()) {
+        const string& start = a_doc.lines[startLine];
+        const string& end = a_doc.lines[endLine];
+        prefix = start.substr(0, min(static_cast<size_t>(max(range["start"]["character"].AsInt(), 0)), start.size()));
+        suffix = end.substr(min(static_cast<size_t>(max(range["end"]["character"].AsInt(), 0)), end.size()));
+    }
+    vector<string> lines = SplitLines(prefix + a_change["text"].text + suffix);
+    ReplaceLines(a_doc, startLine, a_doc.lines.empty() ? 0 : endLine - startLine + 1, lines);
+}
+
+/*
+NAME
+
+    LanguageServer::ReplaceLines - Replace lines of a document and update its index.
+
+SYNOPSIS
+
+    void LanguageServer::ReplaceLines(Document& a_doc, size_t a_first, size_t a_count, vector<string>& a_lines)
+        Document& a_doc         --> The document.
+        size_t a_first          --> The first line replaced.
+        size_t a_count          --> The number of lines replaced.
+        vector<string>& a_lines --> The new lines, which are moved into the document.
+
+DESCRIPTION
+
+    The old lines are taken out of the index and the new ones parsed and put in.  If the number of
+    lines changes, the positions after the replaced lines are moved by the difference; the lists
+    are in order, so only their tails are visited.
+
+*/
+
+void LanguageServer::ReplaceLines(Document& a_doc, size_t a_first, size_t a_count, vector<string>& a_lines)
+{
+    for (size_t line = a_first; line < a_first + a_count; line++) {
+        UnindexLine(a_doc, line);
+    }
+
+    int delta = static_cast<int>(a_lines.size()) - static_cast<int>(a_count);
+    if (delta != 0) {
+        Position after = { static_cast<int>(a_first + a_count), 0 };
+        for (auto& symbol : a_doc.symbols) {
+            for (vector<Position>* list : { &symbol.second.definitions, &symbol.second.declarations, &symbol.second.references }) {
+                for (auto it = lower_bound(list->begin(), list->end(), after, Before<Position>); it != list->end(); ++it) {
+                    it->line += delta;
+                }
+            }
+        }
+    }
+
+    a_doc.lines.erase(a_doc.lines.begin() + a_first, a_doc.lines.begin() + a_first + a_count);
+    a_doc.lines.insert(a_doc.lines.begin() + a_first, make_move_iterator(a_lines.begin()), make_move_iterator(a_lines.end()));
+    a_doc.infos.erase(a_doc.infos.begin() + a_first, a_doc.infos.begin() + a_first + a_count);
+    a_doc.infos.insert(a_doc.infos.begin() + a_first, a_lines.size(), LineInfo());
+    for (size_t line = a_first; line < a_first + a_lines.size(); line++) {
+        a_doc.infos[line] = ParseLine(a_doc.lines[line]);
+        IndexLine(a_doc, line);
+    }
+}
+
+/*
+NAME
+
+    LanguageServer::ParseLine - Parse a line for the index.
+
+SYNOPSIS
+
+    LanguageServer::LineInfo LanguageServer::ParseLine(const string& a_text)
+        const string& a_text --> The line.
+
+DESCRIPTION
+
+    The line is parsed by Instruction, as Pass I parses it, and the columns of its label and operand
+    are found from the tokens of the line.  The errors the assembler would report for the line
+    alone are noted with it.
+
+RETURNS
+
+    LineInfo - The parse of the line.
+*/
+
+LanguageServer::LineInfo LanguageServer::ParseLine(const string& a_text)
+{
+    LineInfo info;
+    vector<string> errors;
+    vector<string>* outer = Errors::CaptureErrors(&errors);
+    info.type = m_inst.ParseInstruction(a_text);
+    Errors::CaptureErrors(outer);
+    info.errors = move(errors);
+
+    // Columns of the tokens before any comment.
+    vector<int> columns;
+    size_t end = min(a_text.find(';'), a_text.size());
+    for (size_t i = 0; i < end; i++) {
+        if (!isspace(static_cast<unsigned char>(a_text[i])) && (i == 0 || isspace(static_cast<unsigned char>(a_text[i - 1])))) {
+            columns.push_back(static_cast<int>(i));
+        }
+    }
+
+    bool hasLabel = m_inst.isLabel();
+    info.label = hasLabel && (info.type == Instruction::ST_MachineLanguage || info.type == Instruction::ST_AssemblerInstr)
+        ? m_inst.GetLabel() : "";
+    info.labelColumn = columns.empty() ? 0 : columns[0];
+    info.operand = m_inst.GetOperand();
+    size_t operandToken = hasLabel ? 2 : 1;
+    info.operandColumn = operandToken < columns.size() ? columns[operandToken] : 0;
+
+    string opcode = m_inst.GetOpCode();
+    info.role = OR_None;
+    info.isData = opcode == "DC" || opcode == "DS";
+    if (info.type == Instruction::ST_MachineLanguage) {
+        if (machineOpcodes.count(opcode) == 0) {
+            info.errors.push_back("Unknown opcode: " + opcode);
+        }
+        else if (!info.operand.empty() && info.operand[0] != '=') {
+            info.role = OR_Reference;   // A literal (=N) names a constant, not a symbol.
+        }
+    }
+    else if (info.type == Instruction::ST_AssemblerInstr && !info.operand.empty()) {
+        if (opcode == "EXTERN") {
+            info.role = OR_Declaration;
+        }
+        else if (opcode == "PUBLIC" || opcode == "ENTRY") {
+            info.role = OR_Reference;
+        }
+        else if (opcode == "DC" && !m_inst.IsNumericOperand()) {
+            info.errors.push_back("Invalid operand for DC directive.");
+        }
+    }
+    bool isSet;
+    int value;
+    if (!m_inst.LocationEffect(isSet, value)) {
+        info.errors.push_back(opcode == "ORG" ? "Invalid operand for ORG directive." : "Invalid size for DS.");
+    }
+    return info;
+}
+
+// Adds the symbols of a parsed line to the index.
+void LanguageServer::IndexLine(Document& a_doc, size_t a_line)
+{
+    const LineInfo& info = a_doc.infos[a_line];
+    int line = static_cast<int>(a_line);
+    if (!info.label.empty()) {
+        InsertPosition(a_doc.symbols[info.label].definitions, Position{ line, info.labelColumn });
+    }
+    if (info.role != OR_None) {
+        Occurrences& occurrences = a_doc.symbols[info.operand];
+        InsertPosition(info.role == OR_Reference ? occurrences.references : occurrences.declarations,
+            Position{ line, info.operandColumn });
+    }
+    if (info.type == Instruction::ST_End) {
+        a_doc.endLines++;
+    }
+}
+
+// Takes the symbols of a line out of the index, dropping symbols that no longer appear.
+void LanguageServer::UnindexLine(Document& a_doc, size_t a_line)
+{
+    const LineInfo& info = a_doc.infos[a_line];
+    int line = static_cast<int>(a_line);
+    auto drop = [&](const string& a_symbol, vector<Position> Occurrences::* a_list, int a_column) {
+        auto entry = a_doc.symbols.find(a_symbol);
+        if (entry == a_doc.symbols.end()) return;
+        ErasePosition(entry->second.*a_list, Position{ line, a_column });
+        if (entry->second.definitions.empty() && entry->second.declarations.empty() && entry->second.references.empty()) {
+            a_doc.symbols.erase(entry);
+        }
+    };
+    if (!info.label.empty()) {
+        drop(info.label, &Occurrences::definitions, info.labelColumn);
+    }
+    if (info.role != OR_None) {
+        drop(info.operand, info.role == OR_Reference ? &Occurrences::references : &Occurrences::declarations,
+            info.operandColumn);
+    }
+    if (info.type == Instruction::ST_End) {
+        a_doc.endLines--;
+    }
+}
+
+/*
+NAME
+
+    LanguageServer::SymbolAt - Find the symbol under the cursor.
+
+SYNOPSIS
+
+    string LanguageServer::SymbolAt(const Document& a_doc, const JsonValue& a_position) const
+        const Document& a_doc       --> The document.
+        const JsonValue& a_position --> The position of the cursor.
+
+RETURNS
+
+    string - The label or symbolic operand at the position, or an empty string if there is none.
+*/
+
+string LanguageServer::SymbolAt(const Document& a_doc, const JsonValue& a_position) const
+{
+    int line = a_position["line"].AsInt();
+    int column = a_position["character"].AsInt();
+    if (line < 0 || line >= static_cast<int>(a_doc.infos.size())) {
+        return "";
+    }
+    const LineInfo& info = a_doc.infos[line];
+    if (!info.label.empty() && column >= info.labelColumn && column <= info.labelColumn + static_cast<int>(info.label.size())) {
+        return info.label;
+    }
+    if (info.role != OR_None && column >= info.operandColumn &&
+        column <= info.operandColumn + static_cast<int>(info.operand.size())) {
+        return info.operand;
+    }
+    return "";
+}
+
+/*
+NAME
+
+    LanguageServer::Definition - Answer textDocument/definition.
+
+SYNOPSIS
+
+    string LanguageServer::Definition(const string& a_uri, const JsonValue& a_params) const
+        const string& a_uri         --> The document.
+        const JsonValue& a_params   --> The parameters of the request.
+
+RETURNS
+
+    string - The locations of the labels defining the symbol under the cursor, or of the EXTERN
+             directives declaring it if it is defined in another module.
+*/
+
+string LanguageServer::Definition(const string& a_uri, const JsonValue& a_params) const
+{
+    const Document& doc = m_documents.at(a_uri);
+    string symbol = SymbolAt(doc, a_params["position"]);
+    auto entry = doc.symbols.find(symbol);
+    if (symbol.empty() || entry == doc.symbols.end()) {
+        return "[]";
+    }
+    const vector<Position>& found = entry->second.definitions.empty() ? entry->second.declarations : entry->second.definitions;
+    string result = "[";
+    for (const Position& position : found) {
+        result += (result.size() > 1 ? "," : "") + string("{\"uri\":") + Quote(a_uri) + ",\"range\":" +
+            Range(position.line, position.column, symbol.size()) + "}";
+    }
+    return result + "]";
+}
+
+/*
+NAME
+
+    LanguageServer::References - Answer textDocument/references.
+
+SYNOPSIS
+
+    string LanguageServer::References(const string& a_uri, const JsonValue& a_params) const
+        const string& a_uri         --> The document.
+        const JsonValue& a_params   --> The parameters of the request.
+
+RETURNS
+
+    string - The locations of the operands naming the symbol under the cursor, in order, with its
+             definitions and declarations if the request includes them.
+*/
+
+string LanguageServer::References(const string& a_uri, const JsonValue& a_params) const
+{
+    const Document& doc = m_documents.at(a_uri);
+    string symbol = SymbolAt(doc, a_params["position"]);
+    auto entry = doc.symbols.find(symbol);
+    if (symbol.empty() || entry == doc.symbols.end()) {
+        return "[]";
+    }
+    vector<Position> found = entry->second.references;
+    if (a_params["context"]["includeDeclaration"].boolean) {
+        found.insert(found.end(), entry->second.definitions.begin(), entry->second.definitions.end());
+        found.insert(found.end(), entry->second.declarations.begin(), entry->second.declarations.end());
+        sort(found.begin(), found.end(), Before<Position>);
+    }
+    string location = "{\"uri\":" + Quote(a_uri) + ",\"range\":";
+    string result = "[";
+    result.reserve(found.size() * (location.size() + 80));
+    for (const Position& position : found) {
+        if (result.size() > 1) {
+            result += ',';
+        }
+        result += location + Range(position.line, position.column, symbol.size()) + "}";
+    }
+    return result + "]";
+}
+
+// Answers textDocument/documentSymbol with the labels of the document, in order.
+string LanguageServer::DocumentSymbols(const string& a_uri) const
+{
+    const int FUNCTION = 12;    // Kinds of symbol in the protocol.
+    const int VARIABLE = 13;
+
+    const Document& doc = m_documents.at(a_uri);
+    string result = "[";
+    for (size_t line = 0; line < doc.infos.size(); line++) {
+        const LineInfo& info = doc.infos[line];
+        if (info.label.empty()) continue;
+
+        result += (result.size() > 1 ? "," : "") + string("{\"name\":") + Quote(info.label) + ",\"kind\":" +
+            to_string(info.isData ? VARIABLE : FUNCTION) + ",\"location\":{\"uri\":" + Quote(a_uri) + ",\"range\":" +
+            Range(static_cast<int>(line), info.labelColumn, info.label.size()) + "}}";
+    }
+    return result + "]";
+}
+
+/*
+NAME
+
+    LanguageServer::PublishDiagnostics - Send the errors in a document.
+
+SYNOPSIS
+
+    void LanguageServer::PublishDiagnostics(const string& a_uri)
+        const string& a_uri --> The document.
+
+DESCRIPTION
+
+    The diagnostics are the errors the assembler would report, placed on the lines they concern:
+    the errors of each line alone, symbols that are used but neither defined nor declared, symbols
+    defined more than once, and a missing END directive.  They come from the index, so the document
+    is not assembled.
+
+*/
+
+void LanguageServer::PublishDiagnostics(const string& a_uri)
+{
+    struct Diagnostic {
+        int line;
+        int column;
+        size_t length;
+        string message;
+    };
+    const Document& doc = m_documents.at(a_uri);
+    vector<Diagnostic> diagnostics;
+    for (size_t line = 0; line < doc.infos.size(); line++) {
+        for (const string& message : doc.infos[line].errors) {
+            diagnostics.push_back(Diagnostic{ static_cast<int>(line), 0, doc.lines[line].size(), message });
+        }
+    }
+    for (const auto& symbol : doc.symbols) {
+        const Occurrences& occurrences = symbol.second;
+        if (occurrences.definitions.empty() && occurrences.declarations.empty()) {
+            for (const Position& position : occurrences.references) {
+                diagnostics.push_back(Diagnostic{ position.line, position.column, symbol.first.size(),
+                    "Undefined symbol: " + symbol.first });
+            }
+        }
+        for (size_t i = 1; i < occurrences.definitions.size(); i++) {
+            diagnostics.push_back(Diagnostic{ occurrences.definitions[i].line, occurrences.definitions[i].column,
+                symbol.first.size(), "Symbol '" + symbol.first + "' is multiply defined." });
+        }
+    }
+    if (doc.endLines == 0) {
+        int last = static_cast<int>(doc.lines.size()) - 1;
+        diagnostics.push_back(Diagnostic{ max(last, 0), 0, last >= 0 ? doc.lines[last].size() : 0, "Missing END directive." });
+    }
+    sort(diagnostics.begin(), diagnostics.end(), Before<Diagnostic>);
+
+    string message = "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":" +
+        Quote(a_uri) + ",\"diagnostics\":[";
+    for (size_t i = 0; i < diagnostics.size(); i++) {
+        message += (i == 0 ? "" : ",") + string("{\"range\":") +
+            Range(diagnostics[i].line, diagnostics[i].column, diagnostics[i].length) +
+            ",\"severity\":1,\"source\":\"vc370\",\"message\":" + Quote(diagnostics[i].message) + "}";
+    }
+    WriteMessage(message + "]}}");
+}
@@ -0,0 +1,87 @@
+//
+//		LanguageServer class.  Serves editors over the Language Server Protocol on the standard
+//		input and output, with go to definition, find references, the symbols of a document and
+//		the assembler's diagnostics.
+//
+#pragma once
+
+#include "Instruction.h"
+#include "stdafx.h"
+
+struct JsonValue;
+
+class LanguageServer {
+
+public:
+    LanguageServer();
+
+    // Serves requests until the client asks the server to exit.  Returns the process exit status.
+    int Run();
+
+private:
+    // A place in a document.  Both numbers count from zero, as the protocol does.
+    struct Position {
+        int line;
+        int column;
+    };
+
+    // Where a symbol appears in a document, each list in order of position.
+    struct Occurrences {
+        vector<Position> definitions;   // Labels that define it.
+        vector<Position> declarations;  // EXTERN directives naming it.
+        vector<Position> references;    // Operands naming it.
+    };
+
+    // What the operand of a line does with the symbol it names.
+    enum OperandRole {
+        OR_None,            // It names no symbol.
+        OR_Reference,       // It uses the symbol.
+        OR_Declaration      // It declares the symbol defined in another module.
+    };
+
+    // The parse of one line.
+    struct LineInfo {
+        Instruction::InstructionType type;
+        string label;               // The label the line defines, if any.
+        int labelColumn;
+        string operand;             // The operand, if any.
+        int operandColumn;
+        OperandRole role;           // What the operand does.
+        bool isData;                // True if the line is a DC or DS directive.
+        vector<string> errors;      // Errors that can be found from the line alone.
+    };
+
+    // An open document and its index.  The index is updated line by line as the document changes,
+    // so queries never parse the document again.
+    struct Document {
+        vector<string> lines;                           // The text.
+        vector<LineInfo> infos;                         // The parse of each line.
+        unordered_map<string, Occurrences> symbols;     // Where each symbol appears.
+        int endLines;                                   // Number of END directives.
+    };
+
+    // Reading and writing messages.
+    bool ReadMessage(string& a_body);
+    void WriteMessage(const string& a_body);
+    void Respond(const JsonValue& a_id, const string& a_result);
+    void RespondError(const JsonValue& a_id, int a_code, const string& a_message);
+    void HandleMessage(const JsonValue& a_message);
+
+    // Keeping the documents and their indexes up to date.
+    void ApplyChange(Document& a_doc, const JsonValue& a_change);
+    void ReplaceLines(Document& a_doc, size_t a_first, size_t a_count, vector<string>& a_lines);
+    void IndexLine(Document& a_doc, size_t a_line);
+    void UnindexLine(Document& a_doc, size_t a_line);
+    LineInfo ParseLine(const string& a_text);
+
+    // Answering queries.
+    string SymbolAt(const Document& a_doc, const JsonValue& a_position) const;
+    string Definition(const string& a_uri, const JsonValue& a_params) const;
+    string References(const string& a_uri, const JsonValue& a_params) const;
+    string DocumentSymbols(const string& a_uri) const;
+    void PublishDiagnostics(const string& a_uri);
+
+    map<string, Document> m_documents;  // The open documents, by URI.
+    Instruction m_inst;                 // Parses the lines.
+    bool m_shutdown;                    // True once the client has asked the server to shut down.
+};
@@ -0,0 +1,231 @@
+// Linker.cpp
+//
+// Implementation of the Linker class.
+// Places object modules one after another, resolves imported symbols against the
+// symbols the other modules export, and loads the result into the emulator.
+//
+#include "stdafx.h"
+#include "Linker.h"
+#include "Errors.h"
+
+/*
+NAME
+
+    Linker::Linker - Constructor for the Linker class.
+
+SYNOPSIS
+
+    Linker::Linker(emulator& a_emul)
+        emulator& a_emul --> The emulator that receives the linked program.
+
+DESCRIPTION
+
+    This constructor creates a linker with no modules.
+
+*/
+
+Linker::Linker(emulator& a_emul)
+    : m_emul(a_emul)
+{
+    m_image.SetAddressDigits(m_emul.getAddressDigits());
+}
+
+/*
+NAME
+
+    Linker::AddModule - Read an object module to be linked.
+
+SYNOPSIS
+
+    bool Linker::AddModule(const string& a_fileName)
+        const string& a_fileName --> The object file.
+
+DESCRIPTION
+
+    This function reads an object module.  Its words must use the same address field width as the
+    emulator, which depends on the size of the address space the module was assembled for.
+
+RETURNS
+
+    bool - True if the module was read and is compatible with the emulator.
+*/
+
+bool Linker::AddModule(const string& a_fileName)
+{
+    PlacedModule placed;
+    placed.name = a_fileName;
+    placed.base = 0;
+    if (!placed.module.Read(a_fileName)) {
+        return false;
+    }
+    if (placed.module.GetAddressDigits() != m_emul.getAddressDigits()) {
+        Errors::RecordError(a_fileName + " was assembled for a different memory size.");
+        return false;
+    }
+    m_modules.push_back(move(placed));
+    return true;
+}
+
+/*
+NAME
+
+    Linker::Link - Link the modules into the emulator.
+
+SYNOPSIS
+
+    bool Linker::Link()
+
+DESCRIPTION
+
+    The first module is placed at location zero, so a main program assembled with ORG 100 keeps its
+    entry point, and each further module follows the last word of the one before.  The symbols each
+    module exports are entered in a global symbol table at their placed locations, which reports any
+    symbol exported twice.  Then every word is relocated: local addresses move by the base of their
+    module and imported addresses are looked up in the global table.  The words are loaded into the
+    emulator and kept as the linked image.  Modules that together exceed the memory are not linked.
+
+RETURNS
+
+    bool - True if the program linked without errors.
+*/
+
+bool Linker::Link()
+{
+    int base = 0;
+    for (auto& placed : m_modules) {
+        placed.base = base;
+        base += placed.module.GetSize();
+
+        for (const auto& entry : placed.module.GetExports()) {
+            string symbol = entry.first;
+            m_globals.AddSymbol(symbol, placed.base + entry.second);
+        }
+    }
+    m_image.SetSize(base);
+    if (base > m_emul.getMemorySize()) {
+        Errors::RecordError("Linked program of " + to_string(base) + " words does not fit in memory of " +
+            to_string(m_emul.getMemorySize()) + " words.");
+        return false;
+    }
+
+    bool ok = true;
+    for (const auto& placed : m_modules) {
+        for (const auto& word : placed.module.GetWords()) {
+            ObjectWord linked;
+            linked.location = placed.base + word.location;
+            linked.relocation = 'A';
+            if (!RelocateWord(placed, word, linked.contents)) {
+                ok = false;
+                continue;
+            }
+            if (!m_emul.insertMemory(linked.location, linked.contents)) {
+                ok = false;
+                continue;
+            }
+            m_image.AddWord(linked);
+        }
+    }
+    return ok && !Errors::WasThereErrors();
+}
+
+/*
+NAME
+
+    Linker::RelocateWord - Relocate one word of a placed module.
+
+SYNOPSIS
+
+    bool Linker::RelocateWord(const PlacedModule& a_placed, const ObjectWord& a_word, int& a_contents) const
+        const PlacedModule& a_placed --> The module the word belongs to.
+        const ObjectWord& a_word     --> The word.
+        int& a_contents              --> Receives the relocated word.
+
+DESCRIPTION
+
+    This function adds the base of the module, or the address of the imported symbol, to the address
+    field of the word.  The result must still be an address within the emulator's memory, which is
+    checked before the word is encoded again.
+
+RETURNS
+
+    bool - True if the word was relocated.
+*/
+
+bool Linker::RelocateWord(const PlacedModule& a_placed, const ObjectWord& a_word, int& a_contents) const
+{
+    int offset = 0;
+    if (a_word.relocation == 'R') {
+        offset = a_placed.base;
+    }
+    else if (a_word.relocation == 'X' && !m_globals.LookupSymbol(a_word.symbol, offset)) {
+        Errors::RecordError("Unresolved external '" + a_word.symbol + "' in " + a_placed.name + ".");
+        return false;
+    }
+    if (a_word.relocation == 'A') {
+        a_contents = a_word.contents;
+        return true;
+    }
+
+    // The address is checked before the word is rebuilt, since one that outgrew the address field
+    // would carry into the opcode.
+    long long address = static_cast<long long>(m_emul.decodeAddress(a_word.contents)) + offset;
+    if (address >= m_emul.getMemorySize()) {
+        Errors::RecordError("Relocated address " + to_string(address) + " in " + a_placed.name +
+            " is outside memory.");
+        return false;
+    }
+    a_contents = m_emul.encodeWord(m_emul.decodeOpcode(a_word.contents), static_cast<int>(address));
+    return true;
+}
+
+/*
+NAME
+
+    Linker::DisplayLinkMap - Display the placement of the modules.
+
+SYNOPSIS
+
+    void Linker::DisplayLinkMap() const
+
+DESCRIPTION
+
+    This function lists each module with its base and size, followed by the global symbol table.
+
+*/
+
+void Linker::DisplayLinkMap() const
+{
+    cout << "\nLink Map:\n";
+    cout << left << setw(12) << "Base" << setw(12) << "Size" << "Module\n";
+    cout << "--------------------------------------\n";
+    for (const auto& placed : m_modules) {
+        cout << setw(12) << placed.base << setw(12) << placed.module.GetSize() << placed.name << "\n";
+    }
+    cout << "--------------------------------------\n";
+    m_globals.DisplaySymbolTable();
+}
+
+/*
+NAME
+
+    Linker::WriteImage - Write the linked program.
+
+SYNOPSIS
+
+    bool Linker::WriteImage(const string& a_fileName) const
+        const string& a_fileName --> The image file.
+
+DESCRIPTION
+
+    The image is an object module whose words are all absolute, so linking it on its own loads the
+    program unchanged.
+
+RETURNS
+
+    bool - True if the file was written.
+*/
+
+bool Linker::WriteImage(const string& a_fileName) const
+{
+    return m_image.Write(a_fileName);
+}
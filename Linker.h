@@ -0,0 +1,45 @@
+//
+//		Linker class.  Combines separately assembled object modules into one
+//		program image in the emulator's memory.
+//
+#pragma once
+
+#include "ObjectModule.h"
+#include "SymTab.h"
+#include "Emulator.h"
+#include "stdafx.h"
+
+class Linker {
+
+public:
+    // The linked program is loaded into a_emul.
+    Linker(emulator& a_emul);
+
+    // Reads an object module to be linked.  Modules are placed in the order they are added.
+    bool AddModule(const string& a_fileName);
+
+    // Places the modules, resolves their references and loads the image.
+    bool Link();
+
+    // Displays where each module was placed and the global symbol table.
+    void DisplayLinkMap() const;
+
+    // Writes the linked image, an object module with nothing left to relocate.
+    bool WriteImage(const string& a_fileName) const;
+
+private:
+    // A module and where it was placed.
+    struct PlacedModule {
+        string name;            // File the module was read from.
+        ObjectModule module;    // The module.
+        int base;               // Location of its first word.
+    };
+
+    // Relocates one word of a placed module, recording an error if it cannot be resolved.
+    bool RelocateWord(const PlacedModule& a_placed, const ObjectWord& a_word, int& a_contents) const;
+
+    emulator& m_emul;                   // Receives the linked program.
+    vector<PlacedModule> m_modules;     // The modules, in placement order.
+    SymbolTable m_globals;              // Exported symbols at their linked locations.
+    ObjectModule m_image;               // The linked program.
+};
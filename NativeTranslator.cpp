@@ -0,0 +1,414 @@
+// NativeTranslator.cpp
+//
+// Implementation of the NativeTranslator class.
+// The translation is a C++ source file with no dependencies beyond the standard library.  Each
+// basic block of the program becomes straight-line code on a local accumulator, and branches
+// become gotos, so the compiler sees the whole control flow graph.  The file can be built as a
+// program:
+//
+//      cl /O2 /EHsc prog.cpp           g++ -O2 -o prog prog.cpp
+//
+// or, with VC_NATIVE_LIBRARY defined, as a DLL or shared object that exports vc_run.
+//
+// A translated program behaves as the emulator does when it runs a program on one hart: it reads
+// and writes the same way and reports the same faults.  The run limits of the emulator do not
+// apply to it.
+//
+#include "stdafx.h"
+#include "NativeTranslator.h"
+#include "Errors.h"
+
+#include <fstream>
+
+namespace {
+    // Opcodes of the machine, as the emulator decodes them.
+    enum Opcode {
+        OP_Load = 5, OP_Store = 6, OP_Read = 7, OP_Write = 8, OP_Branch = 12, OP_Halt = 13,
+        OP_FetchAdd = 14, OP_CompareSwap = 15, OP_BlockCopy = 16, OP_BlockFill = 17, OP_BlockSum = 18,
+        OP_BlockCompare = 19, OP_BlockRead = 20, OP_BlockWrite = 21
+    };
+
+    // True if an instruction writes the word its operand names.
+    bool StoresToOperand(int a_opcode)
+    {
+        return a_opcode == OP_Store || a_opcode == OP_Read || a_opcode == OP_FetchAdd || a_opcode == OP_CompareSwap;
+    }
+
+    // True if an instruction can be followed by the one after it.
+    bool FallsThrough(int a_opcode)
+    {
+        return (a_opcode >= OP_Load && a_opcode <= OP_Write) || (a_opcode >= OP_Branch && a_opcode <= OP_BlockCompare &&
+            a_opcode != OP_Halt);
+    }
+
+    // The support code every translation starts with, after the size of memory.
+    const char* const prologue = R"(
+#ifdef _WIN32
+#define VC_EXPORT extern "C" __declspec(dllexport)
+#else
+#define VC_EXPORT extern "C"
+#endif
+
+namespace {
+    int memory[MEMSZ];
+
+    // Runs of locations holding code, which a block instruction must not write.
+    bool WritesCode(int a_dest, int a_count)
+    {
+        int low = 0;
+        int high = CODERUNS;
+        while (low < high) {
+            int mid = (low + high) / 2;
+            if (codeRuns[mid][1] <= a_dest) {
+                low = mid + 1;
+            }
+            else {
+                high = mid;
+            }
+        }
+        return a_count > 0 && low < CODERUNS && codeRuns[low][0] < a_dest + a_count;
+    }
+
+    bool InMemory(int a_location, int a_count)
+    {
+        return a_location >= 0 && static_cast<long long>(a_location) + a_count <= MEMSZ;
+    }
+
+    // Carries out a block instruction as the emulator does.  Returns 0 if it was carried out, 1 if
+    // its descriptor or a range is out of bounds, and 2 if it would write the code.
+    int Block(int a_opcode, int a_address, int& a_accum)
+    {
+        if (a_address + 2 >= MEMSZ) {
+            return 1;
+        }
+        int dest = memory[a_address];
+        int source = memory[a_address + 1];
+        int count = memory[a_address + 2];
+        bool usesDest = a_opcode != 18;
+        bool usesSource = a_opcode != 17;
+        if (count < 0 || (usesDest && !InMemory(dest, count)) || (usesSource && !InMemory(source, count))) {
+            return 1;
+        }
+        switch (a_opcode) {
+        case 16:
+            if (WritesCode(dest, count)) {
+                return 2;
+            }
+            std::memmove(&memory[dest], &memory[source], count * sizeof(int));
+            break;
+        case 17:
+            if (WritesCode(dest, count)) {
+                return 2;
+            }
+            std::fill_n(&memory[dest], count, a_accum);
+            break;
+        case 18: {
+            unsigned sum = 0;
+            for (int i = 0; i < count; i++) {
+                sum += static_cast<unsigned>(memory[source + i]);
+            }
+            a_accum = static_cast<int>(sum);
+            break;
+        }
+        default:
+            a_accum = 0;
+            for (int i = 0; i < count; i++) {
+                if (memory[dest + i] != memory[source + i]) {
+                    a_accum = i + 1;
+                    break;
+                }
+            }
+            break;
+        }
+        return 0;
+    }
+}
+
+// Runs the program from its initial image.  Returns 0 if it halted, 1 if it faulted, and 2 if a
+// block instruction would have modified the code, in which case the program must be emulated.
+VC_EXPORT int vc_run()
+{
+    std::fill_n(memory, MEMSZ, 0);
+    for (const auto& word : image) {
+        memory[word[0]] = word[1];
+    }
+    int accum = 0;
+    std::cout << "\nResults from emulating program:\n\n";
+)";
+
+    // The end of every translation.
+    const char* const epilogue = R"(}
+
+#ifndef VC_NATIVE_LIBRARY
+int main()
+{
+    return vc_run();
+}
+#endif
+)";
+}
+
+/*
+NAME
+
+    NativeTranslator::NativeTranslator - Constructor for the NativeTranslator class.
+
+SYNOPSIS
+
+    NativeTranslator::NativeTranslator(const emulator& a_emul)
+        const emulator& a_emul --> The emulator holding the program, assembled or linked.
+
+DESCRIPTION
+
+    The program starts at the entry point of the emulator's first hart.
+
+*/
+
+NativeTranslator::NativeTranslator(const emulator& a_emul)
+    : m_emul(a_emul), m_entry(a_emul.getEntryPoint())
+{
+}
+
+/*
+NAME
+
+    NativeTranslator::Write - Write the translation to a file.
+
+SYNOPSIS
+
+    bool NativeTranslator::Write(const string& a_fileName)
+        const string& a_fileName --> The C++ source file to write.
+
+DESCRIPTION
+
+    The file holds the memory image, the support code, and a statement or two for each reachable
+    instruction in the order of their locations, labelled where a branch can reach them.  A
+    program with several harts cannot be translated, since the harts share memory between threads.
+
+RETURNS
+
+    bool - True if the file was written.
+*/
+
+bool NativeTranslator::Write(const string& a_fileName)
+{
+    if (m_emul.getHartCount() > 1) {
+        Errors::RecordError("A program with ENTRY directives cannot be translated to native code.");
+        return false;
+    }
+    if (!FindCode()) {
+        return false;
+    }
+    ofstream out(a_fileName);
+    if (!out) {
+        Errors::RecordError("Native code file " + a_fileName + " could not be opened.");
+        return false;
+    }
+
+    out << "// Translated from a VC370 program by the assembler.\n\n";
+    out << "#include <algorithm>\n#include <cstring>\n#include <iostream>\n\n";
+    out << "namespace {\n    const int MEMSZ = " << m_emul.getMemorySize() << ";\n\n";
+
+    // The image is every word that is not zero.
+    out << "    const int image[][2] = {";
+    int words = 0;
+    for (int loc = 0; loc < m_emul.getMemorySize(); loc++) {
+        int contents = m_emul.peekWord(loc);
+        if (contents != 0) {
+            out << (words % 6 == 0 ? "\n        " : " ") << "{ " << loc << ", " << contents << " },";
+            words++;
+        }
+    }
+    if (words == 0) {
+        out << "\n        { 0, 0 },";
+    }
+    out << "\n    };\n\n";
+
+    // The runs of code, from the first location of each to the location after it.
+    out << "    const int codeRuns[][2] = {";
+    int runs = 0;
+    for (auto loc = m_code.begin(); loc != m_code.end(); ) {
+        int first = *loc;
+        int last = first;
+        while (++loc != m_code.end() && *loc == last + 1) {
+            last++;
+        }
+        out << (runs % 6 == 0 ? "\n        " : " ") << "{ " << first << ", " << last + 1 << " },";
+        runs++;
+    }
+    out << "\n    };\n    const int CODERUNS = " << runs << ";\n}\n";
+
+    out << prologue;
+    out << "    goto L" << m_entry << ";\n";
+    for (int loc : m_code) {
+        TranslateInstruction(loc, out);
+    }
+    out << epilogue;
+
+    if (!out) {
+        Errors::RecordError("Native code file " + a_fileName + " could not be written.");
+        return false;
+    }
+    return true;
+}
+
+/*
+NAME
+
+    NativeTranslator::FindCode - Find the reachable instructions.
+
+SYNOPSIS
+
+    bool NativeTranslator::FindCode()
+
+DESCRIPTION
+
+    The instructions are followed from the entry point through both ways out of each branch.  Since
+    every operand is a fixed address, an instruction that stores into the code is found here, and
+    the program is rejected: its translation would run the instructions it had replaced.  Block
+    instructions take their addresses from memory, so the translation checks them when they run.
+    A program that uses the block device is rejected too, since the translation has none.
+
+RETURNS
+
+    bool - True if the program can be translated.
+*/
+
+bool NativeTranslator::FindCode()
+{
+    const int memSize = m_emul.getMemorySize();
+    m_code.clear();
+    m_leaders.clear();
+    m_leaders.insert(m_entry);
+
+    vector<int> pending = { m_entry };
+    while (!pending.empty()) {
+        int loc = pending.back();
+        pending.pop_back();
+        if (loc < 0 || loc >= memSize || !m_code.insert(loc).second) {
+            continue;
+        }
+        int contents = m_emul.peekWord(loc);
+        int opcode = m_emul.decodeOpcode(contents);
+        int address = m_emul.decodeAddress(contents);
+        if (address < 0 || address >= memSize) {
+            continue;
+        }
+        if (opcode == OP_Branch) {
+            m_leaders.insert(address);
+            pending.push_back(address);
+        }
+        if (FallsThrough(opcode)) {
+            pending.push_back(loc + 1);
+        }
+    }
+
+    bool valid = true;
+    for (int loc : m_code) {
+        int contents = m_emul.peekWord(loc);
+        int opcode = m_emul.decodeOpcode(contents);
+        int address = m_emul.decodeAddress(contents);
+        if (StoresToOperand(opcode) && m_code.count(address) != 0) {
+            Errors::RecordError("The instruction at location " + to_string(loc) + " modifies the code at location " +
+                to_string(address) + ", so the program cannot be translated to native code.");
+            valid = false;
+        }
+        if (opcode == OP_BlockRead || opcode == OP_BlockWrite) {
+            Errors::RecordError("The instruction at location " + to_string(loc) +
+                " uses the block device, so the program cannot be translated to native code.");
+            valid = false;
+        }
+    }
+    return valid;
+}
+
+/*
+NAME
+
+    NativeTranslator::TranslateInstruction - Write the statements for one instruction.
+
+SYNOPSIS
+
+    void NativeTranslator::TranslateInstruction(int a_loc, ostream& a_out) const
+        int a_loc       --> Location of the instruction.
+        ostream& a_out  --> Receives the statements.
+
+DESCRIPTION
+
+    The checks the emulator makes as it runs are made here where they can be, so the statements
+    for an instruction whose operand is out of bounds just report the fault.  The instruction after
+    one that falls through is the next one written, unless the program counter would leave memory.
+
+*/
+
+void NativeTranslator::TranslateInstruction(int a_loc, ostream& a_out) const
+{
+    int contents = m_emul.peekWord(a_loc);
+    int opcode = m_emul.decodeOpcode(contents);
+    int address = m_emul.decodeAddress(contents);
+    string at = " at location " + to_string(a_loc) + ".";
+    string word = "memory[" + to_string(address) + "]";
+
+    if (m_leaders.count(a_loc) != 0) {
+        a_out << "L" << a_loc << ":\n";
+    }
+    if (address < 0 || address >= m_emul.getMemorySize()) {
+        Fault("Error: Address " + to_string(address) + " out of bounds" + at, a_out);
+        return;
+    }
+    switch (opcode) {
+    case OP_Load:
+        a_out << "    accum = " << word << ";\n";
+        break;
+    case OP_Store:
+        a_out << "    " << word << " = accum;\n";
+        break;
+    case OP_Read:
+        a_out << "    {\n        std::cout << \"? \";\n        int value = 0;\n        std::cin >> value;\n        "
+            << word << " = value;\n    }\n";
+        break;
+    case OP_Write:
+        a_out << "    std::cout << " << word << " << std::endl;\n";
+        break;
+    case OP_Branch:
+        a_out << "    if (accum > 0) goto L" << address << ";\n";
+        break;
+    case OP_Halt:
+        a_out << "    std::cout << \"\\nEnd of emulation\" << std::endl;\n    return 0;\n";
+        return;
+    case OP_FetchAdd:
+        a_out << "    {\n        int old = " << word << ";\n        " << word
+            << " = static_cast<int>(static_cast<unsigned>(old) + static_cast<unsigned>(accum));\n"
+            << "        accum = old;\n    }\n";
+        break;
+    case OP_CompareSwap:
+        if (address + 1 >= m_emul.getMemorySize()) {
+            Fault("Error: Address " + to_string(address + 1) + " out of bounds" + at, a_out);
+            return;
+        }
+        a_out << "    {\n        int old = " << word << ";\n        if (old == memory[" << address + 1 << "]) " << word
+            << " = accum;\n        accum = old;\n    }\n";
+        break;
+    case OP_BlockCopy:
+    case OP_BlockFill:
+    case OP_BlockSum:
+    case OP_BlockCompare:
+        a_out << "    switch (Block(" << opcode << ", " << address << ", accum)) {\n"
+            << "    case 1:\n        std::cerr << \"Error: Block at " << address << " out of bounds" << at
+            << "\" << std::endl;\n        return 1;\n"
+            << "    case 2:\n        std::cerr << \"Error: Block at " << address << " would modify the code" << at
+            << "\" << std::endl;\n        return 2;\n    }\n";
+        break;
+    default:
+        Fault("Illegal opcode " + to_string(opcode) + at, a_out);
+        return;
+    }
+    if (a_loc + 1 >= m_emul.getMemorySize()) {
+        Fault("Error: Program counter out of bounds at location " + to_string(a_loc + 1) + ".", a_out);
+    }
+}
+
+void NativeTranslator::Fault(const string& a_message, ostream& a_out)
+{
+    a_out << "    std::cerr << \"" << a_message << "\" << std::endl;\n    return 1;\n";
+}
@@ -0,0 +1,35 @@
+//
+//		NativeTranslator class.  Translates a program image to a C++ source file, so a program
+//		that is run many times can be compiled once to native code instead of being emulated.
+//
+#pragma once
+
+#include "Emulator.h"
+#include "stdafx.h"
+
+class NativeTranslator {
+
+public:
+    // Translates the program loaded in a_emul.
+    NativeTranslator(const emulator& a_emul);
+
+    // Writes the translation to a file.  Records an error and returns false if the program cannot
+    // be translated or the file cannot be written.
+    bool Write(const string& a_fileName);
+
+private:
+    // Finds the instructions that can be reached from the entry point, and the locations that
+    // start basic blocks.  Returns false if a reachable instruction stores into the code.
+    bool FindCode();
+
+    // Writes the statements for the instruction at a location.
+    void TranslateInstruction(int a_loc, ostream& a_out) const;
+
+    // Writes the statements that report a fault and end the run.
+    static void Fault(const string& a_message, ostream& a_out);
+
+    const emulator& m_emul;     // Holds the program.
+    int m_entry;                // Where the program starts.
+    set<int> m_code;            // Locations of the reachable instructions.
+    set<int> m_leaders;         // Locations that start basic blocks: the entry and branch targets.
+};
@@ -0,0 +1,213 @@
+// ObjectModule.cpp
+//
+// Implementation of the ObjectModule class.
+// Object modules are stored as text, one record per line:
+//
+//      VCOBJ <address digits> <size>
+//      PUBLIC <symbol> <offset>
+//      EXTERN <symbol>
+//      <offset> <contents> <A|R|X> [symbol]
+//
+#include "stdafx.h"
+#include "ObjectModule.h"
+#include "Errors.h"
+
+#include <fstream>
+
+/*
+NAME
+
+    ObjectModule::ObjectModule - Constructor for the ObjectModule class.
+
+SYNOPSIS
+
+    ObjectModule::ObjectModule()
+
+DESCRIPTION
+
+    This constructor creates an empty module with the default four digit address field.
+
+*/
+
+ObjectModule::ObjectModule()
+    : m_addrDigits(4), m_size(0)
+{
+}
+
+/*
+NAME
+
+    ObjectModule::Read - Read a module from a file.
+
+SYNOPSIS
+
+    bool ObjectModule::Read(const string& a_fileName)
+        const string& a_fileName --> The object file.
+
+DESCRIPTION
+
+    This function replaces the contents of the module with the module stored in the file.  Any
+    malformed record is reported as an error naming the file and line.
+
+RETURNS
+
+    bool - True if the module was read without errors.
+*/
+
+bool ObjectModule::Read(const string& a_fileName)
+{
+    ifstream file(a_fileName);
+    if (!file) {
+        Errors::RecordError("Object file " + a_fileName + " could not be opened.");
+        return false;
+    }
+    m_words.clear();
+    m_exports.clear();
+    m_imports.clear();
+
+    string line;
+    string record;
+    int lineNum = 0;
+    bool ok = true;
+
+    getline(file, line);
+    lineNum++;
+    istringstream header(line);
+    if (!(header >> record >> m_addrDigits >> m_size) || record != "VCOBJ") {
+        Errors::RecordError(a_fileName + " is not an object module.");
+        return false;
+    }
+
+    while (getline(file, line)) {
+        lineNum++;
+        istringstream iss(line);
+        if (!(iss >> record)) continue;
+
+        bool valid;
+        if (record == "PUBLIC") {
+            pair<string, int> entry;
+            valid = static_cast<bool>(iss >> entry.first >> entry.second);
+            if (valid) m_exports.push_back(entry);
+        }
+        else if (record == "EXTERN") {
+            string symbol;
+            valid = static_cast<bool>(iss >> symbol);
+            if (valid) m_imports.push_back(symbol);
+        }
+        else {
+            ObjectWord word;
+            try {
+                word.location = stoi(record);
+                valid = static_cast<bool>(iss >> word.contents >> word.relocation);
+            }
+            catch (...) {
+                valid = false;
+            }
+            if (valid && word.relocation == 'X') {
+                valid = static_cast<bool>(iss >> word.symbol);
+            }
+            valid = valid && (word.relocation == 'A' || word.relocation == 'R' || word.relocation == 'X');
+            if (valid) m_words.push_back(word);
+        }
+        if (!valid) {
+            Errors::RecordError("Malformed record in " + a_fileName + " line " + to_string(lineNum) + ".");
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/*
+NAME
+
+    ObjectModule::Write - Write the module to a file.
+
+SYNOPSIS
+
+    bool ObjectModule::Write(const string& a_fileName) const
+        const string& a_fileName --> The object file.
+
+DESCRIPTION
+
+    This function stores the module in the text format described at the top of this file.
+
+RETURNS
+
+    bool - True if the file was written.
+*/
+
+bool ObjectModule::Write(const string& a_fileName) const
+{
+    ofstream file(a_fileName);
+    if (!file) {
+        Errors::RecordError("Object file " + a_fileName + " could not be created.");
+        return false;
+    }
+    file << "VCOBJ " << m_addrDigits << " " << m_size << "\n";
+    for (const auto& entry : m_exports) {
+        file << "PUBLIC " << entry.first << " " << entry.second << "\n";
+    }
+    for (const auto& symbol : m_imports) {
+        file << "EXTERN " << symbol << "\n";
+    }
+    for (const auto& word : m_words) {
+        file << word.location << " " << word.contents << " " << word.relocation;
+        if (word.relocation == 'X') {
+            file << " " << word.symbol;
+        }
+        file << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+// Building a module.
+void ObjectModule::SetAddressDigits(int a_digits)
+{
+    m_addrDigits = a_digits;
+}
+
+void ObjectModule::SetSize(int a_size)
+{
+    m_size = a_size;
+}
+
+void ObjectModule::AddWord(const ObjectWord& a_word)
+{
+    m_words.push_back(a_word);
+}
+
+void ObjectModule::AddExport(const string& a_symbol, int a_location)
+{
+    m_exports.push_back(make_pair(a_symbol, a_location));
+}
+
+void ObjectModule::AddImport(const string& a_symbol)
+{
+    m_imports.push_back(a_symbol);
+}
+
+// Accessors
+int ObjectModule::GetAddressDigits() const
+{
+    return m_addrDigits;
+}
+
+int ObjectModule::GetSize() const
+{
+    return m_size;
+}
+
+const vector<ObjectWord>& ObjectModule::GetWords() const
+{
+    return m_words;
+}
+
+const vector<pair<string, int>>& ObjectModule::GetExports() const
+{
+    return m_exports;
+}
+
+const vector<string>& ObjectModule::GetImports() const
+{
+    return m_imports;
+}
@@ -0,0 +1,48 @@
+//
+//		ObjectModule class.  A relocatable object module: the words of a separately
+//		assembled program, the symbols it exports and imports, and how to relocate it.
+//
+#pragma once
+
+#include "stdafx.h"
+
+// One word of an object module.
+struct ObjectWord {
+    int location;       // Offset of the word from the start of the module.
+    int contents;       // The word.  Its address field is relative to the module, or zero for an import.
+    char relocation;    // 'A' absolute, 'R' add the module's base, 'X' add the address of the symbol.
+    string symbol;      // The imported symbol, for 'X'.
+};
+
+class ObjectModule {
+
+public:
+    ObjectModule();
+
+    // Reads a module from a file, recording errors if it is malformed.
+    bool Read(const string& a_fileName);
+
+    // Writes the module to a file.
+    bool Write(const string& a_fileName) const;
+
+    // Building a module.
+    void SetAddressDigits(int a_digits);
+    void SetSize(int a_size);
+    void AddWord(const ObjectWord& a_word);
+    void AddExport(const string& a_symbol, int a_location);
+    void AddImport(const string& a_symbol);
+
+    // Accessors
+    int GetAddressDigits() const;                           // Width of the address field of the words.
+    int GetSize() const;                                    // Words of memory the module spans.
+    const vector<ObjectWord>& GetWords() const;             // The words, in location order.
+    const vector<pair<string, int>>& GetExports() const;    // Exported symbols and their offsets.
+    const vector<string>& GetImports() const;               // Imported symbols.
+
+private:
+    int m_addrDigits;                       // Width of the address field of the words.
+    int m_size;                             // Words of memory the module spans.
+    vector<ObjectWord> m_words;             // The words.
+    vector<pair<string, int>> m_exports;    // Exported symbols and their offsets.
+    vector<string> m_imports;               // Imported symbols.
+};
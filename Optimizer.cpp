@@ -0,0 +1,588 @@
+// Optimizer.cpp
+//
+// Implementation of the Optimizer class.
+// Peephole rewriting of the intermediate representation with label relocation.
+//
+#include "stdafx.h"
+#include "Optimizer.h"
+
+namespace {
+    // Location at which the emulator starts executing.  It must not move.
+    const int ENTRYPOINT = 100;
+
+    // Upper bound on rewriting rounds, so chains of branches settle even if they form cycles.
+    const int MAXROUNDS = 64;
+}
+
+/*
+NAME
+
+    Optimizer::Optimizer - Constructor for the Optimizer class.
+
+SYNOPSIS
+
+    Optimizer::Optimizer(vector<IntermediateInstruction>& a_program, SymbolTable& a_symtab,
+            const vector<string>& a_exports)
+        vector<IntermediateInstruction>& a_program --> The program, as located by Pass I.
+        SymbolTable& a_symtab                      --> The symbol table built by Pass I.
+        const vector<string>& a_exports            --> Symbols named by PUBLIC, which other modules may write.
+
+DESCRIPTION
+
+    This constructor records the program and symbol table to be optimized and indexes the line on
+    which each label is defined.  Nothing is changed until Optimize is called.
+
+*/
+
+Optimizer::Optimizer(vector<IntermediateInstruction>& a_program, SymbolTable& a_symtab,
+    const vector<string>& a_exports)
+    : m_program(a_program), m_symtab(a_symtab), m_exports(a_exports), m_removed(a_program.size(), false),
+    m_leader(a_program.size(), false), m_peephole(false), m_mergeConstants(false), m_instructions(0),
+    m_redundant(0), m_branchesToNext(0), m_unreachable(0), m_threaded(0), m_constants(0), m_merged(0)
+{
+    for (size_t i = 0; i < m_program.size(); i++) {
+        const IntermediateInstruction& interm = m_program[i];
+        if (interm.type == Instruction::ST_MachineLanguage) {
+            m_instructions++;
+        }
+        if (!interm.label.empty() &&
+            (interm.type == Instruction::ST_MachineLanguage || interm.type == Instruction::ST_AssemblerInstr)) {
+            m_labelLine.emplace(interm.label, i);
+        }
+    }
+}
+
+/*
+NAME
+
+    Optimizer::Optimize - Optimize the program.
+
+SYNOPSIS
+
+    bool Optimizer::Optimize()
+
+DESCRIPTION
+
+    This function applies the rewriting rules until none of them changes the program, then merges
+    equal constants, then closes the gaps left by the removed lines and relocates the labels.  Every
+    rule preserves the values the program reads and writes and the words it stores, so the output of
+    the program and the contents of its labeled memory are unchanged; only the number of instructions
+    executed and the size of the program go down.
+
+    Removed lines stay in the program as comments, so they still appear in the listing.
+
+RETURNS
+
+    bool - False if the program cannot be optimized safely, in which case it is left unchanged.
+*/
+
+bool Optimizer::Optimize(bool a_peephole, bool a_mergeConstants)
+{
+    if (!IsSafe()) {
+        return false;
+    }
+    m_peephole = a_peephole;
+    m_mergeConstants = a_mergeConstants;
+
+    for (int round = 0; m_peephole && round < MAXROUNDS; round++) {
+        FindLeaders();
+        bool changed = RemoveRedundant();
+        changed = ThreadBranches() || changed;
+        changed = RemoveUnreachable() || changed;
+        if (!changed) break;
+    }
+    if (m_mergeConstants) {
+        FindLeaders();
+        MergeConstants();
+    }
+    Relocate();
+    return true;
+}
+
+/*
+NAME
+
+    Optimizer::IsSafe - Check that the program may be rewritten.
+
+SYNOPSIS
+
+    bool Optimizer::IsSafe()
+
+DESCRIPTION
+
+    Removing an instruction moves every later word of its ORG region, and a program that loads, stores,
+    reads or writes its own instructions, or branches into data, would see those words change.  This
+    function rejects such programs.  It also rejects programs whose operands are not all labels, since
+    only labels can be relocated, and programs with ENTRY directives, since the rules assume no other
+    hart reads or writes memory between two instructions.  Block instructions are rejected as well:
+    their descriptors hold addresses as numbers, which would not move with the labels.  A literal
+    operand (=N) is allowed: its word is in the literal pool, which the assembler moves itself.
+
+RETURNS
+
+    bool - True if the program may be optimized.
+*/
+
+bool Optimizer::IsSafe()
+{
+    for (const auto& interm : m_program) {
+        if (interm.type == Instruction::ST_AssemblerInstr && interm.opcode == "ENTRY") {
+            m_reason = "the program runs on several harts";
+            return false;
+        }
+        if (interm.type != Instruction::ST_MachineLanguage || interm.operand.empty()) continue;
+
+        if (interm.opcode == "BCOPY" || interm.opcode == "BFILL" || interm.opcode == "BSUM" || interm.opcode == "BCMP" ||
+            interm.opcode == "BREAD" || interm.opcode == "BWRITE") {
+            m_reason = "block instruction at '" + interm.operand + "'";
+            return false;
+        }
+        if (interm.operand[0] == '=') continue;
+
+        auto target = m_labelLine.find(interm.operand);
+        if (target == m_labelLine.end()) {
+            m_reason = "operand '" + interm.operand + "' is not a label";
+            return false;
+        }
+        bool targetIsCode = m_program[target->second].type == Instruction::ST_MachineLanguage;
+        if (interm.opcode == "BP" && !targetIsCode) {
+            m_reason = "branch into data at '" + interm.operand + "'";
+            return false;
+        }
+        if (interm.opcode != "BP" && targetIsCode) {
+            m_reason = "instruction '" + interm.operand + "' is used as data";
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+NAME
+
+    Optimizer::FindLeaders - Find the lines control may reach other than by falling through.
+
+SYNOPSIS
+
+    void Optimizer::FindLeaders()
+
+DESCRIPTION
+
+    A leader is the target of a branch or the instruction at the entry point.  Leaders start the basic
+    blocks of the control flow graph, and the rules never assume anything about the accumulator on
+    entry to one, nor remove one that follows a HALT.
+
+*/
+
+void Optimizer::FindLeaders()
+{
+    fill(m_leader.begin(), m_leader.end(), false);
+    for (size_t i = 0; i < m_program.size(); i++) {
+        if (!IsCode(i)) continue;
+
+        if (m_program[i].location == ENTRYPOINT) {
+            m_leader[i] = true;
+        }
+        if (m_program[i].opcode == "BP") {
+            size_t target = Resolve(m_program[i].operand);
+            if (target < m_program.size()) {
+                m_leader[target] = true;
+            }
+        }
+    }
+}
+
+/*
+NAME
+
+    Optimizer::ThreadBranches - Retarget branches to branches.
+
+SYNOPSIS
+
+    bool Optimizer::ThreadBranches()
+
+DESCRIPTION
+
+    A BP is only taken when the accumulator is positive, and a BP leaves the accumulator alone, so a
+    taken BP whose target is another BP always takes that one too.  This function points such a branch
+    straight at the final target.
+
+RETURNS
+
+    bool - True if any branch was retargeted.
+*/
+
+bool Optimizer::ThreadBranches()
+{
+    bool changed = false;
+    for (size_t i = 0; i < m_program.size(); i++) {
+        if (!IsCode(i) || m_program[i].opcode != "BP") continue;
+
+        size_t target = Resolve(m_program[i].operand);
+        if (target == i || target >= m_program.size() || m_program[target].opcode != "BP") continue;
+        if (m_program[target].operand == m_program[i].operand) continue;
+
+        m_program[i].operand = m_program[target].operand;
+        m_threaded++;
+        changed = true;
+    }
+    return changed;
+}
+
+/*
+NAME
+
+    Optimizer::RemoveRedundant - Remove redundant loads, stores and branches.
+
+SYNOPSIS
+
+    bool Optimizer::RemoveRedundant()
+
+DESCRIPTION
+
+    This function looks at each instruction and the one that follows it in memory:
+
+    - STORE x then LOAD x: the accumulator already holds x, so the LOAD goes.
+    - LOAD x then STORE x: x already holds the accumulator, so the STORE goes.
+    - STORE x then STORE x: the second STORE goes.
+    - LOAD a then LOAD b: the first load is overwritten before it is used, so it goes.
+    - BP to the following instruction: both outcomes continue there, so the BP goes.
+
+    The second instruction of a pair is only removed if it is not a leader, since it might otherwise
+    be reached with a different accumulator.
+
+RETURNS
+
+    bool - True if any instruction was removed.
+*/
+
+bool Optimizer::RemoveRedundant()
+{
+    bool changed = false;
+    for (size_t i = 0; i < m_program.size(); i++) {
+        if (!IsCode(i)) continue;
+
+        const IntermediateInstruction& first = m_program[i];
+        size_t next = Next(i);
+
+        if (first.opcode == "BP") {
+            if (next < m_program.size() && Resolve(first.operand) == next) {
+                changed = Remove(i, m_branchesToNext) || changed;
+            }
+            continue;
+        }
+        if (next >= m_program.size() || !IsCode(next)) continue;
+
+        const IntermediateInstruction& second = m_program[next];
+        if (first.opcode == "LOAD" && second.opcode == "LOAD") {
+            changed = Remove(i, m_redundant) || changed;
+        }
+        else if (!m_leader[next] && first.operand == second.operand &&
+            ((first.opcode == "STORE" && second.opcode == "LOAD") ||
+             (first.opcode == "LOAD" && second.opcode == "STORE") ||
+             (first.opcode == "STORE" && second.opcode == "STORE"))) {
+            changed = Remove(next, m_redundant) || changed;
+        }
+    }
+    return changed;
+}
+
+/*
+NAME
+
+    Optimizer::RemoveUnreachable - Remove instructions that can never execute.
+
+SYNOPSIS
+
+    bool Optimizer::RemoveUnreachable()
+
+DESCRIPTION
+
+    Control never falls through a HALT, so the instructions after one are dead up to the next leader.
+    Data lines stop the search, since they are not executed.
+
+RETURNS
+
+    bool - True if any instruction was removed.
+*/
+
+bool Optimizer::RemoveUnreachable()
+{
+    bool changed = false;
+    for (size_t i = 0; i < m_program.size(); i++) {
+        if (!IsCode(i) || m_program[i].opcode != "HALT") continue;
+
+        for (size_t next = Next(i); next < m_program.size() && IsCode(next) && !m_leader[next]; next = Next(next)) {
+            if (!Remove(next, m_unreachable)) break;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/*
+NAME
+
+    Optimizer::MergeConstants - Merge constants of equal value.
+
+SYNOPSIS
+
+    bool Optimizer::MergeConstants()
+
+DESCRIPTION
+
+    A labeled DC whose label is never the operand of STORE, READ, FAA or CAS, nor named by PUBLIC so
+    another module could write it, keeps its value for the whole run.  Two such constants of equal
+    value may therefore share one word: the later DC goes and its label moves to the earlier one.
+    IsSafe has already ruled out block instructions, whose descriptors could write anywhere, and
+    operands that are not labels.  CAS also reads the word after its operand, so that word stays
+    where it is.  A DC whose operand is not a number is not merged.
+
+RETURNS
+
+    bool - True if any constant was merged.
+*/
+
+bool Optimizer::MergeConstants()
+{
+    // Labels the program may write, and the words CAS reads after its operand.
+    set<string> written(m_exports.begin(), m_exports.end());
+    vector<bool> pinned(m_program.size(), false);
+    for (size_t i = 0; i < m_program.size(); i++) {
+        if (!IsCode(i)) continue;
+
+        const IntermediateInstruction& interm = m_program[i];
+        if (interm.opcode == "STORE" || interm.opcode == "READ" || interm.opcode == "FAA" || interm.opcode == "CAS") {
+            written.insert(interm.operand);
+        }
+        if (interm.opcode == "CAS") {
+            size_t target = Resolve(interm.operand);
+            size_t next = target < m_program.size() ? Next(target) : target;
+            if (next < m_program.size()) {
+                pinned[next] = true;
+            }
+        }
+    }
+
+    map<int, size_t> kept;  // The line of the first constant of each value.
+    Instruction inst;
+    bool changed = false;
+    for (size_t i = 0; i < m_program.size(); i++) {
+        const IntermediateInstruction& interm = m_program[i];
+        if (m_removed[i] || interm.type != Instruction::ST_AssemblerInstr || interm.opcode != "DC") continue;
+
+        m_constants++;
+        if (interm.label.empty() || m_labelLine[interm.label] != i || written.count(interm.label) != 0) continue;
+
+        // Pass I does not check the operand of a DC, so one that is not a number is left for
+        // Pass II to report.
+        inst.ParseInstruction(interm.originalLine);
+        if (!inst.IsNumericOperand()) continue;
+
+        int value = inst.GetOperandNumValue();
+        auto first = kept.find(value);
+        if (first == kept.end()) {
+            kept.emplace(value, i);
+            continue;
+        }
+        if (pinned[i] || !Remove(i, m_merged)) continue;
+
+        m_mergedInto[interm.label] = m_program[first->second].label;
+        changed = true;
+    }
+    return changed;
+}
+
+/*
+NAME
+
+    Optimizer::Relocate - Close the gaps left by removed instructions.
+
+SYNOPSIS
+
+    void Optimizer::Relocate()
+
+DESCRIPTION
+
+    Every removed instruction moves the rest of its ORG region down by one word.  A label on a removed
+    line moves to the word that now follows it, which is where control would have continued, except
+    that the label of a merged constant moves to the constant it was merged into.  The new locations
+    of the labels are given to the symbol table, and removed lines become comments.
+
+*/
+
+void Optimizer::Relocate()
+{
+    unordered_map<string, int> newLocations;
+    int shift = 0; // Words removed since the last ORG.
+
+    for (size_t i = 0; i < m_program.size(); i++) {
+        IntermediateInstruction& interm = m_program[i];
+        interm.location -= shift;
+
+        if (interm.type == Instruction::ST_AssemblerInstr && interm.opcode == "ORG") {
+            shift = 0;
+        }
+        if (!interm.label.empty() && m_labelLine.count(interm.label) != 0 && m_labelLine[interm.label] == i) {
+            newLocations[interm.label] = interm.location;
+        }
+        if (m_removed[i]) {
+            interm.type = Instruction::ST_Comment;
+            shift++;
+        }
+    }
+    for (const auto& alias : m_mergedInto) {
+        newLocations[alias.first] = newLocations[alias.second];
+    }
+    m_symtab.RelocateSymbols(newLocations);
+}
+
+/*
+NAME
+
+    Optimizer::DisplaySavings - Display the number of instructions removed.
+
+SYNOPSIS
+
+    void Optimizer::DisplaySavings(ostream& a_out) const
+        ostream& a_out --> Receives the report.
+
+DESCRIPTION
+
+    This function displays how many instructions each rule removed or retargeted, and the resulting
+    reduction in the size of the program, followed by the number of constants merged if that was
+    asked for.
+
+*/
+
+void Optimizer::DisplaySavings(ostream& a_out) const
+{
+    int removed = m_redundant + m_branchesToNext + m_unreachable;
+
+    a_out << "\nOptimization:\n";
+    a_out << "--------------------------------------\n" << left;
+    if (m_peephole) {
+        a_out << setw(30) << "Redundant loads/stores" << m_redundant << "\n";
+        a_out << setw(30) << "Branches to next instruction" << m_branchesToNext << "\n";
+        a_out << setw(30) << "Unreachable instructions" << m_unreachable << "\n";
+        a_out << setw(30) << "Branches threaded" << m_threaded << "\n";
+        a_out << setw(30) << "Instructions removed" << removed << " of " << m_instructions;
+        if (m_instructions > 0) {
+            a_out << " (" << (100 * removed) / m_instructions << "%)";
+        }
+        a_out << "\n";
+    }
+    if (m_mergeConstants) {
+        a_out << setw(30) << "Constants merged" << m_merged << " of " << m_constants << "\n";
+    }
+    a_out << "--------------------------------------\n\n";
+}
+
+const string& Optimizer::GetReason() const
+{
+    return m_reason;
+}
+
+/*
+NAME
+
+    Optimizer::Next - Find the line that follows another in memory.
+
+SYNOPSIS
+
+    size_t Optimizer::Next(size_t a_line) const
+        size_t a_line --> The line to start from.
+
+DESCRIPTION
+
+    This function skips comments, removed lines and any other lines that occupy no memory.  An ORG
+    breaks the sequence, since the words on either side of it are not adjacent.
+
+RETURNS
+
+    size_t - The index of the next instruction or data line, or the size of the program if there is none.
+*/
+
+size_t Optimizer::Next(size_t a_line) const
+{
+    for (size_t i = a_line + 1; i < m_program.size(); i++) {
+        const IntermediateInstruction& interm = m_program[i];
+        if (m_removed[i] || interm.type == Instruction::ST_Comment || interm.type == Instruction::ST_Invalid) continue;
+        if (interm.type == Instruction::ST_End || interm.opcode == "ORG") break;
+        return i;
+    }
+    return m_program.size();
+}
+
+/*
+NAME
+
+    Optimizer::Resolve - Find the line a label refers to.
+
+SYNOPSIS
+
+    size_t Optimizer::Resolve(const string& a_label) const
+        const string& a_label --> The label.
+
+DESCRIPTION
+
+    A label on a removed line refers to whatever now follows that line, so this function follows
+    removed lines forward until it reaches one that remains.
+
+RETURNS
+
+    size_t - The index of the line, or the size of the program if the label is not defined.
+*/
+
+size_t Optimizer::Resolve(const string& a_label) const
+{
+    auto entry = m_labelLine.find(a_label);
+    if (entry == m_labelLine.end()) {
+        return m_program.size();
+    }
+    size_t line = entry->second;
+    return m_removed[line] ? Next(line) : line;
+}
+
+/*
+NAME
+
+    Optimizer::Remove - Remove an instruction.
+
+SYNOPSIS
+
+    bool Optimizer::Remove(size_t a_line, int& a_counter)
+        size_t a_line  --> The line to remove.
+        int& a_counter --> Savings counter to credit.
+
+DESCRIPTION
+
+    Removing a line below the entry point would move the instruction at the entry point, so such
+    lines are kept.  If the line is a leader, the line that now follows it becomes one, since branches
+    to the removed line land there.
+
+RETURNS
+
+    bool - True if the line was removed.
+*/
+
+bool Optimizer::Remove(size_t a_line, int& a_counter)
+{
+    if (m_program[a_line].location < ENTRYPOINT) {
+        return false;
+    }
+    m_removed[a_line] = true;
+    if (m_leader[a_line]) {
+        size_t next = Next(a_line);
+        if (next < m_program.size()) {
+            m_leader[next] = true;
+        }
+    }
+    a_counter++;
+    return true;
+}
+
+bool Optimizer::IsCode(size_t a_line) const
+{
+    return !m_removed[a_line] && m_program[a_line].type == Instruction::ST_MachineLanguage;
+}
@@ -0,0 +1,72 @@
+//
+//		Optimizer class.  Peephole optimization of the intermediate representation
+//		between Pass I and Pass II, and merging of equal read-only constants.
+//
+#pragma once
+
+#include "Instruction.h"
+#include "SymTab.h"
+#include "stdafx.h"
+
+class Optimizer {
+
+public:
+    // The optimizer rewrites the program and relocates the labels of the symbol table in place.
+    Optimizer(vector<IntermediateInstruction>& a_program, SymbolTable& a_symtab, const vector<string>& a_exports);
+
+    // Optimizes the program with the peephole rules, merging equal constants, or both.  Returns
+    // false, leaving it untouched, if it cannot be done safely.
+    bool Optimize(bool a_peephole, bool a_mergeConstants);
+
+    // Displays the number of instructions removed, by kind.
+    void DisplaySavings(ostream& a_out = cout) const;
+
+    // Reason the program could not be optimized, if Optimize returned false.
+    const string& GetReason() const;
+
+private:
+    // Checks that the program never treats code as data, which relocation would break.
+    bool IsSafe();
+
+    // Finds the lines that control may reach other than by falling through.
+    void FindLeaders();
+
+    // The rewriting rules.  Each returns true if it changed the program.
+    bool ThreadBranches();      // BP to a BP goes straight to the final target.
+    bool RemoveRedundant();     // STORE x/LOAD x, LOAD x/STORE x, LOAD a/LOAD b and BP to the next line.
+    bool RemoveUnreachable();   // Instructions that follow a HALT and are not branched to.
+    bool MergeConstants();      // A DC never written that equals an earlier one shares its word.
+
+    // Closes the gaps left by removed instructions and moves the labels accordingly.
+    void Relocate();
+
+    // Next line after a_line that occupies memory, or the size of the program if there is none.
+    size_t Next(size_t a_line) const;
+
+    // Line a label currently refers to, following a removed line to its successor.
+    size_t Resolve(const string& a_label) const;
+
+    // Removes a line, if it may be moved without moving the entry point of the program.
+    bool Remove(size_t a_line, int& a_counter);
+
+    bool IsCode(size_t a_line) const;   // True for an instruction that has not been removed.
+
+    vector<IntermediateInstruction>& m_program;   // The program being optimized.
+    SymbolTable& m_symtab;                        // Its symbol table.
+    const vector<string>& m_exports;              // Symbols named by PUBLIC.
+    unordered_map<string, size_t> m_labelLine;    // Line each label is defined on.
+    vector<bool> m_removed;                       // Lines removed so far.
+    vector<bool> m_leader;                        // Lines that are the target of a branch or the entry point.
+    unordered_map<string, string> m_mergedInto;   // Label of each merged constant, and of the one it was merged into.
+    string m_reason;                              // Why the program could not be optimized.
+    bool m_peephole;                              // True if the peephole rules were applied.
+    bool m_mergeConstants;                        // True if equal constants were merged.
+
+    int m_instructions;         // Instructions in the original program.
+    int m_redundant;            // Redundant loads and stores removed.
+    int m_branchesToNext;       // Branches to the following instruction removed.
+    int m_unreachable;          // Unreachable instructions removed.
+    int m_threaded;             // Branches retargeted to skip another branch.
+    int m_constants;            // DC constants in the program.
+    int m_merged;               // Constants merged into an earlier one.
+};
@@ -0,0 +1,526 @@
+//
+//  Implementation of the command line options class.
+//
+#include "stdafx.h"
+#include "Options.h"
+#include "Emulator.h"
+
+/*
+NAME
+
+    Options::Options - Constructor for Options that parses the command line.
+
+SYNOPSIS
+
+    Options::Options(int argc, char *argv[])
+        int argc     --> The number of command-line arguments provided.
+        char *argv[] --> An array of strings representing the command-line arguments.
+
+DESCRIPTION
+
+    This constructor scans the command line for the optional switches and the input files, which are
+    a single source file or, when linking, one or more object modules.  The supported switches are:
+
+        -m <words>  --> Size of the emulated address space.  Sizes above emulator::MEMSZ widen the
+                        address field of the machine word and use paged memory.
+        -j <threads> --> Most threads the assembler passes may use.  Defaults to the number of
+                        hardware threads.
+        -O          --> Run the peephole optimizer between Pass I and Pass II.
+        -merge      --> Between the passes, merge DC constants of equal value that the program
+                        never stores to into one word.  May be combined with -O; neither can be
+                        combined with -pipeline or -stream.
+        -pipeline   --> Read, parse and translate the source on separate threads at once, for
+                        sources on slow file systems.  Cannot be combined with -O.
+        -stream     --> Read the source once for each pass instead of holding it in memory, so
+                        memory grows with the number of symbols rather than the size of the source.
+                        A source that cannot be read twice, such as a pipe, is spooled to a
+                        temporary file.  Cannot be combined with -O or -pipeline.
+        -free       --> Run each hart of a program with ENTRY directives on its own thread, rather
+                        than letting the harts take turns on one thread in a repeatable order.
+        -debug      --> Run the program under the interactive debugger.
+        -maxinstr <count> --> Stop a run that has executed this many instructions.
+        -maxtime <ms>     --> Stop a run that has taken this many milliseconds.
+        -maxout <values>  --> Stop a run that tries to write more than this many values.
+                              A run stopped by a limit is reported with where it stopped.  The
+                              limits apply to each hart, and to each run a service makes.
+        -stats <format>   --> At the end, report the time taken by each phase and counts of the
+                              work done to the error stream, as a table with "text" or as a JSON
+                              object with "json".  A build with VC_COUNT_ALLOCATIONS defined also
+                              reports the heap allocations of each phase.
+        -timing     --> Estimate the cycles the program would take on the hardware, and report them
+                        for each basic block and each source line after the run.  Needs a program
+                        with one hart, assembled and run here without -stream.
+        -costs <file> --> With -timing, read the cost of each opcode, the taken-branch penalty, the
+                        I/O latency and the cache from a cost file instead of using the defaults.
+        -c <file>   --> Write a relocatable object module instead of running the program.
+        -link       --> Link the object modules named on the command line and run the result.
+        -o <file>   --> With -link, also write the linked image to a file.
+        -native <file> --> Translate the program, assembled or linked, to a C++ source file instead
+                        of running it, to be compiled to native code.
+        -serve <socket>   --> Run as a service, assembling and running programs for clients that
+                              connect to the Unix domain socket.  No input file is named.
+        -connect <socket> --> Assemble and run the source file through the service on the socket.
+        -lsp        --> Serve an editor over the Language Server Protocol on the standard input and
+                        output.  No input file is named; the editor sends the documents.
+        -crosscheck <programs> --> Run this many random programs on every engine of the emulator
+                        and compare the results, shrinking any program they differ on.  No input
+                        file is named.  -j sets the threads used and -maxinstr the limit on each run.
+        -seed <n>   --> With -crosscheck, the seed of the first program.  Defaults to 1.
+        -alloccheck --> Check that parsing a line and emulating an instruction allocate nothing
+                        once warmed up, and fail if they do.  Needs a build with
+                        VC_COUNT_ALLOCATIONS defined.  No input file is named.
+        -cache <dir>      --> Keep assembled programs in a cache directory and run an unchanged
+                              program from there instead of assembling it again.
+        -device <file>    --> Attach a data file as the block device that BREAD and BWRITE
+                              transfer ranges of words to and from.  A file whose name ends in
+                              .txt holds numbers separated by white space; any other holds 32-bit
+                              words.  The file is created if it does not exist.
+        -devicesize <words> --> With -device, extend the file with zeros to at least this many words.
+
+    If the command line is malformed, the usage is reported and the program terminates.
+
+*/
+
+Options::Options( int argc, char *argv[] )
+{
+    m_memSize = emulator::MEMSZ;
+    m_optimize = false;
+    m_mergeConstants = false;
+    m_link = false;
+    m_pipeline = false;
+    m_stream = false;
+    m_freeRunning = false;
+    m_debug = false;
+    m_languageServer = false;
+    m_allocationCheck = false;
+    m_crossCheckCount = 0;
+    m_seed = 1;
+    m_seedGiven = false;
+    m_instructionLimit = 0;
+    m_timeLimit = 0;
+    m_outputLimit = 0;
+    m_timing = false;
+    m_stats = false;
+    m_statsJson = false;
+    m_deviceSize = 0;
+    m_threads = max( static_cast<int>( thread::hardware_concurrency( ) ), 1 );
+
+    for( int i = 1; i < argc; i++ ) {
+        string arg = argv[i];
+
+        if( arg == "-m" ) {
+            if( ++i >= argc ) {
+                Usage( );
+            }
+            try {
+                m_memSize = stoi( argv[i] );
+            }
+            catch( ... ) {
+                Usage( );
+            }
+            if( m_memSize <= 0 || m_memSize > emulator::MAXMEMSZ ) {
+                cerr << "Memory size must be between 1 and " << emulator::MAXMEMSZ << " words." << endl;
+                exit( 1 );
+            }
+        }
+        else if( arg == "-j" ) {
+            if( ++i >= argc ) {
+                Usage( );
+            }
+            try {
+                m_threads = stoi( argv[i] );
+            }
+            catch( ... ) {
+                Usage( );
+            }
+            if( m_threads <= 0 ) {
+                Usage( );
+            }
+        }
+        else if( arg == "-O" ) {
+            m_optimize = true;
+        }
+        else if( arg == "-merge" ) {
+            m_mergeConstants = true;
+        }
+        else if( arg == "-pipeline" ) {
+            m_pipeline = true;
+        }
+        else if( arg == "-stream" ) {
+            m_stream = true;
+        }
+        else if( arg == "-free" ) {
+            m_freeRunning = true;
+        }
+        else if( arg == "-debug" ) {
+            m_debug = true;
+        }
+        else if( arg == "-lsp" ) {
+            m_languageServer = true;
+        }
+        else if( arg == "-alloccheck" ) {
+            m_allocationCheck = true;
+        }
+        else if( arg == "-crosscheck" || arg == "-seed" ) {
+            if( ++i >= argc ) {
+                Usage( );
+            }
+            try {
+                ( arg == "-crosscheck" ? m_crossCheckCount : m_seed ) = stoll( argv[i] );
+            }
+            catch( ... ) {
+                Usage( );
+            }
+            if( m_crossCheckCount < 0 ) {
+                Usage( );
+            }
+            m_seedGiven = m_seedGiven || arg == "-seed";
+        }
+        else if( arg == "-maxinstr" || arg == "-maxtime" || arg == "-maxout" ) {
+            if( ++i >= argc ) {
+                Usage( );
+            }
+            long long &limit = arg == "-maxinstr" ? m_instructionLimit : arg == "-maxtime" ? m_timeLimit : m_outputLimit;
+            try {
+                limit = stoll( argv[i] );
+            }
+            catch( ... ) {
+                Usage( );
+            }
+            if( limit <= 0 ) {
+                Usage( );
+            }
+        }
+        else if( arg == "-stats" ) {
+            if( ++i >= argc ) {
+                Usage( );
+            }
+            string format = argv[i];
+            if( format != "text" && format != "json" ) {
+                Usage( );
+            }
+            m_stats = true;
+            m_statsJson = format == "json";
+        }
+        else if( arg == "-timing" ) {
+            m_timing = true;
+        }
+        else if( arg == "-costs" ) {
+            if( ++i >= argc ) {
+                Usage( );
+            }
+            m_costFile = argv[i];
+        }
+        else if( arg == "-c" || arg == "-o" ) {
+            if( ++i >= argc ) {
+                Usage( );
+            }
+            ( arg == "-c" ? m_objectFile : m_imageFile ) = argv[i];
+        }
+        else if( arg == "-native" ) {
+            if( ++i >= argc ) {
+                Usage( );
+            }
+            m_nativeFile = argv[i];
+        }
+        else if( arg == "-serve" || arg == "-connect" ) {
+            if( ++i >= argc ) {
+                Usage( );
+            }
+            ( arg == "-serve" ? m_servePath : m_connectPath ) = argv[i];
+        }
+        else if( arg == "-cache" ) {
+            if( ++i >= argc ) {
+                Usage( );
+            }
+            m_cacheDir = argv[i];
+        }
+        else if( arg == "-device" ) {
+            if( ++i >= argc ) {
+                Usage( );
+            }
+            m_deviceFile = argv[i];
+        }
+        else if( arg == "-devicesize" ) {
+            if( ++i >= argc ) {
+                Usage( );
+            }
+            try {
+                m_deviceSize = stoi( argv[i] );
+            }
+            catch( ... ) {
+                Usage( );
+            }
+            if( m_deviceSize <= 0 ) {
+                Usage( );
+            }
+        }
+        else if( arg == "-link" ) {
+            m_link = true;
+        }
+        else if( !arg.empty( ) && arg[0] == '-' ) {
+            Usage( );
+        }
+        else {
+            m_inputFiles.push_back( arg );
+        }
+    }
+    // The optimizer needs the whole program before anything is translated, and a stream keeps
+    // none of it.
+    if( ( m_pipeline || m_stream ) && ( m_optimize || m_mergeConstants ) ) {
+        Usage( );
+    }
+    if( m_pipeline && m_stream ) {
+        Usage( );
+    }
+    if( m_deviceSize > 0 && m_deviceFile.empty( ) ) {
+        Usage( );
+    }
+    if( !m_costFile.empty( ) && !m_timing ) {
+        Usage( );
+    }
+    // A language server takes its documents from the editor and does nothing else.
+    if( m_languageServer ) {
+        if( argc != 2 ) {
+            Usage( );
+        }
+        return;
+    }
+    // The allocation check brings its own lines and program and does nothing else.
+    if( m_allocationCheck ) {
+        if( argc != 2 ) {
+            Usage( );
+        }
+        return;
+    }
+    // The cross-check makes its own programs.
+    if( m_crossCheckCount > 0 ) {
+        if( !m_inputFiles.empty( ) || m_link || !m_servePath.empty( ) || !m_connectPath.empty( ) ||
+            !m_objectFile.empty( ) || !m_cacheDir.empty( ) || !m_nativeFile.empty( ) || m_debug ||
+            !m_deviceFile.empty( ) || m_timing ) {
+            Usage( );
+        }
+        return;
+    }
+    if( m_seedGiven ) {
+        Usage( );
+    }
+    // A service takes its programs from its clients.
+    if( !m_servePath.empty( ) ) {
+        if( !m_inputFiles.empty( ) || m_link || !m_connectPath.empty( ) || !m_objectFile.empty( ) ||
+            !m_cacheDir.empty( ) || !m_nativeFile.empty( ) || !m_deviceFile.empty( ) || m_timing ) {
+            Usage( );
+        }
+        return;
+    }
+    // Check that there is exactly one source file, or at least one module to link.
+    if( m_inputFiles.empty( ) || ( !m_link && m_inputFiles.size( ) != 1 ) ) {
+        Usage( );
+    }
+    if( !m_connectPath.empty( ) && ( m_link || !m_objectFile.empty( ) || !m_deviceFile.empty( ) ) ) {
+        Usage( );
+    }
+    if( !m_cacheDir.empty( ) && ( m_link || !m_objectFile.empty( ) || !m_connectPath.empty( ) || m_stream ) ) {
+        Usage( );
+    }
+    // The debugger runs a program assembled in this process.
+    if( m_debug && ( m_link || !m_objectFile.empty( ) || !m_connectPath.empty( ) || !m_cacheDir.empty( ) ) ) {
+        Usage( );
+    }
+    if( m_link ? !m_objectFile.empty( ) : !m_imageFile.empty( ) ) {
+        Usage( );
+    }
+    // The translation is of a complete program, in place of running it.
+    if( !m_nativeFile.empty( ) && ( !m_objectFile.empty( ) || !m_connectPath.empty( ) || !m_cacheDir.empty( ) || m_debug ) ) {
+        Usage( );
+    }
+    // The device is used by a program that is run here.
+    if( !m_deviceFile.empty( ) && ( !m_objectFile.empty( ) || !m_nativeFile.empty( ) ) ) {
+        Usage( );
+    }
+    // The estimate is reported against the source lines the run executed.
+    if( m_timing && ( m_link || m_stream || m_debug || !m_objectFile.empty( ) || !m_nativeFile.empty( ) ||
+        !m_connectPath.empty( ) || !m_cacheDir.empty( ) ) ) {
+        Usage( );
+    }
+}
+
+/*
+NAME
+
+    Options::Usage - Report the correct usage of the program and terminate.
+
+SYNOPSIS
+
+    void Options::Usage()
+
+DESCRIPTION
+
+    This function prints the command line syntax to the error stream and terminates the program.
+
+*/
+
+void Options::Usage( )
+{
+    cerr << "Usage: Assem [-m <words>] [-j <threads>] [-O] [-merge] [-pipeline | -stream] [-free | -debug] [<Limits>] [<Device>] [-timing [-costs <CostFile>]] [-stats text|json] [-c <ObjectFile> | -cache <Dir> | -native <CppFile>] <FileName>" << endl;
+    cerr << "       Assem [-m <words>] [<Limits>] [<Device>] [-stats text|json] -link [-o <ImageFile>] [-native <CppFile>] <ObjectFile> ..." << endl;
+    cerr << "       Assem [-m <words>] [-j <threads>] [-O] [-merge] [<Limits>] -serve <Socket>" << endl;
+    cerr << "       Assem -connect <Socket> <FileName>" << endl;
+    cerr << "       Assem -lsp" << endl;
+    cerr << "       Assem -alloccheck" << endl;
+    cerr << "       Assem [-j <threads>] [-maxinstr <count>] -crosscheck <Programs> [-seed <n>]" << endl;
+    cerr << "Limits: [-maxinstr <count>] [-maxtime <ms>] [-maxout <values>]" << endl;
+    cerr << "Device: -device <DataFile> [-devicesize <words>]" << endl;
+    exit( 1 );
+}
+
+// Accessors
+const string& Options::GetSourceFile( ) const
+{
+    return m_inputFiles.front( );
+}
+
+const vector<string>& Options::GetInputFiles( ) const
+{
+    return m_inputFiles;
+}
+
+int Options::GetMemorySize( ) const
+{
+    return m_memSize;
+}
+
+int Options::GetThreadCount( ) const
+{
+    return m_threads;
+}
+
+bool Options::GetOptimize( ) const
+{
+    return m_optimize;
+}
+
+bool Options::GetMergeConstants( ) const
+{
+    return m_mergeConstants;
+}
+
+const string& Options::GetObjectFile( ) const
+{
+    return m_objectFile;
+}
+
+bool Options::GetLink( ) const
+{
+    return m_link;
+}
+
+const string& Options::GetImageFile( ) const
+{
+    return m_imageFile;
+}
+
+const string& Options::GetNativeFile( ) const
+{
+    return m_nativeFile;
+}
+
+const string& Options::GetServePath( ) const
+{
+    return m_servePath;
+}
+
+const string& Options::GetConnectPath( ) const
+{
+    return m_connectPath;
+}
+
+const string& Options::GetCacheDir( ) const
+{
+    return m_cacheDir;
+}
+
+const string& Options::GetDeviceFile( ) const
+{
+    return m_deviceFile;
+}
+
+int Options::GetDeviceSize( ) const
+{
+    return m_deviceSize;
+}
+
+bool Options::GetPipeline( ) const
+{
+    return m_pipeline;
+}
+
+bool Options::GetStream( ) const
+{
+    return m_stream;
+}
+
+bool Options::GetFreeRunning( ) const
+{
+    return m_freeRunning;
+}
+
+bool Options::GetDebug( ) const
+{
+    return m_debug;
+}
+
+bool Options::GetLanguageServer( ) const
+{
+    return m_languageServer;
+}
+
+bool Options::GetAllocationCheck( ) const
+{
+    return m_allocationCheck;
+}
+
+long long Options::GetCrossCheckCount( ) const
+{
+    return m_crossCheckCount;
+}
+
+long long Options::GetSeed( ) const
+{
+    return m_seed;
+}
+
+long long Options::GetInstructionLimit( ) const
+{
+    return m_instructionLimit;
+}
+
+long long Options::GetTimeLimit( ) const
+{
+    return m_timeLimit;
+}
+
+long long Options::GetOutputLimit( ) const
+{
+    return m_outputLimit;
+}
+
+bool Options::GetTiming( ) const
+{
+    return m_timing;
+}
+
+const string& Options::GetCostFile( ) const
+{
+    return m_costFile;
+}
+
+bool Options::GetStats( ) const
+{
+    return m_stats;
+}
+
+bool Options::GetStatsJson( ) const
+{
+    return m_statsJson;
+}
@@ -0,0 +1,82 @@
+//
+//		Command line options of the assembler.
+//
+#pragma once
+
+#include "stdafx.h"
+
+class Options {
+
+public:
+
+    // Parses the command line.  Terminates with a usage message if it is malformed.
+    Options( int argc, char *argv[] );
+
+    // Accessors
+    const string& GetSourceFile( ) const;   // Name of the VC source file.
+    const vector<string>& GetInputFiles( ) const;   // All files named on the command line.
+    int GetMemorySize( ) const;             // Number of words in the emulated address space.
+    int GetThreadCount( ) const;            // Most threads a pass may use.
+    bool GetOptimize( ) const;              // True if the peephole optimizer should run.
+    bool GetMergeConstants( ) const;        // True if equal read-only constants are merged.
+    const string& GetObjectFile( ) const;   // Object module to write instead of running, if any.
+    bool GetLink( ) const;                  // True if the input files are object modules to link.
+    const string& GetImageFile( ) const;    // File to write the linked image to, if any.
+    const string& GetNativeFile( ) const;   // C++ file to translate the program to instead of running it, if any.
+    const string& GetServePath( ) const;    // Socket to serve clients on, if running as a service.
+    const string& GetConnectPath( ) const;  // Socket of the service to run the program through, if any.
+    const string& GetCacheDir( ) const;     // Directory of the assembled image cache, if it is used.
+    const string& GetDeviceFile( ) const;   // Data file attached as the block device, if any.
+    int GetDeviceSize( ) const;             // Least number of words in the block device.
+    bool GetPipeline( ) const;              // True if reading, parsing and translating are pipelined.
+    bool GetStream( ) const;                // True if the source is read twice rather than held in memory.
+    bool GetFreeRunning( ) const;           // True if each hart runs on its own thread.
+    bool GetDebug( ) const;                 // True if the program runs under the debugger.
+    bool GetLanguageServer( ) const;        // True if serving an editor as a language server.
+    bool GetAllocationCheck( ) const;       // True if checking that the steady state allocates nothing.
+    long long GetCrossCheckCount( ) const;  // Number of random programs to cross-check the engines on, or 0.
+    long long GetSeed( ) const;             // Seed of the first of them.
+    long long GetInstructionLimit( ) const; // Most instructions a run may execute, or 0 for no limit.
+    long long GetTimeLimit( ) const;        // Most milliseconds a run may take, or 0 for no limit.
+    long long GetOutputLimit( ) const;      // Most values a run may write, or 0 for no limit.
+    bool GetTiming( ) const;                // True if the cycles the program would take are estimated.
+    const string& GetCostFile( ) const;     // Costs of the machine for the estimate, if not the default ones.
+    bool GetStats( ) const;                 // True if statistics are reported at the end.
+    bool GetStatsJson( ) const;             // True if they are reported as JSON rather than text.
+
+private:
+
+    // Reports the correct usage and terminates.
+    static void Usage( );
+
+    vector<string> m_inputFiles;    // Files named on the command line.
+    int m_memSize;          // Number of words in the emulated address space.
+    int m_threads;          // Most threads a pass may use.
+    bool m_optimize;        // True if the peephole optimizer should run.
+    bool m_mergeConstants;  // True if equal read-only constants are merged.
+    string m_objectFile;    // Object module to write instead of running, if any.
+    bool m_link;            // True if the input files are object modules to link.
+    string m_imageFile;     // File to write the linked image to, if any.
+    string m_nativeFile;    // C++ file to translate the program to instead of running it, if any.
+    string m_servePath;     // Socket to serve clients on, if running as a service.
+    string m_connectPath;   // Socket of the service to run the program through, if any.
+    string m_cacheDir;      // Directory of the assembled image cache, if it is used.
+    string m_deviceFile;    // Data file attached as the block device, if any.
+    int m_deviceSize;       // Least number of words in the block device.
+    bool m_pipeline;        // True if reading, parsing and translating are pipelined.
+    bool m_stream;          // True if the source is read twice rather than held in memory.
+    bool m_freeRunning;     // True if each hart runs on its own thread.
+    bool m_debug;           // True if the program runs under the debugger.
+    bool m_languageServer;  // True if serving an editor as a language server.
+    bool m_allocationCheck; // True if checking that the steady state allocates nothing.
+    long long m_crossCheckCount;    // Number of random programs to cross-check the engines on, or 0.
+    long long m_seed;               // Seed of the first of them.
+    bool m_seedGiven;               // True if -seed was given.
+    long long m_instructionLimit;   // Most instructions a run may execute, or 0 for no limit.
+    long long m_timeLimit;          // Most milliseconds a run may take, or 0 for no limit.
+    long long m_outputLimit;        // Most values a run may write, or 0 for no limit.
+    bool m_timing;          // True if the cycles the program would take are estimated.
+    string m_costFile;      // Costs of the machine for the estimate, if not the default ones.
+    bool m_stats;           // True if statistics are reported at the end.
+    bool m_statsJson;       // True if they are reported as JSON rather than text.
+};
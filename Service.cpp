@@ -0,0 +1,751 @@
+// Service.cpp
+//
+// Implementation of the Service class.
+//
+// Clients talk to the service over a Unix domain socket with a line oriented protocol:
+//
+//      client                              service
+//      ASSEMBLE <bytes>\n<source>          OK <words>  or  ERRORS <count> followed by "- <message>" lines
+//      RUN\n                               OUT <value> for each WRITE, then HALT, FAULT <message>
+//                                          or LIMIT <message> if a run limit stopped it
+//      INPUT <value>\n                     (a value for READ; may be sent before it is asked for)
+//                                          READ when the program needs a value that has not been sent
+//      QUIT\n                              (closes the connection)
+//
+// One thread accepts connections and receives requests.  A pool of worker threads assembles
+// and runs the programs.  A program that reaches a READ without input gives up its worker
+// and is only queued again when the INPUT arrives, and a program that runs for a long time
+// yields its worker between time slices, so a few workers serve any number of sessions.
+//
+#include "stdafx.h"
+#include "Service.h"
+#include "Assembler.h"
+#include "Errors.h"
+
+#include <fstream>
+
+#pragma comment(lib, "Ws2_32.lib")
+
+/*
+NAME
+
+    Service::Session::Session - Constructor for a client session.
+
+SYNOPSIS
+
+    Service::Session::Session(SOCKET a_sock)
+        SOCKET a_sock --> The accepted connection.  The session closes it when destroyed.
+
+DESCRIPTION
+
+    This constructor creates a session with no program and nothing to do.
+
+*/
+
+Service::Session::Session(SOCKET a_sock)
+    : sock(a_sock), sourceBytes(0), scheduled(false), closed(false), running(false), waitingForInput(false)
+{
+}
+
+Service::Session::~Session()
+{
+    closesocket(sock);
+}
+
+/*
+NAME
+
+    Service::Service - Constructor for the Service class.
+
+SYNOPSIS
+
+    Service::Service(const Options& a_opts)
+        const Options& a_opts --> The command line options.  -serve names the socket, -j the number of
+                                  worker threads, and the rest apply to the programs served.
+
+DESCRIPTION
+
+    This constructor initializes the socket library.  The socket itself is created by Run.
+
+*/
+
+Service::Service(const Options& a_opts)
+    : m_opts(a_opts), m_listener(INVALID_SOCKET)
+{
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+}
+
+Service::~Service()
+{
+    if (m_listener != INVALID_SOCKET) {
+        closesocket(m_listener);
+    }
+    WSACleanup();
+}
+
+/*
+NAME
+
+    Service::Run - Serve clients.
+
+SYNOPSIS
+
+    int Service::Run()
+
+DESCRIPTION
+
+    This function binds the listening socket, starts the workers, and then waits for connections and
+    requests.  Any stale socket file left by an earlier service is removed first.
+
+RETURNS
+
+    int - Exit status, if the socket could not be set up.  Otherwise the function does not return.
+*/
+
+int Service::Run()
+{
+    const string& path = m_opts.GetServePath();
+    sockaddr_un address = {};
+    if (path.size() >= sizeof(address.sun_path)) {
+        cerr << "Socket path " << path << " is too long." << endl;
+        return 1;
+    }
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    DeleteFileA(path.c_str());
+
+    m_listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_listener == INVALID_SOCKET ||
+        ::bind(m_listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR ||
+        listen(m_listener, SOMAXCONN) == SOCKET_ERROR) {
+        cerr << "Could not listen on " << path << "." << endl;
+        return 1;
+    }
+    cout << "Serving on " << path << " with " << m_opts.GetThreadCount() << " workers." << endl;
+
+    for (int i = 0; i < m_opts.GetThreadCount(); i++) {
+        m_workers.emplace_back(&Service::WorkerLoop, this);
+    }
+
+    while (true) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(m_listener, &readable);
+        for (const auto& entry : m_sessions) {
+            FD_SET(entry.first, &readable);
+        }
+        if (select(0, &readable, nullptr, nullptr, nullptr) == SOCKET_ERROR) {
+            continue;
+        }
+
+        if (FD_ISSET(m_listener, &readable)) {
+            AcceptSession();
+        }
+        for (auto entry = m_sessions.begin(); entry != m_sessions.end(); ) {
+            if (FD_ISSET(entry->first, &readable) && !ReceiveData(entry->second)) {
+                CloseSession(entry->second);
+                entry = m_sessions.erase(entry); // A worker may still hold the session for a while.
+            }
+            else {
+                ++entry;
+            }
+        }
+    }
+}
+
+/*
+NAME
+
+    Service::AcceptSession - Accept a new connection.
+
+SYNOPSIS
+
+    void Service::AcceptSession()
+
+DESCRIPTION
+
+    This function accepts a pending connection and starts a session for it.  Connections beyond what
+    select can wait on are refused.
+
+*/
+
+void Service::AcceptSession()
+{
+    SOCKET sock = accept(m_listener, nullptr, nullptr);
+    if (sock == INVALID_SOCKET) return;
+
+    if (m_sessions.size() + 1 >= FD_SETSIZE) {
+        SendText(sock, "ERR too many sessions\n");
+        closesocket(sock);
+        return;
+    }
+    m_sessions[sock] = make_shared<Session>(sock);
+}
+
+/*
+NAME
+
+    Service::ReceiveData - Read a client's requests.
+
+SYNOPSIS
+
+    bool Service::ReceiveData(const shared_ptr<Session>& a_session)
+        const shared_ptr<Session>& a_session --> A session whose socket is readable.
+
+DESCRIPTION
+
+    This function receives whatever the client has sent and parses any complete requests.
+
+RETURNS
+
+    bool - False if the connection was closed or a request was malformed, in which case the session ends.
+*/
+
+bool Service::ReceiveData(const shared_ptr<Session>& a_session)
+{
+    char buffer[4096];
+    int count = recv(a_session->sock, buffer, sizeof(buffer), 0);
+    if (count <= 0) {
+        return false;
+    }
+    a_session->received.append(buffer, count);
+    return ParseRequests(a_session);
+}
+
+/*
+NAME
+
+    Service::ParseRequests - Turn received bytes into commands.
+
+SYNOPSIS
+
+    bool Service::ParseRequests(const shared_ptr<Session>& a_session)
+        const shared_ptr<Session>& a_session --> The session.
+
+DESCRIPTION
+
+    This function takes complete request lines, and the source text that follows an ASSEMBLE, from
+    the bytes received so far and submits them as commands.  The commands are submitted together, so
+    input sent along with a RUN is already there when the program asks for it.  An incomplete
+    request is left for the next call.
+
+RETURNS
+
+    bool - False if the client sent QUIT or a malformed request.
+*/
+
+bool Service::ParseRequests(const shared_ptr<Session>& a_session)
+{
+    Session& session = *a_session;
+    vector<Command> commands;
+    bool open = true;
+    while (open) {
+        if (session.sourceBytes > 0) {
+            size_t take = min(session.sourceBytes, session.received.size());
+            session.source.append(session.received, 0, take);
+            session.received.erase(0, take);
+            session.sourceBytes -= take;
+            if (session.sourceBytes > 0) break;
+
+            Command command;
+            command.kind = Command::C_Assemble;
+            command.source.swap(session.source);
+            commands.push_back(move(command));
+        }
+
+        size_t newline = session.received.find('\n');
+        if (newline == string::npos) break;
+
+        istringstream request(session.received.substr(0, newline));
+        session.received.erase(0, newline + 1);
+
+        string verb;
+        request >> verb;
+        Command command;
+        if (verb == "ASSEMBLE") {
+            long long bytes = 0;
+            open = (request >> bytes) && bytes >= 0;
+            session.sourceBytes = open ? static_cast<size_t>(bytes) : 0;
+            if (open && bytes == 0) {
+                command.kind = Command::C_Assemble;
+                commands.push_back(move(command));
+            }
+        }
+        else if (verb == "RUN") {
+            command.kind = Command::C_Run;
+            commands.push_back(move(command));
+        }
+        else if (verb == "INPUT") {
+            command.kind = Command::C_Input;
+            open = static_cast<bool>(request >> command.value);
+            if (open) commands.push_back(move(command));
+        }
+        else {
+            open = verb.empty(); // QUIT or an unknown request ends the session.
+        }
+    }
+    if (open && !commands.empty()) {
+        Submit(a_session, commands);
+    }
+    return open;
+}
+
+/*
+NAME
+
+    Service::Submit - Queue commands for a session.
+
+SYNOPSIS
+
+    void Service::Submit(const shared_ptr<Session>& a_session, vector<Command>& a_commands)
+        const shared_ptr<Session>& a_session --> The session.
+        vector<Command>& a_commands          --> The commands, in the order received.  They are moved
+                                                 into the session.
+
+DESCRIPTION
+
+    Input values are kept apart from the other commands so that a program can consume values sent
+    before it asked for them.  A session that is not already with a worker is put on the ready
+    queue.  A session waiting at a READ is only queued once a value arrives.
+
+*/
+
+void Service::Submit(const shared_ptr<Session>& a_session, vector<Command>& a_commands)
+{
+    lock_guard<mutex> lock(m_mutex);
+    for (auto& command : a_commands) {
+        if (command.kind == Command::C_Input) {
+            a_session->input.push_back(command.value);
+        }
+        else {
+            a_session->commands.push_back(move(command));
+        }
+    }
+    if (!a_session->scheduled) {
+        a_session->scheduled = true;
+        m_queue.push_back(a_session);
+        m_ready.notify_one();
+    }
+}
+
+/*
+NAME
+
+    Service::CloseSession - End a session whose client has gone.
+
+SYNOPSIS
+
+    void Service::CloseSession(const shared_ptr<Session>& a_session)
+        const shared_ptr<Session>& a_session --> The session.
+
+DESCRIPTION
+
+    This function marks the session closed, so that a worker holding it stops running its program
+    and drops it.  The connection is closed when the last reference to the session goes.
+
+*/
+
+void Service::CloseSession(const shared_ptr<Session>& a_session)
+{
+    lock_guard<mutex> lock(m_mutex);
+    a_session->closed = true;
+    a_session->commands.clear();
+}
+
+/*
+NAME
+
+    Service::WorkerLoop - Body of each worker thread.
+
+SYNOPSIS
+
+    void Service::WorkerLoop()
+
+DESCRIPTION
+
+    Each worker takes the next session from the ready queue, serves it, and goes back for another.
+
+*/
+
+void Service::WorkerLoop()
+{
+    while (true) {
+        shared_ptr<Session> session;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_ready.wait(lock, [this] { return !m_queue.empty(); });
+            session = m_queue.front();
+            m_queue.pop_front();
+        }
+        Serve(session);
+    }
+}
+
+/*
+NAME
+
+    Service::Serve - Handle a session's queued commands.
+
+SYNOPSIS
+
+    void Service::Serve(const shared_ptr<Session>& a_session)
+        const shared_ptr<Session>& a_session --> The session, which this worker now holds.
+
+DESCRIPTION
+
+    This function runs the session's program if it is waiting for input that has now arrived, then
+    handles queued commands in order.  A running program is resumed after each command that starts
+    it.  The session is released when it has nothing left to do or its program needs input that has
+    not arrived, and is put back at the end of the ready queue when its program uses up a time slice.
+
+*/
+
+void Service::Serve(const shared_ptr<Session>& a_session)
+{
+    Session& session = *a_session;
+    while (true) {
+        // What to do next is decided, and the session released, in one locked section, so that a
+        // value or command Submit adds after the decision finds the session released and queues it.
+        bool resume;
+        Command command;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            if (session.closed) {
+                session.scheduled = false;
+                session.emul.reset();
+                session.loaded.reset();
+                return;
+            }
+            resume = session.running && (!session.waitingForInput || !session.input.empty());
+            if (!resume) {
+                if (session.commands.empty()) {
+                    session.scheduled = false;
+                    return;
+                }
+                command = move(session.commands.front());
+                session.commands.pop_front();
+            }
+        }
+        if (resume) {
+            if (!Resume(session)) {
+                // The time slice ran out; let other sessions have the worker.
+                lock_guard<mutex> lock(m_mutex);
+                m_queue.push_back(a_session);
+                m_ready.notify_one();
+                return;
+            }
+            continue;
+        }
+
+        if (command.kind == Command::C_Assemble) {
+            session.running = false;
+            Assemble(session, command.source);
+        }
+        else if (!session.image || !session.image->errors.empty()) {
+            SendText(session.sock, "FAULT no program\n");
+        }
+        else {
+            // Running the same program again only restores the memory the last run changed.
+            if (session.loaded == session.image) {
+                session.emul->resetImage();
+            }
+            else {
+                session.emul.reset(new emulator(m_opts.GetMemorySize()));
+                session.emul->setLimits({ m_opts.GetInstructionLimit(), m_opts.GetTimeLimit(), m_opts.GetOutputLimit() });
+                for (const auto& word : session.image->module.GetWords()) {
+                    session.emul->insertMemory(word.location, word.contents);
+                }
+                session.emul->saveImage();
+                session.emul->startProgram();
+                session.loaded = session.image;
+            }
+            session.running = true;
+            session.waitingForInput = false;
+        }
+    }
+}
+
+/*
+NAME
+
+    Service::Resume - Continue the running program.
+
+SYNOPSIS
+
+    bool Service::Resume(Session& a_session)
+        Session& a_session --> The session, whose program is running.
+
+DESCRIPTION
+
+    This function supplies any pending input and runs the program for one time slice, relaying its
+    output.  If the program stops at a READ with no input, the client is asked for a value.  When the
+    program halts, faults or reaches a run limit, it stops running but stays loaded for the next RUN.
+
+RETURNS
+
+    bool - False if the time slice ran out with the program still running.
+*/
+
+bool Service::Resume(Session& a_session)
+{
+    emulator& emul = *a_session.emul;
+    if (a_session.waitingForInput) {
+        lock_guard<mutex> lock(m_mutex);
+        emul.provideInput(a_session.input.front());
+        a_session.input.pop_front();
+        a_session.waitingForInput = false;
+    }
+
+    while (true) {
+        ostringstream out;
+        ostringstream err;
+        emulator::RunStatus status = emul.execute(out, err, TIMESLICE);
+
+        string reply;
+        istringstream written(out.str());
+        string value;
+        while (getline(written, value)) {
+            reply += "OUT " + value + "\n";
+        }
+
+        if (status == emulator::RS_NeedInput) {
+            lock_guard<mutex> lock(m_mutex);
+            if (!a_session.input.empty()) {
+                emul.provideInput(a_session.input.front());
+                a_session.input.pop_front();
+                SendText(a_session.sock, reply);
+                continue;
+            }
+            a_session.waitingForInput = true;
+            reply += "READ\n";
+        }
+        else if (status == emulator::RS_Halted) {
+            reply += "HALT\n";
+            a_session.running = false;
+        }
+        else if (status != emulator::RS_Running) {
+            string message = err.str();
+            message.erase(message.find_last_not_of("\r\n") + 1);
+            reply += (status == emulator::RS_LimitReached ? "LIMIT " : "FAULT ") + message + "\n";
+            a_session.running = false;
+        }
+        SendText(a_session.sock, reply);
+        return status != emulator::RS_Running;
+    }
+}
+
+/*
+NAME
+
+    Service::Assemble - Handle an ASSEMBLE request.
+
+SYNOPSIS
+
+    void Service::Assemble(Session& a_session, const string& a_source)
+        Session& a_session      --> The session.
+        const string& a_source  --> The source text.
+
+DESCRIPTION
+
+    This function makes the program the session's current program and reports whether it assembled.
+
+*/
+
+void Service::Assemble(Session& a_session, const string& a_source)
+{
+    a_session.image = LookupImage(a_source);
+
+    const Image& image = *a_session.image;
+    if (image.errors.empty()) {
+        SendText(a_session.sock, "OK " + to_string(image.module.GetWords().size()) + "\n");
+        return;
+    }
+    string reply = "ERRORS " + to_string(image.errors.size()) + "\n";
+    for (const auto& emsg : image.errors) {
+        reply += "- " + emsg + "\n";
+    }
+    SendText(a_session.sock, reply);
+}
+
+/*
+NAME
+
+    Service::LookupImage - Find or assemble a program.
+
+SYNOPSIS
+
+    shared_ptr<const Image> Service::LookupImage(const string& a_source)
+        const string& a_source --> The source text.
+
+DESCRIPTION
+
+    Recently assembled programs are kept in a small cache keyed by their source text, so clients that
+    submit the same program again skip the assembler.  Otherwise the program is assembled on this
+    worker with its errors captured, and added to the cache, displacing the least recently used one.
+    A program that includes files is not added, since an included file may change while the text
+    that includes it stays the same.
+
+RETURNS
+
+    shared_ptr<const Image> - The assembled program.
+*/
+
+shared_ptr<const Service::Image> Service::LookupImage(const string& a_source)
+{
+    {
+        lock_guard<mutex> lock(m_cacheMutex);
+        for (auto entry = m_cache.begin(); entry != m_cache.end(); ++entry) {
+            if (entry->first == a_source) {
+                m_cache.splice(m_cache.begin(), m_cache, entry);
+                return entry->second;
+            }
+        }
+    }
+
+    shared_ptr<Image> image = make_shared<Image>();
+    ostringstream listing;
+    bool includesFiles;
+    vector<string>* outer = Errors::CaptureErrors(&image->errors);
+    {
+        Assembler assem(m_opts, a_source, listing);
+        assem.PassI();
+        assem.Optimize();
+        assem.PassII();
+        assem.BuildObjectModule(image->module);
+        includesFiles = assem.IncludesFiles();
+    }
+    Errors::CaptureErrors(outer);
+
+    // The source text does not show a change to a file it includes, so such a program is not kept.
+    if (includesFiles) {
+        return image;
+    }
+    lock_guard<mutex> lock(m_cacheMutex);
+    m_cache.emplace_front(a_source, image);
+    if (m_cache.size() > IMAGECACHESIZE) {
+        m_cache.pop_back();
+    }
+    return image;
+}
+
+/*
+NAME
+
+    Service::SendText - Send a reply to a client.
+
+SYNOPSIS
+
+    bool Service::SendText(SOCKET a_sock, const string& a_text)
+        SOCKET a_sock        --> The connection.
+        const string& a_text --> The reply.
+
+DESCRIPTION
+
+    This function sends the whole reply, however many calls it takes.
+
+RETURNS
+
+    bool - False if the connection failed.
+*/
+
+bool Service::SendText(SOCKET a_sock, const string& a_text)
+{
+    size_t sent = 0;
+    while (sent < a_text.size()) {
+        int count = send(a_sock, a_text.data() + sent, static_cast<int>(a_text.size() - sent), 0);
+        if (count == SOCKET_ERROR) {
+            return false;
+        }
+        sent += count;
+    }
+    return true;
+}
+
+/*
+NAME
+
+    Service::RunClient - Run a program through a running service.
+
+SYNOPSIS
+
+    int Service::RunClient(const Options& a_opts)
+        const Options& a_opts --> The command line options.  -connect names the socket.
+
+DESCRIPTION
+
+    This function sends the source file to the service, runs it, and relays the program's output and
+    its requests for input between the service and the console.  It is the local client used to
+    try out and test the service.
+
+RETURNS
+
+    int - Zero if the program ran to completion.
+*/
+
+int Service::RunClient(const Options& a_opts)
+{
+    ifstream file(a_opts.GetSourceFile(), ios::in | ios::binary);
+    if (!file) {
+        cerr << "Source file could not be opened." << endl;
+        return 1;
+    }
+    stringstream source;
+    source << file.rdbuf();
+
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, a_opts.GetConnectPath().c_str(), sizeof(address.sun_path) - 1);
+    SOCKET sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == INVALID_SOCKET ||
+        connect(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR) {
+        cerr << "Could not connect to " << a_opts.GetConnectPath() << "." << endl;
+        WSACleanup();
+        return 1;
+    }
+
+    string text = source.str();
+    SendText(sock, "ASSEMBLE " + to_string(text.size()) + "\n" + text + "RUN\n");
+
+    int status = 1;
+    bool done = false;
+    string received;
+    char buffer[4096];
+    while (!done) {
+        int count = recv(sock, buffer, sizeof(buffer), 0);
+        if (count <= 0) break;
+        received.append(buffer, count);
+
+        size_t newline;
+        while (!done && (newline = received.find('\n')) != string::npos) {
+            string line = received.substr(0, newline);
+            received.erase(0, newline + 1);
+
+            if (line.compare(0, 4, "OUT ") == 0) {
+                cout << line.substr(4) << endl;
+            }
+            else if (line == "READ") {
+                cout << "? ";
+                int value = 0;
+                cin >> value;
+                SendText(sock, "INPUT " + to_string(value) + "\n");
+            }
+            else if (line == "HALT") {
+                cout << "\nEnd of emulation" << endl;
+                status = 0;
+                done = true;
+            }
+            else if (line.compare(0, 2, "OK") != 0) {
+                // Errors and faults are reported as they are; ERRORS is followed by its messages.
+                cout << line << endl;
+                done = line.compare(0, 6, "ERRORS") != 0 && line.compare(0, 2, "- ") != 0;
+            }
+        }
+    }
+    closesocket(sock);
+    WSACleanup();
+    return status;
+}
@@ -0,0 +1,100 @@
+//
+//		Service class.  A long-lived assembler and emulator that serves clients over a
+//		local socket, so programs are not assembled and run in a new process each time.
+//
+#pragma once
+
+#include "Options.h"
+#include "ObjectModule.h"
+#include "Emulator.h"
+#include "stdafx.h"
+
+#include <winsock2.h>
+#include <afunix.h>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <list>
+
+class Service {
+
+public:
+    // The service listens on the socket named by the -serve option.
+    Service(const Options& a_opts);
+    ~Service();
+
+    // Serves clients until the process is terminated.  Returns only if the socket cannot be set up.
+    int Run();
+
+    // Assembles and runs a source file through a running service, relaying the program's
+    // input and output to the console.
+    static int RunClient(const Options& a_opts);
+
+private:
+    // An assembled program, shared by every session that runs it.
+    struct Image {
+        ObjectModule module;        // The words of the program.
+        vector<string> errors;      // Assembly errors; the program cannot run if there are any.
+    };
+
+    // A request from a client.
+    struct Command {
+        enum Kind { C_Assemble, C_Run, C_Input } kind;
+        string source;              // Source text, for C_Assemble.
+        int value;                  // Input value, for C_Input.
+    };
+
+    // One client connection.
+    struct Session {
+        SOCKET sock;                        // The connection.
+        string received;                    // Bytes received but not yet parsed.  I/O thread only.
+        size_t sourceBytes;                 // Bytes of ASSEMBLE source still to come.  I/O thread only.
+        string source;                      // ASSEMBLE source received so far.  I/O thread only.
+
+        deque<Command> commands;            // Requests not yet handled.  Guarded by m_mutex.
+        deque<int> input;                   // Values for READ not yet consumed.  Guarded by m_mutex.
+        bool scheduled;                     // True while queued for or held by a worker.  Guarded by m_mutex.
+        bool closed;                        // True once the client has gone.  Guarded by m_mutex.
+
+        shared_ptr<const Image> image;      // Program assembled by the last ASSEMBLE.  Worker only.
+        unique_ptr<emulator> emul;          // The machine, kept loaded between runs.  Worker only.
+        shared_ptr<const Image> loaded;     // The program loaded in emul.  Worker only.
+        bool running;                       // True while the program in emul is running.  Worker only.
+        bool waitingForInput;               // True if the program stopped at a READ.  Worker only.
+
+        Session(SOCKET a_sock);
+        ~Session();
+    };
+
+    void AcceptSession();                                       // Accepts a new connection.
+    bool ReceiveData(const shared_ptr<Session>& a_session);     // Reads and parses a client's requests.
+    bool ParseRequests(const shared_ptr<Session>& a_session);   // Turns received bytes into commands.
+    void Submit(const shared_ptr<Session>& a_session, vector<Command>& a_commands); // Queues commands.
+    void CloseSession(const shared_ptr<Session>& a_session);    // Ends a session whose client has gone.
+
+    void WorkerLoop();                                          // Body of each worker thread.
+    void Serve(const shared_ptr<Session>& a_session);           // Handles a session's queued commands.
+    void Assemble(Session& a_session, const string& a_source);  // Handles ASSEMBLE.
+    bool Resume(Session& a_session);                            // Continues the running program.
+    shared_ptr<const Image> LookupImage(const string& a_source); // Finds or assembles a program.
+
+    static bool SendText(SOCKET a_sock, const string& a_text);  // Sends a reply.
+
+    // Programs kept assembled, most recently used first.
+    const static size_t IMAGECACHESIZE = 64;
+
+    // Taken branches a program may execute before yielding its worker to other sessions.
+    const static long long TIMESLICE = 100'000;
+
+    Options m_opts;                                     // Options for assembling and running programs.
+    SOCKET m_listener;                                  // The listening socket.
+    map<SOCKET, shared_ptr<Session>> m_sessions;        // Open connections.  I/O thread only.
+    vector<thread> m_workers;                           // The worker threads.
+
+    mutex m_mutex;                                      // Guards the ready queue and session requests.
+    condition_variable m_ready;                         // Signaled when a session is queued.
+    deque<shared_ptr<Session>> m_queue;                 // Sessions with work to do.
+
+    mutex m_cacheMutex;                                 // Guards the image cache.
+    list<pair<string, shared_ptr<const Image>>> m_cache; // Source text and image, most recent first.
+};
@@ -0,0 +1,92 @@
+// SourceCache.cpp
+//
+// Implementation of the SourceCache class.
+// A file is keyed by the path it was named by, after the assembler has made it relative to the
+// file that included it.  Its size and last write time are checked on every lookup, which costs a
+// directory lookup rather than a read, so a service picks up a changed file on its next program.
+//
+#include "stdafx.h"
+#include "SourceCache.h"
+#include "Errors.h"
+#include "Stats.h"
+
+#include <fstream>
+
+mutex SourceCache::m_mutex;
+map<string, shared_ptr<const SourceCache::File>> SourceCache::m_files;
+
+/*
+NAME
+
+    SourceCache::Find - Find an included file, reading it if need be.
+
+SYNOPSIS
+
+    shared_ptr<const SourceCache::File> SourceCache::Find(const string& a_path)
+        const string& a_path --> The path of the file.
+
+DESCRIPTION
+
+    This function returns the cached parse of the file if its size and last write time are those
+    it had when it was read.  Otherwise the file is read and each line parsed, and the result
+    replaces the cached one; an assembler still holding the old one keeps it.  The errors found
+    in each line are kept with it rather than recorded, since every program including the line
+    must report them at its own place.  Reading a file is counted in the statistics, so each file
+    counts once however many times it is included.
+
+    Files are read under the lock, so two threads including the same file at once read it once.
+
+RETURNS
+
+    shared_ptr<const SourceCache::File> - The file, or null if it cannot be read.
+*/
+
+shared_ptr<const SourceCache::File> SourceCache::Find(const string& a_path)
+{
+    WIN32_FIND_DATAA data;
+    HANDLE search = FindFirstFileA(a_path.c_str(), &data);
+    if (search == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    FindClose(search);
+    uint64_t size = (uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    uint64_t writeTime = (uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+
+    lock_guard<mutex> lock(m_mutex);
+    auto found = m_files.find(a_path);
+    if (found != m_files.end() && found->second->size == size && found->second->writeTime == writeTime) {
+        return found->second;
+    }
+
+    ifstream in(a_path);
+    if (!in) {
+        return nullptr;
+    }
+    auto file = make_shared<File>();
+    file->name = a_path;
+    file->size = size;
+    file->writeTime = writeTime;
+
+    Instruction inst;
+    vector<string> errors;
+    vector<string>* outer = Errors::CaptureErrors(&errors);
+    string text;
+    while (getline(in, text)) {
+        file->lines.emplace_back();
+        Line& line = file->lines.back();
+        line.type = inst.ParseInstruction(text);
+        line.label = inst.isLabel() ? inst.GetLabel() : "";
+        line.opcode = inst.GetOpCode();
+        line.operand = inst.GetOperand();
+        line.isLiteral = inst.IsLiteralOperand();
+        line.isValid = inst.LocationEffect(line.isSet, line.value);
+        line.errors = move(errors);
+        line.text = move(text);
+        errors.clear();
+    }
+    Errors::CaptureErrors(outer);
+    Stats::Count(Stats::C_IncludeFiles);
+
+    m_files[a_path] = file;
+    return file;
+}
@@ -0,0 +1,46 @@
+//
+//		SourceCache class.  The files named by INCLUDE directives, each read and parsed once however
+//		many times it is included, whether by one program or by the many a service assembles.  Like
+//		Errors and Stats, all members are static, so every assembler in the process shares the cache.
+//
+#pragma once
+
+#include "Instruction.h"
+#include "stdafx.h"
+
+#include <cstdint>
+#include <mutex>
+
+class SourceCache {
+
+public:
+    // A line of an included file and what parsing it found.
+    struct Line {
+        string text;                        // The line as written.
+        Instruction::InstructionType type;
+        string label;                       // The label, if the line defines one.
+        string opcode;
+        string operand;
+        bool isLiteral;                     // True if the operand is a literal (=N).
+        bool isSet;                         // The effect of the line on the location counter.
+        int value;
+        bool isValid;                       // False if the ORG or DS operand could not be parsed.
+        vector<string> errors;              // Errors found in the line alone.
+    };
+
+    // An included file, parsed.
+    struct File {
+        string name;                        // The path it was read from.
+        vector<Line> lines;
+        uint64_t size;                      // Size and last write time when it was read, so a file
+        uint64_t writeTime;                 // that has changed since is read again.
+    };
+
+    // Finds a file, reading and parsing it unless the cache holds it as it is now.  Returns null
+    // if the file cannot be read.  The file stays valid for as long as the caller holds it.
+    static shared_ptr<const File> Find(const string& a_path);
+
+private:
+    static mutex m_mutex;                                   // Guards m_files.
+    static map<string, shared_ptr<const File>> m_files;     // The files read, by path.
+};
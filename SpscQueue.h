@@ -0,0 +1,58 @@
+//
+//		SpscQueue class.  A bounded lock-free queue between exactly one producer thread and
+//		one consumer thread, used to connect the stages of the pipelined assembler.
+//
+#pragma once
+
+#include "stdafx.h"
+
+#include <atomic>
+
+template <typename T>
+class SpscQueue {
+
+public:
+    // The queue holds at most a_capacity items, rounded up to a power of two.
+    SpscQueue(size_t a_capacity)
+        : m_head(0), m_tail(0)
+    {
+        size_t capacity = 1;
+        while (capacity < a_capacity) {
+            capacity *= 2;
+        }
+        m_slots.resize(capacity);
+        m_mask = capacity - 1;
+    }
+
+    // Adds an item, waiting while the queue is full.  Called by the producer only.
+    void Push(T&& a_item)
+    {
+        size_t tail = m_tail.load(memory_order_relaxed);
+        while (tail - m_head.load(memory_order_acquire) > m_mask) {
+            this_thread::yield();
+        }
+        m_slots[tail & m_mask] = move(a_item);
+        m_tail.store(tail + 1, memory_order_release);
+    }
+
+    // Removes the oldest item, waiting while the queue is empty.  Called by the consumer only.
+    T Pop()
+    {
+        size_t head = m_head.load(memory_order_relaxed);
+        while (m_tail.load(memory_order_acquire) == head) {
+            this_thread::yield();
+        }
+        T item = move(m_slots[head & m_mask]);
+        m_head.store(head + 1, memory_order_release);
+        return item;
+    }
+
+private:
+    vector<T> m_slots;                  // The ring of items.
+    size_t m_mask;                      // Capacity less one, to wrap the counters onto the ring.
+
+    // The counters only increase.  Each is written by one thread, and they are kept on separate
+    // cache lines so the producer and consumer do not slow each other down.
+    alignas(64) atomic<size_t> m_head;  // Items removed so far.  Written by the consumer.
+    alignas(64) atomic<size_t> m_tail;  // Items added so far.  Written by the producer.
+};
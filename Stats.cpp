@@ -0,0 +1,339 @@
+// Stats.cpp
+//
+// Implementation of the Stats class.
+// The counters are cheap enough to leave in every build: counting is an addition to a block
+// belonging to the calling thread, and the phases are timed by reading the clocks once at each end.
+// Counting allocations is not, so it needs a build with VC_COUNT_ALLOCATIONS defined, which
+// replaces the global operator new and delete.
+//
+#include "stdafx.h"
+#include "Stats.h"
+#include "Emulator.h"
+
+#include <psapi.h>
+
+#pragma comment(lib, "Psapi.lib")
+
+// Initialize static members
+thread_local Stats::ThreadCounts Stats::m_threadCounts;
+atomic<long long> Stats::m_counts[Stats::COUNTERCOUNT];
+atomic<long long> Stats::m_wall[Stats::PHASECOUNT];
+atomic<long long> Stats::m_cpu[Stats::PHASECOUNT];
+atomic<int> Stats::m_currentPhase(Stats::PHASECOUNT);
+atomic<long long> Stats::m_allocations[Stats::PHASECOUNT + 1];
+atomic<long long> Stats::m_allocatedBytes[Stats::PHASECOUNT + 1];
+
+#ifdef VC_COUNT_ALLOCATIONS
+// Every allocation of the program goes through these, so each is counted.  The counts are static
+// and need no construction, so allocations made before main are counted too.
+void* operator new(size_t a_bytes)
+{
+    Stats::CountAllocation(a_bytes);
+    void* memory = malloc(a_bytes == 0 ? 1 : a_bytes);
+    if (memory == nullptr) {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](size_t a_bytes)
+{
+    return operator new(a_bytes);
+}
+
+void* operator new(size_t a_bytes, const nothrow_t&) noexcept
+{
+    Stats::CountAllocation(a_bytes);
+    return malloc(a_bytes == 0 ? 1 : a_bytes);
+}
+
+void* operator new[](size_t a_bytes, const nothrow_t& a_nothrow) noexcept
+{
+    return operator new(a_bytes, a_nothrow);
+}
+
+void operator delete(void* a_memory) noexcept
+{
+    free(a_memory);
+}
+
+void operator delete[](void* a_memory) noexcept
+{
+    free(a_memory);
+}
+
+void operator delete(void* a_memory, size_t) noexcept
+{
+    free(a_memory);
+}
+
+void operator delete[](void* a_memory, size_t) noexcept
+{
+    free(a_memory);
+}
+#endif
+
+namespace {
+    // Names of the phases and counters, for the text report and the JSON keys.
+    const char* const phaseNames[Stats::PHASECOUNT][2] = {
+        { "Read file", "read_file" },
+        { "Pass I", "pass_1" },
+        { "Symbol table", "symbol_table" },
+        { "Pass II", "pass_2" },
+        { "Listing", "listing" },
+        { "Emulation", "emulation" }
+    };
+    const char* const counterNames[Stats::COUNTERCOUNT][2] = {
+        { "Lines", "lines" },
+        { "Tokens", "tokens" },
+        { "Symbol lookups", "symbol_lookups" },
+        { "Errors", "errors" },
+        { "IR bytes", "ir_bytes" },
+        { "Included files read", "include_files" },
+        { "INCLUDE directives", "includes" },
+        { "Instructions emulated", "instructions" },
+        { "READs", "reads" },
+        { "WRITEs", "writes" }
+    };
+    const char* const otherPhaseNames[2] = { "Other", "other" };
+}
+
+Stats::ThreadCounts::~ThreadCounts()
+{
+    for (int counter = 0; counter < COUNTERCOUNT; counter++) {
+        m_counts[counter] += values[counter];
+    }
+}
+
+/*
+NAME
+
+    Stats::CountRun - Count the work of a run of the emulator.
+
+SYNOPSIS
+
+    void Stats::CountRun(const emulator& a_emul)
+        const emulator& a_emul --> The emulator, which has just finished running the program.
+
+DESCRIPTION
+
+    The emulator counts instructions once per basic block for its run limits, so its counts are
+    taken from it after the run rather than counted again here.
+
+*/
+
+void Stats::CountRun(const emulator& a_emul)
+{
+    emulator::RunCounts counts = a_emul.getRunCounts();
+    Count(C_Instructions, counts.instructions);
+    Count(C_Reads, counts.reads);
+    Count(C_Writes, counts.writes);
+}
+
+/*
+NAME
+
+    Stats::GetAllocations - Total the allocations counted so far.
+
+SYNOPSIS
+
+    long long Stats::GetAllocations()
+
+DESCRIPTION
+
+    The phase an allocation is counted against does not matter here, so that a caller can count
+    the allocations of any stretch of code by calling this before and after it.
+
+RETURNS
+
+    long long - The allocations counted, or -1 in a build without VC_COUNT_ALLOCATIONS.
+*/
+
+long long Stats::GetAllocations()
+{
+#ifdef VC_COUNT_ALLOCATIONS
+    long long total = 0;
+    for (int phase = 0; phase <= PHASECOUNT; phase++) {
+        total += m_allocations[phase];
+    }
+    return total;
+#else
+    return -1;
+#endif
+}
+
+/*
+NAME
+
+    Stats::Report - Write the statistics.
+
+SYNOPSIS
+
+    void Stats::Report(ostream& a_out, bool a_json)
+        ostream& a_out  --> Receives the report.
+        bool a_json     --> True for a JSON object, false for a table.
+
+DESCRIPTION
+
+    The report gives the wall and CPU time of each phase in milliseconds, the counters, and the
+    peak resident set size of the process.  Phases that ran on several threads may have used more
+    CPU time than wall time.  Counts of threads still running, other than the calling thread, are
+    not included.
+
+*/
+
+void Stats::Report(ostream& a_out, bool a_json)
+{
+    long long counts[COUNTERCOUNT];
+    for (int counter = 0; counter < COUNTERCOUNT; counter++) {
+        counts[counter] = m_counts[counter] + m_threadCounts.values[counter];
+    }
+    PROCESS_MEMORY_COUNTERS memory = {};
+    memory.cb = sizeof(memory);
+    GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory));
+    unsigned long long peakRss = memory.PeakWorkingSetSize;
+
+    ios_base::fmtflags flags = a_out.flags();
+    a_out << fixed << setprecision(3);
+    if (a_json) {
+        a_out << "{\"phases\": {";
+        for (int phase = 0; phase < PHASECOUNT; phase++) {
+            a_out << (phase == 0 ? "" : ", ") << "\"" << phaseNames[phase][1] << "\": {\"wall_ms\": "
+                << m_wall[phase] / 1000.0 << ", \"cpu_ms\": " << m_cpu[phase] / 1000.0 << "}";
+        }
+        a_out << "}, \"counters\": {";
+        for (int counter = 0; counter < COUNTERCOUNT; counter++) {
+            a_out << (counter == 0 ? "" : ", ") << "\"" << counterNames[counter][1] << "\": " << counts[counter];
+        }
+        a_out << "}, \"peak_rss_bytes\": " << peakRss;
+        ReportAllocations(a_out, a_json, counts);
+        a_out << "}" << endl;
+    }
+    else {
+        a_out << "\nStatistics:\n\n";
+        a_out << left << setw(24) << "Phase" << right << setw(12) << "Wall ms" << setw(12) << "CPU ms" << "\n";
+        for (int phase = 0; phase < PHASECOUNT; phase++) {
+            a_out << left << setw(24) << phaseNames[phase][0] << right << setw(12) << m_wall[phase] / 1000.0
+                << setw(12) << m_cpu[phase] / 1000.0 << "\n";
+        }
+        a_out << "\n" << left << setw(24) << "Counter" << right << setw(12) << "Value" << "\n";
+        for (int counter = 0; counter < COUNTERCOUNT; counter++) {
+            a_out << left << setw(24) << counterNames[counter][0] << right << setw(12) << counts[counter] << "\n";
+        }
+        a_out << left << setw(24) << "Peak RSS (KB)" << right << setw(12) << peakRss / 1024 << endl;
+        ReportAllocations(a_out, a_json, counts);
+    }
+    a_out.flags(flags);
+}
+
+/*
+NAME
+
+    Stats::ReportAllocations - Write the allocations of each phase.
+
+SYNOPSIS
+
+    void Stats::ReportAllocations(ostream& a_out, bool a_json, const long long a_counts[])
+        ostream& a_out              --> Receives the report.
+        bool a_json                 --> True for members of the JSON object, false for a table.
+        const long long a_counts[]  --> The totals of the counters.
+
+DESCRIPTION
+
+    In a build that counts allocations, this function gives the allocations and bytes of each
+    phase, and of the time outside any phase, followed by the allocations of Pass I and Pass II
+    for each source line and of the emulation for each instruction emulated.  Those are the
+    figures that should be zero once parsing or emulation reaches a steady state.  In any other
+    build it writes nothing.
+
+*/
+
+void Stats::ReportAllocations(ostream& a_out, bool a_json, const long long a_counts[])
+{
+#ifdef VC_COUNT_ALLOCATIONS
+    // Taken first, so the report's own allocations are not included.
+    long long allocations[PHASECOUNT + 1];
+    long long bytes[PHASECOUNT + 1];
+    for (int phase = 0; phase <= PHASECOUNT; phase++) {
+        allocations[phase] = m_allocations[phase];
+        bytes[phase] = m_allocatedBytes[phase];
+    }
+    auto perUnit = [](long long a_allocations, long long a_units) {
+        return a_units == 0 ? 0.0 : static_cast<double>(a_allocations) / a_units;
+    };
+    double perLine[2] = { perUnit(allocations[P_PassI], a_counts[C_Lines]),
+        perUnit(allocations[P_PassII], a_counts[C_Lines]) };
+    double perInstruction = perUnit(allocations[P_Emulation], a_counts[C_Instructions]);
+
+    if (a_json) {
+        a_out << ", \"allocations\": {";
+        for (int phase = 0; phase <= PHASECOUNT; phase++) {
+            const char* name = phase < PHASECOUNT ? phaseNames[phase][1] : otherPhaseNames[1];
+            a_out << (phase == 0 ? "" : ", ") << "\"" << name << "\": {\"count\": " << allocations[phase]
+                << ", \"bytes\": " << bytes[phase] << "}";
+        }
+        a_out << "}, \"allocations_per_line\": {\"pass_1\": " << perLine[0] << ", \"pass_2\": " << perLine[1]
+            << "}, \"allocations_per_instruction\": " << perInstruction;
+    }
+    else {
+        a_out << "\n" << left << setw(24) << "Allocations" << right << setw(12) << "Count" << setw(12) << "KB" << "\n";
+        for (int phase = 0; phase <= PHASECOUNT; phase++) {
+            const char* name = phase < PHASECOUNT ? phaseNames[phase][0] : otherPhaseNames[0];
+            a_out << left << setw(24) << name << right << setw(12) << allocations[phase] << setw(12) << bytes[phase] / 1024
+                << "\n";
+        }
+        a_out << left << setw(24) << "Pass I per line" << right << setw(12) << perLine[0] << "\n";
+        a_out << left << setw(24) << "Pass II per line" << right << setw(12) << perLine[1] << "\n";
+        a_out << left << setw(24) << "Per instruction" << right << setw(12) << perInstruction << endl;
+    }
+#endif
+}
+
+/*
+NAME
+
+    Stats::CpuMicroseconds - The CPU time the process has used.
+
+SYNOPSIS
+
+    long long Stats::CpuMicroseconds()
+
+RETURNS
+
+    long long - The user and kernel time of all the threads of the process, in microseconds.
+*/
+
+long long Stats::CpuMicroseconds()
+{
+    FILETIME creation, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exited, &kernel, &user)) {
+        return 0;
+    }
+    unsigned long long total = ((static_cast<unsigned long long>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime) +
+        ((static_cast<unsigned long long>(user.dwHighDateTime) << 32) | user.dwLowDateTime);
+    return static_cast<long long>(total / 10);
+}
+
+Stats::Timer::Timer(Phase a_phase)
+    : m_phase(a_phase), m_outerPhase(m_currentPhase.exchange(a_phase)), m_wallStart(chrono::steady_clock::now()),
+    m_cpuStart(CpuMicroseconds())
+{
+}
+
+Stats::Timer::~Timer()
+{
+    Switch(m_phase);
+    m_currentPhase = m_outerPhase;
+}
+
+void Stats::Timer::Switch(Phase a_phase)
+{
+    chrono::steady_clock::time_point wall = chrono::steady_clock::now();
+    long long cpu = CpuMicroseconds();
+    m_wall[m_phase] += chrono::duration_cast<chrono::microseconds>(wall - m_wallStart).count();
+    m_cpu[m_phase] += cpu - m_cpuStart;
+    m_phase = a_phase;
+    m_currentPhase = a_phase;
+    m_wallStart = wall;
+    m_cpuStart = cpu;
+}
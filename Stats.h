@@ -0,0 +1,114 @@
+//
+//		Stats class.  Wall and CPU time for each phase of a run, and counters of the work done,
+//		reported with -stats.  Like Errors, all members are static so that any part of the
+//		assembler can count what it does.
+//
+//		A build with VC_COUNT_ALLOCATIONS defined also counts every allocation of the heap, and
+//		the bytes allocated, by the phase being timed when it was made.  The report then gives
+//		the allocations of each phase, and for each line translated and instruction emulated,
+//		so that the steady state of parsing and emulation can be checked to allocate nothing.
+//
+#pragma once
+
+#include "stdafx.h"
+
+#include <atomic>
+#include <chrono>
+
+class emulator;
+
+class Stats {
+
+public:
+    // The phases that are timed.  With -pipeline the file is read during Pass I, which also builds
+    // the symbol table, so all three are timed as Pass I.
+    enum Phase {
+        P_ReadFile,         // Reading the source.
+        P_PassI,            // Parsing the lines and locating them.
+        P_SymbolTable,      // Entering the labels in the symbol table.
+        P_PassII,           // Translating the lines.
+        P_Listing,          // Writing the symbol table and the translation listing.
+        P_Emulation,        // Running the program.
+        PHASECOUNT
+    };
+
+    // The events that are counted.
+    enum Counter {
+        C_Lines,            // Lines of the program up to END, with those of included files.
+        C_Tokens,           // Labels, opcodes and operands of those lines.
+        C_SymbolLookups,    // Lookups in the symbol table.
+        C_Errors,           // Errors recorded.
+        C_IRBytes,          // Size of the intermediate representation handed to Pass II.
+        C_IncludeFiles,     // Files read for INCLUDE directives, each counted once.
+        C_Includes,         // INCLUDE directives expanded, each from the file read once.
+        C_Instructions,     // Instructions emulated.
+        C_Reads,            // Values read by READ.
+        C_Writes,           // Values written by WRITE.
+        COUNTERCOUNT
+    };
+
+    // Adds to a counter.  Each thread counts in a block of its own, so threads counting at once do
+    // not contend for a cache line; the block is added to the totals when the thread ends.
+    static void Count(Counter a_counter, long long a_amount = 1)
+    {
+        m_threadCounts.values[a_counter] += a_amount;
+    }
+
+    // Counts the instructions, READs and WRITEs of the run the emulator has just finished.
+    static void CountRun(const emulator& a_emul);
+
+    // Counts an allocation of a_bytes against the phase being timed.  Called for every allocation
+    // in a build with VC_COUNT_ALLOCATIONS defined, from any thread, so the counts are atomic.
+    static void CountAllocation(size_t a_bytes)
+    {
+        int phase = m_currentPhase.load(memory_order_relaxed);
+        m_allocations[phase].fetch_add(1, memory_order_relaxed);
+        m_allocatedBytes[phase].fetch_add(static_cast<long long>(a_bytes), memory_order_relaxed);
+    }
+
+    // Allocations counted so far in every phase and outside them, or -1 in a build that does not
+    // count them.  The difference of two calls is the allocations made between them.
+    static long long GetAllocations();
+
+    // Writes the statistics gathered so far, as text or as a JSON object.
+    static void Report(ostream& a_out, bool a_json);
+
+    // Adds the time from its construction to its destruction to a phase.  Allocations are counted
+    // against the phase of the innermost timer, on whichever thread they are made.
+    class Timer {
+
+    public:
+        Timer(Phase a_phase);
+        ~Timer();
+
+        // Ends the phase being timed and starts timing another.
+        void Switch(Phase a_phase);
+
+    private:
+        Phase m_phase;                                  // The phase being timed.
+        int m_outerPhase;                               // The phase being timed when it was constructed.
+        chrono::steady_clock::time_point m_wallStart;   // When it started.
+        long long m_cpuStart;                           // CPU time of the process when it started.
+    };
+
+private:
+    // The counts of one thread.
+    struct ThreadCounts {
+        long long values[COUNTERCOUNT] = {};
+        ~ThreadCounts();
+    };
+
+    // CPU time the process has used, in microseconds.
+    static long long CpuMicroseconds();
+
+    // Writes the allocations of each phase, for a build that counts them.
+    static void ReportAllocations(ostream& a_out, bool a_json, const long long a_counts[]);
+
+    static thread_local ThreadCounts m_threadCounts;    // The calling thread's counts.
+    static atomic<long long> m_counts[COUNTERCOUNT];    // Counts of the threads that have ended.
+    static atomic<long long> m_wall[PHASECOUNT];        // Wall time of each phase, in microseconds.
+    static atomic<long long> m_cpu[PHASECOUNT];         // CPU time of each phase, in microseconds.
+    static atomic<int> m_currentPhase;                  // Phase being timed, or PHASECOUNT if none is.
+    static atomic<long long> m_allocations[PHASECOUNT + 1];     // Allocations made in each phase, and outside them.
+    static atomic<long long> m_allocatedBytes[PHASECOUNT + 1];  // Bytes they allocated.
+};
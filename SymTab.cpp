@@ -2,6 +2,7 @@
 
 #include "SymTab.h"
 #include "Errors.h"
+#include "Stats.h"
 #include "stdafx.h"
 
 /*
@@ -52,23 +53,25 @@ NAME
 
 SYNOPSIS
 
-    void SymbolTable::DisplaySymbolTable() const
+    void SymbolTable::DisplaySymbolTable(ostream& a_out) const
+        ostream& a_out --> Receives the table.
 
 DESCRIPTION
 
     This method displays the contents of the symbol table in a formatted manner.
     It provides a header with column labels and lists all symbols along with their
     corresponding locations. If a symbol is marked as multiply defined, it indicates
-    this status next to the symbol.
+    this status next to the symbol.  The entries of the literal pool are named by
+    their literals (=N) and marked as such.
 */
 
 // Display the symbol table.
-void SymbolTable::DisplaySymbolTable() const
+void SymbolTable::DisplaySymbolTable(ostream& a_out) const
 {
     // Header for the symbol table
-    cout << "\nSymbol Table:\n";
-    cout << "Symbol #\tSymbol\tLocation\n";
-    cout << "--------------------------------------\n";
+    a_out << "\nSymbol Table:\n";
+    a_out << "Symbol #\tSymbol\tLocation\n";
+    a_out << "--------------------------------------\n";
 
     // Make a copy of the symbols so we can sort them
     vector<pair<string, int>> sortedSymbols = m_orderedSymbols;
@@ -86,13 +89,16 @@ void SymbolTable::DisplaySymbolTable() const
 
     // Print out the sorted symbols
     for (int i = 0; i < sortedSymbols.size(); i++) {
-        cout << i << "\t\t" << sortedSymbols[i].first << "\t" << sortedSymbols[i].second;
+        a_out << i << "\t\t" << sortedSymbols[i].first << "\t" << sortedSymbols[i].second;
         if (sortedSymbols[i].second == multiplyDefinedSymbol) {
-            cout << " (Multiply Defined)";
+            a_out << " (Multiply Defined)";
         }
-        cout << "\n";
+        else if (sortedSymbols[i].first[0] == '=') {
+            a_out << " (Literal)";
+        }
+        a_out << "\n";
     }
-    cout << "--------------------------------------\n\n";
+    a_out << "--------------------------------------\n\n";
 }
 
 /*
@@ -119,6 +125,34 @@ vector<pair<string, int>> SymbolTable::GetSymbolTable() const
     return m_orderedSymbols;
 }
 
+/*
+NAME
+
+    SymbolTable::RelocateSymbols - Moves symbols to new locations.
+
+SYNOPSIS
+
+    void SymbolTable::RelocateSymbols(const unordered_map<string, int>& a_newLocations)
+
+DESCRIPTION
+
+    This method gives each symbol named in a_newLocations its new location, in both
+    the table and the ordered list.  It is used when the program is rearranged after
+    Pass I.  Multiply defined symbols keep their marker.
+*/
+
+// Move symbols to new locations.
+void SymbolTable::RelocateSymbols(const unordered_map<string, int>& a_newLocations)
+{
+    for (auto& symbol : m_orderedSymbols) {
+        auto entry = a_newLocations.find(symbol.first);
+        if (entry == a_newLocations.end() || symbol.second == multiplyDefinedSymbol) continue;
+
+        symbol.second = entry->second;
+        m_symbolTable[symbol.first] = entry->second;
+    }
+}
+
 /*
 NAME
 
@@ -133,20 +167,27 @@ DESCRIPTION
     This method checks if a given symbol exists in the symbol table and retrieves
     its location if found. It also handles the case where the symbol is multiply
     defined or undefined.
+
+    The lookup only reads the table, and its errors go to the calling thread's
+    capture list if it has one, so once Pass I has built the table any number of
+    threads may look symbols up concurrently.
 */
 
 // Lookup a symbol in the symbol table.
 bool SymbolTable::LookupSymbol(const string& a_symbol, int& a_loc) const
 {
+    Stats::Count(Stats::C_SymbolLookups);
+
     // Check if the symbol exists
-    if (m_symbolTable.find(a_symbol) != m_symbolTable.end()) {
+    auto entry = m_symbolTable.find(a_symbol);
+    if (entry != m_symbolTable.end()) {
         // Check if it is multiply defined
-        if (m_symbolTable.at(a_symbol) == multiplyDefinedSymbol) {
+        if (entry->second == multiplyDefinedSymbol) {
             Errors::RecordError("Symbol '" + a_symbol + "' is multiply defined.");
             return false;
         }
         // Get the location of the symbol
-        a_loc = m_symbolTable.at(a_symbol);
+        a_loc = entry->second;
         return true;
     }
     else {
@@ -17,11 +17,14 @@ public:
     void AddSymbol(string& a_symbol, int a_loc);
 
     // Display the symbol table.
-    void DisplaySymbolTable() const;
+    void DisplaySymbolTable(ostream& a_out = cout) const;
 
     // Lookup a symbol in the symbol table.
     bool LookupSymbol(const string& a_symbol, int& a_loc) const;
 
+    // Move symbols to new locations, given by name.  Multiply defined symbols are left alone.
+    void RelocateSymbols(const unordered_map<string, int>& a_newLocations);
+
     // Getter for symbol table entries maintaining order
     vector<pair<string, int>> GetSymbolTable() const;
 
@@ -22,10 +22,15 @@
 #include <istream>
 #include <iomanip>
 #include <cstring>
+#include <climits>
 #include <vector>
 #include <algorithm> 
 #include <cctype>
 #include <sstream>
 #include <unordered_map>
+#include <set>
+#include <memory>
+#include <thread>
+#include <functional>
 
 using namespace std;